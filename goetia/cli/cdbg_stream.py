@@ -12,12 +12,13 @@ from goetia.cdbg import (compute_connected_component_callback,
                          compute_unitig_fragmentation_callback,
                          write_cdbg_metrics_callback,
                          write_cdbg_callback)
-from goetia.dbg import get_graph_args, process_graph_args
+from goetia.dbg import get_graph_args, process_graph_args, write_memory_usage_callback
 from goetia.parsing import get_fastx_args, iter_fastx_inputs
 from goetia.processors import AsyncSequenceProcessor
 from goetia.messages import (Interval, SampleStarted, SampleFinished, Error, AllMessages)
 from goetia.metadata import CUR_TIME
 from goetia.serialization import cDBGSerialization
+from goetia.storage import rotate_storage_callback
 
 from goetia.cli.args import get_output_interval_args, print_interval_settings
 from goetia.cli.runner import CommandRunner
@@ -90,6 +91,20 @@ class cDBGRunner(CommandRunner):
         # 
         self.to_close = []
 
+        if getattr(args, 'rotate_interval', None) and \
+           args.storage is libgoetia.storage.RollingBitStorage:
+            self.worker_listener.on_message(Interval,
+                                            rotate_storage_callback,
+                                            self.storage,
+                                            args.rotate_interval)
+
+        if args.track_memory:
+            self.worker_listener.on_message(Interval,
+                                            write_memory_usage_callback,
+                                            self.compactor,
+                                            args.track_memory)
+            self.to_close.append(args.track_memory)
+
         if args.track_cdbg_stats:
             self.worker_listener.on_message(Interval,
                                             write_cdbg_metrics_callback,
@@ -190,6 +205,13 @@ def get_cdbg_args(parser):
                         nargs='?',
                         const='goetia.cdbg.stats.json')
 
+    group.add_argument('--track-memory',
+                        metavar='FILE_NAME.json',
+                        nargs='?',
+                        const='goetia.memory.json',
+                        help='Bytes held by the dBG and cDBG, by component, '
+                             'at each fine interval.')
+
     group.add_argument('--track-cdbg-components',
                         metavar='FILE_NAME.json',
                         nargs='?',
@@ -224,6 +246,7 @@ def process_cdbg_args(args):
     args.track_cdbg_components = join(args.track_cdbg_components)
     args.save_cdbg =             join(args.save_cdbg)
     args.track_cdbg_unitig_bp =  join(args.track_cdbg_unitig_bp)
+    args.track_memory =          join(args.track_memory)
 
 
 def print_cdbg_args(args):
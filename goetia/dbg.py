@@ -6,6 +6,10 @@
 # Author : Camille Scott <camille.scott.w@gmail.com>
 # Date   : 14.10.2019
 
+import json
+
+import curio
+
 from goetia import libgoetia
 from goetia.hashing import typenames as hasher_types
 from goetia.storage import get_storage_args, process_storage_args
@@ -44,6 +48,36 @@ def process_graph_args(args):
     args.graph_t = libgoetia.dBG[args.storage, args.hasher_t]
 
 
+def memory_usage_dict(usage):
+    '''Flatten a MemoryUsage into a dict of component -> bytes, with
+    the sum under 'total'.
+    '''
+    data = {item.first: item.second for item in usage.components}
+    data['total'] = usage.total()
+    return data
+
+
+async def write_memory_usage_callback(msg,
+                                      owner,
+                                      out_file,
+                                      interval='fine'):
+    '''Append the memory usage of owner, any object with memory_usage(),
+    eg a dBG, PdBG or StreamingCompactor, at each Interval of the given
+    size.
+    '''
+    if interval in msg.state:
+        data = {'t': msg.t,
+                'sample_name': msg.sample_name}
+        data.update(memory_usage_dict(owner.memory_usage()))
+
+        async with curio.aopen(out_file, 'a') as fp:
+            if await fp.tell() != 0:
+                await fp.write(',\n')
+            else:
+                await fp.write('[\n')
+            await fp.write(json.dumps(data))
+
+
 def print_dBG_args(args):
     print('* dBG will be order', args.ksize, file=sys.stderr)
     print('* dBG will have underlying storage of', args.storage, file=sys.stderr)
@@ -4,7 +4,9 @@ from goetia import libgoetia
 typenames = [(libgoetia.hashing.FwdLemireShifter, 'FwdLemireShifter'),
              (libgoetia.hashing.CanLemireShifter, 'CanLemireShifter'),
              (libgoetia.hashing.FwdUnikmerShifter, 'FwdUnikmerShifter'),
-             (libgoetia.hashing.CanUnikmerShifter, 'CanUnikmerShifter')]
+             (libgoetia.hashing.CanUnikmerShifter, 'CanUnikmerShifter'),
+             (libgoetia.hashing.FwdTwoBitShifter, 'FwdTwoBitShifter'),
+             (libgoetia.hashing.CanTwoBitShifter, 'CanTwoBitShifter')]
 types = [_type for _type, _name in typenames]
 
 
@@ -5,7 +5,11 @@ import argparse
 import sys
 
 _types = [(libgoetia.storage.SparseppSetStorage, tuple()),
+          (libgoetia.storage.FlatSetStorage, tuple()),
+          (libgoetia.storage.FlatCountStorage, tuple()),
           (libgoetia.storage.BitStorage, (100000, 4)),
+          (libgoetia.storage.BlockedBitStorage, (100000, 4)),
+          (libgoetia.storage.RollingBitStorage, (100000, 4)),
           (libgoetia.storage.ByteStorage, (100000, 4)),
           (libgoetia.storage.NibbleStorage, (100000, 4))]
 
@@ -13,7 +17,13 @@ types = {storage_t.__name__.replace(' ', '') : defaults for storage_t, defaults
 
 
 SparseppSetStorage = libgoetia.storage.SparseppSetStorage
+FlatSetStorage     = libgoetia.storage.FlatSetStorage
+FlatCountStorage   = libgoetia.storage.FlatCountStorage
+FrozenStorage      = libgoetia.storage.FrozenStorage
+DiskCountStorage   = libgoetia.storage.DiskCountStorage
+RollingBitStorage  = libgoetia.storage.RollingBitStorage
 BitStorage         = libgoetia.storage.BitStorage
+BlockedBitStorage  = libgoetia.storage.BlockedBitStorage
 ByteStorage        = libgoetia.storage.ByteStorage
 NibbleStorage      = libgoetia.storage.NibbleStorage
 
@@ -28,6 +38,10 @@ def is_probabilistic(klass):
     return check_trait(libgoetia.storage.is_probabilistic, klass)
 
 
+def is_forgetful(klass):
+    return check_trait(libgoetia.storage.is_forgetful, klass)
+
+
 def get_storage_args(parser, default='SparseppSetStorage'):
     if 'storage' in [g.title for g in parser._action_groups]:
         return None
@@ -38,6 +52,22 @@ def get_storage_args(parser, default='SparseppSetStorage'):
                        default=default)
     group.add_argument('-N', '--n_tables', default=4, type=int)
     group.add_argument('-x', '--max-tablesize', default=1e8, type=float)
+    group.add_argument('--table-pages', default='heap',
+                       choices=['heap', 'mmap', 'thp', 'hugetlb-2mb', 'hugetlb-1gb'],
+                       help='Memory backing sketch tables: mmap skips the '
+                            'startup zeroing, thp and hugetlb use huge pages.')
+    group.add_argument('--table-numa', default='local',
+                       choices=['local', 'interleave', 'spread'],
+                       help='NUMA placement of sketch tables.')
+    group.add_argument('--generations', default=4, type=int,
+                       help='RollingBitStorage: filters in the ring.')
+    group.add_argument('--rotate-every', default=0, type=int,
+                       help='RollingBitStorage: rotate after this many new '
+                            'k-mers in the current filter; 0 to disable.')
+    group.add_argument('--rotate-interval', default=None,
+                       choices=['fine', 'medium', 'coarse'],
+                       help='RollingBitStorage: rotate at every interval '
+                            'of this size, keeping a window of reads.')
 
     return group
 
@@ -49,7 +79,23 @@ def process_storage_args(args):
     args.storage = getattr(libgoetia.storage, args.storage)
 
     args.storage_args = ()
-    if args.storage is not libgoetia.storage.SparseppSetStorage:
+    if args.storage not in (libgoetia.storage.SparseppSetStorage,
+                            libgoetia.storage.FlatSetStorage,
+                            libgoetia.storage.FlatCountStorage):
         args.max_tablesize = int(args.max_tablesize)
-        args.storage_args = (args.max_tablesize, args.n_tables)
+        policy = libgoetia.storage.TablePolicy.from_names(args.table_pages,
+                                                          args.table_numa)
+        if args.storage is libgoetia.storage.RollingBitStorage:
+            args.storage_args = (args.max_tablesize, args.n_tables,
+                                 args.generations, args.rotate_every, policy)
+        else:
+            args.storage_args = (args.max_tablesize, args.n_tables, policy)
+
+
+async def rotate_storage_callback(msg, storage, interval='coarse'):
+    '''Rotate a RollingBitStorage at each Interval of the given size, so
+    that it remembers the k-mers of its last n_generations intervals.
+    '''
+    if interval in msg.state:
+        storage.rotate()
 
@@ -1,75 +1,283 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : bench_storage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_BENCH_STORAGE_HH
+#define GOETIA_BENCH_STORAGE_HH
+
 #include "goetia/goetia.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/diskcountstorage.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <iostream>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 
 namespace goetia {
 namespace bench {
 
-template<class storage_type>
-void storage_insert_bench(std::unique_ptr<storage_type>& storage,
-                          std::vector<uint64_t>& hashes) {
+/*
+ * Storage benchmarks over k-mer streams shaped like real data.
+ *
+ * A Workload is the hashes of a set of reads under one shifter, in read
+ * order: either reads from a FASTA/Q file, or reads simulated from a
+ * random genome with Zipfian coverage, so that a few regions are deeply
+ * duplicated and most are not. Each storage is filled from the stream and
+ * queried with it at every thread count, the stream being split into one
+ * contiguous slice per thread; storages which aren't safe to share are
+ * only run on one thread. Every timed phase reports ns/op and, where
+ * perf_event is available, the hardware cache misses of all its threads.
+ * Each row also carries the storage's bytes per distinct k-mer, and its
+ * false positive rate on hashes known to be absent.
+ */
+
+struct Workload {
+    std::string           name;
+    uint16_t              K;
+    // every k-mer hash of the reads, in order
+    std::vector<uint64_t> hashes;
+    uint64_t              n_distinct;
+    // hashes not in the stream, for false positive rates
+    std::vector<uint64_t> absent;
+};
+
+
+struct BenchResult {
+    std::string storage;
+    std::string workload;
+    std::string op;
+    size_t      n_threads;
+    uint64_t    n_ops;
+    double      ns_per_op;
+    // -1 when perf_event isn't available
+    int64_t     cache_misses;
+    double      bytes_per_kmer;
+    double      fp_rate;
+
+    void to_json(std::ostream& out) const;
+};
+
+
+void write_json(const std::vector<BenchResult>& results, std::ostream& out);
+
+
+/**
+ * @Synopsis  Counts the hardware cache misses of this thread, and of the
+ *            threads it starts while counting, through perf_event_open.
+ *            Reports -1 if the kernel or its paranoia level won't allow it.
+ */
+class CacheMissCounter {
+
+    int _fd;
 
-    for (auto hash: hashes) {
-        storage->insert(hash);
+public:
+
+    CacheMissCounter();
+    ~CacheMissCounter();
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    bool available() const {
+        return _fd >= 0;
     }
-}
 
-template<class storage_type>
-void storage_query_bench(std::unique_ptr<storage_type>& storage,
-                         std::vector<uint64_t>& hashes) {
+    void start();
+
+    // Misses since start(), once every counted thread has exited.
+    int64_t stop();
+};
+
+
+struct BenchOptions {
+    // reads to hash; simulated if empty
+    std::string         reads_file;
+    uint16_t            K            = 31;
+    // read k-mers to use, at most
+    uint64_t            max_hashes   = 10000000;
+    // simulated genome length and Zipf exponent of its coverage
+    uint64_t            genome_size  = 1000000;
+    double              zipf_s       = 1.0;
+    size_t              max_threads  = std::thread::hardware_concurrency();
+    uint64_t            seed         = 42;
+    // where DiskCountStorage spills
+    std::string         scratch_dir;
+    // storage names to run; all if empty
+    std::vector<std::string> storages;
+};
+
+
+// Random reads of read_length from a random genome, starting in windows
+// drawn with Zipf(s) frequencies.
+std::vector<std::string> simulate_reads(uint64_t genome_size,
+                                        size_t   read_length,
+                                        uint64_t n_bases,
+                                        double   zipf_s,
+                                        uint64_t seed);
+
+
+std::vector<std::string> load_reads(const std::string& filename, uint64_t max_bases);
 
-    for (auto hash: hashes) {
-        auto val = storage->query(hash);
+
+/**
+ * @Synopsis  Hash reads with ShifterType, and draw absent hashes for
+ *            them; times the hashing as a BenchResult.
+ */
+template<class ShifterType>
+Workload make_workload(const std::string&              name,
+                       const std::string&              shifter_name,
+                       const std::vector<std::string>& reads,
+                       uint16_t                        K,
+                       uint64_t                        max_hashes,
+                       uint64_t                        seed,
+                       BenchResult&                    hashing);
+
+
+// The thread counts to run: powers of two below max_threads, then it.
+std::vector<size_t> thread_counts(size_t max_threads);
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+/**
+ * @Synopsis  Call func(begin, end) over n items split into n_threads
+ *            contiguous slices, one per thread, and return the seconds
+ *            taken and the cache misses of all of them.
+ */
+template<typename Func>
+double run_threaded(size_t n, size_t n_threads, Func&& func, int64_t& cache_misses) {
+    CacheMissCounter counter;
+    counter.start();
+    auto time_start = bench_clock::now();
+
+    if (n_threads == 1) {
+        func(0, n);
+    } else {
+        std::vector<std::thread> threads;
+        const size_t slice = (n + n_threads - 1) / n_threads;
+        for (size_t t = 0; t < n_threads; ++t) {
+            const size_t begin = std::min(n, t * slice);
+            const size_t end = std::min(n, begin + slice);
+            threads.emplace_back([&func, begin, end]() { func(begin, end); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
+
+    auto time_elapsed = bench_clock::now() - time_start;
+    cache_misses = counter.stop();
+    return std::chrono::duration<double>(time_elapsed).count();
 }
 
 
+// Work a storage needs between inserting and querying.
+template<class StorageType>
+struct BenchHooks {
+    static void finish_inserts(StorageType&) { }
+};
+
 
+template<>
+struct BenchHooks<storage::DiskCountStorage> {
+    static void finish_inserts(storage::DiskCountStorage& storage) {
+        storage.finalize();
+    }
+};
 
-template<class storage_type>
-void storage_insert_and_query_bench(std::unique_ptr<storage_type>& storage,
-                                    std::vector<uint64_t>& hashes)  {
 
-    for (auto hash: hashes) {
-        auto val = storage->insert_and_query(hash);
+template<class StorageType>
+double false_positive_rate(const StorageType& storage, const Workload& workload) {
+    if (workload.absent.empty()) {
+        return 0.0;
+    }
+    uint64_t n_false = 0;
+    for (auto hash : workload.absent) {
+        n_false += storage.query(hash) > 0;
     }
+    return (double) n_false / workload.absent.size();
 }
 
 
-template<class callable, class storage_type>
-double time_it(callable &&func,
-               std::unique_ptr<storage_type>& storage,
-               std::vector<uint64_t>& hashes)  {
-    
-    auto time_start = std::chrono::system_clock::now();
-    func(storage, hashes);
-    auto time_elapsed = std::chrono::system_clock::now() - time_start;
-    return std::chrono::duration<double>(time_elapsed).count();
+template<class StorageType>
+double bytes_per_kmer(const StorageType& storage, const Workload& workload) {
+    return (double) storage.memory_usage().total() / std::max<uint64_t>(workload.n_distinct, 1);
 }
 
 
-template<class storage_type>
-void _run_storage_bench(std::unique_ptr<storage_type>& storage,
-                   std::vector<uint64_t>& hashes,
-                   std::string storage_name) {
+/**
+ * @Synopsis  Insert the workload into a fresh storage from make, then
+ *            query it back, at each thread count; storages which aren't
+ *            concurrent only run on one thread. DiskCountStorage's merge
+ *            is timed with its inserts.
+ */
+template<class StorageType>
+std::vector<BenchResult> bench_storage(const std::string&                           name,
+                                       std::function<std::shared_ptr<StorageType>()> make,
+                                       bool                                         concurrent,
+                                       const Workload&                              workload,
+                                       const std::vector<size_t>&                   n_threads) {
+    std::vector<BenchResult> results;
+    const auto& hashes = workload.hashes;
 
-    storage->reset();
-    std::cout << storage_name << ", " << hashes.size() << ", insert, "           << time_it(storage_insert_bench<storage_type>, storage, hashes) << std::endl;
-    std::cout << storage_name << ", " << hashes.size() << ", insert_second, "    << time_it(storage_insert_bench<storage_type>, storage, hashes) << std::endl;
-    std::cout << storage_name << ", " << hashes.size() << ", query, "            << time_it(storage_query_bench<storage_type>, storage, hashes) << std::endl;
-    std::cout << storage_name << ", " << hashes.size() << ", insert_and_query, " << time_it(storage_insert_and_query_bench<storage_type>, storage, hashes) << std::endl;
-}
+    for (auto threads : n_threads) {
+        if (threads > 1 && !concurrent) {
+            continue;
+        }
+        auto storage = make();
+
+        int64_t insert_misses, query_misses;
+        double insert_time = run_threaded(hashes.size(), threads,
+            [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    storage->insert(hashes[i]);
+                }
+            }, insert_misses);
+        auto time_start = bench_clock::now();
+        BenchHooks<StorageType>::finish_inserts(*storage);
+        insert_time += std::chrono::duration<double>(bench_clock::now() - time_start).count();
 
-std::vector<uint64_t> generate_hashes(size_t n_hashes);
+        std::atomic<uint64_t> sink(0);
+        double query_time = run_threaded(hashes.size(), threads,
+            [&](size_t begin, size_t end) {
+                uint64_t total = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    total += storage->query(hashes[i]);
+                }
+                sink.fetch_add(total, std::memory_order_relaxed);
+            }, query_misses);
 
+        const double bytes = bytes_per_kmer(*storage, workload);
+        const double fp = false_positive_rate(*storage, workload);
+        const double n_ops = std::max<size_t>(hashes.size(), 1);
 
-void run_storage_bench();
+        results.push_back({name, workload.name, "insert", threads, hashes.size(),
+                           insert_time * 1e9 / n_ops, insert_misses, bytes, fp});
+        results.push_back({name, workload.name, "query", threads, hashes.size(),
+                           query_time * 1e9 / n_ops, query_misses, bytes, fp});
+    }
 
+    return results;
 }
+
+
+// Every storage over every shifter's workload, as configured.
+std::vector<BenchResult> run_storage_bench(const BenchOptions& options);
+
 }
+}
+
+#endif
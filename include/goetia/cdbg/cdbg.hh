@@ -405,6 +405,32 @@ public:
             return unitig_end_map.size();
         }
 
+        /* Bytes held by the nodes and the maps over them, by component;
+         * the dBG is not included. Not thread-safe (the caller will
+         * need to lock).
+         */
+        goetia::metrics::MemoryUsage memory_usage() const {
+            goetia::metrics::MemoryUsage usage;
+
+            uint64_t dnode_bytes = goetia::metrics::sparse_map_bytes(decision_nodes);
+            for (const auto& dnode : decision_nodes) {
+                dnode_bytes += sizeof(DecisionNode) + dnode.second->sequence.capacity();
+            }
+            usage.add("decision_nodes", dnode_bytes);
+
+            uint64_t unode_bytes = goetia::metrics::sparse_map_bytes(unitig_nodes);
+            for (const auto& unode : unitig_nodes) {
+                unode_bytes += sizeof(UnitigNode)
+                               + unode.second->sequence.capacity()
+                               + goetia::metrics::vector_bytes(unode.second->tags);
+            }
+            usage.add("unitig_nodes", unode_bytes);
+
+            usage.add("unitig_end_map", goetia::metrics::sparse_map_bytes(unitig_end_map));
+            usage.add("unitig_tag_map", goetia::metrics::sparse_map_bytes(unitig_tag_map));
+            return usage;
+        }
+
         /* Node query methods: separate query mechanisms for
          * decision nodes and unitig nodes.
          */
@@ -428,10 +454,8 @@ public:
 
         std::vector<DecisionNode*> query_dnodes(const std::string& sequence)  {
 
-            hashing::KmerIterator<shifter_type> kmers(sequence, this->K);
             std::vector<DecisionNode*> result;
-            while(!kmers.done()) {
-                hash_type h = kmers.next();
+            for (const auto& h : hashing::KmerRange<shifter_type>(sequence, this->K)) {
                 DecisionNode * dnode;
                 if ((dnode = query_dnode(h)) != nullptr) {
                     result.push_back(dnode);
@@ -1294,6 +1318,9 @@ extern template class cdbg::cDBG<dBG<storage::BitStorage, hashing::CanLemireShif
 extern template class cdbg::cDBG<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
 extern template class cdbg::cDBG<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
 
+extern template class cdbg::cDBG<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+extern template class cdbg::cDBG<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+
 extern template class cdbg::cDBG<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
 extern template class cdbg::cDBG<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
 
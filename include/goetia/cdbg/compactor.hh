@@ -226,6 +226,16 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
             return report;
         }
 
+        // Bytes held by the dBG, under "dbg", and by the cDBG, under
+        // "cdbg"; locks the cDBG's nodes while counting them.
+        goetia::metrics::MemoryUsage memory_usage() {
+            goetia::metrics::MemoryUsage usage;
+            usage.add("dbg", dbg->memory_usage());
+            auto lock = cdbg->lock_nodes();
+            usage.add("cdbg", cdbg->memory_usage());
+            return usage;
+        }
+
         size_t insert_sequence(const std::string& sequence,
                                std::shared_ptr<std::vector<hash_type>> hashes = nullptr) {
             std::set<hash_type> new_kmers;
@@ -330,15 +340,14 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
 
             pdebug("FIND SEGMENTS: " << sequence);
 
-            hashing::KmerIterator<extender_type> kmers(sequence, this->K);
             hash_type prev_hash, cur_hash;
             size_t pos = 0;
             bool cur_new = false, prev_new = false, cur_seen = false, prev_seen = false;
 
             std::vector<compact_segment> preprocess;
             compact_segment current_segment; // start null
-            while(!kmers.done()) {
-                cur_hash = kmers.next();
+            for (const auto& h : hashing::KmerRange<extender_type>(sequence, this->K)) {
+                cur_hash = h;
                 cur_new = this->dbg->query(cur_hash) == 0;
                 cur_seen = new_kmers.count(cur_hash);
                 hashes.push_back(cur_hash);
@@ -1145,27 +1154,35 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
     };
     */
 
-    template <class ParserType = parsing::FastxParser<>>
-    class NormalizingCompactor : public FileProcessor<NormalizingCompactor<ParserType>,
+    /*
+     * Digital normalization in front of the compactor: reads whose median
+     * k-mer count has reached cutoff are skipped. The counts are kept in
+     * a dBG over CountStorageType, a ByteStorage by default; pass an
+     * exact storage such as FlatCountStorage to rule out inflated counts.
+     */
+    template <class ParserType       = parsing::FastxParser<>,
+              class CountStorageType = storage::ByteStorage>
+    class NormalizingCompactor : public FileProcessor<NormalizingCompactor<ParserType,
+                                                                           CountStorageType>,
                                                       ParserType> { 
     protected:
 
+        typedef dBG<CountStorageType, ShifterType> count_graph_type;
 
         bool median_count_at_least(const std::string&          sequence,
                                    unsigned int                cutoff,
-                                   dBG<storage::ByteStorage,
-                                       ShifterType>            * counts) {
+                                   count_graph_type *          counts) {
 
-            auto kmers = counts->get_hash_iter(sequence);
-            unsigned int min_req = 0.5 + float(sequence.size() - counts->K + 1) / 2;
+            hashing::KmerRange<count_graph_type> kmers(sequence, *counts);
+            unsigned int min_req = 0.5 + float(kmers.size()) / 2;
             unsigned int num_cutoff_kmers = 0;
 
             // first loop:
             // accumulate at least min_req worth of counts before checking to see
             // if we have enough high-abundance k-mers to indicate success.
-            for (unsigned int i = 0; i < min_req; ++i) {
-                hash_type kmer = kmers->next();
-                if (counts->query(kmer) >= cutoff) {
+            auto kmer = kmers.begin();
+            for (unsigned int i = 0; i < min_req; ++i, ++kmer) {
+                if (counts->query(*kmer) >= cutoff) {
                     ++num_cutoff_kmers;
                 }
             }
@@ -1175,9 +1192,8 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
             if (num_cutoff_kmers >= min_req) {
                 return true;
             }
-            while(!kmers->done()) {
-                hash_type kmer = kmers->next();
-                if (counts->query(kmer) >= cutoff) {
+            for (; kmer != kmers.end(); ++kmer) {
+                if (counts->query(*kmer) >= cutoff) {
                     ++num_cutoff_kmers;
                     if (num_cutoff_kmers >= min_req) {
                         return true;
@@ -1191,13 +1207,21 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
         std::shared_ptr<Compactor>                              compactor;
         std::shared_ptr<graph_type>                             graph;
 
-        std::unique_ptr<dBG<storage::ByteStorage, ShifterType>> counts;
+        std::unique_ptr<count_graph_type>                       counts;
         unsigned int                                            cutoff;
         size_t                                                  n_seq_updates;
 
-        typedef FileProcessor<NormalizingCompactor<ParserType>,
+        typedef FileProcessor<NormalizingCompactor<ParserType, CountStorageType>,
                               ParserType> Base;
 
+        static std::shared_ptr<CountStorageType> default_count_storage() {
+            if constexpr (std::is_same<CountStorageType, storage::ByteStorage>::value) {
+                return storage::ByteStorage::build(100000000, 4);
+            } else {
+                return CountStorageType::build();
+            }
+        }
+
     public:
 
         using Base::process_sequence;
@@ -1207,16 +1231,25 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
                              uint64_t fine_interval   = DEFAULT_INTERVALS::FINE,
                              uint64_t medium_interval = DEFAULT_INTERVALS::MEDIUM,
                              uint64_t coarse_interval = DEFAULT_INTERVALS::COARSE)
+            : NormalizingCompactor(compactor, cutoff, default_count_storage(),
+                                   fine_interval, medium_interval, coarse_interval)
+        {
+        }
+
+        NormalizingCompactor(std::shared_ptr<Compactor>        compactor,
+                             unsigned int                      cutoff,
+                             std::shared_ptr<CountStorageType> count_storage,
+                             uint64_t fine_interval   = DEFAULT_INTERVALS::FINE,
+                             uint64_t medium_interval = DEFAULT_INTERVALS::MEDIUM,
+                             uint64_t coarse_interval = DEFAULT_INTERVALS::COARSE)
             : Base(fine_interval, medium_interval, coarse_interval),
               compactor(compactor),
               graph(compactor->dbg),
               cutoff(cutoff),
               n_seq_updates(0)
         {
-            auto storage = storage::ByteStorage::build(100000000, 4);
             auto hasher = graph->get_hasher();
-            counts = std::make_unique<dBG<storage::ByteStorage,
-                                          ShifterType>>(storage, hasher);
+            counts = std::make_unique<count_graph_type>(count_storage, hasher);
         }
 
         static std::shared_ptr<NormalizingCompactor> build(std::shared_ptr<Compactor> compactor,
@@ -1228,6 +1261,16 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
 
         }
 
+        static std::shared_ptr<NormalizingCompactor> build(std::shared_ptr<Compactor> compactor,
+                                                           unsigned int cutoff,
+                                                           std::shared_ptr<CountStorageType> count_storage,
+                                                           uint64_t fine_interval   = DEFAULT_INTERVALS::FINE,
+                                                           uint64_t medium_interval = DEFAULT_INTERVALS::MEDIUM,
+                                                           uint64_t coarse_interval = DEFAULT_INTERVALS::COARSE) {
+            return std::make_shared<NormalizingCompactor>(compactor, cutoff, count_storage,
+                                                          fine_interval, medium_interval, coarse_interval);
+        }
+
         void process_sequence(const parsing::Record& read) {
 
             if (median_count_at_least(read.sequence, cutoff, counts.get())) {
@@ -1360,12 +1403,14 @@ struct StreamingCompactor<GraphType<StorageType, ShifterType>> {
 }
 
 extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::SparseppSetStorage, goetia::hashing::FwdLemireShifter>>;
+extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::FlatSetStorage, goetia::hashing::FwdLemireShifter>>;
 // extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::BitStorage, goetia::hashing::FwdLemireShifter>>;
 // extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::ByteStorage, goetia::hashing::FwdLemireShifter>>;
 // extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::NibbleStorage, goetia::hashing::FwdLemireShifter>>;
 // extern template class goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::QFStorage, goetia::hashing::FwdLemireShifter>>;
 
 extern template class std::deque<goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::SparseppSetStorage, goetia::hashing::FwdLemireShifter>>>;
+extern template class std::deque<goetia::cdbg::StreamingCompactor<goetia::dBG<goetia::storage::FlatSetStorage, goetia::hashing::FwdLemireShifter>>>;
 
 
 #undef pdebug
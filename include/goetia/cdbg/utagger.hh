@@ -110,12 +110,9 @@ struct UTagger {
 
             // don't confuse dbg.get(), retrieves the raw pointer,
             // with dbg->get(), which reaches through and gets the cursor hash value
-            hashing::KmerIterator<graph_type> kmer_iter(sequence, dbg.get());
-
             std::vector<hash_type> hashes;
             std::deque<shift_pair_type> neighbors;
-            while(!kmer_iter.done()) {
-                auto hash = kmer_iter.next();
+            for (const auto& hash : hashing::KmerRange<graph_type>(sequence, *dbg)) {
                 if (dbg->insert(hash)) {
                     hashes.push_back(hash);
                     // Note that left_extensions() and right_extensions() only collect
@@ -241,14 +238,12 @@ struct UTagger {
         std::vector<Tag> query_sequence_tags(const std::string& sequence) {
 
             std::vector<Tag> tags;
-            hashing::KmerIterator<graph_type> kmer_iter(sequence, dbg.get());
+            hashing::KmerRange<graph_type> kmers(sequence, *dbg);
 
-            hash_type u = kmer_iter.next();
-            if (kmer_iter.done()) {
-                return tags;
-            }
-            while(!kmer_iter.done()) {
-                hash_type v = kmer_iter.next();
+            auto kmer_iter = kmers.begin();
+            hash_type u = *kmer_iter;
+            for (++kmer_iter; kmer_iter != kmers.end(); ++kmer_iter) {
+                hash_type v = *kmer_iter;
                 auto tag = query_tag(u, v);
                 if (tag) {
                     tags.push_back(tag.value());
@@ -268,11 +263,9 @@ struct UTagger {
          */
         link_set_t query_neighborhood_tags(const std::string& sequence) {
 
-            hashing::KmerIterator<graph_type> kmer_iter(sequence, dbg.get());
             link_set_t found;
 
-            while(!kmer_iter.done()) {
-                hash_type root = kmer_iter.next();
+            for (const auto& root : hashing::KmerRange<graph_type>(sequence, *dbg)) {
                 auto neighborhood = dbg->filter_nodes(std::make_pair(dbg->left_extensions(),
                                                                      dbg->right_extensions()));
                 for (const shift_type<hashing::DIR_LEFT>& in_neighbor : neighborhood.first) {
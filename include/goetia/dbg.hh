@@ -14,7 +14,9 @@
 #include "goetia/processors.hh"
 #include "goetia/storage/storage.hh"
 #include "goetia/storage/storage_types.hh"
+#include "goetia/storage/recent_cache.hh"
 #include "goetia/hashing/rollinghashshifter.hh"
+#include "goetia/hashing/multikhasher.hh"
 #include "goetia/hashing/ukhs.hh"
 #include "goetia/sequences/exceptions.hh"
 #include "goetia/traversal.hh"
@@ -69,7 +71,94 @@ public:
 
 protected:
 
+    typedef typename StorageType::value_type storage_value_type;
+
     std::shared_ptr<StorageType> S;
+    std::shared_ptr<storage::RecentCache> _cache;
+
+    inline const bool _insert(storage_value_type h) {
+        if (_cache) {
+            if (_cache->contains(h)) {
+                _cache->record_hit();
+                return false;
+            }
+            _cache->record_miss();
+            const bool is_new = S->insert(h);
+            _cache->remember(h);
+            return is_new;
+        }
+        return S->insert(h);
+    }
+
+    inline const storage::count_t _query(storage_value_type h) const {
+        if (_cache) {
+            if (_cache->contains(h)) {
+                _cache->record_hit();
+                return 1;
+            }
+            _cache->record_miss();
+            const storage::count_t count = S->query(h);
+            if (count) {
+                _cache->remember(h);
+            }
+            return count;
+        }
+        return S->query(h);
+    }
+
+    // The storage's batch operations, with the cache's hits filtered out
+    // of the batch first.
+    uint64_t _insert_many(const storage_value_type * values, size_t n, storage::count_t * counts) {
+        if (!_cache) {
+            return S->insert_many(values, n, counts);
+        }
+
+        std::vector<storage_value_type> misses;
+        std::vector<size_t> positions;
+        _cache->filter(values, n, misses, positions);
+
+        std::vector<storage::count_t> miss_counts(counts ? misses.size() : 0);
+        const uint64_t n_new = S->insert_many(misses.data(), misses.size(),
+                                              counts ? miss_counts.data() : nullptr);
+        if (counts) {
+            std::fill(counts, counts + n, 1);
+            for (size_t i = 0; i < misses.size(); ++i) {
+                counts[positions[i]] = miss_counts[i];
+            }
+        }
+        for (storage_value_type h : misses) {
+            _cache->remember(h);
+        }
+        return n_new;
+    }
+
+    void _query_many(const storage_value_type * values, size_t n, storage::count_t * counts) const {
+        if (!_cache) {
+            S->query_many(values, n, counts);
+            return;
+        }
+
+        std::vector<storage_value_type> misses;
+        std::vector<size_t> positions;
+        _cache->filter(values, n, misses, positions);
+
+        std::vector<storage::count_t> miss_counts(misses.size());
+        S->query_many(misses.data(), misses.size(), miss_counts.data());
+        std::fill(counts, counts + n, 1);
+        for (size_t i = 0; i < misses.size(); ++i) {
+            counts[positions[i]] = miss_counts[i];
+            if (miss_counts[i]) {
+                _cache->remember(misses[i]);
+            }
+        }
+    }
+
+    // Sequences must hold a k-mer before their hash buffers are sized.
+    void _check_length(const std::string& sequence) const {
+        if (sequence.length() < K) {
+            throw SequenceLengthException("Sequence must have length >= K");
+        }
+    }
 
 public:
 
@@ -95,7 +184,8 @@ public:
      */
     dBG(const dBG& other)
         : walker_type(static_cast<const walker_type&>(other)),
-          S(other.S)
+          S(other.S),
+          _cache(other._cache)
     {
     }
 
@@ -125,8 +215,41 @@ public:
      * @Returns   shared_ptr owning the clone.
      */
     std::shared_ptr<dBG> clone() {
-        return std::make_shared<dBG>(S->clone(),
-                                     *this);
+        auto cloned = std::make_shared<dBG>(S->clone(),
+                                            *this);
+        if (_cache) {
+            cloned->enable_cache(_cache->n_bytes());
+        }
+        return cloned;
+    }
+
+    /**
+     * @Synopsis  Put a RecentCache in front of the storage, so that k-mers
+     *            seen recently skip it on insert and query. Only for
+     *            presence storages: the cache can't stand in for the
+     *            increments of a counting storage, nor remember k-mers
+     *            that a forgetful one has dropped. Copies of the dBG made
+     *            by copy construction share the cache.
+     *
+     * @Param bytes Size of the cache; the default is about an L2.
+     */
+    void enable_cache(size_t bytes = storage::RecentCache::DEFAULT_BYTES) {
+        if (storage::is_counting<StorageType>::value) {
+            throw GoetiaException("The recent k-mer cache can't front a counting storage");
+        }
+        if (storage::is_forgetful<StorageType>::value) {
+            throw GoetiaException("The recent k-mer cache can't front a storage that forgets");
+        }
+        _cache = std::make_shared<storage::RecentCache>(bytes);
+    }
+
+    void disable_cache() {
+        _cache.reset();
+    }
+
+    // The cache, with its hit and miss gauges; null when disabled.
+    std::shared_ptr<storage::RecentCache> get_cache() const {
+        return _cache;
     }
 
     /**
@@ -137,11 +260,11 @@ public:
      * @Returns   True if the k-mer was new; false otherwise.
      */
     inline const bool insert(const std::string& kmer) {
-        return S->insert(this->hash(kmer).value());
+        return _insert(this->hash(kmer).value());
     }
 
     inline const bool insert(const hash_type& kmer) {
-        return S->insert(kmer.value());
+        return _insert(kmer.value());
     }
 
     /**
@@ -153,11 +276,16 @@ public:
      * @Returns    Post-insertion count of the element.
      */
     inline const storage::count_t insert_and_query(hash_type& kmer) {
+        if (_cache) {
+            _insert(kmer.value());
+            return 1;
+        }
         return S->insert_and_query(kmer.value());
     }
 
     inline const storage::count_t insert_and_query(const std::string& kmer) {
-        return S->insert_and_query(this->hash(kmer).value());
+        auto h = this->hash(kmer);
+        return insert_and_query(h);
     }
 
     /**
@@ -172,7 +300,7 @@ public:
     }
 
     const storage::count_t query(const hash_type& h) const {
-        return S->query(h.value());
+        return _query(h.value());
     }
 
     /**
@@ -184,6 +312,17 @@ public:
         return S->n_unique_kmers();
     }
 
+    /**
+     * @Synopsis  Estimated number of distinct k-mers, corrected for
+     *            collisions in probabilistic storages; cheap enough to
+     *            poll during ingest.
+     *
+     * @Returns   Estimated distinct k-mers.
+     */
+    uint64_t estimated_cardinality() const {
+        return S->estimated_cardinality();
+    }
+
     /**
      * @Synopsis  Number of occupied buckets in the storage.
      *
@@ -193,6 +332,21 @@ public:
         return S->n_occupied();
     }
 
+    /**
+     * @Synopsis  Bytes held by the graph, by component: the storage's,
+     *            under "storage", and the recent k-mer cache, if enabled.
+     *
+     * @Returns   Memory usage breakdown.
+     */
+    metrics::MemoryUsage memory_usage() const {
+        metrics::MemoryUsage usage;
+        usage.add("storage", S->memory_usage());
+        if (_cache) {
+            usage.add("recent_cache", _cache->n_bytes());
+        }
+        return usage;
+    }
+
     /**
      * @Synopsis  Gets the length K-1 suffix of the given string.
      *
@@ -236,6 +390,70 @@ public:
         return S->estimated_fp();
     }
 
+    /**
+     * @Synopsis  Freeze the dBG into a read-only FrozenStorage index with
+     *            the same hasher, for serving queries once streaming is
+     *            done. The StorageType must be able to list its hashes.
+     *
+     * @Param fingerprint_bits Bits of each k-mer's fingerprint.
+     * @Param count_bits       Bits of each count, if StorageType is counting.
+     *
+     * @Returns   The frozen dBG.
+     */
+    template<typename Frozen = dBG<storage::FrozenStorage, ShifterType>>
+    auto freeze(uint8_t fingerprint_bits = storage::FrozenStorage::DEFAULT_FINGERPRINT_BITS,
+                uint8_t count_bits       = storage::FrozenStorage::DEFAULT_COUNT_BITS)
+    -> std::enable_if_t<storage::is_enumerable<StorageType>::value, std::shared_ptr<Frozen>>
+    {
+        return Frozen::build(storage::FrozenStorage::freeze(*S, fingerprint_bits, count_bits),
+                             *this);
+    }
+
+    /**
+     * @Synopsis  Freeze the k-mers of the given sequences which are in the
+     *            dBG, for storages such as QFStorage which can't list
+     *            their hashes; usually the sequences inserted.
+     *
+     * @Returns   The frozen dBG.
+     */
+    std::shared_ptr<dBG<storage::FrozenStorage, ShifterType>>
+    freeze(const std::vector<std::string>& sequences,
+           uint8_t fingerprint_bits = storage::FrozenStorage::DEFAULT_FINGERPRINT_BITS,
+           uint8_t count_bits       = storage::FrozenStorage::DEFAULT_COUNT_BITS)
+    {
+        std::vector<typename StorageType::value_type> hashes;
+        for (const auto& sequence : sequences) {
+            if (sequence.length() < this->K) {
+                continue;
+            }
+            auto values = hash_values(sequence);
+            hashes.insert(hashes.end(), values.begin(), values.end());
+        }
+        return dBG<storage::FrozenStorage, ShifterType>::build(
+            storage::FrozenStorage::freeze(*S, std::move(hashes),
+                                           storage::is_counting<StorageType>::value,
+                                           fingerprint_bits, count_bits),
+            *this
+        );
+    }
+
+    /**
+     * @Synopsis  Hash all k-mers in the sequence to their raw storage values,
+     *            for use with the batched storage methods.
+     *
+     * @Param sequence string containg the sequence, must be length >= K.
+     *
+     * @Returns   The hash values, in sequence order.
+     */
+    std::vector<typename StorageType::value_type> hash_values(const std::string& sequence) {
+
+        _check_length(sequence);
+        std::vector<typename StorageType::value_type> values(sequence.length() - K + 1);
+        this->hash_sequence(sequence, values.data());
+
+        return values;
+    }
+
     /**
      * @Synopsis  Insert all k-mers from the given sequence.
      *
@@ -248,21 +466,20 @@ public:
     uint64_t insert_sequence(const std::string&          sequence,
                              std::vector<hash_type>&  kmer_hashes,
                              std::vector<storage::count_t>& counts) {
-    
-        hashing::KmerIterator<ShifterType> iter(sequence, static_cast<ShifterType*>(this));
 
-        uint64_t         n_consumed = 0;
-        size_t           pos = 0;
-        storage::count_t count;
-        while(!iter.done()) {
-            auto h = iter.next();
-            count  = insert_and_query(h);
+        _check_length(sequence);
+        const size_t offset = kmer_hashes.size();
+        std::vector<typename StorageType::value_type> values(sequence.length() - K + 1);
+        kmer_hashes.resize(offset + values.size());
+        this->hash_sequence(sequence, values.data(), kmer_hashes.data() + offset);
 
-            kmer_hashes.push_back(h);
-            counts.push_back(count);
+        const size_t count_offset = counts.size();
+        counts.resize(count_offset + values.size());
+        _insert_many(values.data(), values.size(), counts.data() + count_offset);
 
-            n_consumed += (count == 1);
-            ++pos;
+        uint64_t n_consumed = 0;
+        for (size_t pos = count_offset; pos < counts.size(); ++pos) {
+            n_consumed += (counts[pos] == 1);
         }
 
         return n_consumed;
@@ -271,18 +488,12 @@ public:
     uint64_t insert_sequence(const std::string&      sequence,
                              std::set<hash_type>& new_kmers) {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-
         uint64_t n_consumed = 0;
-        size_t pos = 0;
-        bool is_new;
-        while(!iter.done()) {
-            hash_type h = iter.next();
+        for (const auto& h : hashing::KmerRange<ShifterType>(sequence, *this)) {
             if(insert(h)) {
                 new_kmers.insert(h);
-                n_consumed += is_new;
+                ++n_consumed;
             }
-            ++pos;
         }
 
         return n_consumed;
@@ -290,15 +501,19 @@ public:
 
     uint64_t insert_sequence(const std::string& sequence) {
     
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-
-        uint64_t n_consumed = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
-            n_consumed += insert(h);
-        }
+        auto values = hash_values(sequence);
+        return _insert_many(values.data(), values.size(), nullptr);
+    }
 
-        return n_consumed;
+    /**
+     * @Synopsis  Insert k-mers already hashed to their storage values by
+     *            this dBG's shifter, or by anything hashing as it does,
+     *            such as a MultiKHasher at this K.
+     *
+     * @Returns Number of new unique k-mers inserted.
+     */
+    uint64_t insert_values(const std::vector<typename StorageType::value_type>& values) {
+        return _insert_many(values.data(), values.size(), nullptr);
     }
 
     /**
@@ -310,15 +525,9 @@ public:
      */
     std::vector<storage::count_t> insert_and_query_sequence(const std::string& sequence)  {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
-
-        size_t pos = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
-            counts[pos] = S->insert_and_query(h.value());
-            ++pos;
-        }
+        auto values = hash_values(sequence);
+        std::vector<storage::count_t> counts(values.size());
+        _insert_many(values.data(), values.size(), counts.data());
 
         return counts;
     }
@@ -332,15 +541,9 @@ public:
      */
     std::vector<storage::count_t> query_sequence(const std::string& sequence)  {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
-
-        size_t pos = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
-            counts[pos] = query(h);
-            ++pos;
-        }
+        auto values = hash_values(sequence);
+        std::vector<storage::count_t> counts(values.size());
+        _query_many(values.data(), values.size(), counts.data());
 
         return counts;
     }
@@ -349,14 +552,15 @@ public:
                         std::vector<storage::count_t>& counts,
                         std::vector<hash_type>&  hashes) {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
+        _check_length(sequence);
+        const size_t hash_offset = hashes.size();
+        std::vector<typename StorageType::value_type> values(sequence.length() - K + 1);
+        hashes.resize(hash_offset + values.size());
+        this->hash_sequence(sequence, values.data(), hashes.data() + hash_offset);
 
-        while(!iter.done()) {
-            hash_type h = iter.next();
-            storage::count_t result = query(h);
-            counts.push_back(result);
-            hashes.push_back(h);
-        }
+        const size_t offset = counts.size();
+        counts.resize(offset + values.size());
+        _query_many(values.data(), values.size(), counts.data() + offset);
     }
 
     void query_sequence(const std::string& sequence,
@@ -364,10 +568,7 @@ public:
                         std::vector<hash_type>& hashes,
                         std::set<hash_type>& new_hashes) {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-
-        while(!iter.done()) {
-            hash_type h = iter.next();
+        for (const auto& h : hashing::KmerRange<ShifterType>(sequence, *this)) {
             auto result = query(h);
             if (result == 0) {
                 new_hashes.insert(h);
@@ -384,6 +585,9 @@ public:
     void load(std::string filename) {
         uint16_t ksize = K;
         S->load(filename, ksize);
+        if (_cache) {
+            _cache->clear();
+        }
     }
 
     void serialize(std::string& filename) {
@@ -400,6 +604,9 @@ public:
      */
     void reset() {
         S->reset();
+        if (_cache) {
+            _cache->clear();
+        }
     }
 
     auto get_hash_iter(const std::string& sequence)
@@ -466,12 +673,11 @@ struct Masked : public dBGWalker<Masked<StorageType, ShifterType, MaskType>> {
 
     std::vector<storage::count_t> query_sequence(const std::string& sequence)  {
 
-        hashing::KmerIterator<ShifterType> iter(sequence, this);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
+        hashing::KmerRange<ShifterType> kmers(sequence, *this);
+        std::vector<storage::count_t> counts(kmers.size());
 
         size_t pos = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
+        for (const auto& h : kmers) {
             counts[pos] = query(h);
             ++pos;
         }
@@ -490,16 +696,125 @@ std::shared_ptr<Masked<StorageType, ShifterType, MaskType>> make_masked(dBG<Stor
 }
 
 
+/**
+ * @Synopsis  Inserts sequences into dBGs at several K, hashing each
+ *            sequence once for all of them with a MultiKHasher. The
+ *            graphs' shifters must be Lemire shifters, whose hashes the
+ *            MultiKHasher reproduces.
+ *
+ * @tparam GraphType  The dBG type of every graph.
+ */
+template <class GraphType>
+class MultiKInserter {
+
+public:
+
+    typedef GraphType                                  graph_type;
+    typedef typename graph_type::shifter_type          shifter_type;
+    typedef typename graph_type::hash_type             hash_type;
+    typedef hashing::MultiKHasher<hash_type>           hasher_type;
+
+    static_assert(hashing::is_lemire_shifter<shifter_type>::value,
+                  "MultiKInserter needs graphs over Lemire shifters");
+
+protected:
+
+    std::vector<std::shared_ptr<graph_type>> graphs;
+    hasher_type                              hasher;
+
+    static std::vector<uint16_t> _graph_ks(const std::vector<std::shared_ptr<graph_type>>& graphs) {
+        std::vector<uint16_t> Ks;
+        for (const auto& graph : graphs) {
+            Ks.push_back(graph->K);
+        }
+        return Ks;
+    }
+
+public:
+
+    // The least of the graphs' K: sequences shorter are skipped, and
+    // InserterProcessor counts k-mers at it.
+    const uint16_t K;
+
+    explicit MultiKInserter(const std::vector<std::shared_ptr<graph_type>>& graphs)
+        : graphs(graphs),
+          hasher(_graph_ks(graphs)),
+          K(*std::min_element(hasher.Ks().begin(), hasher.Ks().end()))
+    {
+    }
+
+    /**
+     * @Synopsis  Insert the k-mers of sequence into every graph at its K;
+     *            graphs with K longer than the sequence get none.
+     *
+     * @Returns   Number of new unique k-mers, over all the graphs.
+     */
+    uint64_t insert_sequence(const std::string& sequence) {
+        if (sequence.length() < K) {
+            throw SequenceLengthException("Sequence must have length >= K");
+        }
+
+        hasher.hash_sequence(sequence);
+        uint64_t n_new = 0;
+        for (size_t i = 0; i < graphs.size(); ++i) {
+            n_new += graphs[i]->insert_values(hasher.values(i));
+        }
+        return n_new;
+    }
+
+    const std::vector<std::shared_ptr<graph_type>>& get_graphs() const {
+        return graphs;
+    }
+
+    static std::shared_ptr<MultiKInserter> build(const std::vector<std::shared_ptr<graph_type>>& graphs) {
+        return std::make_shared<MultiKInserter>(graphs);
+    }
+
+    using Processor = InserterProcessor<MultiKInserter>;
+};
+
+
 
 extern template class dBG<storage::BitStorage, hashing::FwdLemireShifter>;
 extern template class dBG<storage::BitStorage, hashing::CanLemireShifter>;
 extern template class dBG<storage::BitStorage, hashing::FwdUnikmerShifter>;
 extern template class dBG<storage::BitStorage, hashing::CanUnikmerShifter>;
+extern template class dBG<storage::BitStorage, hashing::FwdTwoBitShifter>;
+extern template class dBG<storage::BitStorage, hashing::CanTwoBitShifter>;
+
+extern template class dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>;
 
 extern template class dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>;
 extern template class dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>;
 extern template class dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>;
 extern template class dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>;
+extern template class dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>;
+extern template class dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>;
+
+extern template class dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::FlatSetStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>;
+
+extern template class dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::FlatCountStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>;
+extern template class dBG<storage::FrozenStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::FrozenStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>;
+extern template class dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::DiskCountStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>;
+extern template class dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>;
+extern template class dBG<storage::RollingBitStorage, hashing::CanLemireShifter>;
+extern template class dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>;
+extern template class dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>;
 
 extern template class dBG<storage::ByteStorage, hashing::FwdLemireShifter>;
 extern template class dBG<storage::ByteStorage, hashing::CanLemireShifter>;
@@ -520,11 +835,42 @@ extern template class dBGWalker<dBG<storage::BitStorage, hashing::FwdLemireShift
 extern template class dBGWalker<dBG<storage::BitStorage, hashing::CanLemireShifter>>;
 extern template class dBGWalker<dBG<storage::BitStorage, hashing::FwdUnikmerShifter>>;
 extern template class dBGWalker<dBG<storage::BitStorage, hashing::CanUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::BitStorage, hashing::FwdTwoBitShifter>>;
+extern template class dBGWalker<dBG<storage::BitStorage, hashing::CanTwoBitShifter>>;
+
+extern template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>>;
 
 extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
 extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
 extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>>;
 extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>>;
+extern template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>>;
+
+extern template class dBGWalker<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>>;
+
+extern template class dBGWalker<dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FlatCountStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::FrozenStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FrozenStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::DiskCountStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>>;
+extern template class dBGWalker<dBG<storage::RollingBitStorage, hashing::CanLemireShifter>>;
+extern template class dBGWalker<dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>>;
+extern template class dBGWalker<dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>>;
 
 extern template class dBGWalker<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
 extern template class dBGWalker<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
@@ -545,11 +891,42 @@ extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::Fw
 extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanLemireShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::FwdUnikmerShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::FwdTwoBitShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanTwoBitShifter>>;
+
+extern template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>>;
 
 extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>>;
+
+extern template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>>;
+
+extern template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::CanLemireShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>>;
+extern template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>>;
 
 extern template class hashing::KmerIterator<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
 extern template class hashing::KmerIterator<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
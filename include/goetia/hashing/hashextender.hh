@@ -412,6 +412,10 @@ typedef HashExtender<DefaultExtensionPolicy<CanLemireShifter>> CanRollingExtende
 typedef HashExtender<FwdUnikmerShifter> FwdUnikmerExtender;
 typedef HashExtender<CanUnikmerShifter> CanUnikmerExtender;
 
+// two-bit shifters keep their own k-mer, and extend from it
+typedef HashExtender<FwdTwoBitShifter> FwdTwoBitExtender;
+typedef HashExtender<CanTwoBitShifter> CanTwoBitExtender;
+
 
 template <typename ShifterType>
 struct extender_selector {
@@ -434,6 +438,20 @@ struct extender_selector<CanUnikmerShifter> {
 };
 
 
+template<>
+struct extender_selector<FwdTwoBitShifter> {
+    typedef HashExtender<FwdTwoBitShifter> type;
+    typedef FwdTwoBitShifter               shifter_type;
+};
+
+
+template<>
+struct extender_selector<CanTwoBitShifter> {
+    typedef HashExtender<CanTwoBitShifter> type;
+    typedef CanTwoBitShifter               shifter_type;
+};
+
+
 template<typename ShifterType>
     using extender_selector_t = typename extender_selector<ShifterType>::type;
 
@@ -447,12 +465,27 @@ extern template class HashExtender<DefaultExtensionPolicy<CanLemireShifter>>;
 extern template class HashExtender<FwdUnikmerShifter>;
 extern template class HashExtender<CanUnikmerShifter>;
 
+extern template class HashExtender<FwdTwoBitShifter>;
+extern template class HashExtender<CanTwoBitShifter>;
+
 extern template class KmerIterator<FwdRollingExtender>;
 extern template class KmerIterator<CanRollingExtender>;
 
 extern template class KmerIterator<FwdUnikmerExtender>;
 extern template class KmerIterator<CanUnikmerExtender>;
 
+extern template class KmerIterator<FwdTwoBitExtender>;
+extern template class KmerIterator<CanTwoBitExtender>;
+
+extern template class KmerRange<FwdRollingExtender>;
+extern template class KmerRange<CanRollingExtender>;
+
+extern template class KmerRange<FwdUnikmerExtender>;
+extern template class KmerRange<CanUnikmerExtender>;
+
+extern template class KmerRange<FwdTwoBitExtender>;
+extern template class KmerRange<CanTwoBitExtender>;
+
 
 
 }
@@ -82,6 +82,7 @@ public:
     typedef typename shift_policy::kmer_type             kmer_type;
     typedef Alphabet                                     alphabet;
     static constexpr bool has_kmer_span = shift_policy::has_kmer_span;
+    static constexpr bool has_sequence_kernel = shift_policy::has_sequence_kernel;
 
     using tagged_type::NAME;
     using tagged_type::OBJECT_ABI_VERSION;
@@ -160,6 +161,40 @@ public:
         return h;
     }
 
+    /**
+     * @Synopsis  Hash every k-mer of the sequence, leaving the shifter on
+     *            the last. Policies with a whole-sequence kernel hash it in
+     *            one pass; the rest shift along it.
+     *
+     * @Param values Room for sequence.length() - K + 1 hash values.
+     * @Param hashes Room for as many hashes, or null.
+     */
+    void hash_sequence(const std::string& sequence,
+                       value_type *       values,
+                       hash_type *        hashes = nullptr) {
+        if (sequence.length() < K) {
+            throw SequenceLengthException("Sequence must at least length K");
+        }
+
+        if constexpr (has_sequence_kernel) {
+            this->hash_sequence_impl(sequence.c_str(), sequence.length(), values, hashes);
+            initialized = true;
+        } else {
+            hash_type h = hash_base(sequence.c_str());
+            values[0] = h.value();
+            if (hashes) {
+                hashes[0] = h;
+            }
+            for (size_t i = 1; i < sequence.length() - K + 1; ++i) {
+                h = this->shift_right_impl(sequence[i - 1], sequence[i + K - 1]);
+                values[i] = h.value();
+                if (hashes) {
+                    hashes[i] = h;
+                }
+            }
+        }
+    }
+
     const hash_type hash(const std::string& sequence) const {
         type hasher(*this);
         return hasher.hash_base(sequence);
@@ -196,6 +231,36 @@ extern template class HashShifter<CanLemirePolicy>;
 typedef HashShifter<FwdLemirePolicy> FwdLemireShifter;
 typedef HashShifter<CanLemirePolicy> CanLemireShifter;
 
+// Shifters compiled for one K, in FIXED_KS; see dispatch_k.
+template<uint16_t K>
+using FixedFwdLemireShifter = HashShifter<typename FixedLemire<K>::template Policy<Hash<uint64_t>>>;
+template<uint16_t K>
+using FixedCanLemireShifter = HashShifter<typename FixedLemire<K>::template Policy<Canonical<uint64_t>>>;
+
+extern template class HashShifter<FixedLemire<21>::Policy<Hash<uint64_t>>>;
+extern template class HashShifter<FixedLemire<21>::Policy<Canonical<uint64_t>>>;
+extern template class HashShifter<FixedLemire<25>::Policy<Hash<uint64_t>>>;
+extern template class HashShifter<FixedLemire<25>::Policy<Canonical<uint64_t>>>;
+extern template class HashShifter<FixedLemire<31>::Policy<Hash<uint64_t>>>;
+extern template class HashShifter<FixedLemire<31>::Policy<Canonical<uint64_t>>>;
+extern template class HashShifter<FixedLemire<51>::Policy<Hash<uint64_t>>>;
+extern template class HashShifter<FixedLemire<51>::Policy<Canonical<uint64_t>>>;
+
+
+/**
+ * @Synopsis  The Lemire shifter over HashType for dispatch_k's k: fixed
+ *            when k is a std::integral_constant, else the runtime one.
+ */
+template<class HashType, class KType>
+struct LemireShifterFor {
+    typedef HashShifter<LemireShifterPolicy<HashType>> type;
+};
+
+template<class HashType, uint16_t K>
+struct LemireShifterFor<HashType, std::integral_constant<uint16_t, K>> {
+    typedef HashShifter<typename FixedLemire<K>::template Policy<HashType>> type;
+};
+
 } // goetia
 
 #endif
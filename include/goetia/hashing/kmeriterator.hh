@@ -17,7 +17,12 @@
 #ifndef GOETIA_KMERITERATOR_HH
 #define GOETIA_KMERITERATOR_HH
 
+#include <cstddef>
+#include <iterator>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "goetia/goetia.hh"
 #include "goetia/hashing/hashshifter.hh"
@@ -141,12 +146,163 @@ public:
 };
 
 
+/**
+ * @Synopsis  The k-mer hashes of a sequence as a range, without copying the
+ *            sequence or allocating. The sequence is viewed, not owned, and
+ *            must outlive the range. The shifter is either borrowed, in which
+ *            case it tracks the current k-mer as the range is walked, so that
+ *            its cursor (left_extensions() etc.) can be used in the loop body;
+ *            or owned, constructed in place within the range itself.
+ *
+ *                for (auto h : KmerRange<ShifterType>(sequence, shifter)) ...
+ */
+template <class ShifterType>
+class KmerRange {
+
+    std::string_view           _seq;
+    std::optional<ShifterType> _owned;
+    ShifterType *              _shifter;
+
+    void _check_length() const {
+        if (_seq.length() < K) {
+            throw SequenceLengthException("Sequence must have length >= K");
+        }
+    }
+
+public:
+
+    typedef ShifterType                     shifter_type;
+    typedef typename ShifterType::hash_type hash_type;
+    const uint16_t                          K;
+
+    class iterator {
+
+        const char *  _seq;
+        ShifterType * _shifter;
+        size_t        _index;
+        size_t        _n_kmers;
+        hash_type     _hash;
+
+    public:
+
+        typedef std::input_iterator_tag iterator_category;
+        typedef hash_type               value_type;
+        typedef std::ptrdiff_t          difference_type;
+        typedef const hash_type *       pointer;
+        typedef const hash_type &       reference;
+
+        iterator(const char * seq, ShifterType * shifter, size_t index, size_t n_kmers)
+            : _seq(seq),
+              _shifter(shifter),
+              _index(index),
+              _n_kmers(n_kmers)
+        {
+        }
+
+        iterator(const char * seq, ShifterType * shifter, size_t n_kmers, const hash_type& first)
+            : _seq(seq),
+              _shifter(shifter),
+              _index(0),
+              _n_kmers(n_kmers),
+              _hash(first)
+        {
+        }
+
+        reference operator*() const {
+            return _hash;
+        }
+
+        pointer operator->() const {
+            return &_hash;
+        }
+
+        // The shift happens here rather than at dereference, so that a
+        // borrowed shifter is always sitting on the current k-mer.
+        iterator& operator++() {
+            if (++_index < _n_kmers) {
+                _hash = _shifter->shift_right(_seq[_index - 1], _seq[_index + _shifter->K - 1]);
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const {
+            return _index == other._index;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return _index != other._index;
+        }
+
+        // Start position of the current k-mer in the sequence.
+        size_t position() const {
+            return _index;
+        }
+    };
+
+    /**
+     * @Synopsis  Borrow shifter; it's reset to the first k-mer on begin().
+     */
+    KmerRange(std::string_view seq, ShifterType& shifter)
+        : _seq(seq),
+          _shifter(&shifter),
+          K(shifter.K)
+    {
+        _check_length();
+    }
+
+    /**
+     * @Synopsis  Own a ShifterType(K, args...), constructed in place.
+     */
+    template<typename... Args>
+    explicit KmerRange(std::string_view seq, uint16_t K, Args&&... args)
+        : _seq(seq),
+          _owned(std::in_place, K, std::forward<Args>(args)...),
+          _shifter(&*_owned),
+          K(K)
+    {
+        _check_length();
+    }
+
+    // _shifter may point into _owned
+    KmerRange(const KmerRange&) = delete;
+    KmerRange& operator=(const KmerRange&) = delete;
+
+    iterator begin() {
+        return iterator(_seq.data(), _shifter, size(), _shifter->hash_base(_seq.data()));
+    }
+
+    iterator end() {
+        return iterator(_seq.data(), _shifter, size(), size());
+    }
+
+    size_t size() const {
+        return _seq.length() - K + 1;
+    }
+
+    ShifterType& shifter() {
+        return *_shifter;
+    }
+};
+
+
 extern template class KmerIterator<FwdLemireShifter>;
 extern template class KmerIterator<CanLemireShifter>;
 
 extern template class KmerIterator<FwdUnikmerShifter>;
 extern template class KmerIterator<CanUnikmerShifter>;
 
+extern template class KmerIterator<FwdTwoBitShifter>;
+extern template class KmerIterator<CanTwoBitShifter>;
+
+extern template class KmerRange<FwdLemireShifter>;
+extern template class KmerRange<CanLemireShifter>;
+
+extern template class KmerRange<FwdUnikmerShifter>;
+extern template class KmerRange<CanUnikmerShifter>;
+
+extern template class KmerRange<FwdTwoBitShifter>;
+extern template class KmerRange<CanTwoBitShifter>;
+
 
 }
 }
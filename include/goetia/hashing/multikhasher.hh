@@ -0,0 +1,103 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : multikhasher.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_MULTIKHASHER_HH
+#define GOETIA_MULTIKHASHER_HH
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "goetia/goetia.hh"
+#include "goetia/hashing/canonical.hh"
+#include "goetia/hashing/hashshifter.hh"
+#include "goetia/hashing/rollinghashshifter.hh"
+#include "goetia/sequences/alphabets.hh"
+
+
+namespace goetia::hashing {
+
+
+/**
+ * @Synopsis  Hashes every k-mer of a sequence at several K in one pass,
+ *            to the same values as LemireShifterPolicy<HashType> at each
+ *            K. The sequence is read, and its symbols and their
+ *            complements looked up, once, into prefix hashes; each K then
+ *            takes its k-mers' hashes from those (see
+ *            lemire::hash_prefixes). The value streams are reused from
+ *            one sequence to the next; each can go to a storage's
+ *            insert_many or a dBG's insert_values, and MultiKInserter
+ *            does the latter for a set of dBGs.
+ *
+ * @tparam HashType  Hash<uint64_t> or Canonical<uint64_t>.
+ */
+template<class HashType>
+class MultiKHasher {
+
+public:
+
+    typedef HashType                       hash_type;
+    typedef typename hash_type::value_type value_type;
+    typedef DNA_SIMPLE                     alphabet;
+
+    static constexpr bool canonical = std::is_same<hash_type, Canonical<value_type>>::value;
+
+protected:
+
+    std::vector<uint16_t>                _Ks;
+    std::vector<uint64_t>                _fw_prefix;
+    std::vector<uint64_t>                _rc_prefix;
+    std::vector<std::vector<value_type>> _values;
+
+public:
+
+    explicit MultiKHasher(const std::vector<uint16_t>& Ks);
+
+    const std::vector<uint16_t>& Ks() const {
+        return _Ks;
+    }
+
+    size_t n_ks() const {
+        return _Ks.size();
+    }
+
+    /**
+     * @Synopsis  Hash the k-mers of sequence at every K; a K longer than
+     *            the sequence gets none.
+     */
+    void hash_sequence(const char * sequence, size_t length);
+
+    void hash_sequence(const std::string& sequence) {
+        hash_sequence(sequence.c_str(), sequence.length());
+    }
+
+    // The hash values at Ks()[i] from the last hash_sequence, in sequence order.
+    const std::vector<value_type>& values(size_t i) const {
+        return _values.at(i);
+    }
+};
+
+
+// Shifters which hash as a MultiKHasher does.
+template<class ShifterType>
+struct is_lemire_shifter : std::false_type { };
+
+template<class HashType>
+struct is_lemire_shifter<HashShifter<LemireShifterPolicy<HashType, DNA_SIMPLE>>> : std::true_type { };
+
+
+extern template class MultiKHasher<Hash<uint64_t>>;
+extern template class MultiKHasher<Canonical<uint64_t>>;
+
+typedef MultiKHasher<Hash<uint64_t>> FwdMultiKHasher;
+typedef MultiKHasher<Canonical<uint64_t>> CanMultiKHasher;
+
+}
+
+#endif
@@ -16,9 +16,157 @@
 
 #include "goetia/hashing/rollinghash/cyclichash.h"
 
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 namespace goetia::hashing {
 
 
+/*
+ * Whole-sequence kernels for the cyclic hash, which hash every k-mer of a
+ * sequence in one call rather than one shift at a time.
+ *
+ * The hash of a k-mer is the XOR of each symbol's hash rotated by its
+ * distance from the end, so it can be started at any position. The vector
+ * kernels split a sequence into 4 (AVX2) or 8 (AVX-512) equal runs of
+ * k-mers and roll them all in lockstep, one run per lane, with the hashes
+ * of ACGTacgt in small tables; the scalar kernel rolls through it with the
+ * complement hashes tabled. The kernel is picked at runtime from the CPU's
+ * features, and sequences with other symbols, or too short to repay
+ * starting every lane from scratch, take the scalar kernel. All produce
+ * the same hashes as CyclicHash.
+ */
+
+
+/*
+ * Compile-time K.
+ *
+ * K is otherwise a runtime value, so no loop over a k-mer has a known trip
+ * count and every rotation by K is by a register. For the K we use most,
+ * the scalar whole-sequence kernel and FixedLemire<K>'s shifter policy are
+ * compiled with K a constant, and dispatch_k picks them at runtime.
+ */
+constexpr std::array<uint16_t, 4> FIXED_KS = {21, 25, 31, 51};
+
+
+/**
+ * @Synopsis  Call func(k), with k a std::integral_constant<uint16_t, K> if K
+ *            is in FIXED_KS and K itself if not; k converts to K either way.
+ */
+template<typename Func>
+decltype(auto) dispatch_k(uint16_t K, Func&& func) {
+    switch (K) {
+        case 21:
+            return func(std::integral_constant<uint16_t, 21>());
+        case 25:
+            return func(std::integral_constant<uint16_t, 25>());
+        case 31:
+            return func(std::integral_constant<uint16_t, 31>());
+        case 51:
+            return func(std::integral_constant<uint16_t, 51>());
+        default:
+            return func(K);
+    }
+}
+
+
+namespace lemire {
+
+    inline uint64_t rotl(uint64_t x, unsigned r) {
+        return (x << (r & 63)) | (x >> (-r & 63));
+    }
+
+    inline uint64_t rotr1(uint64_t x) {
+        return (x >> 1) | (x << 63);
+    }
+
+    // The hash of each symbol, as in CyclicHash.
+    const uint64_t * symbol_hashes();
+
+    // The hash of each symbol's complement under Alphabet.
+    template<class Alphabet>
+    const uint64_t * complement_hashes() {
+        static const std::array<uint64_t, 256> table = [] {
+            std::array<uint64_t, 256> table;
+            for (int c = 0; c < 256; ++c) {
+                table[c] = symbol_hashes()[(unsigned char) Alphabet::complement((char) c)];
+            }
+            return table;
+        }();
+        return table.data();
+    }
+
+    /**
+     * @Synopsis  Hash the n_kmers k-mers of sequence.
+     *
+     * @Param complements  complement_hashes() to hash both strands, or
+     *                     null for forward hashes only.
+     * @Param values       Forward hashes, or the canonical (lesser) hash
+     *                     of each k-mer with complements.
+     * @Param fw           Forward hashes, or null.
+     * @Param rc           Reverse complement hashes, or null.
+     * @Param last_fw      Set to the last k-mer's forward hash.
+     * @Param last_rc      Set to its reverse complement hash, with
+     *                     complements.
+     *
+     * K in FIXED_KS takes a scalar kernel compiled for that K.
+     */
+    void hash_kmers(const char *     sequence,
+                    size_t           n_kmers,
+                    uint16_t         K,
+                    const uint64_t * complements,
+                    uint64_t *       values,
+                    uint64_t *       fw,
+                    uint64_t *       rc,
+                    uint64_t&        last_fw,
+                    uint64_t&        last_rc);
+
+    /**
+     * @Synopsis  Prefix hashes of sequence, from which any k-mer's hashes,
+     *            at any K, are a couple of lookups; see hash_kmers_prefixed.
+     *
+     *            fw_prefix[i] is the XOR of the hash of each symbol j < i
+     *            rotated right by j, and rc_prefix[i] that of the hash of
+     *            its complement rotated left by j. For sequence[j, j + K),
+     *            the XOR of the prefixes at j + K and j rotated left by
+     *            j + K - 1 is its hash, and the same for rc_prefix rotated
+     *            right by j that of its reverse complement.
+     *
+     * @Param complements  complement_hashes(), or null for forward
+     *                     prefixes only.
+     * @Param fw_prefix    Room for length + 1.
+     * @Param rc_prefix    Room for length + 1, or null.
+     */
+    void hash_prefixes(const char *     sequence,
+                       size_t           length,
+                       const uint64_t * complements,
+                       uint64_t *       fw_prefix,
+                       uint64_t *       rc_prefix);
+
+    /**
+     * @Synopsis  Hash n_kmers k-mers from hash_prefixes' prefixes, as
+     *            hash_kmers would; rc_prefix null for forward hashes.
+     */
+    void hash_kmers_prefixed(const uint64_t * fw_prefix,
+                             const uint64_t * rc_prefix,
+                             size_t           n_kmers,
+                             uint16_t         K,
+                             uint64_t *       values,
+                             uint64_t *       fw,
+                             uint64_t *       rc);
+
+    // The kernel in use: "avx512", "avx2" or "scalar".
+    std::string kernel();
+
+    // Use the named kernel, eg to compare them; throws if the CPU lacks it.
+    void set_kernel(const std::string& name);
+
+}
+
+
 template<class HashType>
 struct LemireShifterPolicyBase {
 protected:
@@ -62,6 +210,7 @@ public:
     typedef Kmer<hash_type>           kmer_type;
     typedef Alphabet                       alphabet;
     static constexpr bool has_kmer_span = false;
+    static constexpr bool has_sequence_kernel = true;
 
     const uint16_t K;
 
@@ -104,6 +253,23 @@ public:
         return get_impl();
     }
 
+    // Hash every k-mer of sequence with the whole-sequence kernel, leaving
+    // the hasher on the last; hashes may be null.
+    void hash_sequence_impl(const char * sequence,
+                            size_t       length,
+                            value_type * values,
+                            hash_type *  hashes) {
+        const size_t n_kmers = length - K + 1;
+        uint64_t last_rc;
+        lemire::hash_kmers(sequence, n_kmers, K, nullptr, values, nullptr, nullptr,
+                           this->hasher.hashvalue, last_rc);
+        if (hashes) {
+            for (size_t i = 0; i < n_kmers; ++i) {
+                hashes[i] = hash_type(values[i]);
+            }
+        }
+    }
+
 protected:
 
     explicit LemireShifterPolicy(uint16_t K)
@@ -216,12 +382,179 @@ LemireShifterPolicy<Canonical<uint64_t>>
     return get_impl();
 }
 
+template<>
+inline void
+LemireShifterPolicy<Canonical<uint64_t>>
+::hash_sequence_impl(const char * sequence,
+                     size_t       length,
+                     value_type * values,
+                     hash_type *  hashes) {
+    const size_t n_kmers = length - K + 1;
+    const uint64_t * complements = lemire::complement_hashes<alphabet>();
+    if (hashes) {
+        std::vector<uint64_t> fw(n_kmers), rc(n_kmers);
+        lemire::hash_kmers(sequence, n_kmers, K, complements, values, fw.data(), rc.data(),
+                           hasher.hashvalue, rc_hasher.hashvalue);
+        for (size_t i = 0; i < n_kmers; ++i) {
+            hashes[i] = hash_type(fw[i], rc[i]);
+        }
+    } else {
+        lemire::hash_kmers(sequence, n_kmers, K, complements, values, nullptr, nullptr,
+                           hasher.hashvalue, rc_hasher.hashvalue);
+    }
+}
+
 typedef LemireShifterPolicy<Hash<uint64_t>> FwdLemirePolicy;
 typedef LemireShifterPolicy<Canonical<uint64_t>> CanLemirePolicy;
 
 extern template class LemireShifterPolicy<Hash<uint64_t>>;
 extern template class LemireShifterPolicy<Canonical<uint64_t>>;
 
+
+/**
+ * @Synopsis  LemireShifterPolicy with K fixed at compile time, for
+ *            HashShifter<FixedLemire<K>::Policy<HashType>>. Rolls its own
+ *            hashes rather than through CyclicHash, whose rotations are
+ *            all by runtime amounts, but they're the same hashes.
+ */
+template<uint16_t FixedK>
+struct FixedLemire {
+
+    static_assert(FixedK > 0, "K must be positive");
+
+    template<typename HashType,
+             typename Alphabet = DNA_SIMPLE>
+    class Policy {
+
+    public:
+
+        typedef HashType                       hash_type;
+        typedef typename hash_type::value_type value_type;
+        typedef Kmer<hash_type>                kmer_type;
+        typedef Alphabet                       alphabet;
+        static constexpr bool has_kmer_span = false;
+        static constexpr bool has_sequence_kernel = true;
+
+        static constexpr uint16_t K = FixedK;
+
+    protected:
+
+        static constexpr bool canonical = std::is_same<hash_type, Canonical<value_type>>::value;
+        static constexpr unsigned R = K % 64;
+
+        const uint64_t * T;
+        const uint64_t * TC;
+        value_type       fw;
+        value_type       rc;
+
+    public:
+
+        __attribute__((visibility("default")))
+        inline hash_type hash_base_impl(const char * sequence) {
+            fw = rc = 0;
+            for (uint16_t i = 0; i < K; ++i) {
+                if (sequence[i] == '\0') {
+                    throw SequenceLengthException("Encountered null terminator in k-mer!");
+                }
+                _eat(sequence[i], i);
+            }
+            return get_impl();
+        }
+
+        template<class It> __attribute__((visibility("default")))
+        inline hash_type hash_base_impl(It begin, It end) {
+            fw = rc = 0;
+            for (uint16_t i = 0; begin != end; ++i, ++begin) {
+                _eat(*begin, i);
+            }
+            return get_impl();
+        }
+
+        hash_type get_impl() {
+            if constexpr (canonical) {
+                return {fw, rc};
+            } else {
+                return {fw};
+            }
+        }
+
+        hash_type shift_left_impl(const char& in, const char& out) {
+            const unsigned char i = in, o = out;
+            fw = lemire::rotr1(fw ^ lemire::rotl(T[i], R) ^ T[o]);
+            if constexpr (canonical) {
+                rc = lemire::rotl(rc, 1) ^ lemire::rotl(TC[o], R) ^ TC[i];
+            }
+            return get_impl();
+        }
+
+        hash_type shift_right_impl(const char& out, const char& in) {
+            const unsigned char i = in, o = out;
+            fw = lemire::rotl(fw, 1) ^ lemire::rotl(T[o], R) ^ T[i];
+            if constexpr (canonical) {
+                rc = lemire::rotr1(rc ^ lemire::rotl(TC[i], R) ^ TC[o]);
+            }
+            return get_impl();
+        }
+
+        void hash_sequence_impl(const char * sequence,
+                                size_t       length,
+                                value_type * values,
+                                hash_type *  hashes) {
+            const size_t n_kmers = length - K + 1;
+            if constexpr (canonical) {
+                if (hashes) {
+                    std::vector<uint64_t> fw_hashes(n_kmers), rc_hashes(n_kmers);
+                    lemire::hash_kmers(sequence, n_kmers, K, TC, values,
+                                       fw_hashes.data(), rc_hashes.data(), fw, rc);
+                    for (size_t i = 0; i < n_kmers; ++i) {
+                        hashes[i] = hash_type(fw_hashes[i], rc_hashes[i]);
+                    }
+                } else {
+                    lemire::hash_kmers(sequence, n_kmers, K, TC, values, nullptr, nullptr, fw, rc);
+                }
+            } else {
+                lemire::hash_kmers(sequence, n_kmers, K, nullptr, values, nullptr, nullptr, fw, rc);
+                if (hashes) {
+                    for (size_t i = 0; i < n_kmers; ++i) {
+                        hashes[i] = hash_type(values[i]);
+                    }
+                }
+            }
+        }
+
+    protected:
+
+        explicit Policy(uint16_t K)
+            : T(lemire::symbol_hashes()),
+              TC(lemire::complement_hashes<alphabet>()),
+              fw(0),
+              rc(0)
+        {
+            if (K != FixedK) {
+                throw GoetiaException("Shifter for K=" + std::to_string(FixedK)
+                                      + " built with K=" + std::to_string(K));
+            }
+        }
+
+        explicit Policy(const Policy& other)
+            : Policy(other.K)
+        {
+        }
+
+        Policy() = delete;
+
+    private:
+
+        // the reverse complement of the symbol at i is rotated by i
+        inline void _eat(unsigned char c, uint16_t i) {
+            fw = lemire::rotl(fw, 1) ^ T[c];
+            if constexpr (canonical) {
+                rc ^= lemire::rotl(TC[c], i % 64);
+            }
+        }
+    };
+};
+
 } 
 
 #endif
@@ -8,4 +8,5 @@
 
 #include "goetia/hashing/rollinghashshifter.hh"
 #include "goetia/hashing/hashshifter.hh"
-#include "goetia/hashing/unikmershifter.hh"
\ No newline at end of file
+#include "goetia/hashing/unikmershifter.hh"
+#include "goetia/hashing/twobitshifter.hh"
\ No newline at end of file
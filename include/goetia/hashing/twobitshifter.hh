@@ -0,0 +1,347 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : twobitshifter.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_TWOBITSHIFTER_HH
+#define GOETIA_TWOBITSHIFTER_HH
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "goetia/goetia.hh"
+#include "goetia/hashing/canonical.hh"
+#include "goetia/hashing/hashshifter.hh"
+#include "goetia/sequences/alphabets.hh"
+#include "goetia/sequences/exceptions.hh"
+
+
+namespace goetia::hashing {
+
+
+/*
+ * Two-bit k-mers.
+ *
+ * A k-mer of K <= 32 packs into the low 2K bits of a word, A, C, G, T as
+ * 0-3 with its first symbol highest, so that a symbol's complement is its
+ * code XOR 3 and both strands shift in or out a symbol in O(1). The hash
+ * of a packed k-mer is Thomas Wang's 64-bit integer mix, masked to 2K
+ * bits; each of its steps is a bijection on 2K bits, so a hash can be
+ * inverted back to the k-mer it came from.
+ */
+namespace twobit {
+
+    constexpr std::array<uint8_t, 256> make_codes() {
+        std::array<uint8_t, 256> codes{};
+        for (size_t c = 0; c < codes.size(); ++c) {
+            codes[c] = 4;
+        }
+        codes['A'] = codes['a'] = 0;
+        codes['C'] = codes['c'] = 1;
+        codes['G'] = codes['g'] = 2;
+        codes['T'] = codes['t'] = 3;
+        return codes;
+    }
+
+    // The code of each symbol, or 4 if it has none.
+    inline constexpr std::array<uint8_t, 256> CODES = make_codes();
+    inline constexpr char SYMBOLS[4] = {'A', 'C', 'G', 'T'};
+
+    constexpr uint64_t mask(uint16_t K) {
+        return K >= 32 ? ~uint64_t(0) : (uint64_t(1) << (2 * K)) - 1;
+    }
+
+    // The inverse of odd a modulo 2^64, by Newton's iteration.
+    constexpr uint64_t mul_inverse(uint64_t a) {
+        uint64_t x = a;
+        for (int i = 0; i < 5; ++i) {
+            x *= 2 - a * x;
+        }
+        return x;
+    }
+
+    inline uint64_t mix(uint64_t key, uint64_t mask) {
+        key = (~key + (key << 21)) & mask;
+        key = key ^ (key >> 24);
+        key = (key + (key << 3) + (key << 8)) & mask;
+        key = key ^ (key >> 14);
+        key = (key + (key << 2) + (key << 4)) & mask;
+        key = key ^ (key >> 28);
+        key = (key + (key << 31)) & mask;
+        return key;
+    }
+
+    inline uint64_t unxorshift(uint64_t key, unsigned shift) {
+        uint64_t x = key;
+        for (unsigned done = shift; done < 64; done += shift) {
+            x = key ^ (x >> shift);
+        }
+        return x;
+    }
+
+    // mix's inverse: each multiply is undone by its inverse modulo 2^64,
+    // which is also its inverse modulo 2^2K.
+    inline uint64_t unmix(uint64_t key, uint64_t mask) {
+        key = (key * mul_inverse((uint64_t(1) << 31) + 1)) & mask;
+        key = unxorshift(key, 28);
+        key = (key * mul_inverse(21)) & mask;
+        key = unxorshift(key, 14);
+        key = (key * mul_inverse(265)) & mask;
+        key = unxorshift(key, 24);
+        key = ((key + 1) * mul_inverse((uint64_t(1) << 21) - 1)) & mask;
+        return key;
+    }
+
+    std::string decode(uint64_t packed, uint16_t K);
+
+    uint64_t encode(const char * sequence, uint16_t K);
+
+}
+
+
+/**
+ * @Synopsis  Shifter policy over two-bit k-mers, for K <= 32. Hashes are
+ *            invertible with unhash(), and the policy keeps the k-mer
+ *            itself in its packed words, so it's also the extension
+ *            policy for HashExtender<HashShifter<TwoBitShifterPolicy>>:
+ *            extensions and the cursor come from the words with no ring
+ *            buffer. Out symbols passed to the two-symbol shifts are
+ *            ignored.
+ */
+template<typename HashType,
+         typename Alphabet = DNA_SIMPLE>
+class TwoBitShifterPolicy {
+
+    static_assert(std::is_same<Alphabet, DNA_SIMPLE>::value,
+                  "Two-bit k-mers are over DNA_SIMPLE");
+
+public:
+
+    typedef HashType                       hash_type;
+    typedef typename hash_type::value_type value_type;
+    typedef Kmer<hash_type>                kmer_type;
+    typedef Alphabet                       alphabet;
+    typedef Shift<hash_type, DIR_LEFT>     shift_left_type;
+    typedef Shift<hash_type, DIR_RIGHT>    shift_right_type;
+    static constexpr bool has_kmer_span = true;
+    static constexpr bool has_sequence_kernel = false;
+
+    const uint16_t K;
+
+protected:
+
+    static constexpr bool canonical = std::is_same<hash_type, Canonical<value_type>>::value;
+
+    const uint64_t mask;
+    // where the first symbol sits
+    const unsigned front_shift;
+
+    // the k-mer and, if canonical, its reverse complement
+    uint64_t fw;
+    uint64_t rc;
+    bool     loaded;
+
+public:
+
+    __attribute__((visibility("default")))
+    inline hash_type hash_base_impl(const char * sequence) {
+        fw = rc = 0;
+        for (uint16_t i = 0; i < K; ++i) {
+            _eat(sequence[i]);
+        }
+        loaded = true;
+        return get_impl();
+    }
+
+    template<class It> __attribute__((visibility("default")))
+    inline hash_type hash_base_impl(It begin, It end) {
+        fw = rc = 0;
+        while (begin != end) {
+            _eat(*begin);
+            ++begin;
+        }
+        loaded = true;
+        return get_impl();
+    }
+
+    hash_type get_impl() {
+        return _hash(fw, rc);
+    }
+
+    hash_type shift_left_impl(const char& in, const char& /*out*/) {
+        return shift_left_impl(in);
+    }
+
+    hash_type shift_right_impl(const char& /*out*/, const char& in) {
+        return shift_right_impl(in);
+    }
+
+    hash_type shift_left_impl(const char& in) {
+        const uint64_t c = _code(in);
+        fw = _prepend_fw(c);
+        if constexpr (canonical) {
+            rc = _prepend_rc(c);
+        }
+        return get_impl();
+    }
+
+    hash_type shift_right_impl(const char& in) {
+        const uint64_t c = _code(in);
+        fw = _append_fw(c);
+        if constexpr (canonical) {
+            rc = _append_rc(c);
+        }
+        return get_impl();
+    }
+
+    // The hashes of the k-mers before and after the cursor, straight
+    // from the packed words; the cursor doesn't move.
+    std::vector<shift_left_type> left_extensions_impl() {
+        std::vector<shift_left_type> hashes;
+        hashes.reserve(4);
+        for (uint64_t c = 0; c < 4; ++c) {
+            hashes.emplace_back(_hash(_prepend_fw(c), _prepend_rc(c)), twobit::SYMBOLS[c]);
+        }
+        return hashes;
+    }
+
+    std::vector<shift_right_type> right_extensions_impl() {
+        std::vector<shift_right_type> hashes;
+        hashes.reserve(4);
+        for (uint64_t c = 0; c < 4; ++c) {
+            hashes.emplace_back(_hash(_append_fw(c), _append_rc(c)), twobit::SYMBOLS[c]);
+        }
+        return hashes;
+    }
+
+    hash_type set_cursor_impl(const char * sequence) {
+        return hash_base_impl(sequence);
+    }
+
+    const bool is_loaded() const {
+        return loaded;
+    }
+
+    const char front() const {
+        return twobit::SYMBOLS[fw >> front_shift];
+    }
+
+    const char back() const {
+        return twobit::SYMBOLS[fw & 3];
+    }
+
+    const std::string to_string() const {
+        return twobit::decode(fw, K);
+    }
+
+    void to_deque(std::deque<char>& d) const {
+        for (auto symbol : to_string()) {
+            d.push_back(symbol);
+        }
+    }
+
+    // The cursor's k-mer, packed.
+    uint64_t packed() const {
+        return fw;
+    }
+
+    /**
+     * @Synopsis  Recover the k-mer a hash value came from; for canonical
+     *            hashes, that's whichever strand's hash was the lesser.
+     */
+    std::string unhash(value_type value) const {
+        return twobit::decode(twobit::unmix(value, mask), K);
+    }
+
+protected:
+
+    explicit TwoBitShifterPolicy(uint16_t K)
+        : K(K),
+          mask(twobit::mask(K)),
+          front_shift(2 * (K - 1)),
+          fw(0),
+          rc(0),
+          loaded(false)
+    {
+        if (K == 0 || K > 32) {
+            throw GoetiaException("Two-bit shifters need 0 < K <= 32, got K="
+                                  + std::to_string(K));
+        }
+    }
+
+    explicit TwoBitShifterPolicy(const TwoBitShifterPolicy& other)
+        : TwoBitShifterPolicy(other.K)
+    {
+    }
+
+    TwoBitShifterPolicy() = delete;
+
+private:
+
+    inline uint64_t _code(const char c) const {
+        const uint8_t code = twobit::CODES[(unsigned char) c];
+        if (code > 3) {
+            if (c == '\0') {
+                throw SequenceLengthException("Encountered null terminator in k-mer!");
+            }
+            throw InvalidCharacterException(std::string("Two-bit shifters can't hash '") + c + "'");
+        }
+        return code;
+    }
+
+    inline void _eat(const char c) {
+        const uint64_t code = _code(c);
+        fw = _append_fw(code);
+        if constexpr (canonical) {
+            rc = _append_rc(code);
+        }
+    }
+
+    inline uint64_t _append_fw(uint64_t c) const {
+        return ((fw << 2) | c) & mask;
+    }
+
+    inline uint64_t _append_rc(uint64_t c) const {
+        return (rc >> 2) | ((c ^ 3) << front_shift);
+    }
+
+    inline uint64_t _prepend_fw(uint64_t c) const {
+        return (fw >> 2) | (c << front_shift);
+    }
+
+    inline uint64_t _prepend_rc(uint64_t c) const {
+        return ((rc << 2) | (c ^ 3)) & mask;
+    }
+
+    inline hash_type _hash(uint64_t fw_bits, uint64_t rc_bits) const {
+        if constexpr (canonical) {
+            return {twobit::mix(fw_bits, mask), twobit::mix(rc_bits, mask)};
+        } else {
+            return {twobit::mix(fw_bits, mask)};
+        }
+    }
+};
+
+
+typedef TwoBitShifterPolicy<Hash<uint64_t>> FwdTwoBitPolicy;
+typedef TwoBitShifterPolicy<Canonical<uint64_t>> CanTwoBitPolicy;
+
+extern template class TwoBitShifterPolicy<Hash<uint64_t>>;
+extern template class TwoBitShifterPolicy<Canonical<uint64_t>>;
+
+extern template class HashShifter<FwdTwoBitPolicy>;
+extern template class HashShifter<CanTwoBitPolicy>;
+
+typedef HashShifter<FwdTwoBitPolicy> FwdTwoBitShifter;
+typedef HashShifter<CanTwoBitPolicy> CanTwoBitShifter;
+
+}
+
+#endif
@@ -163,6 +163,7 @@ public:
     typedef Shift<wmer_type, DIR_RIGHT>                    shift_right_type;
 
     static constexpr bool has_kmer_span = true;
+    static constexpr bool has_sequence_kernel = false;
 
 protected:
 
@@ -17,12 +17,21 @@
 #include "goetia/goetia.hh"
 
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/mapped_file.hh"
+#include "goetia/storage/table_allocator.hh"
 #include "goetia/storage/nibblestorage.hh"
 #include "goetia/storage/bitstorage.hh"
+#include "goetia/storage/blockedbitstorage.hh"
 #include "goetia/storage/qfstorage.hh"
 #include "goetia/storage/bytestorage.hh"
 #include "goetia/storage/partitioned_storage.hh"
 #include "goetia/storage/sparseppstorage.hh"
+#include "goetia/storage/flatsetstorage.hh"
+#include "goetia/storage/flatcountstorage.hh"
+#include "goetia/storage/frozenstorage.hh"
+#include "goetia/storage/diskcountstorage.hh"
+#include "goetia/storage/rollingbitstorage.hh"
+#include "goetia/storage/recent_cache.hh"
 #include "goetia/storage/sparsepp/spp.h"
 
 #include "goetia/hashing/kmeriterator.hh"
@@ -31,6 +40,8 @@
 #include "goetia/hashing/ukhs.hh"
 #include "goetia/hashing/rollinghashshifter.hh"
 #include "goetia/hashing/unikmershifter.hh"
+#include "goetia/hashing/twobitshifter.hh"
+#include "goetia/hashing/multikhasher.hh"
 #include "goetia/hashing/canonical.hh"
 
 #include "goetia/sequences/alphabets.hh"
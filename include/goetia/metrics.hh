@@ -12,8 +12,12 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <iterator>
+#include <map>
 #include <random>
+#include <string>
+#include <vector>
 
 namespace goetia {
 namespace metrics {
@@ -94,6 +98,80 @@ struct Gauge : public std::atomic_int64_t {
 };
 
 
+/**
+ * @Synopsis  Bytes held by an object, by component. Components of owned
+ *            objects are added under the owner's name for them, joined
+ *            with a dot, eg "storage.tables".
+ */
+struct MemoryUsage {
+    std::map<std::string, uint64_t> components;
+
+    MemoryUsage& add(const std::string& component, uint64_t bytes) {
+        components[component] += bytes;
+        return *this;
+    }
+
+    MemoryUsage& add(const std::string& owner, const MemoryUsage& usage) {
+        for (const auto& component : usage.components) {
+            components[owner + "." + component.first] += component.second;
+        }
+        return *this;
+    }
+
+    // Bytes of the component, or of all components under it.
+    uint64_t get(const std::string& component) const {
+        uint64_t bytes = 0;
+        for (const auto& c : components) {
+            if (c.first == component ||
+                c.first.compare(0, component.size() + 1, component + ".") == 0) {
+                bytes += c.second;
+            }
+        }
+        return bytes;
+    }
+
+    uint64_t total() const {
+        uint64_t bytes = 0;
+        for (const auto& component : components) {
+            bytes += component.second;
+        }
+        return bytes;
+    }
+};
+
+
+/**
+ * @Synopsis  Estimate of the heap held by a node-based hash map or set:
+ *            its bucket array plus one node, value and next pointer
+ *            plus the cached hash, per element.
+ */
+template <class Map>
+inline uint64_t node_map_bytes(const Map& map) {
+    return map.bucket_count() * sizeof(void*)
+           + map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+
+/**
+ * @Synopsis  Estimate of the heap held by a sparsepp map or set: the
+ *            values themselves plus the group headers, about half a byte
+ *            per bucket.
+ */
+template <class Map>
+inline uint64_t sparse_map_bytes(const Map& map) {
+    return map.size() * sizeof(typename Map::value_type) + map.bucket_count() / 2;
+}
+
+
+/**
+ * @Synopsis  Heap held by a vector's elements.
+ */
+template <class T>
+inline uint64_t vector_bytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+
 }
 }
 
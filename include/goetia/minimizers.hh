@@ -169,11 +169,9 @@ struct WKMinimizer {
 
         auto get_minimizers(const std::string& sequence)
         -> typename minimizer_type::vector_type {
-            hashing::KmerIterator<ShifterType> iter(sequence, K);
             this->reset();
-            
-            while(!iter.done()) {
-                hash_type h = iter.next();
+
+            for (const auto& h : hashing::KmerRange<ShifterType>(sequence, K)) {
                 minimizer_type::update(h.value());
             }
 
@@ -181,11 +179,9 @@ struct WKMinimizer {
         }
 
         std::vector<value_type> get_minimizer_values(const std::string& sequence) {
-            hashing::KmerIterator<ShifterType> iter(sequence, K);
             this->reset();
 
-            while(!iter.done()) {
-                hash_type h = iter.next();
+            for (const auto& h : hashing::KmerRange<ShifterType>(sequence, K)) {
                 minimizer_type::update(h.value());
             }
 
@@ -28,6 +28,7 @@
 #include "goetia/storage/storage.hh"
 #include "goetia/storage/storage_types.hh"
 #include "goetia/storage/partitioned_storage.hh"
+#include "goetia/storage/recent_cache.hh"
 
 #include <algorithm>
 #include <memory>
@@ -58,6 +59,7 @@ protected:
     std::shared_ptr<PartitionedStorage<BaseStorageType>> S;
     std::shared_ptr<ukhs_type>                           ukhs;
     extender_type                                        partitioner;
+    std::shared_ptr<storage::RecentCache>                _cache;
 
 public:
 
@@ -101,22 +103,47 @@ public:
 
     inline std::vector<hash_type> get_hashes(const std::string& sequence) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-        std::vector<hash_type> kmer_hashes;
-
-        while(!iter.done()) {
-            hash_type h = iter.next();
-            kmer_hashes.push_back(h);
-        }
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
+        std::vector<hash_type> kmer_hashes(kmers.begin(), kmers.end());
 
         return kmer_hashes;
     }
 
     inline std::shared_ptr<graph_type> clone() {
-        return std::make_shared<graph_type>(K,
-                                            partition_K,
-                                            ukhs,
-                                            S);
+        auto cloned = std::make_shared<graph_type>(K,
+                                                   partition_K,
+                                                   ukhs,
+                                                   S);
+        if (_cache) {
+            cloned->enable_cache(_cache->n_bytes());
+        }
+        return cloned;
+    }
+
+    /**
+     * @Synopsis  Put a RecentCache in front of the partitions, so that
+     *            k-mers seen recently skip them on insert and query. Only
+     *            for presence storages that don't forget.
+     *
+     * @Param bytes Size of the cache; the default is about an L2.
+     */
+    void enable_cache(size_t bytes = storage::RecentCache::DEFAULT_BYTES) {
+        if (storage::is_counting<BaseStorageType>::value) {
+            throw GoetiaException("The recent k-mer cache can't front a counting storage");
+        }
+        if (storage::is_forgetful<BaseStorageType>::value) {
+            throw GoetiaException("The recent k-mer cache can't front a storage that forgets");
+        }
+        _cache = std::make_shared<storage::RecentCache>(bytes);
+    }
+
+    void disable_cache() {
+        _cache.reset();
+    }
+
+    // The cache, with its hit and miss gauges; null when disabled.
+    std::shared_ptr<storage::RecentCache> get_cache() const {
+        return _cache;
     }
 
     inline const bool insert(const std::string& kmer) {
@@ -124,10 +151,20 @@ public:
         partitioner.set_cursor(kmer);
         auto bh = partitioner.get();
 
-        return S->insert(bh.value(), bh.minimizer.partition);
+        return insert(bh);
     }
 
     inline const bool insert(const hash_type& h) {
+        if (_cache) {
+            if (_cache->contains(h.value())) {
+                _cache->record_hit();
+                return false;
+            }
+            _cache->record_miss();
+            const bool is_new = S->insert(h.value(), h.minimizer.partition);
+            _cache->remember(h.value());
+            return is_new;
+        }
         return S->insert(h.value(), h.minimizer.partition);
     }
 
@@ -136,19 +173,36 @@ public:
         partitioner.set_cursor(kmer);
         auto h = partitioner.get();
 
-        return S->insert_and_query(h.value(), h.minimizer.partition);
+        return insert_and_query(h);
     }
 
     inline const storage::count_t insert_and_query(const hash_type& h) {
+        if (_cache) {
+            // presence storages count 1 once inserted
+            insert(h);
+            return 1;
+        }
         return S->insert_and_query(h.value(), h.minimizer.partition);
     }
 
     inline const storage::count_t query(const std::string& kmer) {
         auto h = hash(kmer);
-        return S->query(h.value(), h.minimizer.partition);
+        return query(h);
     }
 
     inline const storage::count_t query(const hash_type& h) {
+        if (_cache) {
+            if (_cache->contains(h.value())) {
+                _cache->record_hit();
+                return 1;
+            }
+            _cache->record_miss();
+            const storage::count_t count = S->query(h.value(), h.minimizer.partition);
+            if (count) {
+                _cache->remember(h.value());
+            }
+            return count;
+        }
         return S->query(h.value(), h.minimizer.partition);
     }
 
@@ -156,20 +210,15 @@ public:
                                    std::vector<hash_type>&        kmer_hashes,
                                    std::vector<storage::count_t>& counts) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-
         uint64_t         n_consumed = 0;
-        size_t           pos = 0;
         storage::count_t count;
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : hashing::KmerRange<extender_type>(sequence, partitioner)) {
             count = insert_and_query(h);
 
             kmer_hashes.push_back(h);
             counts.push_back(count);
 
             n_consumed += (count == 1);
-            ++pos;
         }
 
         return n_consumed;
@@ -178,29 +227,38 @@ public:
     inline const uint64_t insert_sequence(const std::string&   sequence,
                                    std::set<hash_type>& new_kmers) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-
         uint64_t n_consumed = 0;
-        size_t pos = 0;
-        bool is_new;
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : hashing::KmerRange<extender_type>(sequence, partitioner)) {
             if(insert(h)) {
                 new_kmers.insert(h);
-                n_consumed += is_new;
+                ++n_consumed;
             }
-            ++pos;
         }
 
         return n_consumed;
     }
 
     inline const uint64_t insert_sequence(const std::string& sequence) {
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
 
         uint64_t n_consumed = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
+        if (_cache) {
+            // tally hits here rather than on the shared gauges per k-mer
+            uint64_t n_hits = 0, n_misses = 0;
+            for (const auto& h : kmers) {
+                if (_cache->contains(h.value())) {
+                    ++n_hits;
+                    continue;
+                }
+                ++n_misses;
+                n_consumed += S->insert(h.value(), h.minimizer.partition);
+                _cache->remember(h.value());
+            }
+            _cache->record(n_hits, n_misses);
+            return n_consumed;
+        }
+
+        for (const auto& h : kmers) {
             n_consumed += insert(h);
         }
 
@@ -208,16 +266,16 @@ public:
     }
 
     inline const uint64_t insert_sequence_rolling(const std::string& sequence) {
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
 
         uint64_t          n_consumed    = 0;
-        auto              h             = iter.next();
-        uint64_t          cur_pid       = h.minimizer.partition;
+        auto              iter          = kmers.begin();
+        uint64_t          cur_pid       = iter->minimizer.partition;
         BaseStorageType * cur_partition = S->query_partition(cur_pid);
-        cur_partition->insert(h.value());
+        cur_partition->insert(iter->value());
 
-        while(!iter.done()) {
-            h = iter.next();
+        for (++iter; iter != kmers.end(); ++iter) {
+            const auto& h = *iter;
             if (h.minimizer.partition != cur_pid) {
                 cur_pid = h.minimizer.partition;
                 cur_partition = S->query_partition(cur_pid);
@@ -229,14 +287,67 @@ public:
     }
 
 
+    /**
+     * @Synopsis  Insert a batch of sequences in parallel.
+     *
+     * Producer threads each hash a stride of the sequences with their own
+     * extender and bucket the hashes by partition; the storage then drains
+     * the buckets with one owner thread per group of partitions, so no
+     * partition is ever shared between threads. Sequences shorter than K
+     * are skipped.
+     *
+     * @Param sequences The sequences.
+     * @Param n_threads Threads for each phase; 0 picks one per core.
+     *
+     * @Returns   Number of k-mers which were new.
+     */
+    uint64_t insert_sequences(const std::vector<std::string>& sequences,
+                              size_t                          n_threads = 0) {
+
+        typedef PartitionedStorage<BaseStorageType> storage_type;
+        if (n_threads == 0) {
+            n_threads = storage::default_threads(n_partitions());
+        }
+        const size_t n_producers = std::max<size_t>(1, std::min(n_threads, sequences.size()));
+
+        std::vector<typename storage_type::bucket_set> buckets(n_producers, S->make_buckets());
+        storage::run_threads(n_producers, [&](size_t t) {
+            extender_type extender(K, partition_K, ukhs);
+            uint64_t n_hits = 0, n_misses = 0;
+            for (size_t i = t; i < sequences.size(); i += n_producers) {
+                if (sequences[i].length() < K) {
+                    continue;
+                }
+                for (const auto& h : hashing::KmerRange<extender_type>(sequences[i], extender)) {
+                    if (_cache) {
+                        // remembered before the drain, which inserts it
+                        // before this returns
+                        if (_cache->contains(h.value())) {
+                            ++n_hits;
+                            continue;
+                        }
+                        ++n_misses;
+                        _cache->remember(h.value());
+                    }
+                    buckets[t][h.minimizer.partition].push_back(h.value());
+                }
+            }
+            if (_cache) {
+                _cache->record(n_hits, n_misses);
+            }
+        });
+
+        return S->drain_buckets(buckets, n_threads);
+    }
+
+
     inline std::vector<storage::count_t> insert_and_query_sequence(const std::string& sequence) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
+        std::vector<storage::count_t> counts(kmers.size());
 
         size_t pos = 0;
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : kmers) {
             counts[pos] = insert_and_query(h);
             ++pos;
         }
@@ -247,12 +358,11 @@ public:
 
     inline std::vector<storage::count_t> query_sequence(const std::string& sequence) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
+        std::vector<storage::count_t> counts(kmers.size());
 
         size_t pos = 0;
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : kmers) {
             counts[pos] = query(h);
             ++pos;
         }
@@ -263,17 +373,17 @@ public:
 
     inline std::vector<storage::count_t> query_sequence_rolling(const std::string& sequence) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-        std::vector<storage::count_t> counts(sequence.length() - K + 1);
+        hashing::KmerRange<extender_type> kmers(sequence, partitioner);
+        std::vector<storage::count_t> counts(kmers.size());
         
-        hash_type         h             = iter.next();
-        uint64_t          cur_pid       = h.minimizer.partition;
+        auto              iter          = kmers.begin();
+        uint64_t          cur_pid       = iter->minimizer.partition;
         BaseStorageType * cur_partition = S->query_partition(cur_pid);
-        counts[0]                       = cur_partition->query(h.value());
+        counts[0]                       = cur_partition->query(iter->value());
 
         size_t pos = 1;
-        while(!iter.done()) {
-            h = iter.next();
+        for (++iter; iter != kmers.end(); ++iter) {
+            const auto& h = *iter;
             if (h.minimizer.partition != cur_pid) {
                 cur_pid = h.minimizer.partition;
                 cur_partition = S->query_partition(cur_pid);
@@ -290,10 +400,7 @@ public:
                         std::vector<storage::count_t>& counts,
                         std::vector<hash_type>&        hashes) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : hashing::KmerRange<extender_type>(sequence, partitioner)) {
             storage::count_t result = query(h);
             counts.push_back(result);
             hashes.push_back(h);
@@ -306,10 +413,7 @@ public:
                         std::vector<hash_type>&        hashes,
                         std::set<hash_type>&           new_hashes) {
 
-        hashing::KmerIterator<extender_type> iter(sequence, &partitioner);
-
-        while(!iter.done()) {
-            auto h = iter.next();
+        for (const auto& h : hashing::KmerRange<extender_type>(sequence, partitioner)) {
             auto result = query(h);
             if (result == 0) {
                 new_hashes.insert(h);
@@ -324,6 +428,10 @@ public:
         return S->n_unique_kmers();
     }
 
+    uint64_t estimated_cardinality() const {
+        return S->estimated_cardinality();
+    }
+
     uint64_t n_occupied() const {
         return S->n_occupied();
     }
@@ -332,6 +440,17 @@ public:
         return S->n_partition_stores();
     }
 
+    // As dBG::memory_usage; the storage's components are summed over
+    // the partitions.
+    metrics::MemoryUsage memory_usage() const {
+        metrics::MemoryUsage usage;
+        usage.add("storage", S->memory_usage());
+        if (_cache) {
+            usage.add("recent_cache", _cache->n_bytes());
+        }
+        return usage;
+    }
+
     const std::string suffix(const std::string& kmer) {
         return kmer.substr(kmer.length() - this->K + 1);
     }
@@ -410,10 +529,16 @@ public:
     void load(std::string filename) {
         uint16_t ksize = K;
         S->load(filename, ksize);
+        if (_cache) {
+            _cache->clear();
+        }
     }
 
     void reset() {
         S->reset();
+        if (_cache) {
+            _cache->clear();
+        }
     }
 
     std::vector<size_t> get_partition_counts() {
@@ -425,9 +550,21 @@ public:
 extern template class PdBG<storage::BitStorage, hashing::FwdUnikmerShifter>;
 extern template class PdBG<storage::BitStorage, hashing::CanUnikmerShifter>;
 
+extern template class PdBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>;
+extern template class PdBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>;
+
+extern template class PdBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>;
+extern template class PdBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>;
+
 extern template class PdBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>;
 extern template class PdBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>;
 
+extern template class PdBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>;
+extern template class PdBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>;
+
+extern template class PdBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>;
+extern template class PdBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>;
+
 extern template class PdBG<storage::ByteStorage, hashing::FwdUnikmerShifter>;
 extern template class PdBG<storage::ByteStorage, hashing::CanUnikmerShifter>;
 
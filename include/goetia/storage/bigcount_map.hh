@@ -0,0 +1,164 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : bigcount_map.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_BIGCOUNT_MAP_HH
+#define GOETIA_BIGCOUNT_MAP_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "goetia/goetia.hh"
+#include "goetia/metrics.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/flathash.hh"
+#include "goetia/storage/mapped_file.hh"
+
+
+namespace goetia {
+namespace storage {
+
+/*
+ * \class BigCountMap
+ *
+ * \brief Exact counts of the k-mers whose counters saturated in a
+ *        count-min sketch, safe to update from many threads.
+ *
+ * Counts are spread over N_SHARDS hash maps by the top bits of the mixed
+ * hash, each behind its own spinlock and on its own cache line, so
+ * threads promoting different k-mers rarely wait on each other.
+ * increment_many takes each shard's lock once per batch.
+ *
+ * load_mapped points the map at the sorted arrays written by save_mapped,
+ * which are searched in place; counts updated since live in the shards,
+ * in front of the arrays.
+ */
+class BigCountMap {
+
+public:
+
+    typedef uint64_t value_type;
+
+    static constexpr size_t N_SHARDS    = 64;
+    static constexpr size_t SHARD_SHIFT = 58;
+
+protected:
+
+    struct alignas(64) Shard {
+        mutable uint32_t                        lock;
+        std::unordered_map<value_type, count_t> counts;
+
+        Shard() : lock(0) { }
+
+        void acquire() const {
+            while (!__sync_bool_compare_and_swap(&lock, 0, 1));
+        }
+
+        void release() const {
+            __sync_bool_compare_and_swap(&lock, 1, 0);
+        }
+    };
+
+    std::unique_ptr<Shard[]> _shards;
+
+    // sorted hashes and their counts, from a mapped file
+    std::shared_ptr<MappedFile> _mapping;
+    const value_type *          _mapped_hashes;
+    const count_t *             _mapped_counts;
+    uint64_t                    _n_mapped;
+    // mapped hashes since given a count in a shard
+    uint64_t                    _n_shadowed;
+
+    static inline size_t _shard_for(value_type h) {
+        return flat::mix(h) >> SHARD_SHIFT;
+    }
+
+    // count_t is signed, so counts can't go past its limit.
+    static inline count_t _clamp(uint32_t max) {
+        return std::min<uint32_t>(max, std::numeric_limits<count_t>::max());
+    }
+
+    // The mapped count of h, or 0.
+    count_t _mapped_count(value_type h) const;
+
+    // Add one to h's count in its locked shard.
+    void _increment(Shard& shard, value_type h, count_t first, count_t max);
+
+public:
+
+    BigCountMap();
+
+    BigCountMap(const BigCountMap&) = delete;
+    BigCountMap& operator=(const BigCountMap&) = delete;
+
+    /**
+     * @Synopsis  Add one to a k-mer's count: a k-mer without one starts
+     *            at first, and counts saturate at max, or at the
+     *            largest count_t if that is smaller.
+     */
+    void increment(value_type h, count_t first, uint32_t max);
+
+    // Batched variant: each shard is locked once.
+    void increment_many(const value_type * hashes, size_t n, count_t first, uint32_t max);
+
+    // Whether h has a count, written to count if so.
+    bool find(value_type h, count_t& count) const;
+
+    // Set a count outright, eg while loading.
+    void set(value_type h, count_t count);
+
+    // Call f(hash, count) for every count. Each shard is copied out under
+    // its lock and f runs after it is released, so f may call find.
+    template<typename Func>
+    void for_each(Func f) const {
+        std::vector<std::pair<value_type, count_t>> snapshot;
+        for (size_t s = 0; s < N_SHARDS; ++s) {
+            const Shard& shard = _shards[s];
+            shard.acquire();
+            snapshot.assign(shard.counts.begin(), shard.counts.end());
+            shard.release();
+            for (const auto& it : snapshot) {
+                f(it.first, it.second);
+            }
+        }
+        for (uint64_t i = 0; i < _n_mapped; ++i) {
+            const Shard& shard = _shards[_shard_for(_mapped_hashes[i])];
+            shard.acquire();
+            const bool shadowed = shard.counts.count(_mapped_hashes[i]);
+            shard.release();
+            if (!shadowed) {
+                f(_mapped_hashes[i], _mapped_counts[i]);
+            }
+        }
+    }
+
+    const uint64_t size() const;
+
+    // Drop every count, and the mapping.
+    void clear();
+
+    // Replace the counts with those of a plain map.
+    void assign(const std::unordered_map<value_type, count_t>& counts);
+
+    // Write the count, then the sorted hashes and counts as sections.
+    void save_mapped(MappedFileWriter& out) const;
+
+    // Point at the sections written by save_mapped, advancing offset.
+    void load_mapped(std::shared_ptr<MappedFile> mapping, size_t& offset);
+
+    metrics::MemoryUsage memory_usage() const;
+};
+
+}
+}
+
+#endif
@@ -56,6 +56,8 @@
 
 #include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/mapped_file.hh"
+#include "goetia/storage/table_allocator.hh"
 
 
 namespace goetia {
@@ -84,20 +86,60 @@ protected:
     uint64_t _occupied_bins;
     uint64_t _n_unique_kmers;
     byte_t ** _counts;
+    // set when the tables point into a mapped file rather than the heap
+    std::shared_ptr<MappedFile> _mapping;
+    TableAllocator _allocator;
+
+    // Set the bit for bin in the given table, returning true if
+    // it was previously unset.
+    inline bool _set_bin(size_t table, uint64_t bin)
+    {
+        const uint64_t byte = bin / 8;
+        const unsigned char bit = (unsigned char)(1 << (bin % 8));
+
+        unsigned char bits_orig = __sync_fetch_and_or(_counts[table] + byte, bit);
+        if (!(bits_orig & bit)) {
+            if (table == 0) {
+                __sync_add_and_fetch(&_occupied_bins, 1);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    inline bool _test_bin(size_t table, uint64_t bin) const
+    {
+        return _counts[table][bin / 8] & (1 << (bin % 8));
+    }
+
+    // Check that other has the same tables and that ours can be written.
+    void _check_combinable(const BitStorage& other) const;
+
+    // Combine other's tables into ours with op, a word at a time, then
+    // re-count the occupied bins of the first table and re-estimate the
+    // number of distinct k-mers from them.
+    template <typename Op>
+    void _combine(const BitStorage& other, Op op);
 
 public:
 
     using Storage<uint64_t>::value_type;
 
-    BitStorage(uint64_t max_table, uint16_t N)
-        : BitStorage(get_n_primes_near_x(N, max_table))
+    BitStorage(uint64_t max_table, uint16_t N, TablePolicy policy = TablePolicy())
+        : BitStorage(get_n_primes_near_x(N, max_table), policy)
     {
     }
 
-    BitStorage(const std::vector<uint64_t>& tablesizes) :
+    BitStorage(const std::vector<uint64_t>& tablesizes,
+               TablePolicy                  policy = TablePolicy()) :
         _tablesizes(tablesizes),
-        _n_tables(tablesizes.size())
+        _n_tables(tablesizes.size()),
+        _allocator(policy)
     {
+        if (_n_tables > MAX_TABLES) {
+            throw GoetiaException("BitStorage can have at most "
+                                  + std::to_string(MAX_TABLES) + " tables");
+        }
         _occupied_bins = 0;
         _n_unique_kmers = 0;
 
@@ -105,23 +147,21 @@ public:
     }
     ~BitStorage()
     {
-        if (_counts) {
-            for (size_t i = 0; i < _n_tables; i++) {
-                delete[] _counts[i];
-                _counts[i] = NULL;
-            }
-            delete[] _counts;
-            _counts = NULL;
-
-            _n_tables = 0;
-        }
+        _free_counters();
     }
 
     std::shared_ptr<BitStorage> clone() const {
-        return std::make_shared<BitStorage>(this->_tablesizes);
+        return std::make_shared<BitStorage>(this->_tablesizes, _allocator.policy());
     }
 
-    static std::shared_ptr<BitStorage> build(uint64_t max_table, uint16_t N);
+    static std::shared_ptr<BitStorage> build(uint64_t    max_table,
+                                             uint16_t    N,
+                                             TablePolicy policy = TablePolicy());
+
+    const TablePolicy& table_policy() const
+    {
+        return _allocator.policy();
+    }
 
     void _allocate_counters()
     {
@@ -133,11 +173,27 @@ public:
             uint64_t tablesize = _tablesizes[i];
             uint64_t tablebytes = tablesize / 8 + 1;
 
-            _counts[i] = new byte_t[tablebytes];
-            memset(_counts[i], 0, tablebytes);
+            _counts[i] = _allocator.allocate(tablebytes, i);
         }
     }
 
+    void _free_counters()
+    {
+        if (_counts) {
+            for (size_t i = 0; i < _n_tables; i++) {
+                if (!_mapping) {
+                    _allocator.release(_counts[i]);
+                }
+                _counts[i] = NULL;
+            }
+            delete[] _counts;
+            _counts = NULL;
+
+            _n_tables = 0;
+        }
+        _mapping.reset();
+    }
+
     // Accessors for protected/private table info members
     std::vector<uint64_t> get_tablesizes() const
     {
@@ -152,6 +208,17 @@ public:
     void save(std::string, uint16_t ksize);
     void load(std::string, uint16_t& ksize);
 
+    // Save in the page-aligned mapped format, and map such a file in
+    // place of the tables; see MappedFile. Without writable, the tables
+    // are read-only and inserting throws.
+    void save_mapped(std::string, uint16_t ksize);
+    void load_mapped(std::string, uint16_t& ksize, bool writable = false);
+
+    const bool is_mapped() const
+    {
+        return bool(_mapping);
+    }
+
     // count number of occupied bins
     const uint64_t n_occupied() const
     {
@@ -163,8 +230,16 @@ public:
         return _n_unique_kmers;
     }
 
+    // Inverted from the occupancy of the first table; see
+    // occupancy_cardinality.
+    const uint64_t estimated_cardinality() const
+    {
+        return occupancy_cardinality(__atomic_load_n(&_occupied_bins, __ATOMIC_RELAXED),
+                                     _tablesizes[0]);
+    }
+
     double estimated_fp() {
-        double fp = n_occupied() / _tablesizes[0];
+        double fp = (double) n_occupied() / _tablesizes[0];
         fp = pow(fp, n_tables());
         return fp;
     }
@@ -181,6 +256,12 @@ public:
     // get the count for the given k-mer hash.
     const count_t query(value_type khash) const;
 
+    // Batched variants: all bins for a batch are computed and prefetched
+    // before any are touched.
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
     // Writing to the tables outside of defined methods has undefined behavior!
     // As such, this should only be used to return read-only interfaces
     byte_t ** get_raw_tables()
@@ -188,16 +269,27 @@ public:
         return _counts;
     }
 
+    metrics::MemoryUsage memory_usage() const;
+
     void reset();
 
     void update_from(const BitStorage&);
 
-    // not implemented
-    static std::shared_ptr<BitStorage> deserialize(std::ifstream& in) {
-        return {};
-    }
-
-    void serialize(std::ofstream& out) {}
+    // Set operations with another BitStorage of the same table sizes,
+    // done a word at a time over chunks of the tables in parallel:
+    // merge is the union (OR), intersect the intersection (AND) and
+    // subtract the difference (AND NOT). merge and intersect hold the
+    // k-mers of the combined set plus the usual false positives; subtract
+    // can also drop k-mers that share a bin with one of other's.
+    // n_unique_kmers is re-estimated from the occupancy of the first
+    // table. Not safe to run alongside inserts.
+    void merge(const BitStorage& other);
+    void intersect(const BitStorage& other);
+    void subtract(const BitStorage& other);
+
+    static std::shared_ptr<BitStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
 };
 
 template<>
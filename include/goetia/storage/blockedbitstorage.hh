@@ -0,0 +1,257 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : blockedbitstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_BLOCKEDBITSTORAGE_HH
+#define GOETIA_BLOCKEDBITSTORAGE_HH
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/mapped_file.hh"
+#include "goetia/storage/table_allocator.hh"
+
+
+namespace goetia {
+namespace storage {
+
+/*
+ * \class BlockedBitStorage
+ *
+ * \brief A cache-line blocked Bloom filter.
+ *
+ * Where BitStorage probes 'n_tables' separate tables, BlockedBitStorage
+ * keeps a single table of 512-bit blocks and sets all 'n_probes' bits for
+ * a hash within one block, so that each insert or query touches exactly
+ * one cache line. The block is selected with a multiply-shift range
+ * reduction rather than a modulo, and the bits within the block are
+ * derived from salted multiplies of the low word of the hash.
+ *
+ * For the same (max_table, N) arguments it uses the same amount of memory
+ * as BitStorage, at the cost of a slightly higher false positive rate.
+ *
+ */
+
+class BlockedBitStorage : public Storage<uint64_t>,
+                          public Tagged<BlockedBitStorage>
+{
+public:
+
+    using Storage<uint64_t>::value_type;
+
+    static constexpr size_t   BLOCK_BITS  = 512;
+    static constexpr size_t   BLOCK_BYTES = BLOCK_BITS / 8;
+    static constexpr size_t   BLOCK_WORDS = BLOCK_BITS / 64;
+    static constexpr uint16_t MAX_PROBES  = 8;
+
+protected:
+
+    uint64_t   _max_table;
+    uint16_t   _n_probes;
+    uint64_t   _n_blocks;
+    uint64_t   _occupied_bins;
+    uint64_t   _n_unique_kmers;
+    uint64_t * _blocks;
+    byte_t *   _raw_tables[1];
+    // set when the blocks point into a mapped file rather than the heap
+    std::shared_ptr<MappedFile> _mapping;
+    TableAllocator _allocator;
+
+    static constexpr uint32_t _salts[MAX_PROBES] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    // Multiply-shift range reduction of the mixed hash onto [0, _n_blocks).
+    inline uint64_t * _block_for(value_type khash) const
+    {
+        const uint64_t mixed = khash * 0x9e3779b97f4a7c15ULL;
+        const uint64_t block = static_cast<uint64_t>(
+            (static_cast<__uint128_t>(mixed) * _n_blocks) >> 64
+        );
+        return _blocks + block * BLOCK_WORDS;
+    }
+
+    // Bit index in [0, BLOCK_BITS) for the i'th probe.
+    static inline uint32_t _probe_bit(value_type khash, uint16_t i)
+    {
+        return (static_cast<uint32_t>(khash) * _salts[i]) >> 23;
+    }
+
+    // Set the probe bits for khash in block, returning true if any
+    // were previously unset.
+    inline bool _set_bits(uint64_t * block, value_type khash)
+    {
+        bool is_new_kmer = false;
+        for (uint16_t i = 0; i < _n_probes; ++i) {
+            const uint32_t bit  = _probe_bit(khash, i);
+            const uint64_t mask = 1ULL << (bit & 63);
+
+            uint64_t bits_orig = __sync_fetch_and_or(block + (bit >> 6), mask);
+            if (!(bits_orig & mask)) {
+                __sync_add_and_fetch(&_occupied_bins, 1);
+                is_new_kmer = true;
+            }
+        }
+        return is_new_kmer;
+    }
+
+    inline bool _test_bits(const uint64_t * block, value_type khash) const
+    {
+        for (uint16_t i = 0; i < _n_probes; ++i) {
+            const uint32_t bit = _probe_bit(khash, i);
+            if (!(block[bit >> 6] & (1ULL << (bit & 63)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void _allocate_blocks();
+    void _free_blocks();
+
+    // Combine other's blocks into ours with op, a word at a time, then
+    // re-count the set bits and re-estimate the number of distinct k-mers.
+    template <typename Op>
+    void _combine(const BlockedBitStorage& other, Op op);
+
+public:
+
+    BlockedBitStorage(uint64_t max_table, uint16_t N, TablePolicy policy = TablePolicy());
+
+    ~BlockedBitStorage();
+
+    std::shared_ptr<BlockedBitStorage> clone() const {
+        return std::make_shared<BlockedBitStorage>(_max_table, _n_probes, _allocator.policy());
+    }
+
+    static std::shared_ptr<BlockedBitStorage> build(uint64_t    max_table,
+                                                    uint16_t    N,
+                                                    TablePolicy policy = TablePolicy());
+
+    const TablePolicy& table_policy() const
+    {
+        return _allocator.policy();
+    }
+
+    // The blocks are treated as one table of n_blocks * BLOCK_BITS bits.
+    std::vector<uint64_t> get_tablesizes() const
+    {
+        return {_n_blocks * BLOCK_BITS};
+    }
+
+    const size_t n_tables() const
+    {
+        return 1;
+    }
+
+    const uint16_t n_probes() const
+    {
+        return _n_probes;
+    }
+
+    const uint64_t n_blocks() const
+    {
+        return _n_blocks;
+    }
+
+    void save(std::string, uint16_t ksize);
+    void load(std::string, uint16_t& ksize);
+
+    // Save in the page-aligned mapped format, and map such a file in
+    // place of the blocks; see MappedFile. Without writable, the blocks
+    // are read-only and inserting throws.
+    void save_mapped(std::string, uint16_t ksize);
+    void load_mapped(std::string, uint16_t& ksize, bool writable = false);
+
+    const bool is_mapped() const
+    {
+        return bool(_mapping);
+    }
+
+    // number of set bits across all blocks
+    const uint64_t n_occupied() const
+    {
+        return _occupied_bins;
+    }
+
+    const uint64_t n_unique_kmers() const
+    {
+        return _n_unique_kmers;
+    }
+
+    // Inverted from the set bits across all blocks, each k-mer setting
+    // n_probes of them; see occupancy_cardinality.
+    const uint64_t estimated_cardinality() const
+    {
+        return occupancy_cardinality(__atomic_load_n(&_occupied_bins, __ATOMIC_RELAXED),
+                                     _n_blocks * BLOCK_BITS,
+                                     _n_probes);
+    }
+
+    double estimated_fp() {
+        double fp = (double)n_occupied() / (double)(_n_blocks * BLOCK_BITS);
+        fp = pow(fp, n_probes());
+        return fp;
+    }
+
+    const bool insert(value_type khash);
+
+    const count_t insert_and_query(value_type khash);
+
+    const count_t query(value_type khash) const;
+
+    // Batched variants: the blocks for a batch are prefetched before
+    // any are touched.
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
+    // Writing to the tables outside of defined methods has undefined behavior!
+    // As such, this should only be used to return read-only interfaces
+    byte_t ** get_raw_tables()
+    {
+        return _raw_tables;
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+    void reset();
+
+    // Set operations with another BlockedBitStorage of the same shape, as
+    // for BitStorage: merge (OR), intersect (AND) and subtract (AND NOT),
+    // over chunks of the blocks in parallel. Not safe to run alongside
+    // inserts.
+    void merge(const BlockedBitStorage& other);
+    void intersect(const BlockedBitStorage& other);
+    void subtract(const BlockedBitStorage& other);
+
+    static std::shared_ptr<BlockedBitStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
+};
+
+template<>
+struct is_probabilistic<BlockedBitStorage> {
+      static const bool value = true;
+};
+
+template<>
+struct is_counting<BlockedBitStorage> {
+    static const bool value = false;
+};
+
+}
+}
+
+#endif
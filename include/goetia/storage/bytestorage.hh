@@ -55,6 +55,9 @@
 
 #include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/bigcount_map.hh"
+#include "goetia/storage/mapped_file.hh"
+#include "goetia/storage/table_allocator.hh"
 
 #   define MAX_KCOUNT 255
 
@@ -73,6 +76,10 @@ namespace storage {
  * Like other Storage classes, ByteStorage manages setting the bits and
  * tracking statistics, as well as save/load, and not much else.
  *
+ * Counters are updated with lock-free CAS loops, so inserts can run
+ * concurrently and the counts stay exact; n_unique_kmers can count a
+ * k-mer twice if two threads insert it for the first time at once.
+ *
  */
 
 class ByteStorageFile;
@@ -100,13 +107,15 @@ protected:
     count_t         _max_count;
     unsigned int    _max_bigcount;
 
-    uint32_t _bigcount_spin_lock;
     std::vector<uint64_t> _tablesizes;
     size_t   _n_tables;
     uint64_t _n_unique_kmers;
     uint64_t _occupied_bins;
 
     byte_t ** _counts;
+    // set when the tables point into a mapped file rather than the heap
+    std::shared_ptr<MappedFile> _mapping;
+    TableAllocator _allocator;
 
     // initialize counts with empty hashtables.
     void _allocate_counters()
@@ -115,27 +124,65 @@ protected:
 
         _counts = new byte_t*[_n_tables];
         for (size_t i = 0; i < _n_tables; i++) {
-            _counts[i] = new byte_t[_tablesizes[i]];
-            memset(_counts[i], 0, _tablesizes[i]);
+            _counts[i] = _allocator.allocate(_tablesizes[i], i);
+        }
+    }
+
+    void _free_counters()
+    {
+        if (_counts) {
+            for (size_t i = 0; i < _n_tables; i++) {
+                if (_counts[i] && !_mapping) {
+                    _allocator.release(_counts[i]);
+                }
+                _counts[i] = NULL;
+            }
+
+            delete[] _counts;
+            _counts = NULL;
+
+            _n_tables = 0;
         }
+        _mapping.reset();
     }
+
+    // Saturating increment of one bin; returns the pre-increment count.
+    byte_t _increment_bin(size_t table, uint64_t bin);
+
+    void _increment_bigcount(value_type khash);
+
+    count_t _query_bigcount(value_type khash, count_t min_count) const;
+
+    // Combine other's tables into ours with the per-counter op, in
+    // parallel chunks, and the bigcounts with the per-count full_op; then
+    // re-count the occupied bins of the first table and re-estimate the
+    // number of distinct k-mers from them.
+    template <typename Op, typename FullOp>
+    void _combine(const ByteStorage& other, Op op, FullOp full_op);
+
 public:
-    CountMap _bigcounts;
+    // exact counts of the k-mers saturated in every table
+    BigCountMap _bigcounts;
 
-    ByteStorage(uint64_t max_table, uint16_t N)
-        : ByteStorage(get_n_primes_near_x(N, max_table))
+    ByteStorage(uint64_t max_table, uint16_t N, TablePolicy policy = TablePolicy())
+        : ByteStorage(get_n_primes_near_x(N, max_table), policy)
     {
     }
 
     // constructor: create an empty CountMin sketch.
-    ByteStorage(const std::vector<uint64_t>& tablesizes ) :
+    ByteStorage(const std::vector<uint64_t>& tablesizes,
+                TablePolicy                  policy = TablePolicy()) :
         _max_count(MAX_KCOUNT),
         _max_bigcount(MAX_BIGCOUNT),
-        _bigcount_spin_lock(false), 
         _tablesizes(tablesizes),
         _n_unique_kmers(0), 
-        _occupied_bins(0)
+        _occupied_bins(0),
+        _allocator(policy)
     {
+        if (_tablesizes.size() > MAX_TABLES) {
+            throw GoetiaException("ByteStorage can have at most "
+                                  + std::to_string(MAX_TABLES) + " tables");
+        }
         _supports_bigcount = true;
         _allocate_counters();
     }
@@ -143,35 +190,34 @@ public:
     // destructor: clear out the memory.
     ~ByteStorage()
     {
-        if (_counts) {
-            for (size_t i = 0; i < _n_tables; i++) {
-                if (_counts[i]) {
-                    delete[] _counts[i];
-                    _counts[i] = NULL;
-                }
-            }
-
-            delete[] _counts;
-            _counts = NULL;
-
-            _n_tables = 0;
-        }
+        _free_counters();
     }
 
     void reset()
     {
+        check_writable(_mapping);
         for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
             uint64_t tablesize = _tablesizes[table_num];
-            memset(_counts[table_num], 0, tablesize);
+            _allocator.zero(_counts[table_num], tablesize);
         }
+        _bigcounts.clear();
+        _occupied_bins = 0;
+        _n_unique_kmers = 0;
     }
 
     std::shared_ptr<ByteStorage> clone() const {
-        return std::make_shared<ByteStorage>(this->_tablesizes);
+        return std::make_shared<ByteStorage>(this->_tablesizes, _allocator.policy());
     }
 
-    static std::shared_ptr<ByteStorage> build(uint64_t max_table, uint16_t N) {
-        return std::make_shared<ByteStorage>(max_table, N);
+    static std::shared_ptr<ByteStorage> build(uint64_t    max_table,
+                                              uint16_t    N,
+                                              TablePolicy policy = TablePolicy()) {
+        return std::make_shared<ByteStorage>(max_table, N, policy);
+    }
+
+    const TablePolicy& table_policy() const
+    {
+        return _allocator.policy();
     }
 
     std::vector<uint64_t> get_tablesizes() const
@@ -192,8 +238,16 @@ public:
         return _occupied_bins;
     }
 
+    // Inverted from the occupancy of the first table; see
+    // occupancy_cardinality.
+    const uint64_t estimated_cardinality() const
+    {
+        return occupancy_cardinality(__atomic_load_n(&_occupied_bins, __ATOMIC_RELAXED),
+                                     _tablesizes[0]);
+    }
+
     double estimated_fp() {
-        double fp = n_occupied() / _tablesizes[0];
+        double fp = (double) n_occupied() / _tablesizes[0];
         fp = pow(fp, n_tables());
         return fp;
     }
@@ -201,12 +255,30 @@ public:
     void save(std::string, uint16_t);
     void load(std::string, uint16_t&);
 
+    // Save in the page-aligned mapped format, and map such a file in
+    // place of the tables; see MappedFile. Without writable, the tables
+    // are read-only and inserting throws. Bigcounts are read into memory.
+    void save_mapped(std::string, uint16_t ksize);
+    void load_mapped(std::string, uint16_t& ksize, bool writable = false);
+
+    const bool is_mapped() const
+    {
+        return bool(_mapping);
+    }
+
     const bool insert(value_type khash);
 
     const count_t insert_and_query(value_type khash);
 
     // get the count for the given k-mer hash.
     const count_t query(value_type khash) const;
+
+    // Batched variants: all bins for a batch are computed and prefetched
+    // before any are touched.
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
     // Get direct access to the counts.
     //
     // Note:
@@ -216,12 +288,25 @@ public:
     {
         return _counts;
     }
-    // not implemented
-    static std::shared_ptr<ByteStorage> deserialize(std::ifstream& in) {
-        return {};
-    }
 
-    void serialize(std::ofstream& out) {}
+    metrics::MemoryUsage memory_usage() const;
+
+    // Combine with another ByteStorage of the same table sizes, counter
+    // by counter over chunks of the tables in parallel. merge adds the
+    // counts, saturating at the counter maximum; intersect keeps the
+    // lesser count and subtract the difference, floored at zero. As the
+    // counters are overestimates, subtract can undercount a k-mer that
+    // collides with one of other's. Bigcounts are combined for k-mers
+    // that already had one on either side. n_unique_kmers is
+    // re-estimated from the occupancy of the first table. Not safe to
+    // run alongside inserts.
+    void merge(const ByteStorage& other);
+    void intersect(const ByteStorage& other);
+    void subtract(const ByteStorage& other);
+
+    static std::shared_ptr<ByteStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
 };
 
 
@@ -0,0 +1,260 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : diskcountstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+
+#ifndef GOETIA_DISKCOUNTSTORAGE_HH
+#define GOETIA_DISKCOUNTSTORAGE_HH
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/mapped_file.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace goetia {
+namespace storage {
+
+
+/*
+ * \class DiskCountStorage
+ *
+ * \brief Exact k-mer counts for inputs too large for memory, counted
+ *        through local disk.
+ *
+ * Inserted hashes are buffered in memory. When the buffer fills, it is
+ * sorted, run-length encoded into (hash, count) records and spilled as
+ * one sorted run per partition, partitions being ranges of the hash's
+ * top bits after a bijective mix. finalize() then k-way merges each
+ * partition's runs, reading every run through a small fixed buffer, into
+ * a sorted array of hashes and one of counts. At most MERGE_FAN_IN runs
+ * are read at once: a partition with more is first merged in groups of
+ * that many into longer runs, pass by pass, so open files and memory are
+ * bounded by the insert buffer plus MERGE_FAN_IN * READ_BUFFER records
+ * per merging thread, however many runs were spilled.
+ *
+ * Merged partitions are mapped from disk; a query finds its block from
+ * every SAMPLE_STRIDE-th hash, held in memory, and binary searches that
+ * block, so it touches about one page. Queries see the counts as of the
+ * last finalize() and throw while inserts are waiting to be merged, as
+ * do insert_and_query and the counts of insert_many: counts aren't known
+ * until the merge. For the same reason, insert can't tell whether a hash
+ * is new and always returns false.
+ *
+ * Each storage works in a fresh directory made under the one it is built
+ * with, and removes it when destroyed unless save() kept it; save writes
+ * a small manifest naming that directory, which load maps again. A loaded
+ * storage merges further inserts into those same files, so save it again
+ * after finalizing them.
+ */
+class DiskCountStorage : public Storage<uint64_t>,
+                         public Tagged<DiskCountStorage> {
+
+public:
+
+    using Storage<uint64_t>::value_type;
+    typedef uint32_t full_count_type;
+
+    static constexpr uint64_t DEFAULT_BUFFER_BYTES = 1ULL << 30;
+    static constexpr uint16_t DEFAULT_N_PARTITIONS = 256;
+
+    // merged hashes per in-memory sample; 4 KiB of hashes
+    static constexpr uint64_t SAMPLE_STRIDE = 512;
+    // records buffered per run while merging
+    static constexpr size_t   READ_BUFFER   = 4096;
+    // runs merged at once; more take extra passes
+    static constexpr size_t   MERGE_FAN_IN  = 64;
+
+    struct Record {
+        uint64_t hash;
+        uint64_t count;
+    };
+
+protected:
+
+    struct Run {
+        uint64_t offset;
+        uint64_t n_records;
+    };
+
+    struct Partition {
+        // unmerged runs, in the partition's run file
+        std::vector<Run>            runs;
+
+        std::shared_ptr<MappedFile> hashes_map;
+        std::shared_ptr<MappedFile> counts_map;
+        const uint64_t *            hashes;
+        const full_count_type *     counts;
+        uint64_t                    size;
+        std::vector<uint64_t>       samples;
+
+        Partition() : hashes(nullptr), counts(nullptr), size(0) { }
+    };
+
+    std::string            _parent;
+    std::string            _directory;
+    uint64_t               _buffer_bytes;
+    uint16_t               _n_partitions;
+    uint8_t                _partition_shift;
+    bool                   _keep;
+
+    std::vector<value_type> _buffer;
+    std::vector<Partition>  _partitions;
+    uint64_t                _n_pending;
+    uint64_t                _n_runs;
+    mutable uint32_t        _lock;
+
+    // murmur3's finalizer; a bijection, so mixed hashes count exactly
+    static inline uint64_t _mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    inline size_t _partition_for(uint64_t mixed) const {
+        return _n_partitions > 1 ? mixed >> _partition_shift : 0;
+    }
+
+    inline void _lock_buffer() const {
+        while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+    }
+
+    inline void _unlock_buffer() const {
+        __sync_bool_compare_and_swap(&_lock, 1, 0);
+    }
+
+    std::string _path(size_t partition, const std::string& kind) const;
+
+    void _make_directory();
+
+    void _remove_files();
+
+    // Sort the buffer and append it to the run files; the buffer lock
+    // must be held.
+    void _spill();
+
+    // Merge a partition's runs in groups of MERGE_FAN_IN into fewer,
+    // longer runs, until at most MERGE_FAN_IN are left.
+    void _merge_passes(size_t partition);
+
+    // Merge a partition's runs and its merged arrays into new arrays.
+    void _merge(size_t partition);
+
+    // Map a partition's merged arrays and sample them.
+    void _map(size_t partition, uint64_t size);
+
+    void _check_merged() const;
+
+public:
+
+    DiskCountStorage(const std::string& directory,
+                     uint64_t           buffer_bytes = DEFAULT_BUFFER_BYTES,
+                     uint16_t           n_partitions = DEFAULT_N_PARTITIONS);
+
+    ~DiskCountStorage();
+
+    DiskCountStorage(const DiskCountStorage&) = delete;
+    DiskCountStorage& operator=(const DiskCountStorage&) = delete;
+
+    static std::shared_ptr<DiskCountStorage> build(const std::string& directory);
+
+    static std::shared_ptr<DiskCountStorage> build(const std::string& directory,
+                                                   uint64_t           buffer_bytes);
+
+    static std::shared_ptr<DiskCountStorage> build(const std::string& directory,
+                                                   uint64_t           buffer_bytes,
+                                                   uint16_t           n_partitions);
+
+    // Empty, in a new directory beside this one's.
+    std::shared_ptr<DiskCountStorage> clone() const;
+
+    /**
+     * @Synopsis  Spill the buffer and merge every partition's runs, making
+     *            all inserts so far queryable.
+     *
+     * @Param n_threads Partitions merged at once; 0 picks one per core.
+     */
+    void finalize(size_t n_threads = 0);
+
+    void reset();
+
+    // the working directory
+    const std::string& directory() const {
+        return _directory;
+    }
+
+    const uint64_t buffer_bytes() const {
+        return _buffer_bytes;
+    }
+
+    const uint16_t n_partitions() const {
+        return _n_partitions;
+    }
+
+    // Hashes inserted since the last finalize.
+    const uint64_t n_pending() const {
+        return _n_pending;
+    }
+
+    // Runs spilled since the last finalize.
+    const uint64_t n_runs() const {
+        return _n_runs;
+    }
+
+    // Distinct hashes as of the last finalize.
+    const uint64_t n_unique_kmers() const;
+
+    const uint64_t n_occupied() const {
+        return n_unique_kmers();
+    }
+
+    void save(std::string, uint16_t );
+
+    void load(std::string, uint16_t &);
+
+    const bool insert(value_type h);
+
+    const count_t insert_and_query(value_type h);
+
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    const count_t query(value_type h) const;
+
+    // The count without clamping to count_t.
+    const full_count_type query_count(value_type h) const;
+
+    byte_t ** get_raw_tables() {
+        return nullptr;
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+};
+
+
+template<>
+struct is_probabilistic<DiskCountStorage> {
+    static const bool value = false;
+};
+
+template<>
+struct is_counting<DiskCountStorage> {
+    static const bool value = true;
+};
+
+}
+
+}
+#endif
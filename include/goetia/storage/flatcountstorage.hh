@@ -0,0 +1,209 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : flatcountstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+
+#ifndef GOETIA_FLATCOUNTSTORAGE_HH
+#define GOETIA_FLATCOUNTSTORAGE_HH
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/flathash.hh"
+#include "goetia/storage/sparsepp/spp.h"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace goetia {
+namespace storage {
+
+
+/*
+ * \class FlatCountStorage
+ *
+ * \brief Exact counts of hashes in flat open-addressing tables.
+ *
+ * The hashes are split over n_shards tables by the high bits of their
+ * mixed hash, each probed like FlatSetStorage's and guarded by its own
+ * spinlock, so threads inserting into different shards don't contend.
+ *
+ * Counts live in tiers: an 8-bit counter beside each slot, promoted to a
+ * 16-bit and then a 32-bit side map once they overflow. A counter at the
+ * top of its tier marks that the count has moved up. Most k-mers are seen
+ * only a few times, so nearly all counts stay in the inline byte. Counts
+ * saturate at 2^32 - 1; query clamps to count_t and query_count returns
+ * the full count.
+ */
+class FlatCountStorage : public Storage<uint64_t>,
+                         public Tagged<FlatCountStorage> {
+
+public:
+
+    using Storage<uint64_t>::value_type;
+    typedef uint32_t full_count_type;
+
+    static constexpr double   DEFAULT_MAX_LOAD_FACTOR = 0.875;
+    static constexpr uint16_t DEFAULT_N_SHARDS        = 64;
+
+protected:
+
+    struct Shard {
+        std::vector<byte_t>     ctrl;
+        std::vector<value_type> slots;
+        std::vector<uint8_t>    counts;
+        uint64_t                capacity;
+        uint64_t                size;
+        uint64_t                growth_limit;
+
+        spp::sparse_hash_map<value_type, uint16_t> counts16;
+        spp::sparse_hash_map<value_type, uint32_t> counts32;
+
+        mutable uint32_t        lock;
+
+        Shard() : capacity(0), size(0), growth_limit(0), lock(0) { }
+    };
+
+    std::vector<Shard> _shards;
+    uint16_t           _n_shards;
+    uint8_t            _shard_shift;
+    double             _max_load_factor;
+
+    inline Shard& _shard(uint64_t mixed) {
+        return _shards[_n_shards > 1 ? mixed >> _shard_shift : 0];
+    }
+
+    inline const Shard& _shard(uint64_t mixed) const {
+        return _shards[_n_shards > 1 ? mixed >> _shard_shift : 0];
+    }
+
+    static inline void _lock(const Shard& shard) {
+        while (!__sync_bool_compare_and_swap(&shard.lock, 0, 1));
+    }
+
+    static inline void _unlock(const Shard& shard) {
+        __sync_bool_compare_and_swap(&shard.lock, 1, 0);
+    }
+
+    void _allocate(Shard& shard, uint64_t capacity) const;
+
+    void _rehash(Shard& shard, uint64_t capacity) const;
+
+    // Slot of h in the shard, inserting it with a zero count if absent;
+    // is_new reports which. The shard must be locked.
+    uint64_t _find_or_insert(Shard& shard, value_type h, uint64_t mixed, bool& is_new);
+
+    // Slot of h in the shard, or capacity if absent.
+    uint64_t _find(const Shard& shard, value_type h, uint64_t mixed) const;
+
+    // Count held in slot, following promoted counts into the side maps.
+    full_count_type _slot_count(const Shard& shard, uint64_t slot) const;
+
+    // Add one to the count in slot, promoting it if its tier is full;
+    // returns the new count.
+    full_count_type _increment(Shard& shard, uint64_t slot);
+
+    static inline count_t _clamp(full_count_type count) {
+        return std::min<full_count_type>(count, std::numeric_limits<count_t>::max());
+    }
+
+public:
+
+    FlatCountStorage(double   max_load_factor = DEFAULT_MAX_LOAD_FACTOR,
+                     uint16_t n_shards        = DEFAULT_N_SHARDS);
+
+    static std::shared_ptr<FlatCountStorage> build();
+
+    static std::shared_ptr<FlatCountStorage> build(double max_load_factor);
+
+    static std::shared_ptr<FlatCountStorage> build(double   max_load_factor,
+                                                   uint16_t n_shards);
+
+    static std::shared_ptr<FlatCountStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
+
+    std::shared_ptr<FlatCountStorage> clone() const;
+
+    void reset();
+
+    const uint64_t n_unique_kmers() const;
+
+    const uint64_t n_occupied() const {
+        return n_unique_kmers();
+    }
+
+    const uint16_t n_shards() const {
+        return _n_shards;
+    }
+
+    const double max_load_factor() const {
+        return _max_load_factor;
+    }
+
+    // Call f(hash, count) for every hash. Not safe alongside inserts.
+    template<typename Func>
+    void for_each(Func f) const {
+        for (const auto& shard : _shards) {
+            for (uint64_t i = 0; i < shard.capacity; ++i) {
+                if (shard.ctrl[i] != flat::CTRL_EMPTY) {
+                    f(shard.slots[i], _slot_count(shard, i));
+                }
+            }
+        }
+    }
+
+    // Hashes whose counts have outgrown the 8-bit tier.
+    const uint64_t n_promoted() const;
+
+    // slots, control bytes and inline counters, plus an estimate of the
+    // side maps
+    const uint64_t n_bytes() const;
+
+    void save(std::string, uint16_t );
+
+    void load(std::string, uint16_t &);
+
+    const bool insert(value_type h);
+
+    const count_t insert_and_query(value_type h);
+
+    const count_t query(value_type h) const;
+
+    // The count without clamping to count_t.
+    const full_count_type query_count(value_type h) const;
+
+    byte_t ** get_raw_tables() {
+        return nullptr;
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+};
+
+
+template<>
+struct is_probabilistic<FlatCountStorage> {
+    static const bool value = false;
+};
+
+template<>
+struct is_counting<FlatCountStorage> {
+    static const bool value = true;
+};
+
+template<>
+struct is_enumerable<FlatCountStorage> {
+    static const bool value = true;
+};
+
+}
+
+}
+#endif
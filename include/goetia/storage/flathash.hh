@@ -0,0 +1,89 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : flathash.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_FLATHASH_HH
+#define GOETIA_FLATHASH_HH
+
+#include "goetia/storage/storage.hh"
+
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace goetia {
+namespace storage {
+
+/*
+ * Group probing shared by the flat open-addressing storages.
+ *
+ * Each slot has a control byte: CTRL_EMPTY, or h2 of the slot's mixed
+ * hash. A probe compares GROUP_WIDTH control bytes at once; the table
+ * keeps its first GROUP_WIDTH control bytes mirrored past the end so a
+ * group load never wraps. Groups are visited triangularly, which covers
+ * every group of a power-of-two table.
+ */
+namespace flat {
+
+static constexpr size_t GROUP_WIDTH  = 16;
+static constexpr size_t MIN_CAPACITY = GROUP_WIDTH;
+static constexpr byte_t CTRL_EMPTY   = 0x80;
+
+// Fold the 128-bit product so every input bit reaches the low bits,
+// which become h2.
+inline uint64_t mix(uint64_t h) {
+    __uint128_t p = (__uint128_t) h * 0x9E3779B97F4A7C15ULL;
+    return (uint64_t) p ^ (uint64_t) (p >> 64);
+}
+
+inline byte_t h2(uint64_t mixed) {
+    return mixed & 0x7F;
+}
+
+// First group of the probe in a table of capacity slots.
+inline uint64_t h1(uint64_t mixed, uint64_t capacity) {
+    return (mixed >> 7) & (capacity - 1);
+}
+
+// Bit i is set if ctrl[i] == tag.
+inline uint32_t match(const byte_t * ctrl, byte_t tag) {
+#ifdef __SSE2__
+    const __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) tag)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (uint32_t) (ctrl[i] == tag) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i is set if ctrl[i] is empty.
+inline uint32_t match_empty(const byte_t * ctrl) {
+#ifdef __SSE2__
+    // only CTRL_EMPTY has the high bit set
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    return match(ctrl, CTRL_EMPTY);
+#endif
+}
+
+// Slots a table may fill before growing; always leaves one empty so
+// probes terminate.
+inline uint64_t growth_limit(uint64_t capacity, double max_load_factor) {
+    return std::min<uint64_t>(capacity * max_load_factor, capacity - 1);
+}
+
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : flatsetstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+
+#ifndef GOETIA_FLATSETSTORAGE_HH
+#define GOETIA_FLATSETSTORAGE_HH
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/flathash.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace goetia {
+namespace storage {
+
+
+/*
+ * \class FlatSetStorage
+ *
+ * \brief An exact set of hashes in a flat open-addressing table.
+ *
+ * Hashes are kept in one array of slots, with a parallel array of control
+ * bytes probed a group at a time (with SSE2 where available; see
+ * flathash.hh), so most lookups touch one control line and one slot.
+ *
+ * The table doubles once it holds more than max_load_factor of its slots.
+ * Hashes are never erased, so there are no tombstones. Like
+ * SparseppSetStorage, it is not safe for concurrent inserts.
+ */
+class FlatSetStorage : public Storage<uint64_t>,
+                       public Tagged<FlatSetStorage> {
+
+public:
+
+    using Storage<uint64_t>::value_type;
+
+    static constexpr double DEFAULT_MAX_LOAD_FACTOR = 0.875;
+
+protected:
+
+    std::vector<byte_t>     _ctrl;
+    std::vector<value_type> _slots;
+    uint64_t                _capacity;
+    uint64_t                _size;
+    uint64_t                _growth_limit;
+    double                  _max_load_factor;
+
+    inline void _set_ctrl(uint64_t slot, byte_t c) {
+        _ctrl[slot] = c;
+        if (slot < flat::GROUP_WIDTH) {
+            _ctrl[_capacity + slot] = c;
+        }
+    }
+
+    inline void _prefetch(uint64_t mixed) const {
+        const uint64_t pos = flat::h1(mixed, _capacity);
+        __builtin_prefetch(&_ctrl[pos], 0, 1);
+        __builtin_prefetch(&_slots[pos], 0, 1);
+    }
+
+    // Insert a hash already known to be absent, without growing.
+    void _insert_new(value_type h, uint64_t mixed);
+
+    // Insert given the mixed hash; true if it was new. Never grows, so the
+    // caller must have reserved room.
+    bool _insert(value_type h, uint64_t mixed);
+
+    bool _contains(value_type h, uint64_t mixed) const;
+
+    void _allocate(uint64_t capacity);
+
+    void _rehash(uint64_t capacity);
+
+    // Grow until n hashes fit under the load factor.
+    inline void _reserve(uint64_t n) {
+        if (n > _growth_limit) {
+            uint64_t capacity = _capacity;
+            while (n > flat::growth_limit(capacity, _max_load_factor)) {
+                capacity <<= 1;
+            }
+            _rehash(capacity);
+        }
+    }
+
+public:
+
+    FlatSetStorage(double max_load_factor = DEFAULT_MAX_LOAD_FACTOR);
+
+    static std::shared_ptr<FlatSetStorage> build();
+
+    static std::shared_ptr<FlatSetStorage> build(double max_load_factor);
+
+    static std::shared_ptr<FlatSetStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
+
+    std::shared_ptr<FlatSetStorage> clone() const;
+
+    void reset();
+
+    // Make room for n hashes without further growth.
+    void reserve(uint64_t n) {
+        _reserve(n);
+    }
+
+    const uint64_t n_unique_kmers() const {
+        return _size;
+    }
+
+    const uint64_t n_occupied() const {
+        return _size;
+    }
+
+    const uint64_t capacity() const {
+        return _capacity;
+    }
+
+    const double load_factor() const {
+        return (double) _size / _capacity;
+    }
+
+    const double max_load_factor() const {
+        return _max_load_factor;
+    }
+
+    // Call f(hash, 1) for every hash.
+    template<typename Func>
+    void for_each(Func f) const {
+        for (uint64_t i = 0; i < _capacity; ++i) {
+            if (_ctrl[i] != flat::CTRL_EMPTY) {
+                f(_slots[i], 1);
+            }
+        }
+    }
+
+    // slots plus control bytes
+    const uint64_t n_bytes() const {
+        return _capacity * sizeof(value_type) + _ctrl.size();
+    }
+
+    void save(std::string, uint16_t );
+
+    void load(std::string, uint16_t &);
+
+    const bool insert(value_type h);
+
+    const count_t insert_and_query(value_type h);
+
+    const count_t query(value_type h) const;
+
+    // Batched variants: the batch's groups are prefetched before any are
+    // probed, and the table grows at most once per batch.
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
+    byte_t ** get_raw_tables() {
+        return nullptr;
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+};
+
+
+template<>
+struct is_probabilistic<FlatSetStorage> {
+    static const bool value = false;
+};
+
+template<>
+struct is_counting<FlatSetStorage> {
+    static const bool value = false;
+};
+
+template<>
+struct is_enumerable<FlatSetStorage> {
+    static const bool value = true;
+};
+
+}
+
+}
+#endif
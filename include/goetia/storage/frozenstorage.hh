@@ -0,0 +1,321 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : frozenstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+
+#ifndef GOETIA_FROZENSTORAGE_HH
+#define GOETIA_FROZENSTORAGE_HH
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/flathash.hh"
+#include "goetia/storage/mapped_file.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace goetia {
+namespace storage {
+
+
+/*
+ * \class FrozenStorage
+ *
+ * \brief An immutable index over a finished set of hashes, for serving
+ *        queries once streaming is done.
+ *
+ * Hashes are mapped to [0, n) by a minimal perfect hash in the style of
+ * BBHash: each level is a bit array of gamma times the hashes still
+ * unplaced, a hash is placed in the first level where no other hash lands
+ * on its bit, and its index is the rank of that bit. The few hashes left
+ * after MAX_LEVELS go to a small sorted fallback array. At gamma 1 this
+ * costs about 3 bits per hash.
+ *
+ * A perfect hash maps any hash to some index, so each index also stores
+ * a fingerprint_bits fingerprint of its hash; absent hashes are rejected
+ * unless their fingerprint matches, which happens with probability
+ * 2^-fingerprint_bits. With count_bits set, each index also stores the
+ * count of its hash, saturating at 2^count_bits - 1.
+ *
+ * The index can't be inserted into. save writes the mapped format, and
+ * load maps it read-only in place, so processes serving the same file
+ * share its pages.
+ */
+class FrozenStorage : public Storage<uint64_t>,
+                      public Tagged<FrozenStorage> {
+
+public:
+
+    using Storage<uint64_t>::value_type;
+    typedef uint32_t full_count_type;
+
+    static constexpr double  DEFAULT_GAMMA            = 1.0;
+    static constexpr uint8_t DEFAULT_FINGERPRINT_BITS = 8;
+    static constexpr uint8_t DEFAULT_COUNT_BITS       = 8;
+    static constexpr size_t  MAX_LEVELS               = 32;
+
+    // bits per sampled rank
+    static constexpr uint64_t RANK_BLOCK = 512;
+
+protected:
+
+    // Arrays of an index built in memory; a loaded index points into its
+    // mapping instead.
+    struct Tables {
+        std::vector<uint64_t> bits;
+        std::vector<uint64_t> ranks;
+        std::vector<uint64_t> fallback;
+        std::vector<uint64_t> fingerprints;
+        std::vector<uint64_t> counts;
+    };
+
+    std::shared_ptr<Tables>     _tables;
+    std::shared_ptr<MappedFile> _mapping;
+
+    // the level bit arrays, concatenated
+    const uint64_t * _bits;
+    // set bits before each RANK_BLOCK of _bits
+    const uint64_t * _ranks;
+    // sorted hashes which no level placed
+    const uint64_t * _fallback;
+    // packed fingerprint_bits and count_bits arrays, by index
+    const uint64_t * _fingerprints;
+    const uint64_t * _counts;
+
+    std::vector<uint64_t> _level_bits;
+    // offset of each level into _bits, in bits
+    std::vector<uint64_t> _level_offsets;
+
+    uint64_t _n_keys;
+    uint64_t _n_level_keys;
+    uint64_t _n_fallback;
+    uint8_t  _fingerprint_bits;
+    uint8_t  _count_bits;
+    double   _gamma;
+
+    static inline uint64_t _level_hash(value_type h, size_t level) {
+        return flat::mix(h ^ (0xC6A4A7935BD1E995ULL * (level + 1)));
+    }
+
+    // Map a hash onto [0, n) without division.
+    static inline uint64_t _reduce(uint64_t h, uint64_t n) {
+        return (uint64_t) (((__uint128_t) h * n) >> 64);
+    }
+
+    inline uint64_t _fingerprint(value_type h) const {
+        return flat::mix(h ^ 0x2545F4914F6CDD1DULL) >> (64 - _fingerprint_bits);
+    }
+
+    static inline uint64_t _get_packed(const uint64_t * words, uint64_t i, uint8_t width) {
+        const uint64_t bit = i * width;
+        const uint64_t word = bit >> 6;
+        const unsigned shift = bit & 63;
+        uint64_t value = words[word] >> shift;
+        if (shift + width > 64) {
+            value |= words[word + 1] << (64 - shift);
+        }
+        return value & ((1ULL << width) - 1);
+    }
+
+    static void _set_packed(uint64_t * words, uint64_t i, uint8_t width, uint64_t value);
+
+    // Set bits of _bits before bit pos.
+    inline uint64_t _rank(uint64_t pos) const {
+        const uint64_t word = pos >> 6;
+        uint64_t rank = _ranks[pos / RANK_BLOCK];
+        for (uint64_t w = word & ~uint64_t(RANK_BLOCK / 64 - 1); w < word; ++w) {
+            rank += __builtin_popcountll(_bits[w]);
+        }
+        return rank + __builtin_popcountll(_bits[word] & ((1ULL << (pos & 63)) - 1));
+    }
+
+    // Index the perfect hash gives h, or _n_keys if no level or the
+    // fallback holds it. Without checking the fingerprint, a hash that
+    // was never frozen may still get an index.
+    uint64_t _lookup(value_type h) const;
+
+    // Index of h, or _n_keys if h was not frozen.
+    inline uint64_t _index(value_type h) const {
+        const uint64_t index = _lookup(h);
+        if (index < _n_keys && _fingerprint_bits &&
+            _get_packed(_fingerprints, index, _fingerprint_bits) != _fingerprint(h)) {
+            return _n_keys;
+        }
+        return index;
+    }
+
+    void _set_levels(std::vector<uint64_t> level_bits);
+
+    void _point_at_tables();
+
+public:
+
+    FrozenStorage();
+
+    // An empty index, to load into.
+    static std::shared_ptr<FrozenStorage> build();
+
+    /**
+     * @Synopsis  Freeze a set of distinct hashes.
+     *
+     * @Param hashes           The hashes; consumed.
+     * @Param counts           Count of each hash, or empty for none.
+     * @Param fingerprint_bits Bits of each fingerprint, up to 32; 0 stores
+     *                         none, so absent hashes can't be rejected.
+     * @Param count_bits       Bits of each count, up to 32; ignored without
+     *                         counts.
+     * @Param gamma            Level size per unplaced hash, at least 1;
+     *                         larger is faster to build and query but
+     *                         takes more bits.
+     */
+    static std::shared_ptr<FrozenStorage> build(std::vector<value_type>      hashes,
+                                                std::vector<full_count_type> counts,
+                                                uint8_t fingerprint_bits = DEFAULT_FINGERPRINT_BITS,
+                                                uint8_t count_bits       = DEFAULT_COUNT_BITS,
+                                                double  gamma            = DEFAULT_GAMMA);
+
+    /**
+     * @Synopsis  Freeze every hash of an exact storage, and its counts if
+     *            the storage is counting.
+     */
+    template<class SourceType>
+    static std::shared_ptr<FrozenStorage> freeze(const SourceType& source,
+                                                 uint8_t fingerprint_bits = DEFAULT_FINGERPRINT_BITS,
+                                                 uint8_t count_bits       = DEFAULT_COUNT_BITS) {
+        static_assert(is_enumerable<SourceType>::value,
+                      "Only storages which can list their hashes can be frozen directly");
+
+        std::vector<value_type> hashes;
+        std::vector<full_count_type> counts;
+        hashes.reserve(source.n_unique_kmers());
+        if (is_counting<SourceType>::value && count_bits) {
+            counts.reserve(source.n_unique_kmers());
+        }
+        source.for_each([&](value_type h, full_count_type count) {
+            hashes.push_back(h);
+            if (is_counting<SourceType>::value && count_bits) {
+                counts.push_back(count);
+            }
+        });
+        return build(std::move(hashes), std::move(counts), fingerprint_bits, count_bits);
+    }
+
+    /**
+     * @Synopsis  Freeze those of the given hashes present in any storage,
+     *            with their counts from it if it is counting. Storages
+     *            which keep only part of each hash, like QFStorage, can't
+     *            list their hashes, so these come from the caller, eg from
+     *            the sequences which were inserted. Duplicates are fine.
+     */
+    static std::shared_ptr<FrozenStorage> freeze(const Storage<uint64_t>& source,
+                                                 std::vector<value_type>  hashes,
+                                                 bool    counting,
+                                                 uint8_t fingerprint_bits = DEFAULT_FINGERPRINT_BITS,
+                                                 uint8_t count_bits       = DEFAULT_COUNT_BITS);
+
+    static std::shared_ptr<FrozenStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
+
+    // Shares the immutable tables.
+    std::shared_ptr<FrozenStorage> clone() const;
+
+    void reset();
+
+    const uint64_t n_unique_kmers() const {
+        return _n_keys;
+    }
+
+    const uint64_t n_occupied() const {
+        return _n_keys;
+    }
+
+    const uint8_t fingerprint_bits() const {
+        return _fingerprint_bits;
+    }
+
+    const uint8_t count_bits() const {
+        return _count_bits;
+    }
+
+    const double gamma() const {
+        return _gamma;
+    }
+
+    const size_t n_levels() const {
+        return _level_bits.size();
+    }
+
+    // Hashes in the fallback array rather than a level.
+    const uint64_t n_fallback() const {
+        return _n_fallback;
+    }
+
+    // bytes of all the tables
+    const uint64_t n_bytes() const;
+
+    // bits of the perfect hash alone, and of the whole index, per hash
+    const double mphf_bits_per_kmer() const;
+
+    const double bits_per_kmer() const;
+
+    // Chance that an absent hash is reported present.
+    const double estimated_fp() const {
+        return _fingerprint_bits ? std::ldexp(1.0, -_fingerprint_bits) : 1.0;
+    }
+
+    const bool is_mapped() const {
+        return bool(_mapping);
+    }
+
+    // Save in the mapped format, and map such a file read-only.
+    void save(std::string, uint16_t );
+
+    void load(std::string, uint16_t &);
+
+    // These throw: the index is read-only.
+    const bool insert(value_type h);
+
+    const count_t insert_and_query(value_type h);
+
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    // 0 if absent; otherwise the count, or 1 without counts.
+    const count_t query(value_type h) const;
+
+    // The count without clamping to count_t.
+    const full_count_type query_count(value_type h) const;
+
+    // Batched variant: the first level's bits for a batch are prefetched
+    // before any are probed.
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
+    byte_t ** get_raw_tables() {
+        return nullptr;
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+};
+
+
+template<>
+struct is_probabilistic<FrozenStorage> {
+    static const bool value = true;
+};
+
+template<>
+struct is_counting<FrozenStorage> {
+    static const bool value = true;
+};
+
+}
+
+}
+#endif
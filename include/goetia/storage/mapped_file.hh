@@ -0,0 +1,149 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : mapped_file.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_MAPPED_FILE_HH
+#define GOETIA_MAPPED_FILE_HH
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/storage.hh"
+
+
+namespace goetia {
+namespace storage {
+
+/*
+ * \class MappedFile
+ *
+ * \brief A storage file mapped into memory.
+ *
+ * The mapped format is the oxli header with SAVED_MAPPED_FORMAT_VERSION,
+ * followed by storage-specific scalar fields and then a series of sections
+ * which each start on an ALIGNMENT boundary. A storage loaded from it points
+ * its tables straight at the sections, so nothing is copied at load and
+ * pages are faulted in as they are touched.
+ *
+ * Read-only mappings are shared, so several processes querying the same
+ * file share its physical pages; writing to one faults. Writable mappings
+ * are private copy-on-write: changes are never written back to the file.
+ */
+class MappedFile {
+
+    int      _fd;
+    byte_t * _data;
+    size_t   _size;
+    bool     _writable;
+    std::string _filename;
+
+public:
+
+    static constexpr size_t ALIGNMENT = 4096;
+
+    MappedFile(const std::string& filename, bool writable);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static std::shared_ptr<MappedFile> open(const std::string& filename,
+                                            bool writable = false) {
+        return std::make_shared<MappedFile>(filename, writable);
+    }
+
+    static size_t align(size_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    byte_t * data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool writable() const {
+        return _writable;
+    }
+
+    const std::string& filename() const {
+        return _filename;
+    }
+
+    // Pointer to length bytes at offset; throws if they run past the end.
+    byte_t * at(size_t offset, size_t length) const;
+
+    // Check the signature, version and type; returns the offset past them.
+    size_t check_header(unsigned char ht_type) const;
+
+    template<typename T>
+    T read(size_t& offset) const {
+        T value;
+        memcpy(&value, at(offset, sizeof(T)), sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    // The section of length bytes at the next aligned offset, as written
+    // by MappedFileWriter::write_section; advances offset past it.
+    byte_t * section(size_t& offset, size_t length) const {
+        offset = align(offset);
+        byte_t * ptr = at(offset, length);
+        offset += length;
+        return ptr;
+    }
+};
+
+
+// Throw unless the storage holding mapping may be written to: it isn't
+// mapped, or its mapping is writable. Called by every mutating method of
+// the mapped storages, since writing to a read-only mapping faults.
+inline void check_writable(const std::shared_ptr<MappedFile>& mapping) {
+    if (mapping && !mapping->writable()) {
+        throw GoetiaException("Cannot modify a read-only mapped storage.");
+    }
+}
+
+
+/*
+ * \class MappedFileWriter
+ *
+ * \brief Writes the mapped format read by MappedFile.
+ */
+class MappedFileWriter {
+
+    std::ofstream _out;
+    std::string   _filename;
+    size_t        _offset;
+
+public:
+
+    MappedFileWriter(const std::string& filename, unsigned char ht_type);
+
+    template<typename T>
+    void write(const T& value) {
+        _out.write((const char *) &value, sizeof(T));
+        _offset += sizeof(T);
+    }
+
+    // Pad to the next MappedFile::ALIGNMENT boundary and write the data.
+    void write_section(const void * data, size_t length);
+
+    void close();
+};
+
+}
+}
+
+#endif
@@ -55,6 +55,8 @@
 
 #include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/mapped_file.hh"
+#include "goetia/storage/table_allocator.hh"
 
 
 namespace goetia {
@@ -73,6 +75,10 @@ namespace storage {
  * Like other Storage classes, NibbleStorage manages setting the bits and
  * tracking statistics, as well as save/load, and not much else.
  *
+ * Counters are updated with lock-free CAS loops, so inserts can run
+ * concurrently and the counts stay exact; n_unique_kmers can count a
+ * k-mer twice if two threads insert it for the first time at once.
+ *
  */
 class NibbleStorage : public Storage<uint64_t>,
                       public Tagged<NibbleStorage>
@@ -87,63 +93,75 @@ protected:
     size_t _n_tables;
     uint64_t _occupied_bins;
     uint64_t _n_unique_kmers;
-    std::array<std::mutex, 32> mutexes;
     static constexpr uint8_t _max_count{15};
     byte_t ** _counts;
+    // set when the tables point into a mapped file rather than the heap
+    std::shared_ptr<MappedFile> _mapping;
+    TableAllocator _allocator;
 
-    // Compute index into the table, this retrieves the correct byte
-    // which you then need to select the correct nibble from
-    uint64_t _table_index(const value_type k, const uint64_t tablesize) const
-    {
-        return (k % tablesize) / 2;
-    }
-    // Compute which half of the byte to use for this hash value
-    uint8_t _mask(const value_type k, const uint64_t tablesize) const
+    // Compute which half of the byte to use for this bin; the byte
+    // itself is at bin / 2.
+    static uint8_t _bin_mask(const uint64_t bin)
     {
-        return (k%tablesize)%2 ? 15 : 240;
+        return bin % 2 ? 15 : 240;
     }
-    // Compute which half of the byte to use for this hash value
-    uint8_t _shift(const value_type k, const uint64_t tablesize) const
+    // Compute the shift for the half of the byte used by this bin
+    static uint8_t _bin_shift(const uint64_t bin)
     {
-        return (k%tablesize)%2 ? 0 : 4;
+        return bin % 2 ? 0 : 4;
     }
 
+    // Saturating increment of one bin; returns the pre-increment count.
+    uint8_t _increment_bin(size_t table, uint64_t bin);
+
+    uint8_t _query_bin(size_t table, uint64_t bin) const;
+
+    // Combine other's tables into ours with the per-counter op, applied to
+    // both halves of every byte in parallel chunks, then re-count the
+    // occupied bins of the first table and re-estimate the number of
+    // distinct k-mers from them.
+    template <typename Op>
+    void _combine(const NibbleStorage& other, Op op);
+
 public:
-    NibbleStorage(uint64_t max_table, uint16_t N)
-        : NibbleStorage(get_n_primes_near_x(N, max_table))
+    NibbleStorage(uint64_t max_table, uint16_t N, TablePolicy policy = TablePolicy())
+        : NibbleStorage(get_n_primes_near_x(N, max_table), policy)
     {
     }
 
-    NibbleStorage(const std::vector<uint64_t>& tablesizes) :
+    NibbleStorage(const std::vector<uint64_t>& tablesizes,
+                  TablePolicy                  policy = TablePolicy()) :
         _tablesizes{tablesizes},
         _n_tables(_tablesizes.size()),
         _occupied_bins{0},
-        _n_unique_kmers{0}
+        _n_unique_kmers{0},
+        _allocator(policy)
     {
-        // to allow more than 32 tables increase the size of mutex pool
-        assert(_n_tables <= 32);
+        if (_n_tables > MAX_TABLES) {
+            throw GoetiaException("NibbleStorage can have at most "
+                                  + std::to_string(MAX_TABLES) + " tables");
+        }
         _allocate_counters();
     }
 
     ~NibbleStorage()
     {
-        if (_counts) {
-            for (size_t i = 0; i < _n_tables; i++) {
-                delete[] _counts[i];
-                _counts[i] = NULL;
-            }
-            delete[] _counts;
-            _counts = NULL;
-            _n_tables = 0;
-        }
+        _free_counters();
     }
 
-    static std::shared_ptr<NibbleStorage> build(uint64_t max_table, uint16_t N) {
-        return std::make_shared<NibbleStorage>(max_table, N);
+    static std::shared_ptr<NibbleStorage> build(uint64_t    max_table,
+                                                uint16_t    N,
+                                                TablePolicy policy = TablePolicy()) {
+        return std::make_shared<NibbleStorage>(max_table, N, policy);
     }
 
     std::shared_ptr<NibbleStorage> clone() const {
-        return std::make_shared<NibbleStorage>(this->_tablesizes);
+        return std::make_shared<NibbleStorage>(this->_tablesizes, _allocator.policy());
+    }
+
+    const TablePolicy& table_policy() const
+    {
+        return _allocator.policy();
     }
 
     void _allocate_counters()
@@ -154,18 +172,36 @@ public:
             const uint64_t tablesize = _tablesizes[i];
             const uint64_t tablebytes = tablesize / 2 + 1;
 
-            _counts[i] = new byte_t[tablebytes];
-            memset(_counts[i], 0, tablebytes);
+            _counts[i] = _allocator.allocate(tablebytes, i);
         }
     }
+
+    void _free_counters()
+    {
+        if (_counts) {
+            for (size_t i = 0; i < _n_tables; i++) {
+                if (!_mapping) {
+                    _allocator.release(_counts[i]);
+                }
+                _counts[i] = NULL;
+            }
+            delete[] _counts;
+            _counts = NULL;
+            _n_tables = 0;
+        }
+        _mapping.reset();
+    }
     
     void reset()
     {
+        check_writable(_mapping);
         for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
             uint64_t tablesize = _tablesizes[table_num];
             uint64_t tablebytes = tablesize / 2 + 1;
-            memset(_counts[table_num], 0, tablebytes);
+            _allocator.zero(_counts[table_num], tablebytes);
         }
+        _occupied_bins = 0;
+        _n_unique_kmers = 0;
     }
 
     const bool insert(value_type khash);
@@ -175,6 +211,12 @@ public:
     // get the count for the given k-mer hash.
     const count_t query(value_type khash) const;
 
+    // Batched variants: all bins for a batch are computed and prefetched
+    // before any are touched.
+    uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
     // Accessors for protected/private table info members
     std::vector<uint64_t> get_tablesizes() const
     {
@@ -192,25 +234,51 @@ public:
     {
         return _occupied_bins;
     }
+    // Inverted from the occupancy of the first table; see
+    // occupancy_cardinality.
+    const uint64_t estimated_cardinality() const
+    {
+        return occupancy_cardinality(__atomic_load_n(&_occupied_bins, __ATOMIC_RELAXED),
+                                     _tablesizes[0]);
+    }
+
     double estimated_fp() {
-        double fp = n_occupied() / _tablesizes[0];
+        double fp = (double) n_occupied() / _tablesizes[0];
         fp = pow(fp, n_tables());
         return fp;
     }
     void save(std::string outfilename, uint16_t ksize);
     void load(std::string infilename, uint16_t& ksize);
 
+    // Save in the page-aligned mapped format, and map such a file in
+    // place of the tables; see MappedFile. Without writable, the tables
+    // are read-only and inserting throws.
+    void save_mapped(std::string outfilename, uint16_t ksize);
+    void load_mapped(std::string infilename, uint16_t& ksize, bool writable = false);
+
+    const bool is_mapped() const
+    {
+        return bool(_mapping);
+    }
+
     byte_t ** get_raw_tables()
     {
         return _counts;
     }
 
-    // not implemented
-    static std::shared_ptr<NibbleStorage> deserialize(std::ifstream& in) {
-        return {};
-    }
+    metrics::MemoryUsage memory_usage() const;
+
+    // Combine with another NibbleStorage of the same table sizes, as for
+    // ByteStorage: merge adds the counts, saturating at 15; intersect
+    // keeps the lesser and subtract the difference, floored at zero. Not
+    // safe to run alongside inserts.
+    void merge(const NibbleStorage& other);
+    void intersect(const NibbleStorage& other);
+    void subtract(const NibbleStorage& other);
+
+    static std::shared_ptr<NibbleStorage> deserialize(std::ifstream& in);
 
-    void serialize(std::ofstream& out) {}
+    void serialize(std::ofstream& out);
 };
 
 
@@ -18,26 +18,59 @@
 #define GOETIA_PARTITIONEDSTORAGE_HH
 
 #include "goetia/goetia.hh"
+#include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
 #include "sparsepp/spp.h"
 
+#include <algorithm>
+#include <fstream>
 #include <vector>
 
 namespace goetia {
 namespace storage {
 
 
+/*
+ * \class PartitionedStorage
+ *
+ * \brief One BaseStorageType per partition.
+ *
+ * save writes a small header file holding the type tags, ksize and
+ * partition count, and each partition to its own file beside it, named by
+ * partition_filename, in the base storage's serialize format. Partitions
+ * are written and read in parallel. load_partitions reads back only the
+ * selected partitions, leaving the rest as constructed.
+ *
+ * For bulk ingest, producers bucket hashes by partition into their own
+ * bucket_set and drain_buckets hands each partition to a single owner
+ * thread, so the base storages are never shared between threads.
+ */
 template <class BaseStorageType>
-class PartitionedStorage : public Storage<uint64_t> {
+class PartitionedStorage : public Storage<uint64_t>,
+                           public Tagged<PartitionedStorage<BaseStorageType>> {
 
 protected:
     std::vector<std::shared_ptr<BaseStorageType>> partitions;
     const uint64_t                                n_partitions;
 
+    // Run f over the given partitions on up to hardware_concurrency threads.
+    template <typename Func>
+    void _for_each_parallel(const std::vector<uint64_t>& which, Func f) {
+        const size_t n_threads = default_threads(which.size());
+        run_threads(n_threads, [&](size_t t) {
+            for (size_t i = t; i < which.size(); i += n_threads) {
+                f(which[i]);
+            }
+        });
+    }
+
 public:
 
     typedef uint64_t        value_type;
     typedef BaseStorageType base_storage_type;
+
+    // Hashes bucketed by partition: one vector per partition.
+    typedef std::vector<std::vector<value_type>> bucket_set;
     
     template <typename... Args>
     PartitionedStorage(const uint64_t  n_partitions,
@@ -84,12 +117,24 @@ public:
         return sum;
     }
 
+    const uint64_t estimated_cardinality() const {
+        uint64_t sum = 0;
+        for (auto& partition : partitions) {
+            sum += partition->estimated_cardinality();
+        }
+        return sum;
+    }
+
     const uint64_t n_tables() const {
         return partitions.front()->n_tables();
     }
 
     const uint64_t n_occupied() const {
-        return partitions.front()->n_occupied();
+        uint64_t sum = 0;
+        for (auto& partition : partitions) {
+            sum += partition->n_occupied();
+        }
+        return sum;
     }
 
     const uint64_t n_partition_stores() const {
@@ -107,12 +152,95 @@ public:
         return sum / (double)n_partition_stores();
     }
 
-    void save(std::string, uint16_t ) {
-     
+    static std::string partition_filename(const std::string& filename,
+                                          uint64_t           partition) {
+        return filename + "." + std::to_string(partition);
+    }
+
+    void save(std::string filename, uint16_t ksize) {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        if (!out.is_open()) {
+            throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                      + filename);
+        }
+        serialize_tag<PartitionedStorage<BaseStorageType>>(out);
+        serialize_tag<BaseStorageType>(out);
+        out.write((const char *) &ksize, sizeof(ksize));
+        out.write((const char *) &n_partitions, sizeof(n_partitions));
+        out.close();
+
+        std::vector<uint64_t> all(n_partitions);
+        for (uint64_t i = 0; i < n_partitions; ++i) {
+            all[i] = i;
+        }
+        _for_each_parallel(all, [&](uint64_t partition) {
+            const std::string pfilename = partition_filename(filename, partition);
+            std::ofstream pout(pfilename.c_str(), std::ios::binary);
+            if (!pout.is_open()) {
+                throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                          + pfilename);
+            }
+            partitions[partition]->serialize(pout);
+            if (pout.fail()) {
+                throw GoetiaFileException("Error writing " + pfilename);
+            }
+        });
     }
 
-    void load(std::string, uint16_t &) {
+    void load(std::string filename, uint16_t &ksize) {
+        std::vector<uint64_t> all(n_partitions);
+        for (uint64_t i = 0; i < n_partitions; ++i) {
+            all[i] = i;
+        }
+        load_partitions(filename, ksize, all);
+    }
 
+    /**
+     * @Synopsis  Load only the given partitions of a storage written by
+     *            save; the others are left untouched.
+     */
+    void load_partitions(std::string                  filename,
+                         uint16_t &                   ksize,
+                         const std::vector<uint64_t>& which) {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        if (!in.is_open()) {
+            throw GoetiaFileException("Cannot open k-mer storage file: " + filename);
+        }
+        deserialize_tag<PartitionedStorage<BaseStorageType>>(in);
+        deserialize_tag<BaseStorageType>(in);
+
+        uint16_t save_ksize;
+        uint64_t save_n_partitions;
+        in.read((char *) &save_ksize, sizeof(save_ksize));
+        in.read((char *) &save_n_partitions, sizeof(save_n_partitions));
+        if (!in) {
+            throw GoetiaFileException("Unexpected end of file: " + filename);
+        } else if (save_n_partitions != n_partitions) {
+            throw GoetiaFileException("File has " + std::to_string(save_n_partitions)
+                                      + " partitions, storage has "
+                                      + std::to_string(n_partitions));
+        }
+        for (auto partition : which) {
+            if (partition >= n_partitions) {
+                throw GoetiaException("Invalid storage partition: "
+                                      + std::to_string(partition));
+            }
+        }
+        ksize = save_ksize;
+
+        _for_each_parallel(which, [&](uint64_t partition) {
+            const std::string pfilename = partition_filename(filename, partition);
+            std::ifstream pin(pfilename.c_str(), std::ios::binary);
+            if (!pin.is_open()) {
+                throw GoetiaFileException("Cannot open k-mer storage file: " + pfilename);
+            }
+            auto loaded = BaseStorageType::deserialize(pin);
+            if (!loaded) {
+                throw GoetiaException("Serialization is not supported for "
+                                      + std::string(BaseStorageType::NAME));
+            }
+            partitions[partition] = loaded;
+        });
     }
 
     inline const bool insert(value_type h, uint64_t partition) {
@@ -129,6 +257,87 @@ public:
     }
 
 
+    bucket_set make_buckets() const {
+        return bucket_set(n_partitions);
+    }
+
+    /**
+     * @Synopsis  Insert bucketed hashes, one owner thread per group of
+     *            partitions.
+     *
+     * Each element of buckets is one producer's bucket_set. Partition p is
+     * owned by thread p % n_threads, which drains bucket p of every producer
+     * through the base storage's insert_many. No partition is touched by
+     * two threads, so the base storages need no locking. The buckets are
+     * cleared.
+     *
+     * @Param buckets   Producer bucket sets, each with n_partitions buckets.
+     * @Param n_threads Owner threads; 0 picks default_threads.
+     *
+     * @Returns   Number of hashes which were new.
+     */
+    uint64_t drain_buckets(std::vector<bucket_set>& buckets,
+                           size_t                   n_threads = 0) {
+        for (const auto& producer : buckets) {
+            if (producer.size() != n_partitions) {
+                throw GoetiaException("Bucket set does not match the number of partitions");
+            }
+        }
+        if (n_threads == 0) {
+            n_threads = default_threads(n_partitions);
+        }
+        n_threads = std::min<size_t>(n_threads, n_partitions);
+
+        std::vector<uint64_t> n_new(n_threads, 0);
+        run_threads(n_threads, [&](size_t t) {
+            for (uint64_t p = t; p < n_partitions; p += n_threads) {
+                auto * store = partitions[p].get();
+                for (auto& producer : buckets) {
+                    auto& bucket = producer[p];
+                    n_new[t] += store->insert_many(bucket.data(), bucket.size(), nullptr);
+                    bucket.clear();
+                }
+            }
+        });
+
+        uint64_t total = 0;
+        for (auto n : n_new) {
+            total += n;
+        }
+        return total;
+    }
+
+    /**
+     * @Synopsis  Insert n hashes with their partition ids in parallel:
+     *            producer threads bucket slices of the input by partition,
+     *            then drain_buckets inserts them.
+     *
+     * @Returns   Number of hashes which were new.
+     */
+    uint64_t insert_partitioned(const value_type * khashes,
+                                const uint64_t *   partition_ids,
+                                size_t             n,
+                                size_t             n_threads = 0) {
+        if (n_threads == 0) {
+            n_threads = default_threads(n_partitions);
+        }
+        std::vector<bucket_set> buckets(n_threads, make_buckets());
+        const size_t slice = (n + n_threads - 1) / n_threads;
+
+        run_threads(n_threads, [&](size_t t) {
+            const size_t end = std::min(n, (t + 1) * slice);
+            for (size_t i = t * slice; i < end; ++i) {
+                if (partition_ids[i] >= n_partitions) {
+                    throw GoetiaException("Invalid storage partition: "
+                                          + std::to_string(partition_ids[i]));
+                }
+                buckets[t][partition_ids[i]].push_back(khashes[i]);
+            }
+        });
+
+        return drain_buckets(buckets, n_threads);
+    }
+
     BaseStorageType * query_partition(uint64_t partition) {
         if (partition < n_partitions) {
             return partitions[partition].get();
@@ -141,6 +350,15 @@ public:
         return nullptr;
     }
 
+    // The partitions' components, summed.
+    metrics::MemoryUsage memory_usage() const {
+        metrics::MemoryUsage usage;
+        for (auto& partition : partitions) {
+            usage.add("partitions", partition->memory_usage());
+        }
+        return usage;
+    }
+
 
     const bool insert(value_type khash ) {
         throw GoetiaException("Method not available!");
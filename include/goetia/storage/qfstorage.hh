@@ -60,9 +60,12 @@
 #include <mutex>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/bytestorage.hh"
+#include "goetia/storage/mapped_file.hh"
 
 struct quotient_filter;
 typedef quotient_filter QF;
@@ -74,23 +77,119 @@ namespace storage {
  * \class QFStorage
  *
  * \brief A Quotient Filter storage
+ *
+ * The filter can be split into a power-of-two number of partitions, each
+ * its own CQF guarded by its own spinlock; the low bits of a hash pick the
+ * partition and the rest form the key within it. Every operation takes the
+ * lock of the partition it touches, so the storage is safe to share between
+ * threads, and with n_partitions > 1 inserts into different partitions
+ * proceed concurrently. The total number of slots and the fingerprint
+ * length are the same for any number of partitions.
+ *
+ * A partition grows when its newest filter passes GROWTH_THRESHOLD
+ * occupancy. The bundled CQF has a fixed 8-bit remainder and keeps only
+ * the truncated key, so entries can't be rehashed into a wider quotient;
+ * instead a filter with twice the slots is chained on and takes the
+ * inserts from then on, and counts are summed across the chain. The older
+ * filters keep answering with their narrower keys, so each adds its own
+ * collisions: counts after growth are approximate, overcounting more often
+ * the longer the chain, and n_unique_kmers misses the k-mers that collide
+ * with one already counted. Counts are clamped to count_t.
+ *
+ * With max_bytes set, the filters may use all but 1 / OVERFLOW_BUDGET_SHARE
+ * of the budget. When a partition can't grow within it, that partition
+ * stops taking CQF inserts and falls over to a ByteStorage sized from the
+ * remaining share, so counts from there on are count-min estimates
+ * rather than silently wrong.
  */
 class QFStorage : public Storage<uint64_t>,
                   public Tagged<QFStorage> {
+public:
+
+    static constexpr double GROWTH_THRESHOLD = 0.9;
+
+    // merge refuses to fill a filter past this occupancy
+    static constexpr double MERGE_CAPACITY = 0.95;
+
+    // most keys merge probes in a wider filter to find a k-mer of a
+    // narrower one when counting distinct k-mers
+    static constexpr uint64_t MERGE_MAX_PROBES = 16;
+
 protected:
-    std::shared_ptr<QF> cf;
+
+    // Lock and distinct-key count for a partition, one per cache line so
+    // that partitions don't false-share. The count is kept here rather than
+    // read from the CQF, whose own ndistinct_elts undercounts. full is set
+    // once the partition has fallen over to the overflow tier. active
+    // mirrors the back of the partition's chain so that the batch paths
+    // can prefetch without taking the lock.
+    struct alignas(64) PartitionState {
+        uint32_t lock     = 0;
+        uint64_t n_unique = 0;
+        bool     full     = false;
+        QF *     active   = nullptr;
+    };
+
+    // per partition, oldest first; the back filter takes inserts
+    std::vector<std::vector<std::shared_ptr<QF>>> _filters;
+    std::unique_ptr<PartitionState[]> _states;
     int _size;
+    uint16_t _n_partitions;
+    uint16_t _partition_bits;
+
+    uint64_t _max_bytes;
+    uint64_t _n_bytes;
+    std::shared_ptr<ByteStorage> _overflow;
+    uint32_t _overflow_lock;
+    // set when the filters were mapped from a file by load_mapped
+    std::shared_ptr<MappedFile> _mapping;
+
+    inline size_t _partition_for(value_type khash) const {
+        return khash & (_n_partitions - 1);
+    }
+
+    inline void _lock(size_t partition) const {
+        while (!__sync_bool_compare_and_swap(&_states[partition].lock, 0, 1));
+    }
+
+    inline void _unlock(size_t partition) const {
+        __sync_bool_compare_and_swap(&_states[partition].lock, 1, 0);
+    }
+
+    // Count a newly seen key; only called with the partition lock held.
+    inline void _count_unique(size_t partition) {
+        __atomic_store_n(&_states[partition].n_unique,
+                         _states[partition].n_unique + 1,
+                         __ATOMIC_RELAXED);
+    }
+
+    uint64_t _key_for(const QF * qf, value_type khash) const;
+
+    std::shared_ptr<QF> _new_filter(int log_slots);
+    bool _reserve_bytes(uint64_t bytes);
+    void _grow(size_t partition);
+    void _make_overflow();
+
+    // The partition lock must be held for these.
+    count_t _count(size_t partition, value_type khash) const;
+    count_t _insert(size_t partition, value_type khash);
+
+    void _init_filters();
+    void _reset_partitions(uint16_t n_partitions);
+    void _count_bytes();
 
 public:
   
   using Storage<uint64_t>::value_type;
 
-  QFStorage(int size);
+  QFStorage(int size, uint16_t n_partitions = 1, uint64_t max_bytes = 0);
 
   ~QFStorage();
 
-  static std::shared_ptr<QFStorage> build(int size) {
-      return std::make_shared<QFStorage>(size);
+  static std::shared_ptr<QFStorage> build(int size,
+                                          uint16_t n_partitions = 1,
+                                          uint64_t max_bytes = 0) {
+      return std::make_shared<QFStorage>(size, n_partitions, max_bytes);
   }
   std::shared_ptr<QFStorage> clone() const;
 
@@ -100,9 +199,33 @@ public:
   // get the count for the given k-mer hash.
   const count_t query(value_type khash) const;
 
+  // Batched variants: the home block of every key in a batch is
+  // prefetched before any are touched.
+  uint64_t insert_many(const value_type * khashes, size_t n, count_t * counts);
+
+  void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
+  const uint16_t n_partitions() const { return _n_partitions; }
+
+  // bytes budgeted for the storage, 0 if unbounded
+  const uint64_t max_bytes() const { return _max_bytes; }
+
+  // bytes held by the CQF blocks, not counting the overflow tier
+  const uint64_t n_bytes() const {
+      return __atomic_load_n(&_n_bytes, __ATOMIC_RELAXED);
+  }
+
+  // number of filters in the partition's growth chain
+  const size_t n_filters(size_t partition) const;
+
+  // true once any partition has fallen over to the overflow tier,
+  // after which counts are no longer exact
+  const bool overflowed() const { return bool(_overflow); }
+
   // Accessors for protected/private table info members
   // xnslots is larger than nslots. It includes some extra slots to deal
-  // with some details of how the counting is implemented
+  // with some details of how the counting is implemented; the sizes of
+  // the partitions are summed into the one table.
   std::vector<uint64_t> get_tablesizes() const;
   const size_t n_tables() const { return 1; }
   
@@ -112,20 +235,45 @@ public:
   void save(std::string outfilename, uint16_t ksize);
   void load(std::string infilename, uint16_t &ksize);
 
+  // Save in the page-aligned mapped format, and map such a file in place
+  // of the filters' blocks; see MappedFile. Without writable, the blocks
+  // are read-only and inserting throws. Filters added by later growth
+  // live on the heap as usual.
+  void save_mapped(std::string outfilename, uint16_t ksize);
+  void load_mapped(std::string infilename, uint16_t &ksize, bool writable = false);
+
+  // Add other's counts to ours; the partitions are merged in parallel.
+  // The storages need the same number of partitions, and neither may have
+  // overflowed. Each of other's filters is combined with qf_merge into a
+  // fresh copy of a filter of ours with the same range if the result
+  // stays under MERGE_CAPACITY, and is otherwise copied onto our chain;
+  // counts are summed across the chain either way. Throws, leaving this
+  // unchanged, if the copies don't fit in the budget, or if a combined
+  // filter holds fewer counts than went into it. The distinct count
+  // is estimated: a k-mer already in a filter more than MERGE_MAX_PROBES
+  // times wider than the one of other's holding it is counted again, and
+  // false positives can hide new ones. Intersection and difference aren't
+  // offered, since keys in filters of different ranges can't be matched.
+  void merge(const QFStorage& other);
+
   byte_t **get_raw_tables() { return nullptr; }
-  void reset() {}; //nop
+
+  metrics::MemoryUsage memory_usage() const;
+
+  // Drop the growth chains and the overflow tier, leaving each partition
+  // a single empty filter of the original size on the heap. Not safe to
+  // run alongside inserts.
+  void reset();
 
   double estimated_fp() {
-      double fp = n_occupied() / get_tablesizes()[0];
+      double fp = (double) n_occupied() / get_tablesizes()[0];
       fp = pow(fp, n_tables());
       return fp;
   }
 
-  static std::shared_ptr<QFStorage> deserialize(std::ifstream& in) {
-    return {};
-  }
+  static std::shared_ptr<QFStorage> deserialize(std::ifstream& in);
 
-  void serialize(std::ofstream& out) {}
+  void serialize(std::ofstream& out);
 
 
 };
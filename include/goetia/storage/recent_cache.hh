@@ -0,0 +1,207 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : recent_cache.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_RECENT_CACHE_HH
+#define GOETIA_RECENT_CACHE_HH
+
+#include "goetia/goetia.hh"
+#include "goetia/metrics.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/flathash.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+namespace goetia {
+namespace storage {
+
+/*
+ * \class RecentCache
+ *
+ * \brief A direct-mapped cache of hashes recently confirmed present in a
+ *        presence storage, kept in front of it so that inserts and
+ *        queries of those hashes skip the storage.
+ *
+ * Each hash has one slot, picked by its mixed hash; remembering a hash
+ * evicts whatever was there. A hit means the hash was inserted, so a hit
+ * can only stand in for a storage which never forgets and whose counts
+ * are all 1: it can't be put in front of a counting storage, and it must
+ * be cleared along with the storage.
+ *
+ * Slots are read and written with relaxed atomics, so threads may share
+ * the cache: a slot always holds some hash that was present. Hits and
+ * misses are kept as metrics gauges; callers add them up a batch at a
+ * time with record. Single lookups go to record_hit and record_miss,
+ * which tally into a per-thread stripe and publish to the gauges every
+ * PUBLISH_EVERY, so that concurrent callers don't contend on the gauges.
+ * hit_rate counts the unpublished tallies; flush publishes them.
+ */
+class RecentCache {
+
+    // 0 marks an empty slot, so a hash of 0 is never cached
+    static constexpr uint64_t EMPTY = 0;
+
+    std::vector<uint64_t> _slots;
+    uint8_t               _shift;
+
+    inline uint64_t _slot(uint64_t h) const {
+        return flat::mix(h) >> _shift;
+    }
+
+    // Single-lookup tallies, one cache line each.
+    struct alignas(64) Stripe {
+        uint64_t hits   = 0;
+        uint64_t misses = 0;
+    };
+
+    static constexpr size_t N_STRIPES = 16;
+
+    std::array<Stripe, N_STRIPES> _stripes;
+
+    // Threads take stripes round-robin on first use.
+    static inline size_t _stripe_index() {
+        static std::atomic<size_t> next(0);
+        thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed)
+                                          % N_STRIPES;
+        return index;
+    }
+
+    inline void _tally(uint64_t& tally, metrics::Gauge& gauge) {
+        if (__atomic_add_fetch(&tally, 1, __ATOMIC_RELAXED) >= PUBLISH_EVERY) {
+            _publish(tally, gauge);
+        }
+    }
+
+    static inline void _publish(uint64_t& tally, metrics::Gauge& gauge) {
+        const uint64_t n = __atomic_exchange_n(&tally, 0, __ATOMIC_RELAXED);
+        if (n) {
+            gauge.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+public:
+
+    // about a core's L2
+    static constexpr size_t DEFAULT_BYTES = 1 << 18;
+    static constexpr size_t MIN_SLOTS     = 64;
+    // single lookups a stripe tallies before publishing
+    static constexpr uint64_t PUBLISH_EVERY = 1024;
+
+    metrics::Gauge n_hits;
+    metrics::Gauge n_misses;
+
+    // The largest power-of-two number of slots that fits in bytes.
+    RecentCache(size_t bytes = DEFAULT_BYTES)
+        : n_hits   {"recent_cache", "hit"},
+          n_misses {"recent_cache", "miss"}
+    {
+        size_t n_slots = MIN_SLOTS;
+        while (n_slots * 2 * sizeof(uint64_t) <= bytes) {
+            n_slots <<= 1;
+        }
+        _slots.assign(n_slots, EMPTY);
+        _shift = 64 - __builtin_ctzll(n_slots);
+    }
+
+    RecentCache(const RecentCache&) = delete;
+    RecentCache& operator=(const RecentCache&) = delete;
+
+    inline bool contains(uint64_t h) const {
+        return h != EMPTY && __atomic_load_n(&_slots[_slot(h)], __ATOMIC_RELAXED) == h;
+    }
+
+    // Remember a hash now present in the storage.
+    inline void remember(uint64_t h) {
+        __atomic_store_n(&_slots[_slot(h)], h, __ATOMIC_RELAXED);
+    }
+
+    inline void record(uint64_t hits, uint64_t misses) {
+        if (hits) {
+            n_hits.fetch_add(hits, std::memory_order_relaxed);
+        }
+        if (misses) {
+            n_misses.fetch_add(misses, std::memory_order_relaxed);
+        }
+    }
+
+    inline void record_hit() {
+        _tally(_stripes[_stripe_index()].hits, n_hits);
+    }
+
+    inline void record_miss() {
+        _tally(_stripes[_stripe_index()].misses, n_misses);
+    }
+
+    // Publish every stripe's tallies to the gauges.
+    void flush() {
+        for (auto& stripe : _stripes) {
+            _publish(stripe.hits, n_hits);
+            _publish(stripe.misses, n_misses);
+        }
+    }
+
+    /**
+     * @Synopsis  Split a batch into the hashes the cache doesn't hold,
+     *            appended to misses with their batch positions, and record
+     *            the hits and misses.
+     *
+     * @Returns   Number of hits.
+     */
+    size_t filter(const uint64_t *       hashes,
+                  size_t                 n,
+                  std::vector<uint64_t>& misses,
+                  std::vector<size_t>&   positions)
+    {
+        const size_t n_misses_before = misses.size();
+        for (size_t i = 0; i < n; ++i) {
+            if (!contains(hashes[i])) {
+                misses.push_back(hashes[i]);
+                positions.push_back(i);
+            }
+        }
+        const size_t n_new_misses = misses.size() - n_misses_before;
+        record(n - n_new_misses, n_new_misses);
+        return n - n_new_misses;
+    }
+
+    // Forget every hash, eg when the storage is reset; keeps the gauges.
+    void clear() {
+        for (auto& slot : _slots) {
+            __atomic_store_n(&slot, EMPTY, __ATOMIC_RELAXED);
+        }
+    }
+
+    const size_t n_slots() const {
+        return _slots.size();
+    }
+
+    const size_t n_bytes() const {
+        return _slots.size() * sizeof(uint64_t);
+    }
+
+    // Fraction of lookups which hit; 0 before any.
+    const double hit_rate() const {
+        double hits = n_hits.load(std::memory_order_relaxed);
+        double misses = n_misses.load(std::memory_order_relaxed);
+        for (const auto& stripe : _stripes) {
+            hits += __atomic_load_n(&stripe.hits, __ATOMIC_RELAXED);
+            misses += __atomic_load_n(&stripe.misses, __ATOMIC_RELAXED);
+        }
+        const double total = hits + misses;
+        return total > 0 ? hits / total : 0.0;
+    }
+};
+
+}
+}
+
+#endif
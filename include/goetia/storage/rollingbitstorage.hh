@@ -0,0 +1,221 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : rollingbitstorage.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+
+#ifndef GOETIA_ROLLINGBITSTORAGE_HH
+#define GOETIA_ROLLINGBITSTORAGE_HH
+
+#include "goetia/meta.hh"
+#include "goetia/storage/storage.hh"
+#include "goetia/storage/bitstorage.hh"
+#include "goetia/storage/table_allocator.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace goetia {
+namespace storage {
+
+
+/*
+ * \class RollingBitStorage
+ *
+ * \brief A Bloom filter over a sliding window of a stream, for feeds too
+ *        long for any one filter.
+ *
+ * The storage is a ring of n_generations BitStorage filters. Inserts go
+ * to the current generation, and queries report a hash present if any
+ * generation holds it. rotate() clears the oldest generation and makes it
+ * current, forgetting the hashes not seen since it was last current. A
+ * hash inserted again is set in the current generation too, so hashes
+ * that keep recurring survive rotation.
+ *
+ * Rotation can be driven two ways. With rotate_every set, the storage
+ * rotates itself once the current generation has taken that many new
+ * hashes, which bounds every generation's load and so the false positive
+ * rate. Otherwise, call rotate() from a FileProcessor interval to keep a
+ * window of reads; see goetia.storage.rotate_storage_callback.
+ *
+ * Memory is fixed at n_generations filters. A rotation racing inserts
+ * may lose some of them; queries racing a rotation may miss hashes of the
+ * generation being cleared.
+ */
+class RollingBitStorage : public Storage<uint64_t>,
+                          public Tagged<RollingBitStorage> {
+
+public:
+
+    using Storage<uint64_t>::value_type;
+
+    static constexpr uint16_t DEFAULT_N_GENERATIONS = 4;
+
+protected:
+
+    std::vector<std::shared_ptr<BitStorage>> _generations;
+    size_t   _current;
+    uint64_t _rotate_every;
+    // new hashes taken by the current generation
+    uint64_t _n_current;
+    uint64_t _n_rotations;
+    uint64_t _n_unique_kmers;
+    uint32_t _lock;
+
+    inline BitStorage& _current_generation() const {
+        return *_generations[__atomic_load_n(&_current, __ATOMIC_ACQUIRE)];
+    }
+
+    // Whether a generation other than the current one holds h.
+    inline bool _in_older(value_type h, size_t current) const {
+        for (size_t g = 0; g < _generations.size(); ++g) {
+            if (g != current && _generations[g]->query(h)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    RollingBitStorage(std::vector<std::shared_ptr<BitStorage>> generations,
+                      uint64_t                                 rotate_every);
+
+    // Rotate if the current generation is full; called by the insert
+    // which filled it, so only one thread does.
+    inline void _count_new(uint64_t n) {
+        if (_rotate_every) {
+            const uint64_t after = __sync_add_and_fetch(&_n_current, n);
+            if (after >= _rotate_every && after - n < _rotate_every) {
+                rotate();
+            }
+        }
+    }
+
+public:
+
+    RollingBitStorage(const std::vector<uint64_t>& tablesizes,
+                      uint16_t    n_generations = DEFAULT_N_GENERATIONS,
+                      uint64_t    rotate_every  = 0,
+                      TablePolicy policy        = TablePolicy());
+
+    RollingBitStorage(uint64_t    max_table,
+                      uint16_t    N,
+                      uint16_t    n_generations = DEFAULT_N_GENERATIONS,
+                      uint64_t    rotate_every  = 0,
+                      TablePolicy policy        = TablePolicy())
+        : RollingBitStorage(get_n_primes_near_x(N, max_table),
+                            n_generations,
+                            rotate_every,
+                            policy)
+    {
+    }
+
+    /**
+     * @Synopsis  A ring of n_generations filters, each of N tables of
+     *            about max_table bits.
+     *
+     * @Param rotate_every  New hashes per generation before rotating
+     *                      automatically; 0 rotates only on rotate().
+     */
+    static std::shared_ptr<RollingBitStorage> build(uint64_t    max_table,
+                                                    uint16_t    N,
+                                                    uint16_t    n_generations = DEFAULT_N_GENERATIONS,
+                                                    uint64_t    rotate_every  = 0,
+                                                    TablePolicy policy        = TablePolicy());
+
+    std::shared_ptr<RollingBitStorage> clone() const;
+
+    // Clear the oldest generation and make it current.
+    void rotate();
+
+    const size_t n_generations() const {
+        return _generations.size();
+    }
+
+    const uint64_t rotate_every() const {
+        return _rotate_every;
+    }
+
+    const uint64_t n_rotations() const {
+        return _n_rotations;
+    }
+
+    // The generation made current age rotations ago; 0 is the current.
+    std::shared_ptr<BitStorage> get_generation(size_t age) const;
+
+    std::vector<uint64_t> get_tablesizes() const {
+        return _generations.front()->get_tablesizes();
+    }
+
+    const size_t n_tables() const {
+        return _generations.front()->n_tables();
+    }
+
+    // Occupied bins of the current generation's first table.
+    const uint64_t n_occupied() const {
+        return _current_generation().n_occupied();
+    }
+
+    // Hashes new to the window when inserted, over the whole stream.
+    const uint64_t n_unique_kmers() const {
+        return _n_unique_kmers;
+    }
+
+    // Hashes in the window, from each generation's occupancy; hashes in
+    // several generations count once per generation.
+    const uint64_t estimated_cardinality() const;
+
+    // Chance that a hash in no generation is reported present.
+    double estimated_fp();
+
+    void save(std::string, uint16_t );
+
+    void load(std::string, uint16_t &);
+
+    const bool insert(value_type h);
+
+    const count_t insert_and_query(value_type h);
+
+    const count_t query(value_type h) const;
+
+    // Batched variant: each generation is queried with its own batched
+    // query, which prefetches.
+    void query_many(const value_type * khashes, size_t n, count_t * counts) const;
+
+    byte_t ** get_raw_tables() {
+        return _current_generation().get_raw_tables();
+    }
+
+    metrics::MemoryUsage memory_usage() const;
+
+    void reset();
+
+    static std::shared_ptr<RollingBitStorage> deserialize(std::ifstream& in);
+
+    void serialize(std::ofstream& out);
+};
+
+
+template<>
+struct is_probabilistic<RollingBitStorage> {
+    static const bool value = true;
+};
+
+template<>
+struct is_counting<RollingBitStorage> {
+    static const bool value = false;
+};
+
+template<>
+struct is_forgetful<RollingBitStorage> {
+    static const bool value = true;
+};
+
+}
+
+}
+#endif
@@ -12,6 +12,7 @@
 
 #include "goetia/meta.hh"
 #include "goetia/storage/storage.hh"
+#include "goetia/storage/bitstorage.hh"
 #include "goetia/storage/sparsepp/spp.h"
 
 #include <cstdint>
@@ -23,6 +24,16 @@ namespace goetia {
 namespace storage {
 
 
+/*
+ * \class SparseppSetStorage
+ *
+ * \brief An exact set of hashes backed by a sparsepp hash set.
+ *
+ * Built with max_bytes, the set may use all but 1 / OVERFLOW_BUDGET_SHARE
+ * of the budget (by an estimate of sparsepp's footprint); after that, new
+ * hashes go to a BitStorage sized from the remaining share. Queries check
+ * both, so the storage is exact only until overflowed() becomes true.
+ */
 class SparseppSetStorage : public Storage<uint64_t>,
                            public Tagged<SparseppSetStorage> {
 
@@ -34,17 +45,24 @@ public:
 protected:
 
     std::unique_ptr<store_type> _store;
+    uint64_t                    _max_bytes;
+    std::shared_ptr<BitStorage> _overflow;
+
+    void _make_overflow();
 
 public:
     
     template<typename... Args>
     SparseppSetStorage(Args&&... args)
+        : _max_bytes(0)
     {
         _store = std::make_unique<store_type>();
     }
 
     static std::shared_ptr<SparseppSetStorage> build();
 
+    static std::shared_ptr<SparseppSetStorage> build(uint64_t max_bytes);
+
     static std::shared_ptr<SparseppSetStorage> deserialize(std::ifstream& in);
 
     void serialize(std::ofstream& out);
@@ -53,6 +71,7 @@ public:
 
     void reset() {
         _store->clear();
+        _overflow.reset();
     }
 
     const uint64_t get_maxsize() const {
@@ -60,7 +79,27 @@ public:
     }
 
     const uint64_t n_unique_kmers() const {
-        return _store->size();
+        return _store->size() + (_overflow ? _overflow->n_unique_kmers() : 0);
+    }
+
+    const uint64_t estimated_cardinality() const {
+        return _store->size() + (_overflow ? _overflow->estimated_cardinality() : 0);
+    }
+
+    // bytes budgeted for the storage, 0 if unbounded
+    const uint64_t max_bytes() const {
+        return _max_bytes;
+    }
+
+    // Estimate of the set's footprint: the values themselves plus
+    // sparsepp's group headers, about half a byte per bucket.
+    const uint64_t n_bytes() const {
+        return _store->size() * sizeof(value_type) + _store->bucket_count() / 2;
+    }
+
+    // true once new hashes are going to the Bloom filter tier
+    const bool overflowed() const {
+        return bool(_overflow);
     }
 
     const uint64_t n_buckets() const {
@@ -71,6 +110,18 @@ public:
         return n_buckets();
     }
 
+    // Call f(hash, 1) for every hash. Hashes which went to the overflow
+    // tier can't be listed, so this throws once overflowed.
+    template<typename Func>
+    void for_each(Func f) const {
+        if (_overflow) {
+            throw GoetiaException("Can't list the hashes of an overflowed SparseppSetStorage");
+        }
+        for (const auto& h : *_store) {
+            f(h, 1);
+        }
+    }
+
     void save(std::string, uint16_t );
 
     void load(std::string, uint16_t &);
@@ -86,6 +137,8 @@ public:
         return nullptr;
     }
 
+    metrics::MemoryUsage memory_usage() const;
+
 };
 
 
@@ -99,6 +152,11 @@ struct is_counting<SparseppSetStorage> {
     static const bool value = false;
 };
 
+template<>
+struct is_enumerable<SparseppSetStorage> {
+    static const bool value = true;
+};
+
 }
 
 }
@@ -48,19 +48,28 @@
 
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 #include <array>
+#include <exception>
+#include <istream>
 #include <memory>
 #include <mutex>
+#include <ostream>
+#include <sstream> // IWYU pragma: keep
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "goetia/goetia.hh"
+#include "goetia/metrics.hh"
 
 
 #   define MAX_BIGCOUNT 65535
 #   define SAVED_SIGNATURE "OXLI"
 #   define SAVED_FORMAT_VERSION 4
+#   define SAVED_MAPPED_FORMAT_VERSION 6
 #   define SAVED_COUNTING_HT 1
 #   define SAVED_HASHBITS 2
 #   define SAVED_TAGS 3
@@ -69,6 +78,9 @@
 #   define SAVED_LABELSET 6
 #   define SAVED_SMALLCOUNT 7
 #   define SAVED_QFCOUNT 8
+#   define SAVED_BLOCKEDHASHBITS 9
+#   define SAVED_PARTITIONEDQFCOUNT 10
+#   define SAVED_FROZEN 11
 
 
 namespace goetia {
@@ -80,6 +92,32 @@ typedef uint8_t                     byte_t;
 typedef int16_t                     count_t;
 typedef std::pair<count_t, count_t> full_count_t;
 
+// Number of hashes whose table addresses are computed and prefetched
+// together by the batched insert_many / query_many paths.
+static constexpr size_t PREFETCH_BATCH = 16;
+
+// Most tables a multi-table sketch may have, as its file formats allow.
+static constexpr size_t MAX_TABLES = 255;
+
+// Bins the batched paths of multi-table sketches hold on the stack: a
+// full PREFETCH_BATCH of hashes with up to 16 tables, fewer with more.
+static constexpr size_t PREFETCH_BINS = PREFETCH_BATCH * 16;
+
+// Hashes per batch for a sketch with n_tables tables.
+inline size_t prefetch_batch(size_t n_tables) {
+    return n_tables ? std::max<size_t>(1, std::min(PREFETCH_BATCH, PREFETCH_BINS / n_tables))
+                    : PREFETCH_BATCH;
+}
+
+// Storages built with a byte budget keep 1 / OVERFLOW_BUDGET_SHARE of it
+// for the probabilistic tier they fall over to when the exact tier can
+// no longer grow.
+static constexpr uint64_t OVERFLOW_BUDGET_SHARE = 4;
+
+// Table operations split their tables into chunks of at least this many
+// bytes per thread; smaller tables aren't worth a thread.
+static constexpr size_t PARALLEL_CHUNK_BYTES = 1 << 22;
+
 template<class Storage> 
 struct is_probabilistic { 
     static const bool value = false;
@@ -90,6 +128,20 @@ struct is_counting {
     static const bool value = false;
 };
 
+// Storages which drop k-mers on their own, eg by rotating out old
+// generations, so that a k-mer once inserted may later be absent.
+template<class Storage>
+struct is_forgetful {
+    static const bool value = false;
+};
+
+// Exact storages which can list their hashes with for_each(f), calling
+// f(hash, count) for each.
+template<class Storage>
+struct is_enumerable {
+    static const bool value = false;
+};
+
 //
 // base Storage class for hashtable-related storage of information in memory.
 //
@@ -118,13 +170,72 @@ public:
     virtual const uint64_t n_occupied() const = 0;
     virtual const uint64_t n_unique_kmers() const = 0;
 
+    /**
+     * @Synopsis  Estimate of the number of distinct k-mers inserted.
+     *
+     * Unlike n_unique_kmers, which probabilistic storages can only count
+     * as the inserts which changed a bin, this corrects for collisions.
+     * It is computed from counters kept up to date by insert, so it is
+     * cheap and safe to poll during ingest. Exact storages return
+     * n_unique_kmers.
+     */
+    virtual const uint64_t estimated_cardinality() const
+    {
+        return n_unique_kmers();
+    }
+
     virtual const bool    insert(value_type khash ) = 0;
     virtual const count_t insert_and_query(value_type khash) = 0;
     virtual const count_t query(value_type khash) const = 0;
 
+    /**
+     * @Synopsis  Insert a batch of hashes.
+     *
+     * @Param khashes Pointer to the hash values.
+     * @Param n       Number of hashes.
+     * @Param counts  If non-null, receives the post-insertion count of
+     *                each hash, as returned by insert_and_query.
+     *
+     * @Returns   Number of hashes which were new.
+     */
+    virtual uint64_t insert_many(const value_type * khashes,
+                                 size_t             n,
+                                 count_t *          counts)
+    {
+        uint64_t n_new = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bool is_new = insert(khashes[i]);
+            n_new += is_new;
+            if (counts) {
+                counts[i] = is_new ? 1 : query(khashes[i]);
+            }
+        }
+        return n_new;
+    }
+
+    /**
+     * @Synopsis  Query a batch of hashes, writing their counts to counts.
+     */
+    virtual void query_many(const value_type * khashes,
+                            size_t             n,
+                            count_t *          counts) const
+    {
+        for (size_t i = 0; i < n; ++i) {
+            counts[i] = query(khashes[i]);
+        }
+    }
+
     virtual byte_t ** get_raw_tables() = 0;
     virtual void reset() = 0;
 
+    /**
+     * @Synopsis  Bytes the storage holds, by component. Sizes of tables
+     *            are exact; those of hash maps are estimates from their
+     *            sizes and bucket counts. Mapped tables count in full,
+     *            whether or not their pages are resident.
+     */
+    virtual metrics::MemoryUsage memory_usage() const = 0;
+
     void set_use_bigcount(bool b)
     {
         if (!_supports_bigcount) {
@@ -142,6 +253,134 @@ public:
 };
 
 
+/**
+ * @Synopsis  Write the Tagged<> name and ABI version of T at the head of
+ *            a serialized object; deserialize_tag<T> checks them.
+ */
+template<class T>
+inline void serialize_tag(std::ostream& out)
+{
+    const std::string name(T::NAME);
+    out.write(name.c_str(), name.size());
+    out.write(T::version_binary(), sizeof(T::OBJECT_ABI_VERSION));
+}
+
+
+template<class T>
+inline void deserialize_tag(std::istream& in)
+{
+    const std::string expected(T::NAME);
+    std::string name;
+    name.resize(expected.size());
+    size_t version;
+
+    in.read(&name[0], name.size());
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading tag for "
+                                  + expected);
+    } else if (name != expected) {
+        std::ostringstream err;
+        err << "File has wrong type tag: found "
+            << name
+            << ", should be "
+            << expected;
+        throw GoetiaFileException(err.str());
+    } else if (version != T::OBJECT_ABI_VERSION) {
+        std::ostringstream err;
+        err << "File has wrong binary version: found "
+            << std::to_string(version)
+            << ", expected "
+            << std::to_string(T::OBJECT_ABI_VERSION);
+        throw GoetiaFileException(err.str());
+    }
+}
+
+
+/**
+ * @Synopsis  Estimate distinct k-mers from the occupancy of a table.
+ *
+ * n k-mers each setting hashes_per_kmer of m bins are expected to leave
+ * m (1 - e^(-n hashes_per_kmer / m)) of them occupied, which this inverts.
+ * A full table is treated as one bin short of full.
+ *
+ * @Param occupied        Occupied bins.
+ * @Param bins            Total bins, m.
+ * @Param hashes_per_kmer Bins set by each k-mer.
+ */
+inline uint64_t occupancy_cardinality(uint64_t occupied,
+                                      uint64_t bins,
+                                      double   hashes_per_kmer = 1.0)
+{
+    if (bins == 0) {
+        return 0;
+    }
+    const double m = bins;
+    const double x = std::min<double>(occupied, m - 1);
+    return (uint64_t) std::llround(-m / hashes_per_kmer * std::log1p(-x / m));
+}
+
+
+// hardware_concurrency, capped at max_useful and at least 1
+inline size_t default_threads(size_t max_useful)
+{
+    return std::max<size_t>(1,
+        std::min<size_t>(std::thread::hardware_concurrency(), max_useful));
+}
+
+
+/**
+ * @Synopsis  Run f(t) for t in [0, n_threads) on their own threads. The
+ *            first exception raised is rethrown once all have finished.
+ */
+template <typename Func>
+inline void run_threads(size_t n_threads, Func f)
+{
+    std::vector<std::exception_ptr> errors(n_threads);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            try {
+                f(t);
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+
+/**
+ * @Synopsis  Call f(begin, end) over [0, n_bytes) split into cache-line
+ *            aligned chunks of at least PARALLEL_CHUNK_BYTES, in parallel.
+ */
+template <typename Func>
+inline void parallel_chunks(size_t n_bytes, Func f)
+{
+    const size_t n_threads = default_threads(n_bytes / PARALLEL_CHUNK_BYTES);
+    if (n_threads == 1) {
+        f(size_t(0), n_bytes);
+        return;
+    }
+    const size_t chunk = (n_bytes / n_threads + 63) & ~size_t(63);
+    run_threads(n_threads, [&](size_t t) {
+        const size_t begin = std::min(n_bytes, t * chunk);
+        const size_t end = t + 1 == n_threads ? n_bytes : std::min(n_bytes, begin + chunk);
+        f(begin, end);
+    });
+}
+
+
 inline bool is_prime(uint64_t n)
 {
     if (n < 2) {
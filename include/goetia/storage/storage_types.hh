@@ -1,6 +1,12 @@
 #include "goetia/storage/nibblestorage.hh"
 #include "goetia/storage/bitstorage.hh"
+#include "goetia/storage/blockedbitstorage.hh"
 #include "goetia/storage/storage.hh"
 #include "goetia/storage/qfstorage.hh"
 #include "goetia/storage/bytestorage.hh"
 #include "goetia/storage/sparseppstorage.hh"
+#include "goetia/storage/flatsetstorage.hh"
+#include "goetia/storage/flatcountstorage.hh"
+#include "goetia/storage/frozenstorage.hh"
+#include "goetia/storage/diskcountstorage.hh"
+#include "goetia/storage/rollingbitstorage.hh"
@@ -0,0 +1,136 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : table_allocator.hh
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#ifndef GOETIA_TABLE_ALLOCATOR_HH
+#define GOETIA_TABLE_ALLOCATOR_HH
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/storage.hh"
+
+
+namespace goetia {
+namespace storage {
+
+/*
+ * \struct TablePolicy
+ *
+ * \brief How a sketch storage's tables are allocated.
+ *
+ * pages picks the backing memory:
+ *   HEAP        the heap, zeroed with memset.
+ *   MMAP        anonymous mappings; the kernel zeroes pages lazily on
+ *               first touch, so there is no startup memset.
+ *   THP         MMAP aligned to 2 MB and advised for transparent huge
+ *               pages.
+ *   HUGETLB_2MB
+ *   HUGETLB_1GB explicit hugetlbfs pages of that size, which must be
+ *               reserved (vm.nr_hugepages); falls back to THP if none
+ *               are available.
+ *
+ * numa places the mapped pages:
+ *   NUMA_LOCAL      the kernel default, first touch.
+ *   NUMA_INTERLEAVE every table round-robin over all online nodes.
+ *   NUMA_SPREAD     table i preferring node i % n_nodes.
+ * Any NUMA placement implies at least MMAP pages. It does nothing on a
+ * single-node machine.
+ */
+struct TablePolicy {
+
+    enum Pages : uint8_t {
+        HEAP,
+        MMAP,
+        THP,
+        HUGETLB_2MB,
+        HUGETLB_1GB
+    };
+
+    enum Numa : uint8_t {
+        NUMA_LOCAL,
+        NUMA_INTERLEAVE,
+        NUMA_SPREAD
+    };
+
+    Pages pages;
+    Numa  numa;
+
+    TablePolicy(Pages pages = HEAP, Numa numa = NUMA_LOCAL)
+        : pages(pages == HEAP && numa != NUMA_LOCAL ? MMAP : pages),
+          numa(numa)
+    {
+    }
+
+    // Parse the names used on the command line, eg "thp", "interleave".
+    static TablePolicy from_names(const std::string& pages,
+                                  const std::string& numa = "local");
+};
+
+
+/*
+ * \class TableAllocator
+ *
+ * \brief Allocates a storage's zeroed tables under a TablePolicy and
+ *        frees them again.
+ *
+ * It remembers the length actually mapped for each table, which may
+ * differ from the requested policy after a hugetlbfs fallback, so it
+ * owns its tables and is not copyable.
+ */
+class TableAllocator {
+
+    TablePolicy _policy;
+    // length of each mapped table; heap tables aren't recorded
+    std::unordered_map<byte_t *, size_t> _mapped;
+
+    byte_t * _map(size_t bytes, TablePolicy::Pages pages, size_t& length);
+
+    void _place(byte_t * table, size_t length, size_t index) const;
+
+public:
+
+    TableAllocator(TablePolicy policy = TablePolicy())
+        : _policy(policy)
+    {
+    }
+
+    ~TableAllocator();
+
+    TableAllocator(const TableAllocator&) = delete;
+    TableAllocator& operator=(const TableAllocator&) = delete;
+
+    const TablePolicy& policy() const {
+        return _policy;
+    }
+
+    /**
+     * @Synopsis  Allocate a zeroed table of at least bytes.
+     *
+     * @Param bytes Size of the table.
+     * @Param index Which of the storage's tables this is, for NUMA_SPREAD.
+     */
+    byte_t * allocate(size_t bytes, size_t index = 0);
+
+    // Free a table from allocate; null is ignored.
+    void release(byte_t * table);
+
+    // Zero a table from allocate. Mapped tables are dropped back to the
+    // kernel rather than written.
+    void zero(byte_t * table, size_t bytes);
+
+    // Online NUMA nodes, from sysfs; 1 if unknown.
+    static size_t n_numa_nodes();
+};
+
+}
+}
+
+#endif
@@ -949,12 +949,10 @@ public:
                              std::vector<hash_type>&      decision_hashes,
                              std::vector<neighbor_pair_type>& decision_neighbors) {
 
-        hashing::KmerIterator<dBGWalker> iter(sequence, this);
         size_t pos = 0;
-        while(!iter.done()) {
-            hash_type h = iter.next();
+        for (const auto& h : hashing::KmerRange<dBGWalker>(sequence, *this)) {
             neighbor_pair_type neighbors;
-            if (get_decision_neighbors(iter.shifter,
+            if (get_decision_neighbors(this,
                                        neighbors)) {
 
                 decision_neighbors.push_back(neighbors);
@@ -17,11 +17,13 @@ set(_headers
     include/goetia/hashing/hashextender.hh
     include/goetia/hashing/kmeriterator.hh
     include/goetia/hashing/kmer_span.hh
+    include/goetia/hashing/multikhasher.hh
     include/goetia/hashing/shifter_types.hh
     include/goetia/hashing/rollinghash/characterhash.h
     include/goetia/hashing/rollinghash/cyclichash.h
     include/goetia/hashing/rollinghashshifter.hh
     include/goetia/hashing/smhasher/MurmurHash3.h
+    include/goetia/hashing/twobitshifter.hh
     include/goetia/hashing/unikmershifter.hh
     include/goetia/hashing/ukhs.hh
     include/goetia/interface.hh
@@ -40,9 +42,18 @@ set(_headers
     include/goetia/signatures/sourmash/sourmash.h
     include/goetia/signatures/sourmash_signature.hh
     include/goetia/signatures/ukhs_signature.hh
+    include/goetia/storage/bigcount_map.hh
     include/goetia/storage/bitstorage.hh
+    include/goetia/storage/blockedbitstorage.hh
     include/goetia/storage/bytestorage.hh
     include/goetia/storage/cqf/gqf.h
+    include/goetia/storage/flatcountstorage.hh
+    include/goetia/storage/frozenstorage.hh
+    include/goetia/storage/diskcountstorage.hh
+    include/goetia/storage/rollingbitstorage.hh
+    include/goetia/storage/flathash.hh
+    include/goetia/storage/flatsetstorage.hh
+    include/goetia/storage/mapped_file.hh
     include/goetia/storage/nibblestorage.hh
     include/goetia/storage/partitioned_storage.hh
     include/goetia/storage/qfstorage.hh
@@ -50,6 +61,7 @@ set(_headers
     include/goetia/storage/sparseppstorage.hh
     include/goetia/storage/storage.hh
     include/goetia/storage/storage_types.hh
+    include/goetia/storage/table_allocator.hh
     include/goetia/traversal.hh
     include/goetia/utils/stringutils.h
 )
@@ -57,10 +69,19 @@ set(_headers
 set(_sources
     src/goetia/pdbg.cc
     src/goetia/storage/qfstorage.cc
+    src/goetia/storage/bigcount_map.cc
     src/goetia/storage/bytestorage.cc
     src/goetia/storage/bitstorage.cc
+    src/goetia/storage/blockedbitstorage.cc
     src/goetia/storage/sparseppstorage.cc
+    src/goetia/storage/flatsetstorage.cc
+    src/goetia/storage/flatcountstorage.cc
+    src/goetia/storage/frozenstorage.cc
+    src/goetia/storage/diskcountstorage.cc
+    src/goetia/storage/rollingbitstorage.cc
     src/goetia/storage/nibblestorage.cc
+    src/goetia/storage/mapped_file.cc
+    src/goetia/storage/table_allocator.cc
     src/goetia/signatures/ukhs_signature.cc
     src/goetia/signatures/sourmash_signature.cc
     src/goetia/benchmarks/bench_storage.cc
@@ -68,7 +89,9 @@ set(_sources
     src/goetia/hashing/hashextender.cc
     src/goetia/hashing/kmeriterator.cc
     src/goetia/hashing/kmer_span.cc
+    src/goetia/hashing/multikhasher.cc
     src/goetia/hashing/rollinghashshifter.cc
+    src/goetia/hashing/twobitshifter.cc
     src/goetia/hashing/unikmershifter.cc
     src/goetia/hashing/smhasher/MurmurHash3.cc
     src/goetia/hashing/ukhs.cc
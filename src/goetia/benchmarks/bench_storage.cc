@@ -1,58 +1,445 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : bench_storage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
 #include "goetia/benchmarks/bench_storage.hh"
 
-#include "goetia/storage/bitstorage.hh"
-#include "goetia/storage/bytestorage.hh"
-#include "goetia/storage/nibblestorage.hh"
-#include "goetia/storage/sparseppstorage.hh"
+#include "goetia/hashing/kmeriterator.hh"
+#include "goetia/hashing/shifter_types.hh"
+#include "goetia/parsing/readers.hh"
+#include "goetia/storage/storage_types.hh"
 
-#include <iostream>
-#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
 #include <random>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace goetia {
 namespace bench {
 
-std::vector<uint64_t> generate_hashes(size_t n_hashes) {
-    std::random_device rd;
-    std::mt19937_64 gen(rd());
-    std::uniform_int_distribution<uint64_t> dis;
 
-    std::vector<uint64_t> hashes;
-    for (int n = 0; n < n_hashes; ++n) {
-        hashes.push_back(dis(gen));
+void
+BenchResult::to_json(std::ostream& out) const {
+    out << "{\"storage\": \"" << storage << "\", "
+        << "\"workload\": \"" << workload << "\", "
+        << "\"op\": \"" << op << "\", "
+        << "\"n_threads\": " << n_threads << ", "
+        << "\"n_ops\": " << n_ops << ", "
+        << "\"ns_per_op\": " << std::setprecision(6) << ns_per_op << ", "
+        << "\"cache_misses\": ";
+    if (cache_misses < 0) {
+        out << "null";
+    } else {
+        out << cache_misses;
+    }
+    out << ", \"bytes_per_kmer\": " << bytes_per_kmer << ", "
+        << "\"fp_rate\": " << fp_rate << "}";
+}
+
+
+void
+write_json(const std::vector<BenchResult>& results, std::ostream& out) {
+    out << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << (i ? ",\n " : "\n ");
+        results[i].to_json(out);
+    }
+    out << "\n]" << std::endl;
+}
+
+
+#ifdef __linux__
+
+CacheMissCounter::CacheMissCounter()
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+CacheMissCounter::~CacheMissCounter()
+{
+    if (_fd >= 0) {
+        close(_fd);
     }
+}
+
 
-    return hashes;
+void
+CacheMissCounter::start() {
+    if (_fd >= 0) {
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
 }
 
 
-void run_storage_bench() {
+int64_t
+CacheMissCounter::stop() {
+    if (_fd < 0) {
+        return -1;
+    }
+    ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+    int64_t count = 0;
+    if (read(_fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+    return count;
+}
 
-    std::vector<size_t> hashes_sizes = {1000000, 10000000, 100000000};
+#else
 
+CacheMissCounter::CacheMissCounter() : _fd(-1) { }
 
-    std::unique_ptr<storage::BitStorage> bitstorage;
-    std::unique_ptr<storage::NibbleStorage> nibblestorage;
-    std::unique_ptr<storage::ByteStorage> bytestorage;
-    std::unique_ptr<storage::SparseppSetStorage> sparseppstorage;
-    
-    std::cout << "storage_type, n_hashes, bench, time" << std::endl;
-    for (auto n_hashes : hashes_sizes) {
-        bitstorage = std::make_unique<storage::BitStorage>(n_hashes / 4, 4);
-        nibblestorage = std::make_unique<storage::NibbleStorage>(n_hashes / 4, 4);
-        bytestorage = std::make_unique<storage::ByteStorage>(n_hashes / 4, 4);
-        sparseppstorage  = std::make_unique<storage::SparseppSetStorage>();
+CacheMissCounter::~CacheMissCounter() { }
 
-        auto hashes = generate_hashes(n_hashes);
+void CacheMissCounter::start() { }
+
+int64_t CacheMissCounter::stop() {
+    return -1;
+}
 
-        for (size_t N = 0; N < 3; ++N) {
-            _run_storage_bench(bitstorage, hashes, "BitStorage");
-            _run_storage_bench(nibblestorage, hashes, "NibbleStorage");
-            _run_storage_bench(bytestorage, hashes, "ByteStorage");
-            _run_storage_bench(sparseppstorage, hashes, "SparseppSetStorage");
+#endif
+
+
+std::vector<std::string>
+simulate_reads(uint64_t genome_size,
+               size_t   read_length,
+               uint64_t n_bases,
+               double   zipf_s,
+               uint64_t seed) {
+    if (genome_size < read_length) {
+        throw GoetiaException("Simulated genome is shorter than a read.");
+    }
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<int> base(0, 3);
+    const char bases[] = "ACGT";
+
+    std::string genome(genome_size, 'A');
+    for (auto& b : genome) {
+        b = bases[base(gen)];
+    }
+
+    // read starts are drawn from windows of a read length, the i-th most
+    // covered with weight 1 / i^s, in shuffled genome order
+    const size_t n_windows = (genome_size - read_length) / read_length + 1;
+    std::vector<double> cumulative(n_windows);
+    double total = 0.0;
+    for (size_t i = 0; i < n_windows; ++i) {
+        total += 1.0 / std::pow(i + 1, zipf_s);
+        cumulative[i] = total;
+    }
+    std::vector<size_t> order(n_windows);
+    for (size_t i = 0; i < n_windows; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), gen);
+
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    std::uniform_int_distribution<size_t> jitter(0, read_length - 1);
+    std::vector<std::string> reads;
+    for (uint64_t n = 0; n < n_bases; n += read_length) {
+        const size_t rank = std::lower_bound(cumulative.begin(), cumulative.end(),
+                                             uniform(gen)) - cumulative.begin();
+        const size_t start = std::min(order[std::min(rank, n_windows - 1)] * read_length
+                                      + jitter(gen),
+                                      genome_size - read_length);
+        reads.push_back(genome.substr(start, read_length));
+    }
+    return reads;
+}
+
+
+std::vector<std::string>
+load_reads(const std::string& filename, uint64_t max_bases) {
+    parsing::FastxParser<> parser(filename);
+    std::vector<std::string> reads;
+    uint64_t n_bases = 0;
+    while (!parser.is_complete() && n_bases < max_bases) {
+        auto record = parser.next();
+        if (record) {
+            n_bases += record->sequence.size();
+            reads.push_back(std::move(record->sequence));
         }
     }
+    return reads;
 }
 
+
+template<class ShifterType>
+Workload
+make_workload(const std::string&              name,
+              const std::string&              shifter_name,
+              const std::vector<std::string>& reads,
+              uint16_t                        K,
+              uint64_t                        max_hashes,
+              uint64_t                        seed,
+              BenchResult&                    hashing) {
+    Workload workload;
+    workload.name = name;
+    workload.K = K;
+
+    ShifterType shifter(K);
+    int64_t cache_misses;
+    CacheMissCounter counter;
+    counter.start();
+    auto time_start = bench_clock::now();
+    for (const auto& read : reads) {
+        if (read.size() < K || workload.hashes.size() >= max_hashes) {
+            continue;
+        }
+        for (const auto& h : hashing::KmerRange<ShifterType>(read, shifter)) {
+            if (workload.hashes.size() >= max_hashes) {
+                break;
+            }
+            workload.hashes.push_back(h.value());
+        }
+    }
+    const double elapsed = std::chrono::duration<double>(bench_clock::now() - time_start).count();
+    cache_misses = counter.stop();
+
+    std::unordered_set<uint64_t> distinct(workload.hashes.begin(), workload.hashes.end());
+    workload.n_distinct = distinct.size();
+
+    std::mt19937_64 gen(seed);
+    const size_t n_absent = std::min<uint64_t>(workload.n_distinct, 1000000);
+    while (workload.absent.size() < n_absent) {
+        const uint64_t hash = gen();
+        if (!distinct.count(hash)) {
+            workload.absent.push_back(hash);
+        }
+    }
+
+    hashing = {shifter_name, name, "hash", 1, workload.hashes.size(),
+               elapsed * 1e9 / std::max<size_t>(workload.hashes.size(), 1),
+               cache_misses, 0.0, 0.0};
+    return workload;
+}
+
+
+std::vector<size_t>
+thread_counts(size_t max_threads) {
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(std::max<size_t>(max_threads, 1));
+    return counts;
+}
+
+
+/**
+ * @Synopsis  FrozenStorage can't be inserted into: freeze an exact count
+ *            of the workload, timed as its insert, then query at each
+ *            thread count.
+ */
+static std::vector<BenchResult>
+bench_frozen(const Workload& workload, const std::vector<size_t>& n_threads) {
+    std::vector<BenchResult> results;
+    const auto& hashes = workload.hashes;
+    const double n_ops = std::max<size_t>(hashes.size(), 1);
+
+    auto source = storage::FlatCountStorage::build();
+    for (auto hash : hashes) {
+        source->insert(hash);
+    }
+    int64_t build_misses;
+    std::shared_ptr<storage::FrozenStorage> frozen;
+    double build_time = run_threaded(1, 1,
+        [&](size_t, size_t) {
+            frozen = storage::FrozenStorage::freeze(*source);
+        }, build_misses);
+    source.reset();
+
+    const double bytes = bytes_per_kmer(*frozen, workload);
+    const double fp = false_positive_rate(*frozen, workload);
+    results.push_back({"FrozenStorage", workload.name, "build", 1, workload.n_distinct,
+                       build_time * 1e9 / std::max<uint64_t>(workload.n_distinct, 1),
+                       build_misses, bytes, fp});
+
+    for (auto threads : n_threads) {
+        int64_t query_misses;
+        std::atomic<uint64_t> sink(0);
+        double query_time = run_threaded(hashes.size(), threads,
+            [&](size_t begin, size_t end) {
+                uint64_t total = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    total += frozen->query(hashes[i]);
+                }
+                sink.fetch_add(total, std::memory_order_relaxed);
+            }, query_misses);
+        results.push_back({"FrozenStorage", workload.name, "query", threads, hashes.size(),
+                           query_time * 1e9 / n_ops, query_misses, bytes, fp});
+    }
+    return results;
+}
+
+
+std::vector<BenchResult>
+run_storage_bench(const BenchOptions& options) {
+    using namespace storage;
+
+    std::vector<std::string> reads;
+    if (options.reads_file.empty()) {
+        // about max_hashes k-mers of 150 bp reads, or of K bp reads
+        // when K is longer
+        const size_t read_length = std::max<size_t>(150, options.K);
+        reads = simulate_reads(options.genome_size, read_length,
+                               options.max_hashes * read_length
+                               / (read_length - options.K + 1),
+                               options.zipf_s, options.seed);
+    } else {
+        reads = load_reads(options.reads_file, UINT64_MAX);
+    }
+
+    std::vector<BenchResult> results;
+    std::vector<Workload> workloads;
+    const std::string source = options.reads_file.empty() ? "zipf" : "reads";
+    BenchResult hashing;
+    workloads.push_back(make_workload<hashing::FwdLemireShifter>(
+        source + ":FwdLemireShifter", "FwdLemireShifter", reads, options.K,
+        options.max_hashes, options.seed, hashing));
+    results.push_back(hashing);
+    workloads.push_back(make_workload<hashing::CanLemireShifter>(
+        source + ":CanLemireShifter", "CanLemireShifter", reads, options.K,
+        options.max_hashes, options.seed, hashing));
+    results.push_back(hashing);
+    // two-bit hashes are the k-mers themselves, so only go to K=32
+    if (options.K <= 32) {
+        workloads.push_back(make_workload<hashing::FwdTwoBitShifter>(
+            source + ":FwdTwoBitShifter", "FwdTwoBitShifter", reads, options.K,
+            options.max_hashes, options.seed, hashing));
+        results.push_back(hashing);
+        workloads.push_back(make_workload<hashing::CanTwoBitShifter>(
+            source + ":CanTwoBitShifter", "CanTwoBitShifter", reads, options.K,
+            options.max_hashes, options.seed, hashing));
+        results.push_back(hashing);
+    }
+    reads.clear();
+
+    const std::string scratch = options.scratch_dir.empty()
+                                ? std::filesystem::temp_directory_path().string()
+                                : options.scratch_dir;
+    const auto n_threads = thread_counts(options.max_threads);
+    auto selected = [&](const std::string& name) {
+        return options.storages.empty()
+               || std::find(options.storages.begin(), options.storages.end(), name)
+                  != options.storages.end();
+    };
+    auto extend = [&](std::vector<BenchResult>&& more) {
+        results.insert(results.end(), more.begin(), more.end());
+    };
+
+    for (const auto& workload : workloads) {
+        // sketches get about a byte of bit tables, or four counters, per
+        // distinct k-mer
+        const uint64_t n = std::max<uint64_t>(workload.n_distinct, 1000);
+        int qf_size = 1;
+        while ((1ULL << qf_size) < n + n / 4) {
+            ++qf_size;
+        }
+
+        if (selected("BitStorage")) {
+            extend(bench_storage<BitStorage>("BitStorage",
+                [=]() { return BitStorage::build(n * 2, 4); },
+                true, workload, n_threads));
+        }
+        if (selected("BlockedBitStorage")) {
+            extend(bench_storage<BlockedBitStorage>("BlockedBitStorage",
+                [=]() { return BlockedBitStorage::build(n * 8, 4); },
+                true, workload, n_threads));
+        }
+        if (selected("RollingBitStorage")) {
+            extend(bench_storage<RollingBitStorage>("RollingBitStorage",
+                [=]() { return RollingBitStorage::build(n * 2, 4); },
+                true, workload, n_threads));
+        }
+        if (selected("NibbleStorage")) {
+            extend(bench_storage<NibbleStorage>("NibbleStorage",
+                [=]() { return NibbleStorage::build(n, 4); },
+                true, workload, n_threads));
+        }
+        if (selected("ByteStorage")) {
+            extend(bench_storage<ByteStorage>("ByteStorage",
+                [=]() { return ByteStorage::build(n, 4); },
+                true, workload, n_threads));
+        }
+        if (selected("QFStorage")) {
+            extend(bench_storage<QFStorage>("QFStorage",
+                [=]() { return QFStorage::build(qf_size, 16); },
+                true, workload, n_threads));
+        }
+        if (selected("SparseppSetStorage")) {
+            extend(bench_storage<SparseppSetStorage>("SparseppSetStorage",
+                []() { return SparseppSetStorage::build(); },
+                false, workload, n_threads));
+        }
+        if (selected("FlatSetStorage")) {
+            extend(bench_storage<FlatSetStorage>("FlatSetStorage",
+                []() { return FlatSetStorage::build(); },
+                false, workload, n_threads));
+        }
+        if (selected("FlatCountStorage")) {
+            extend(bench_storage<FlatCountStorage>("FlatCountStorage",
+                []() { return FlatCountStorage::build(); },
+                true, workload, n_threads));
+        }
+        if (selected("DiskCountStorage")) {
+            extend(bench_storage<DiskCountStorage>("DiskCountStorage",
+                [=]() { return DiskCountStorage::build(scratch, 64ULL << 20, 16); },
+                true, workload, n_threads));
+        }
+        if (selected("FrozenStorage")) {
+            extend(bench_frozen(workload, n_threads));
+        }
+    }
+
+    return results;
+}
+
+
+template Workload make_workload<hashing::FwdLemireShifter>(const std::string&,
+                                                           const std::string&,
+                                                           const std::vector<std::string>&,
+                                                           uint16_t, uint64_t, uint64_t,
+                                                           BenchResult&);
+template Workload make_workload<hashing::CanLemireShifter>(const std::string&,
+                                                           const std::string&,
+                                                           const std::vector<std::string>&,
+                                                           uint16_t, uint64_t, uint64_t,
+                                                           BenchResult&);
+template Workload make_workload<hashing::FwdTwoBitShifter>(const std::string&,
+                                                           const std::string&,
+                                                           const std::vector<std::string>&,
+                                                           uint16_t, uint64_t, uint64_t,
+                                                           BenchResult&);
+template Workload make_workload<hashing::CanTwoBitShifter>(const std::string&,
+                                                           const std::string&,
+                                                           const std::vector<std::string>&,
+                                                           uint16_t, uint64_t, uint64_t,
+                                                           BenchResult&);
+
 }
 }
@@ -1,8 +1,75 @@
 #include "goetia/benchmarks/bench_storage.hh"
 
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
 using namespace goetia;
 using namespace goetia::bench;
 
-int main() {
-    run_storage_bench();
+
+static void usage() {
+    std::cerr << "usage: do_bench_storage [--reads FILE] [-K K] [--hashes N]\n"
+                 "                        [--genome-size N] [--zipf S] [--threads N]\n"
+                 "                        [--seed N] [--scratch DIR]\n"
+                 "                        [--storages A,B,...] [--out FILE]\n"
+                 "\n"
+                 "Benchmarks every storage on the k-mers of the reads, or of reads\n"
+                 "simulated with Zipfian coverage, and writes the results as JSON.\n";
+}
+
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    std::string out_file;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value(argv[++i]);
+        if (arg == "--reads") {
+            options.reads_file = value;
+        } else if (arg == "-K") {
+            options.K = std::stoul(value);
+        } else if (arg == "--hashes") {
+            options.max_hashes = std::stoull(value);
+        } else if (arg == "--genome-size") {
+            options.genome_size = std::stoull(value);
+        } else if (arg == "--zipf") {
+            options.zipf_s = std::stod(value);
+        } else if (arg == "--threads") {
+            options.max_threads = std::stoul(value);
+        } else if (arg == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (arg == "--scratch") {
+            options.scratch_dir = value;
+        } else if (arg == "--storages") {
+            std::stringstream names(value);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                options.storages.push_back(name);
+            }
+        } else if (arg == "--out") {
+            out_file = value;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    auto results = run_storage_bench(options);
+    if (out_file.empty()) {
+        write_json(results, std::cout);
+    } else {
+        std::ofstream out(out_file);
+        write_json(results, out);
+    }
 }
@@ -20,6 +20,9 @@ template class cdbg::cDBG<dBG<storage::BitStorage, hashing::CanLemireShifter>>;
 template class cdbg::cDBG<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
 template class cdbg::cDBG<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
 
+template class cdbg::cDBG<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+template class cdbg::cDBG<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+
 template class cdbg::cDBG<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
 template class cdbg::cDBG<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
 
@@ -19,11 +19,42 @@ namespace goetia {
     template class dBG<storage::BitStorage, hashing::CanLemireShifter>;
     template class dBG<storage::BitStorage, hashing::FwdUnikmerShifter>;
     template class dBG<storage::BitStorage, hashing::CanUnikmerShifter>;
+    template class dBG<storage::BitStorage, hashing::FwdTwoBitShifter>;
+    template class dBG<storage::BitStorage, hashing::CanTwoBitShifter>;
+
+    template class dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>;
 
     template class dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>;
     template class dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>;
     template class dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>;
     template class dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>;
+    template class dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>;
+    template class dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>;
+
+    template class dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::FlatSetStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>;
+
+    template class dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::FlatCountStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>;
+    template class dBG<storage::FrozenStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::FrozenStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>;
+    template class dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::DiskCountStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>;
+    template class dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>;
+    template class dBG<storage::RollingBitStorage, hashing::CanLemireShifter>;
+    template class dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>;
+    template class dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>;
 
     template class dBG<storage::ByteStorage, hashing::FwdLemireShifter>;
     template class dBG<storage::ByteStorage, hashing::CanLemireShifter>;
@@ -45,11 +76,42 @@ namespace goetia {
     template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanLemireShifter>>;
     template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::FwdUnikmerShifter>>;
     template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::FwdTwoBitShifter>>;
+    template class hashing::KmerIterator<dBG<storage::BitStorage, hashing::CanTwoBitShifter>>;
+
+    template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>>;
 
     template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
     template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
     template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>>;
     template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>>;
+    template class hashing::KmerIterator<dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>>;
+
+    template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>>;
+
+    template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::CanLemireShifter>>;
+    template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>>;
+    template class hashing::KmerIterator<dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>>;
 
     template class hashing::KmerIterator<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
     template class hashing::KmerIterator<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
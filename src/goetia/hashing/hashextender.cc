@@ -25,10 +25,25 @@ namespace goetia::hashing {
     template class HashExtender<FwdUnikmerShifter>;
     template class HashExtender<CanUnikmerShifter>;
 
+    template class HashExtender<FwdTwoBitShifter>;
+    template class HashExtender<CanTwoBitShifter>;
+
     template class KmerIterator<FwdRollingExtender>;
     template class KmerIterator<CanRollingExtender>;
 
     template class KmerIterator<FwdUnikmerExtender>;
     template class KmerIterator<CanUnikmerExtender>;
 
+    template class KmerIterator<FwdTwoBitExtender>;
+    template class KmerIterator<CanTwoBitExtender>;
+
+    template class KmerRange<FwdRollingExtender>;
+    template class KmerRange<CanRollingExtender>;
+
+    template class KmerRange<FwdUnikmerExtender>;
+    template class KmerRange<CanUnikmerExtender>;
+
+    template class KmerRange<FwdTwoBitExtender>;
+    template class KmerRange<CanTwoBitExtender>;
+
 }
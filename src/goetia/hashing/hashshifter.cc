@@ -19,3 +19,35 @@ template goetia::hashing::HashShifter<goetia::hashing::FwdLemirePolicy>::HashShi
 template class goetia::hashing::HashShifter<goetia::hashing::CanLemirePolicy>;
 template goetia::hashing::HashShifter<goetia::hashing::CanLemirePolicy>::HashShifter(uint16_t);
 template goetia::hashing::HashShifter<goetia::hashing::CanLemirePolicy>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Hash<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Canonical<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<21>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Hash<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Canonical<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<25>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Hash<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Canonical<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<31>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Hash<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Hash<uint64_t>>>::HashShifter(const std::string&, uint16_t);
+
+template class goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Canonical<uint64_t>>>;
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(uint16_t);
+template goetia::hashing::HashShifter<goetia::hashing::FixedLemire<51>::Policy<goetia::hashing::Canonical<uint64_t>>>::HashShifter(const std::string&, uint16_t);
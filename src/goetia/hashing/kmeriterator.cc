@@ -17,4 +17,16 @@ namespace goetia::hashing {
     template class KmerIterator<FwdUnikmerShifter>;
     template class KmerIterator<CanUnikmerShifter>;
 
+    template class KmerIterator<FwdTwoBitShifter>;
+    template class KmerIterator<CanTwoBitShifter>;
+
+    template class KmerRange<FwdLemireShifter>;
+    template class KmerRange<CanLemireShifter>;
+
+    template class KmerRange<FwdUnikmerShifter>;
+    template class KmerRange<CanUnikmerShifter>;
+
+    template class KmerRange<FwdTwoBitShifter>;
+    template class KmerRange<CanTwoBitShifter>;
+
 }
@@ -0,0 +1,59 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : multikhasher.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include <string>
+
+#include "goetia/hashing/multikhasher.hh"
+
+
+namespace goetia::hashing {
+
+
+template<class HashType>
+MultiKHasher<HashType>::MultiKHasher(const std::vector<uint16_t>& Ks)
+    : _Ks(Ks),
+      _values(Ks.size())
+{
+    if (Ks.empty()) {
+        throw GoetiaException("MultiKHasher needs at least one K");
+    }
+    for (auto K : Ks) {
+        if (K == 0) {
+            throw GoetiaException("MultiKHasher can't hash with K=0");
+        }
+    }
+}
+
+
+template<class HashType>
+void
+MultiKHasher<HashType>::hash_sequence(const char * sequence, size_t length) {
+    _fw_prefix.resize(length + 1);
+    if constexpr (canonical) {
+        _rc_prefix.resize(length + 1);
+        lemire::hash_prefixes(sequence, length, lemire::complement_hashes<alphabet>(),
+                              _fw_prefix.data(), _rc_prefix.data());
+    } else {
+        lemire::hash_prefixes(sequence, length, nullptr, _fw_prefix.data(), nullptr);
+    }
+
+    for (size_t i = 0; i < _Ks.size(); ++i) {
+        const uint16_t K = _Ks[i];
+        const size_t n_kmers = length >= K ? length - K + 1 : 0;
+        _values[i].resize(n_kmers);
+        lemire::hash_kmers_prefixed(_fw_prefix.data(),
+                                    canonical ? _rc_prefix.data() : nullptr,
+                                    n_kmers, K, _values[i].data(), nullptr, nullptr);
+    }
+}
+
+
+template class MultiKHasher<Hash<uint64_t>>;
+template class MultiKHasher<Canonical<uint64_t>>;
+
+}
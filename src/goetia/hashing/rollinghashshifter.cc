@@ -8,6 +8,14 @@
  */
 
 #include "goetia/hashing/rollinghashshifter.hh"
+#include "goetia/goetia.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace goetia {
 
@@ -16,6 +24,797 @@ namespace hashing {
 template class LemireShifterPolicy<Hash<uint64_t>>;
 template class LemireShifterPolicy<Canonical<uint64_t>>;
 
+
+namespace lemire {
+
+namespace {
+
+enum class Kernel { scalar, avx2, avx512 };
+
+Kernel detect_kernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+        return Kernel::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel::avx2;
+    }
+#endif
+    return Kernel::scalar;
+}
+
+Kernel active_kernel = detect_kernel();
+
+
+// The vector kernels look symbols up by the code ((c >> 1) & 3) | ((c >> 3) & 4),
+// which is distinct for each of these.
+const char CODE_SYMBOLS[8] = {'A', 'C', 'T', 'G', 'a', 'c', 't', 'g'};
+
+bool all_coded(const char * sequence, size_t length) {
+    static const std::array<bool, 256> coded = [] {
+        std::array<bool, 256> coded{};
+        for (char c : CODE_SYMBOLS) {
+            coded[(unsigned char) c] = true;
+        }
+        return coded;
+    }();
+    for (size_t i = 0; i < length; ++i) {
+        if (!coded[(unsigned char) sequence[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ * The scalar kernel takes K as a KType, either uint16_t or, from
+ * dispatch_k, a std::integral_constant, so that its loops over the k-mer
+ * are compiled for the common K. The vector kernels only use K setting up
+ * their lanes and gain nothing from it.
+ */
+
+/*
+ * Hash the k-mer at sequence from scratch: forward by eating each symbol,
+ * reverse complement as the complement of each symbol rotated by its
+ * distance from the start.
+ */
+template<class KType>
+inline void hash_base(const char *     sequence,
+                      KType            K,
+                      const uint64_t * T,
+                      const uint64_t * TC,
+                      uint64_t&        fw,
+                      uint64_t&        rc) {
+    fw = 0;
+    for (uint16_t j = 0; j < K; ++j) {
+        fw = rotl(fw, 1) ^ T[(unsigned char) sequence[j]];
+    }
+    rc = 0;
+    if (TC) {
+        for (uint16_t j = 0; j < K; ++j) {
+            rc ^= rotl(TC[(unsigned char) sequence[j]], j % 64);
+        }
+    }
+}
+
+
+inline void emit(size_t     i,
+                 uint64_t   fw_h,
+                 uint64_t   rc_h,
+                 bool       canonical,
+                 uint64_t * values,
+                 uint64_t * fw,
+                 uint64_t * rc) {
+    values[i] = canonical ? std::min(fw_h, rc_h) : fw_h;
+    if (fw) {
+        fw[i] = fw_h;
+    }
+    if (rc) {
+        rc[i] = rc_h;
+    }
+}
+
+
+/*
+ * Roll from k-mer begin - 1, whose hashes are in fw_h and rc_h, through
+ * k-mer end - 1.
+ */
+template<class KType>
+void roll_scalar(const char *     sequence,
+                 size_t           begin,
+                 size_t           end,
+                 KType            K,
+                 const uint64_t * T,
+                 const uint64_t * TC,
+                 uint64_t *       values,
+                 uint64_t *       fw,
+                 uint64_t *       rc,
+                 uint64_t&        fw_h,
+                 uint64_t&        rc_h) {
+    const unsigned r = K % 64;
+    for (size_t i = begin; i < end; ++i) {
+        const unsigned char out = sequence[i - 1];
+        const unsigned char in = sequence[i + K - 1];
+        fw_h = rotl(fw_h, 1) ^ rotl(T[out], r) ^ T[in];
+        if (TC) {
+            rc_h = rotr1(rc_h ^ rotl(TC[in], r) ^ TC[out]);
+        }
+        emit(i, fw_h, rc_h, TC, values, fw, rc);
+    }
+}
+
+
+template<class KType>
+void hash_scalar(const char *     sequence,
+                 size_t           n_kmers,
+                 KType            K,
+                 const uint64_t * TC,
+                 uint64_t *       values,
+                 uint64_t *       fw,
+                 uint64_t *       rc,
+                 uint64_t&        last_fw,
+                 uint64_t&        last_rc) {
+    const uint64_t * T = symbol_hashes();
+    hash_base(sequence, K, T, TC, last_fw, last_rc);
+    emit(0, last_fw, last_rc, TC, values, fw, rc);
+    roll_scalar(sequence, 1, n_kmers, K, T, TC, values, fw, rc, last_fw, last_rc);
+}
+
+
+/*
+ * Hash k-mers begin through end - 1 from prefix hashes; each is the XOR of
+ * two prefixes rotated back by its position, so no k-mer depends on the
+ * one before and the vector kernels take them a lane each.
+ */
+void prefixed_scalar(const uint64_t * fw_prefix,
+                     const uint64_t * rc_prefix,
+                     size_t           begin,
+                     size_t           end,
+                     uint16_t         K,
+                     uint64_t *       values,
+                     uint64_t *       fw,
+                     uint64_t *       rc) {
+    for (size_t i = begin; i < end; ++i) {
+        const uint64_t fw_h = rotl(fw_prefix[i + K] ^ fw_prefix[i], i + K - 1);
+        if (rc_prefix) {
+            const uint64_t rc_h = rotl(rc_prefix[i + K] ^ rc_prefix[i], -(unsigned) i);
+            values[i] = std::min(fw_h, rc_h);
+            if (fw) {
+                fw[i] = fw_h;
+                rc[i] = rc_h;
+            }
+        } else {
+            values[i] = fw_h;
+            if (fw) {
+                fw[i] = fw_h;
+            }
+        }
+    }
+}
+
+
+/*
+ * The vector kernels give each lane an equal run of k-mers and hash the
+ * lanes together, gathering the next eight symbols of every lane at a time
+ * as codes packed in one word per lane. The first k-mer of each run is
+ * hashed from scratch, its reverse complement front to back as
+ * rc = rotr1(rc) ^ rotl(TC[c], K - 1), and the rest rolled, eight steps
+ * to a block; a block's hashes are transposed from steps by lane to lanes
+ * by step and stored a lane at a time. The k-mers left over after the
+ * last run are rolled on from it by the scalar kernel.
+ */
+template<size_t N_LANES>
+struct Lanes {
+    size_t                   length;
+    size_t                   run;
+    alignas(64) uint64_t     fw[N_LANES];
+    alignas(64) uint64_t     rc[N_LANES];
+    // the tables by symbol code, and rotated by K and K - 1
+    alignas(64) uint64_t     T[8];
+    alignas(64) uint64_t     T_r[8];
+    alignas(64) uint64_t     TC[8];
+    alignas(64) uint64_t     TC_r[8];
+    alignas(64) uint64_t     TC_base[8];
+
+    Lanes(size_t n_kmers, uint16_t K, const uint64_t * T_sym, const uint64_t * TC_sym)
+        : length(n_kmers + K - 1),
+          run(n_kmers / N_LANES)
+    {
+        for (int code = 0; code < 8; ++code) {
+            const unsigned char c = CODE_SYMBOLS[code];
+            T[code] = T_sym[c];
+            T_r[code] = rotl(T_sym[c], K % 64);
+            TC[code] = TC_sym ? TC_sym[c] : 0;
+            TC_r[code] = rotl(TC[code], K % 64);
+            TC_base[code] = rotl(TC[code], (K - 1) % 64);
+        }
+    }
+
+    // Whether every lane has a whole word from at to gather.
+    bool can_gather(size_t at) const {
+        return (N_LANES - 1) * run + at + 8 <= length;
+    }
+
+    // Load the codes of the n <= 8 symbols from at in each lane's run a
+    // lane at a time, for the blocks too near the end to gather.
+    void load(const char * sequence, size_t at, size_t n, uint64_t * codes) const {
+        for (size_t l = 0; l < N_LANES; ++l) {
+            const size_t begin = l * run + at;
+            uint64_t symbols = 0;
+            if (begin + 8 <= length) {
+                std::memcpy(&symbols, sequence + begin, 8);
+            } else {
+                for (size_t j = 0; j < n; ++j) {
+                    symbols |= (uint64_t) (unsigned char) sequence[begin + j] << (8 * j);
+                }
+            }
+            codes[l] = ((symbols >> 1) & CODE_LOW) | ((symbols >> 3) & CODE_HIGH);
+        }
+    }
+
+    // Emit the first k-mer of each run, from fw and rc.
+    void emit_bases(bool canonical, uint64_t * values, uint64_t * fw_out, uint64_t * rc_out) const {
+        for (size_t l = 0; l < N_LANES; ++l) {
+            emit(l * run, fw[l], rc[l], canonical, values, fw_out, rc_out);
+        }
+    }
+
+    // the bits of each symbol's code, bytewise
+    static constexpr uint64_t CODE_LOW  = 0x0303030303030303ULL;
+    static constexpr uint64_t CODE_HIGH = 0x0404040404040404ULL;
+};
+
+
+#if defined(__x86_64__)
+
+// all_coded, 32 symbols at a time; the last load overlaps the one before.
+__attribute__((target("avx2")))
+bool all_coded_avx2(const char * sequence, size_t length) {
+    if (length < 32) {
+        return all_coded(sequence, length);
+    }
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i c = _mm256_set1_epi8('c');
+    const __m256i g = _mm256_set1_epi8('g');
+    const __m256i t = _mm256_set1_epi8('t');
+    bool ok = true;
+    for (size_t i = 0; ok && i < length; i += 32) {
+        const size_t at = std::min(i, length - 32);
+        const __m256i symbols = _mm256_or_si256(
+                                    _mm256_loadu_si256((const __m256i *) (sequence + at)), lower);
+        const __m256i matched = _mm256_or_si256(
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(symbols, a),
+                                                    _mm256_cmpeq_epi8(symbols, c)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(symbols, g),
+                                                    _mm256_cmpeq_epi8(symbols, t)));
+        ok = _mm256_movemask_epi8(matched) == -1;
+    }
+    _mm256_zeroupper();
+    return ok;
+}
+
+
+__attribute__((target("avx512f")))
+inline __m512i load_codes_avx512(const Lanes<8>& lanes,
+                                 const char *    sequence,
+                                 size_t          at,
+                                 size_t          n,
+                                 __m512i         offsets) {
+    if (!lanes.can_gather(at)) {
+        alignas(64) uint64_t codes[8];
+        lanes.load(sequence, at, n, codes);
+        return _mm512_load_si512(codes);
+    }
+    const __m512i symbols = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xff, offsets,
+                                                          (const void *) (sequence + at), 1);
+    return _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi64(symbols, 1),
+                                            _mm512_set1_epi64(Lanes<8>::CODE_LOW)),
+                           _mm512_and_si512(_mm512_srli_epi64(symbols, 3),
+                                            _mm512_set1_epi64(Lanes<8>::CODE_HIGH)));
 }
+
+
+// Transpose a block of n <= 8 steps by lane, and store each lane's steps
+// at dest + lane * run.
+__attribute__((target("avx512f")))
+inline void store_block_avx512(const __m512i * rows, size_t n, uint64_t * dest, size_t run) {
+    __m512i t[8], u[8];
+    for (int r = 0; r < 8; r += 2) {
+        t[r] = _mm512_unpacklo_epi64(rows[r], rows[r + 1]);
+        t[r + 1] = _mm512_unpackhi_epi64(rows[r], rows[r + 1]);
+    }
+    // u[0], u[1]: even lanes of rows 0-3; u[2], u[3]: odd; u[4-7] likewise for rows 4-7
+    u[0] = _mm512_shuffle_i64x2(t[0], t[2], 0x88);
+    u[1] = _mm512_shuffle_i64x2(t[0], t[2], 0xdd);
+    u[2] = _mm512_shuffle_i64x2(t[1], t[3], 0x88);
+    u[3] = _mm512_shuffle_i64x2(t[1], t[3], 0xdd);
+    u[4] = _mm512_shuffle_i64x2(t[4], t[6], 0x88);
+    u[5] = _mm512_shuffle_i64x2(t[4], t[6], 0xdd);
+    u[6] = _mm512_shuffle_i64x2(t[5], t[7], 0x88);
+    u[7] = _mm512_shuffle_i64x2(t[5], t[7], 0xdd);
+
+    const __mmask8 mask = (1u << n) - 1;
+    _mm512_mask_storeu_epi64(dest,           mask, _mm512_shuffle_i64x2(u[0], u[4], 0x88));
+    _mm512_mask_storeu_epi64(dest + run,     mask, _mm512_shuffle_i64x2(u[2], u[6], 0x88));
+    _mm512_mask_storeu_epi64(dest + 2 * run, mask, _mm512_shuffle_i64x2(u[1], u[5], 0x88));
+    _mm512_mask_storeu_epi64(dest + 3 * run, mask, _mm512_shuffle_i64x2(u[3], u[7], 0x88));
+    _mm512_mask_storeu_epi64(dest + 4 * run, mask, _mm512_shuffle_i64x2(u[0], u[4], 0xdd));
+    _mm512_mask_storeu_epi64(dest + 5 * run, mask, _mm512_shuffle_i64x2(u[2], u[6], 0xdd));
+    _mm512_mask_storeu_epi64(dest + 6 * run, mask, _mm512_shuffle_i64x2(u[1], u[5], 0xdd));
+    _mm512_mask_storeu_epi64(dest + 7 * run, mask, _mm512_shuffle_i64x2(u[3], u[7], 0xdd));
 }
 
+
+__attribute__((target("avx512f")))
+void hash_avx512(const char *     sequence,
+                 size_t           n_kmers,
+                 uint16_t         K,
+                 const uint64_t * TC_sym,
+                 uint64_t *       values,
+                 uint64_t *       fw_out,
+                 uint64_t *       rc_out,
+                 uint64_t&        last_fw,
+                 uint64_t&        last_rc) {
+    const uint64_t * T_sym = symbol_hashes();
+    Lanes<8> lanes(n_kmers, K, T_sym, TC_sym);
+    const size_t run = lanes.run;
+    const bool canonical = TC_sym;
+
+    // permutexvar only reads the low three bits of each index, so the
+    // packed codes need no masking
+    const __m512i T = _mm512_load_si512(lanes.T);
+    const __m512i T_r = _mm512_load_si512(lanes.T_r);
+    const __m512i TC = _mm512_load_si512(lanes.TC);
+    const __m512i TC_r = _mm512_load_si512(lanes.TC_r);
+    const __m512i TC_base = _mm512_load_si512(lanes.TC_base);
+    const __m512i offsets = _mm512_set_epi64(7 * run, 6 * run, 5 * run, 4 * run,
+                                             3 * run, 2 * run, run, 0);
+
+    __m512i fw = _mm512_setzero_si512();
+    __m512i rc = _mm512_setzero_si512();
+    for (size_t j = 0; j < K; j += 8) {
+        const size_t n = std::min<size_t>(8, K - j);
+        __m512i codes = load_codes_avx512(lanes, sequence, j, n, offsets);
+        for (size_t step = 0; step < n; ++step) {
+            fw = _mm512_xor_si512(_mm512_rol_epi64(fw, 1), _mm512_permutexvar_epi64(codes, T));
+            rc = _mm512_xor_si512(_mm512_ror_epi64(rc, 1), _mm512_permutexvar_epi64(codes, TC_base));
+            codes = _mm512_srli_epi64(codes, 8);
+        }
+    }
+    _mm512_store_si512(lanes.fw, fw);
+    _mm512_store_si512(lanes.rc, rc);
+    lanes.emit_bases(canonical, values, fw_out, rc_out);
+
+    __m512i fw_rows[8], rc_rows[8], value_rows[8];
+    for (int step = 0; step < 8; ++step) {
+        fw_rows[step] = rc_rows[step] = value_rows[step] = _mm512_setzero_si512();
+    }
+
+    for (size_t i = 1; i < run; i += 8) {
+        const size_t n = std::min<size_t>(8, run - i);
+        __m512i out = load_codes_avx512(lanes, sequence, i - 1, n, offsets);
+        __m512i in = load_codes_avx512(lanes, sequence, i + K - 1, n, offsets);
+
+        for (size_t step = 0; step < n; ++step) {
+            fw = _mm512_xor_si512(_mm512_rol_epi64(fw, 1),
+                                  _mm512_xor_si512(_mm512_permutexvar_epi64(out, T_r),
+                                                   _mm512_permutexvar_epi64(in, T)));
+            fw_rows[step] = fw;
+            if (canonical) {
+                rc = _mm512_ror_epi64(
+                         _mm512_xor_si512(rc,
+                             _mm512_xor_si512(_mm512_permutexvar_epi64(in, TC_r),
+                                              _mm512_permutexvar_epi64(out, TC))), 1);
+                rc_rows[step] = rc;
+                value_rows[step] = _mm512_min_epu64(fw, rc);
+            }
+            out = _mm512_srli_epi64(out, 8);
+            in = _mm512_srli_epi64(in, 8);
+        }
+
+        store_block_avx512(canonical ? value_rows : fw_rows, n, values + i, run);
+        if (fw_out) {
+            store_block_avx512(fw_rows, n, fw_out + i, run);
+        }
+        if (rc_out) {
+            store_block_avx512(rc_rows, n, rc_out + i, run);
+        }
+    }
+
+    _mm512_store_si512(lanes.fw, fw);
+    _mm512_store_si512(lanes.rc, rc);
+    // leave no dirty upper state for the SSE code around us
+    _mm256_zeroupper();
+    last_fw = lanes.fw[7];
+    last_rc = canonical ? lanes.rc[7] : 0;
+    roll_scalar(sequence, 8 * run, n_kmers, K, T_sym, TC_sym,
+                values, fw_out, rc_out, last_fw, last_rc);
+}
+
+
+__attribute__((target("avx2")))
+inline __m256i load_codes_avx2(const Lanes<4>& lanes,
+                               const char *    sequence,
+                               size_t          at,
+                               size_t          n,
+                               __m256i         offsets) {
+    if (!lanes.can_gather(at)) {
+        alignas(32) uint64_t codes[4];
+        lanes.load(sequence, at, n, codes);
+        return _mm256_load_si256((const __m256i *) codes);
+    }
+    const __m256i symbols = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(),
+                                                          (const long long *) (sequence + at),
+                                                          offsets, _mm256_set1_epi64x(-1), 1);
+    return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi64(symbols, 1),
+                                            _mm256_set1_epi64x(Lanes<4>::CODE_LOW)),
+                           _mm256_and_si256(_mm256_srli_epi64(symbols, 3),
+                                            _mm256_set1_epi64x(Lanes<4>::CODE_HIGH)));
+}
+
+
+// store_block_avx512 for four lanes, as two 4 x 4 transposes.
+__attribute__((target("avx2")))
+inline void store_block_avx2(const __m256i * rows, size_t n, uint64_t * dest, size_t run) {
+    for (size_t half = 0; half < 2 && 4 * half < n; ++half) {
+        const __m256i * r = rows + 4 * half;
+        const __m256i t0 = _mm256_unpacklo_epi64(r[0], r[1]);
+        const __m256i t1 = _mm256_unpackhi_epi64(r[0], r[1]);
+        const __m256i t2 = _mm256_unpacklo_epi64(r[2], r[3]);
+        const __m256i t3 = _mm256_unpackhi_epi64(r[2], r[3]);
+        const __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n - 4 * half),
+                                                _mm256_set_epi64x(3, 2, 1, 0));
+        long long * at = (long long *) (dest + 4 * half);
+        _mm256_maskstore_epi64(at,           mask, _mm256_permute2x128_si256(t0, t2, 0x20));
+        _mm256_maskstore_epi64(at + run,     mask, _mm256_permute2x128_si256(t1, t3, 0x20));
+        _mm256_maskstore_epi64(at + 2 * run, mask, _mm256_permute2x128_si256(t0, t2, 0x31));
+        _mm256_maskstore_epi64(at + 3 * run, mask, _mm256_permute2x128_si256(t1, t3, 0x31));
+    }
+}
+
+
+__attribute__((target("avx2")))
+void hash_avx2(const char *     sequence,
+               size_t           n_kmers,
+               uint16_t         K,
+               const uint64_t * TC_sym,
+               uint64_t *       values,
+               uint64_t *       fw_out,
+               uint64_t *       rc_out,
+               uint64_t&        last_fw,
+               uint64_t&        last_rc) {
+    const uint64_t * T_sym = symbol_hashes();
+    Lanes<4> lanes(n_kmers, K, T_sym, TC_sym);
+    const size_t run = lanes.run;
+    const bool canonical = TC_sym;
+
+    // AVX2 has no 64-bit permute by register, so each rolling step gathers
+    // its terms from tables by (outgoing, incoming) code pair
+    alignas(32) uint64_t fw_pairs[64], rc_pairs[64];
+    for (int out = 0; out < 8; ++out) {
+        for (int in = 0; in < 8; ++in) {
+            fw_pairs[out * 8 + in] = lanes.T_r[out] ^ lanes.T[in];
+            rc_pairs[out * 8 + in] = lanes.TC_r[in] ^ lanes.TC[out];
+        }
+    }
+
+    const __m256i offsets = _mm256_set_epi64x(3 * run, 2 * run, run, 0);
+    const __m256i code_mask = _mm256_set1_epi64x(7);
+    const __m256i pair_mask = _mm256_set1_epi64x(63);
+    const __m256i sign = _mm256_set1_epi64x(1ULL << 63);
+
+    __m256i fw = _mm256_setzero_si256();
+    __m256i rc = _mm256_setzero_si256();
+    for (size_t j = 0; j < K; j += 8) {
+        const size_t n = std::min<size_t>(8, K - j);
+        __m256i codes = load_codes_avx2(lanes, sequence, j, n, offsets);
+        for (size_t step = 0; step < n; ++step) {
+            const __m256i code = _mm256_and_si256(codes, code_mask);
+            fw = _mm256_xor_si256(
+                     _mm256_or_si256(_mm256_slli_epi64(fw, 1), _mm256_srli_epi64(fw, 63)),
+                     _mm256_i64gather_epi64((const long long *) lanes.T, code, 8));
+            rc = _mm256_xor_si256(
+                     _mm256_or_si256(_mm256_srli_epi64(rc, 1), _mm256_slli_epi64(rc, 63)),
+                     _mm256_i64gather_epi64((const long long *) lanes.TC_base, code, 8));
+            codes = _mm256_srli_epi64(codes, 8);
+        }
+    }
+    _mm256_store_si256((__m256i *) lanes.fw, fw);
+    _mm256_store_si256((__m256i *) lanes.rc, rc);
+    lanes.emit_bases(canonical, values, fw_out, rc_out);
+
+    __m256i fw_rows[8], rc_rows[8], value_rows[8];
+    for (int step = 0; step < 8; ++step) {
+        fw_rows[step] = rc_rows[step] = value_rows[step] = _mm256_setzero_si256();
+    }
+
+    for (size_t i = 1; i < run; i += 8) {
+        const size_t n = std::min<size_t>(8, run - i);
+        __m256i pairs = _mm256_or_si256(
+                            _mm256_slli_epi64(load_codes_avx2(lanes, sequence, i - 1, n, offsets), 3),
+                            load_codes_avx2(lanes, sequence, i + K - 1, n, offsets));
+
+        for (size_t step = 0; step < n; ++step) {
+            const __m256i pair = _mm256_and_si256(pairs, pair_mask);
+            fw = _mm256_xor_si256(
+                     _mm256_or_si256(_mm256_slli_epi64(fw, 1), _mm256_srli_epi64(fw, 63)),
+                     _mm256_i64gather_epi64((const long long *) fw_pairs, pair, 8));
+            fw_rows[step] = fw;
+            if (canonical) {
+                rc = _mm256_xor_si256(rc, _mm256_i64gather_epi64((const long long *) rc_pairs, pair, 8));
+                rc = _mm256_or_si256(_mm256_srli_epi64(rc, 1), _mm256_slli_epi64(rc, 63));
+                // unsigned min through a signed compare
+                const __m256i rc_less = _mm256_cmpgt_epi64(_mm256_xor_si256(fw, sign),
+                                                           _mm256_xor_si256(rc, sign));
+                rc_rows[step] = rc;
+                value_rows[step] = _mm256_blendv_epi8(fw, rc, rc_less);
+            }
+            pairs = _mm256_srli_epi64(pairs, 8);
+        }
+
+        store_block_avx2(canonical ? value_rows : fw_rows, n, values + i, run);
+        if (fw_out) {
+            store_block_avx2(fw_rows, n, fw_out + i, run);
+        }
+        if (rc_out) {
+            store_block_avx2(rc_rows, n, rc_out + i, run);
+        }
+    }
+
+    _mm256_store_si256((__m256i *) lanes.fw, fw);
+    _mm256_store_si256((__m256i *) lanes.rc, rc);
+    _mm256_zeroupper();
+    last_fw = lanes.fw[3];
+    last_rc = canonical ? lanes.rc[3] : 0;
+    roll_scalar(sequence, 4 * run, n_kmers, K, T_sym, TC_sym,
+                values, fw_out, rc_out, last_fw, last_rc);
+}
+
+
+__attribute__((target("avx512f")))
+void prefixed_avx512(const uint64_t * fw_prefix,
+                     const uint64_t * rc_prefix,
+                     size_t           n_kmers,
+                     uint16_t         K,
+                     uint64_t *       values,
+                     uint64_t *       fw_out,
+                     uint64_t *       rc_out) {
+    const __m512i step = _mm512_set1_epi64(8);
+    const __m512i to_end = _mm512_set1_epi64(K - 1);
+    __m512i pos = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t i = 0;
+    for (; i + 8 <= n_kmers; i += 8) {
+        const __m512i fw = _mm512_rolv_epi64(
+            _mm512_xor_si512(_mm512_loadu_si512(fw_prefix + i + K),
+                             _mm512_loadu_si512(fw_prefix + i)),
+            _mm512_add_epi64(pos, to_end));
+        if (rc_prefix) {
+            const __m512i rc = _mm512_rorv_epi64(
+                _mm512_xor_si512(_mm512_loadu_si512(rc_prefix + i + K),
+                                 _mm512_loadu_si512(rc_prefix + i)),
+                pos);
+            _mm512_storeu_si512(values + i, _mm512_min_epu64(fw, rc));
+            if (fw_out) {
+                _mm512_storeu_si512(fw_out + i, fw);
+                _mm512_storeu_si512(rc_out + i, rc);
+            }
+        } else {
+            _mm512_storeu_si512(values + i, fw);
+            if (fw_out) {
+                _mm512_storeu_si512(fw_out + i, fw);
+            }
+        }
+        pos = _mm512_add_epi64(pos, step);
+    }
+    _mm256_zeroupper();
+
+    prefixed_scalar(fw_prefix, rc_prefix, i, n_kmers, K, values, fw_out, rc_out);
+}
+
+
+// AVX2 has no 64-bit rotates or unsigned minimum; shift pairs and a
+// signed compare with the sign bits flipped stand in.
+__attribute__((target("avx2")))
+inline __m256i rotl_avx2(__m256i x, __m256i r) {
+    r = _mm256_and_si256(r, _mm256_set1_epi64x(63));
+    return _mm256_or_si256(_mm256_sllv_epi64(x, r),
+                           _mm256_srlv_epi64(x, _mm256_sub_epi64(_mm256_set1_epi64x(64), r)));
+}
+
+
+__attribute__((target("avx2")))
+inline __m256i min_epu64_avx2(__m256i a, __m256i b) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i a_gt_b = _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign),
+                                              _mm256_xor_si256(b, sign));
+    return _mm256_blendv_epi8(a, b, a_gt_b);
+}
+
+
+__attribute__((target("avx2")))
+void prefixed_avx2(const uint64_t * fw_prefix,
+                   const uint64_t * rc_prefix,
+                   size_t           n_kmers,
+                   uint16_t         K,
+                   uint64_t *       values,
+                   uint64_t *       fw_out,
+                   uint64_t *       rc_out) {
+    const __m256i step = _mm256_set1_epi64x(4);
+    const __m256i to_end = _mm256_set1_epi64x(K - 1);
+    __m256i pos = _mm256_setr_epi64x(0, 1, 2, 3);
+
+    size_t i = 0;
+    for (; i + 4 <= n_kmers; i += 4) {
+        const __m256i fw = rotl_avx2(
+            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (fw_prefix + i + K)),
+                             _mm256_loadu_si256((const __m256i *) (fw_prefix + i))),
+            _mm256_add_epi64(pos, to_end));
+        if (rc_prefix) {
+            // rotating left by -i rotates right by i
+            const __m256i rc = rotl_avx2(
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (rc_prefix + i + K)),
+                                 _mm256_loadu_si256((const __m256i *) (rc_prefix + i))),
+                _mm256_sub_epi64(_mm256_setzero_si256(), pos));
+            _mm256_storeu_si256((__m256i *) (values + i), min_epu64_avx2(fw, rc));
+            if (fw_out) {
+                _mm256_storeu_si256((__m256i *) (fw_out + i), fw);
+                _mm256_storeu_si256((__m256i *) (rc_out + i), rc);
+            }
+        } else {
+            _mm256_storeu_si256((__m256i *) (values + i), fw);
+            if (fw_out) {
+                _mm256_storeu_si256((__m256i *) (fw_out + i), fw);
+            }
+        }
+        pos = _mm256_add_epi64(pos, step);
+    }
+    _mm256_zeroupper();
+
+    prefixed_scalar(fw_prefix, rc_prefix, i, n_kmers, K, values, fw_out, rc_out);
+}
+
+#endif
+
+}
+
+
+const uint64_t *
+symbol_hashes() {
+    static const CharacterHash<uint64_t> hasher(maskfnc<uint64_t>(64));
+    return hasher.hashvalues;
+}
+
+
+void
+hash_kmers(const char *     sequence,
+           size_t           n_kmers,
+           uint16_t         K,
+           const uint64_t * complements,
+           uint64_t *       values,
+           uint64_t *       fw,
+           uint64_t *       rc,
+           uint64_t&        last_fw,
+           uint64_t&        last_rc) {
+    if (n_kmers == 0) {
+        return;
+    }
+
+#if defined(__x86_64__)
+    if (active_kernel != Kernel::scalar) {
+        // every lane hashes its first k-mer from scratch, which only pays
+        // off over long enough runs: roughly K / 4 k-mers a lane for
+        // AVX-512 and K for AVX2, twice and four times that for forward
+        // hashes, whose scalar kernel is cheaper
+        const bool avx512 = active_kernel == Kernel::avx512;
+        const size_t n_lanes = avx512 ? 8 : 4;
+        const size_t run_quarters = (avx512 ? 1 : 4) * (complements ? 1 : (avx512 ? 2 : 4));
+        const size_t min_run = std::max<size_t>(2, (K * run_quarters + 3) / 4);
+        if (n_kmers / n_lanes >= min_run && all_coded_avx2(sequence, n_kmers + K - 1)) {
+            if (avx512) {
+                hash_avx512(sequence, n_kmers, K, complements, values, fw, rc, last_fw, last_rc);
+            } else {
+                hash_avx2(sequence, n_kmers, K, complements, values, fw, rc, last_fw, last_rc);
+            }
+            return;
+        }
+    }
+#endif
+
+    dispatch_k(K, [&](auto k) {
+        hash_scalar(sequence, n_kmers, k, complements, values, fw, rc, last_fw, last_rc);
+    });
+}
+
+
+void
+hash_prefixes(const char *     sequence,
+              size_t           length,
+              const uint64_t * complements,
+              uint64_t *       fw_prefix,
+              uint64_t *       rc_prefix) {
+    const uint64_t * T = symbol_hashes();
+
+    // rotating each symbol by its position leaves only an XOR chained
+    // from one to the next; the two strands' chains run side by side
+    uint64_t fw_h = 0;
+    fw_prefix[0] = 0;
+    if (complements) {
+        uint64_t rc_h = 0;
+        rc_prefix[0] = 0;
+        for (size_t i = 0; i < length; ++i) {
+            const unsigned char symbol = sequence[i];
+            fw_h ^= rotl(T[symbol], -(unsigned) i);
+            rc_h ^= rotl(complements[symbol], i);
+            fw_prefix[i + 1] = fw_h;
+            rc_prefix[i + 1] = rc_h;
+        }
+    } else {
+        for (size_t i = 0; i < length; ++i) {
+            fw_h ^= rotl(T[(unsigned char) sequence[i]], -(unsigned) i);
+            fw_prefix[i + 1] = fw_h;
+        }
+    }
+}
+
+
+void
+hash_kmers_prefixed(const uint64_t * fw_prefix,
+                    const uint64_t * rc_prefix,
+                    size_t           n_kmers,
+                    uint16_t         K,
+                    uint64_t *       values,
+                    uint64_t *       fw,
+                    uint64_t *       rc) {
+#if defined(__x86_64__)
+    if (active_kernel == Kernel::avx512) {
+        prefixed_avx512(fw_prefix, rc_prefix, n_kmers, K, values, fw, rc);
+        return;
+    }
+    if (active_kernel == Kernel::avx2) {
+        prefixed_avx2(fw_prefix, rc_prefix, n_kmers, K, values, fw, rc);
+        return;
+    }
+#endif
+    prefixed_scalar(fw_prefix, rc_prefix, 0, n_kmers, K, values, fw, rc);
+}
+
+std::string
+kernel() {
+    switch (active_kernel) {
+        case Kernel::avx512:
+            return "avx512";
+        case Kernel::avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+
+void
+set_kernel(const std::string& name) {
+    if (name == "scalar") {
+        active_kernel = Kernel::scalar;
+        return;
+    }
+#if defined(__x86_64__)
+    if (name == "avx512" && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+        active_kernel = Kernel::avx512;
+        return;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        active_kernel = Kernel::avx2;
+        return;
+    }
+#endif
+    throw GoetiaException("Rolling hash kernel unavailable: " + name);
+}
+
+}
+
+}
+}
@@ -0,0 +1,58 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : twobitshifter.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include <string>
+
+#include "goetia/hashing/twobitshifter.hh"
+#include "goetia/hashing/hashshifter.hh"
+
+
+namespace goetia::hashing {
+
+namespace twobit {
+
+std::string
+decode(uint64_t packed, uint16_t K) {
+    std::string kmer(K, ' ');
+    for (uint16_t i = K; i > 0; --i) {
+        kmer[i - 1] = SYMBOLS[packed & 3];
+        packed >>= 2;
+    }
+    return kmer;
+}
+
+
+uint64_t
+encode(const char * sequence, uint16_t K) {
+    uint64_t packed = 0;
+    for (uint16_t i = 0; i < K; ++i) {
+        const uint8_t code = CODES[(unsigned char) sequence[i]];
+        if (code > 3) {
+            throw InvalidCharacterException(std::string("Two-bit k-mers can't hold '")
+                                            + sequence[i] + "'");
+        }
+        packed = (packed << 2) | code;
+    }
+    return packed;
+}
+
+}
+
+
+template class TwoBitShifterPolicy<Hash<uint64_t>>;
+template class TwoBitShifterPolicy<Canonical<uint64_t>>;
+
+template class HashShifter<FwdTwoBitPolicy>;
+template HashShifter<FwdTwoBitPolicy>::HashShifter(uint16_t);
+template HashShifter<FwdTwoBitPolicy>::HashShifter(const std::string&, uint16_t);
+
+template class HashShifter<CanTwoBitPolicy>;
+template HashShifter<CanTwoBitPolicy>::HashShifter(uint16_t);
+template HashShifter<CanTwoBitPolicy>::HashShifter(const std::string&, uint16_t);
+
+}
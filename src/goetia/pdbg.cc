@@ -15,9 +15,21 @@ namespace goetia {
     template class PdBG<storage::BitStorage, hashing::FwdUnikmerShifter>;
     template class PdBG<storage::BitStorage, hashing::CanUnikmerShifter>;
 
+    template class PdBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>;
+    template class PdBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>;
+
+    template class PdBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>;
+    template class PdBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>;
+
     template class PdBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>;
     template class PdBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>;
 
+    template class PdBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>;
+    template class PdBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>;
+
+    template class PdBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>;
+    template class PdBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>;
+
     template class PdBG<storage::ByteStorage, hashing::FwdUnikmerShifter>;
     template class PdBG<storage::ByteStorage, hashing::CanUnikmerShifter>;
 
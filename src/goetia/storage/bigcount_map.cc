@@ -0,0 +1,231 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : bigcount_map.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/storage/bigcount_map.hh"
+
+#include <algorithm>
+
+namespace goetia {
+
+namespace storage {
+
+
+BigCountMap::BigCountMap()
+    : _shards(new Shard[N_SHARDS]),
+      _mapped_hashes(nullptr),
+      _mapped_counts(nullptr),
+      _n_mapped(0),
+      _n_shadowed(0)
+{
+}
+
+
+count_t
+BigCountMap::_mapped_count(value_type h) const {
+    const value_type * end = _mapped_hashes + _n_mapped;
+    const value_type * it = std::lower_bound(_mapped_hashes, end, h);
+    if (it != end && *it == h) {
+        return _mapped_counts[it - _mapped_hashes];
+    }
+    return 0;
+}
+
+
+void
+BigCountMap::_increment(Shard& shard, value_type h, count_t first, count_t max) {
+    auto it = shard.counts.find(h);
+    if (it == shard.counts.end()) {
+        const count_t mapped = _n_mapped ? _mapped_count(h) : 0;
+        if (mapped) {
+            __sync_add_and_fetch(&_n_shadowed, 1);
+            shard.counts.emplace(h, mapped < max ? mapped + 1 : mapped);
+        } else {
+            shard.counts.emplace(h, first);
+        }
+    } else if (it->second < max) {
+        it->second += 1;
+    }
+}
+
+
+void
+BigCountMap::increment(value_type h, count_t first, uint32_t max) {
+    Shard& shard = _shards[_shard_for(h)];
+    shard.acquire();
+    _increment(shard, h, first, _clamp(max));
+    shard.release();
+}
+
+
+void
+BigCountMap::increment_many(const value_type * hashes,
+                            size_t             n,
+                            count_t            first,
+                            uint32_t           max) {
+    if (n == 1) {
+        increment(hashes[0], first, max);
+        return;
+    }
+
+    const count_t clamped = _clamp(max);
+
+    // bucket the batch by shard, then take each shard's lock once
+    std::vector<size_t> shard_ids(n);
+    std::vector<size_t> offsets(N_SHARDS + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        shard_ids[i] = _shard_for(hashes[i]);
+        ++offsets[shard_ids[i] + 1];
+    }
+    for (size_t s = 0; s < N_SHARDS; ++s) {
+        offsets[s + 1] += offsets[s];
+    }
+    std::vector<value_type> bucketed(n);
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        bucketed[fill[shard_ids[i]]++] = hashes[i];
+    }
+
+    for (size_t s = 0; s < N_SHARDS; ++s) {
+        if (offsets[s] == offsets[s + 1]) {
+            continue;
+        }
+        Shard& shard = _shards[s];
+        shard.acquire();
+        for (size_t i = offsets[s]; i < offsets[s + 1]; ++i) {
+            _increment(shard, bucketed[i], first, clamped);
+        }
+        shard.release();
+    }
+}
+
+
+bool
+BigCountMap::find(value_type h, count_t& count) const {
+    const Shard& shard = _shards[_shard_for(h)];
+    shard.acquire();
+    auto it = shard.counts.find(h);
+    const bool found = it != shard.counts.end();
+    if (found) {
+        count = it->second;
+    }
+    shard.release();
+
+    if (!found && _n_mapped) {
+        const count_t mapped = _mapped_count(h);
+        if (mapped) {
+            count = mapped;
+            return true;
+        }
+    }
+    return found;
+}
+
+
+void
+BigCountMap::set(value_type h, count_t count) {
+    Shard& shard = _shards[_shard_for(h)];
+    shard.acquire();
+    auto inserted = shard.counts.emplace(h, count);
+    if (inserted.second) {
+        if (_n_mapped && _mapped_count(h)) {
+            __sync_add_and_fetch(&_n_shadowed, 1);
+        }
+    } else {
+        inserted.first->second = count;
+    }
+    shard.release();
+}
+
+
+const uint64_t
+BigCountMap::size() const {
+    uint64_t size = _n_mapped - _n_shadowed;
+    for (size_t s = 0; s < N_SHARDS; ++s) {
+        _shards[s].acquire();
+        size += _shards[s].counts.size();
+        _shards[s].release();
+    }
+    return size;
+}
+
+
+void
+BigCountMap::clear() {
+    for (size_t s = 0; s < N_SHARDS; ++s) {
+        _shards[s].acquire();
+        _shards[s].counts.clear();
+        _shards[s].release();
+    }
+    _mapping.reset();
+    _mapped_hashes = nullptr;
+    _mapped_counts = nullptr;
+    _n_mapped = 0;
+    _n_shadowed = 0;
+}
+
+
+void
+BigCountMap::assign(const std::unordered_map<value_type, count_t>& counts) {
+    clear();
+    for (const auto& it : counts) {
+        _shards[_shard_for(it.first)].counts.emplace(it.first, it.second);
+    }
+}
+
+
+void
+BigCountMap::save_mapped(MappedFileWriter& out) const {
+    std::vector<std::pair<value_type, count_t>> sorted;
+    for_each([&](value_type h, count_t count) {
+        sorted.emplace_back(h, count);
+    });
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<value_type> hashes(sorted.size());
+    std::vector<count_t> counts(sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        hashes[i] = sorted[i].first;
+        counts[i] = sorted[i].second;
+    }
+
+    out.write<uint64_t>(sorted.size());
+    out.write_section(hashes.data(), hashes.size() * sizeof(value_type));
+    out.write_section(counts.data(), counts.size() * sizeof(count_t));
+}
+
+
+void
+BigCountMap::load_mapped(std::shared_ptr<MappedFile> mapping, size_t& offset) {
+    const uint64_t n = mapping->read<uint64_t>(offset);
+    const value_type * hashes = (const value_type *) mapping->section(offset, n * sizeof(value_type));
+    const count_t * counts = (const count_t *) mapping->section(offset, n * sizeof(count_t));
+
+    clear();
+    _mapping = mapping;
+    _mapped_hashes = hashes;
+    _mapped_counts = counts;
+    _n_mapped = n;
+}
+
+
+metrics::MemoryUsage
+BigCountMap::memory_usage() const {
+    metrics::MemoryUsage usage;
+    usage.add("shards", N_SHARDS * sizeof(Shard));
+    for (size_t s = 0; s < N_SHARDS; ++s) {
+        _shards[s].acquire();
+        usage.add("shards", metrics::node_map_bytes(_shards[s].counts));
+        _shards[s].release();
+    }
+    usage.add("mapped", _n_mapped * (sizeof(value_type) + sizeof(count_t)));
+    return usage;
+}
+
+}
+
+}
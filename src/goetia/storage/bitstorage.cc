@@ -53,6 +53,8 @@
 
 #include "goetia/storage/bitstorage.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <errno.h>
 #include <sstream> // IWYU pragma: keep
 #include <fstream>
@@ -66,27 +68,17 @@ using namespace goetia;
 using namespace goetia::storage;
 
 std::shared_ptr<BitStorage>
-BitStorage::build(uint64_t max_table, uint16_t N) {
-    return std::make_shared<BitStorage>(max_table, N);
+BitStorage::build(uint64_t max_table, uint16_t N, TablePolicy policy) {
+    return std::make_shared<BitStorage>(max_table, N, policy);
 }
 
 const bool
 BitStorage::insert( value_type khash ) {
+    check_writable(_mapping);
     bool is_new_kmer = false;
 
     for (size_t i = 0; i < _n_tables; i++) {
-        uint64_t bin = khash % _tablesizes[i];
-        uint64_t byte = bin / 8;
-        unsigned char bit = (unsigned char)(1 << (bin % 8));
-
-        unsigned char bits_orig = __sync_fetch_and_or( *(_counts + i) +
-                                  byte, bit );
-        if (!(bits_orig & bit)) {
-            if (i == 0) {
-                __sync_add_and_fetch( &_occupied_bins, 1 );
-            }
-            is_new_kmer = true;
-        }
+        is_new_kmer |= _set_bin(i, khash % _tablesizes[i]);
     } // iteration over hashtables
 
     if (is_new_kmer) {
@@ -111,11 +103,7 @@ const count_t
 BitStorage::query(value_type khash) const
 {
     for (size_t i = 0; i < _n_tables; i++) {
-        uint64_t bin = khash % _tablesizes[i];
-        uint64_t byte = bin / 8;
-        unsigned char bit = bin % 8;
-
-        if (!(_counts[i][byte] & (1 << bit))) {
+        if (!_test_bin(i, khash % _tablesizes[i])) {
             return 0;
         }
     }
@@ -123,51 +111,170 @@ BitStorage::query(value_type khash) const
 }
 
 
+uint64_t
+BitStorage::insert_many(const value_type * khashes,
+                        size_t             n,
+                        count_t *          counts)
+{
+    check_writable(_mapping);
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin / 8, 1);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            bool is_new_kmer = false;
+            for (size_t i = 0; i < _n_tables; ++i) {
+                is_new_kmer |= _set_bin(i, bins[j * _n_tables + i]);
+            }
+            if (is_new_kmer) {
+                __sync_add_and_fetch( &_n_unique_kmers, 1 );
+                ++n_new;
+            }
+            if (counts) {
+                counts[start + j] = 1;
+            }
+        }
+    }
+
+    return n_new;
+}
+
+
+void
+BitStorage::query_many(const value_type * khashes,
+                       size_t             n,
+                       count_t *          counts) const
+{
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin / 8, 0);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            count_t present = 1;
+            for (size_t i = 0; i < _n_tables; ++i) {
+                if (!_test_bin(i, bins[j * _n_tables + i])) {
+                    present = 0;
+                    break;
+                }
+            }
+            counts[start + j] = present;
+        }
+    }
+}
+
+
 void
 BitStorage::update_from(const BitStorage& other)
+{
+    merge(other);
+}
+
+
+void
+BitStorage::_check_combinable(const BitStorage& other) const
 {
     if (_tablesizes != other._tablesizes) {
         throw GoetiaException("both nodegraphs must have same table sizes");
     }
+    if (&other == this) {
+        throw GoetiaException("Cannot combine a storage with itself.");
+    }
+    check_writable(_mapping);
+}
 
-    byte_t tmp = 0;
+
+template <typename Op>
+void
+BitStorage::_combine(const BitStorage& other, Op op)
+{
+    _check_combinable(other);
+
+    uint64_t occupied = 0;
     for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
         byte_t * me = _counts[table_num];
-        byte_t * ot = other._counts[table_num];
-        uint64_t tablesize = _tablesizes[table_num];
-        uint64_t tablebytes = tablesize / 8 + 1;
-
-        for (uint64_t index = 0; index < tablebytes; index++) {
-            // Bloom filters can be unioned with bitwise OR.
-            // First, get the new value
-            tmp = me[index] | ot[index];
+        const byte_t * ot = other._counts[table_num];
+        const uint64_t tablebytes = _tablesizes[table_num] / 8 + 1;
+
+        parallel_chunks(tablebytes, [&](size_t begin, size_t end) {
+            uint64_t bits = 0;
+            size_t index = begin;
+            // whole words first; the compiler vectorizes this loop
+            for (; index + 8 <= end; index += 8) {
+                uint64_t a, b;
+                memcpy(&a, me + index, 8);
+                memcpy(&b, ot + index, 8);
+                a = op(a, b);
+                memcpy(me + index, &a, 8);
+                bits += __builtin_popcountll(a);
+            }
+            for (; index < end; index++) {
+                me[index] = (byte_t) op(me[index], ot[index]);
+                bits += __builtin_popcountll(me[index]);
+            }
             if (table_num == 0) {
-                // We'd like for the merged filter to have an accurate
-                // count of occupied bins.  First, observe that
-                // HammingDistance(x,y) is equivalent to
-                // HammingWeight(x^y).  Then, observe that the number
-                // of additional occupied bins from the update is the
-                // hamming distance between the original bin and the
-                // OR'd bin. Thus, we can use the builtin popcountll
-                // function, which calls a hardware instruction for
-                // hamming weight, with the original and merged bin,
-                // to find the number of additional occupied bins.
-                _occupied_bins += __builtin_popcountll(me[index] ^ tmp);
+                __sync_add_and_fetch(&occupied, bits);
             }
-            me[index] = tmp;
-        }
+        });
     }
+
+    _occupied_bins = occupied;
+    _n_unique_kmers = estimated_cardinality();
+}
+
+
+void
+BitStorage::merge(const BitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+
+void
+BitStorage::intersect(const BitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a & b; });
+}
+
+
+void
+BitStorage::subtract(const BitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a & ~b; });
 }
 
 
 void
 BitStorage::reset()
 {
+    check_writable(_mapping);
     for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
         uint64_t tablesize = _tablesizes[table_num];
         uint64_t tablebytes = tablesize / 8 + 1;
-        memset(_counts[table_num], 0, tablebytes);
+        _allocator.zero(_counts[table_num], tablebytes);
     }
+    _occupied_bins = 0;
+    _n_unique_kmers = 0;
 }
 
 
@@ -242,14 +349,7 @@ BitStorage::load(std::string infilename, uint16_t &ksize)
         throw GoetiaFileException(err);
     }
 
-    if (_counts) {
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            delete[] _counts[i];
-            _counts[i] = NULL;
-        }
-        delete[] _counts;
-        _counts = NULL;
-    }
+    _free_counters();
     _tablesizes.clear();
 
     try {
@@ -303,7 +403,7 @@ BitStorage::load(std::string infilename, uint16_t &ksize)
             _tablesizes.push_back(tablesize);
 
             tablebytes = tablesize / 8 + 1;
-            _counts[i] = new byte_t[tablebytes];
+            _counts[i] = _allocator.allocate(tablebytes, i);
 
             unsigned long long loaded = 0;
             while (loaded != tablebytes) {
@@ -328,3 +428,125 @@ BitStorage::load(std::string infilename, uint16_t &ksize)
         throw GoetiaFileException(err);
     }
 }
+
+
+void
+BitStorage::save_mapped(std::string outfilename, uint16_t ksize)
+{
+    if (!_counts[0]) {
+        throw GoetiaException();
+    }
+
+    MappedFileWriter out(outfilename, SAVED_HASHBITS);
+
+    out.write<uint32_t>(ksize);
+    out.write<uint32_t>(_n_tables);
+    out.write<uint64_t>(_occupied_bins);
+    out.write<uint64_t>(_n_unique_kmers);
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write<uint64_t>(_tablesizes[i]);
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write_section(_counts[i], _tablesizes[i] / 8 + 1);
+    }
+
+    out.close();
+}
+
+
+void
+BitStorage::load_mapped(std::string infilename, uint16_t &ksize, bool writable)
+{
+    auto mapping = MappedFile::open(infilename, writable);
+    size_t offset = mapping->check_header(SAVED_HASHBITS);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const uint32_t n_tables = mapping->read<uint32_t>(offset);
+    const uint64_t occupied_bins = mapping->read<uint64_t>(offset);
+    const uint64_t n_unique_kmers = mapping->read<uint64_t>(offset);
+    if (n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid number of tables in " + infilename);
+    }
+
+    std::vector<uint64_t> tablesizes;
+    for (uint32_t i = 0; i < n_tables; i++) {
+        tablesizes.push_back(mapping->read<uint64_t>(offset));
+    }
+
+    std::unique_ptr<byte_t*[]> counts(new byte_t*[n_tables]);
+    for (uint32_t i = 0; i < n_tables; i++) {
+        counts[i] = mapping->section(offset, tablesizes[i] / 8 + 1);
+    }
+
+    _free_counters();
+    _tablesizes = tablesizes;
+    _n_tables = n_tables;
+    _occupied_bins = occupied_bins;
+    _n_unique_kmers = n_unique_kmers;
+    _counts = counts.release();
+    _mapping = mapping;
+}
+
+
+void
+BitStorage::serialize(std::ofstream& out)
+{
+    serialize_tag<BitStorage>(out);
+
+    uint64_t n_tables = _n_tables;
+    out.write((const char *) &n_tables, sizeof(n_tables));
+    out.write((const char *) &_occupied_bins, sizeof(_occupied_bins));
+    out.write((const char *) &_n_unique_kmers, sizeof(_n_unique_kmers));
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) &_tablesizes[i], sizeof(_tablesizes[i]));
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) _counts[i], _tablesizes[i] / 8 + 1);
+    }
+}
+
+
+std::shared_ptr<BitStorage>
+BitStorage::deserialize(std::ifstream& in)
+{
+    deserialize_tag<BitStorage>(in);
+
+    uint64_t n_tables, occupied_bins, n_unique_kmers;
+    in.read((char *) &n_tables, sizeof(n_tables));
+    in.read((char *) &occupied_bins, sizeof(occupied_bins));
+    in.read((char *) &n_unique_kmers, sizeof(n_unique_kmers));
+    if (!in || n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid serialized BitStorage header.");
+    }
+
+    std::vector<uint64_t> tablesizes(n_tables);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) &tablesizes[i], sizeof(tablesizes[i]));
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized BitStorage.");
+    }
+
+    auto storage = std::make_shared<BitStorage>(tablesizes);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) storage->_counts[i], tablesizes[i] / 8 + 1);
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized BitStorage.");
+    }
+    storage->_occupied_bins = occupied_bins;
+    storage->_n_unique_kmers = n_unique_kmers;
+
+    return storage;
+}
+
+
+metrics::MemoryUsage
+BitStorage::memory_usage() const
+{
+    metrics::MemoryUsage usage;
+    for (size_t i = 0; i < _n_tables; i++) {
+        usage.add("tables", _tablesizes[i] / 8 + 1);
+    }
+    return usage;
+}
@@ -0,0 +1,479 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : blockedbitstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/storage/blockedbitstorage.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <errno.h>
+#include <sstream> // IWYU pragma: keep
+#include <fstream>
+#include <iostream>
+
+#include "goetia/goetia.hh"
+
+using namespace std;
+using namespace goetia;
+using namespace goetia::storage;
+
+
+constexpr uint32_t BlockedBitStorage::_salts[BlockedBitStorage::MAX_PROBES];
+
+
+BlockedBitStorage::BlockedBitStorage(uint64_t max_table, uint16_t N, TablePolicy policy)
+    : _max_table(max_table),
+      _n_probes(N),
+      _occupied_bins(0),
+      _n_unique_kmers(0),
+      _blocks(nullptr),
+      _allocator(policy)
+{
+    if (N == 0 || N > MAX_PROBES) {
+        throw GoetiaException("BlockedBitStorage supports between 1 and "
+                              + std::to_string(MAX_PROBES) + " probes.");
+    }
+    // Same bit budget as a BitStorage with N tables of max_table bits.
+    _n_blocks = (max_table * N + BLOCK_BITS - 1) / BLOCK_BITS;
+    if (_n_blocks == 0) {
+        _n_blocks = 1;
+    }
+    _allocate_blocks();
+}
+
+
+BlockedBitStorage::~BlockedBitStorage()
+{
+    _free_blocks();
+}
+
+
+std::shared_ptr<BlockedBitStorage>
+BlockedBitStorage::build(uint64_t max_table, uint16_t N, TablePolicy policy) {
+    return std::make_shared<BlockedBitStorage>(max_table, N, policy);
+}
+
+
+void
+BlockedBitStorage::_allocate_blocks()
+{
+    // allocated tables are at least cache-line aligned
+    _blocks = reinterpret_cast<uint64_t*>(_allocator.allocate(_n_blocks * BLOCK_BYTES));
+    _raw_tables[0] = reinterpret_cast<byte_t*>(_blocks);
+}
+
+
+void
+BlockedBitStorage::_free_blocks()
+{
+    if (_blocks) {
+        if (!_mapping) {
+            _allocator.release(reinterpret_cast<byte_t*>(_blocks));
+        }
+        _blocks = nullptr;
+        _raw_tables[0] = nullptr;
+    }
+    _mapping.reset();
+}
+
+
+const bool
+BlockedBitStorage::insert(value_type khash)
+{
+    check_writable(_mapping);
+    if (_set_bits(_block_for(khash), khash)) {
+        __sync_add_and_fetch(&_n_unique_kmers, 1);
+        return 1; // kmer not seen before
+    }
+
+    return 0; // kmer already seen
+}
+
+
+const count_t
+BlockedBitStorage::insert_and_query(value_type khash)
+{
+    insert(khash);
+    // presence filter, should always be 1 after insert
+    return 1;
+}
+
+
+const count_t
+BlockedBitStorage::query(value_type khash) const
+{
+    return _test_bits(_block_for(khash), khash);
+}
+
+
+uint64_t
+BlockedBitStorage::insert_many(const value_type * khashes,
+                               size_t             n,
+                               count_t *          counts)
+{
+    check_writable(_mapping);
+    uint64_t * blocks[PREFETCH_BATCH];
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            blocks[j] = _block_for(khashes[start + j]);
+            __builtin_prefetch(blocks[j], 1);
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            if (_set_bits(blocks[j], khashes[start + j])) {
+                __sync_add_and_fetch(&_n_unique_kmers, 1);
+                ++n_new;
+            }
+            if (counts) {
+                counts[start + j] = 1;
+            }
+        }
+    }
+
+    return n_new;
+}
+
+
+void
+BlockedBitStorage::query_many(const value_type * khashes,
+                              size_t             n,
+                              count_t *          counts) const
+{
+    const uint64_t * blocks[PREFETCH_BATCH];
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            blocks[j] = _block_for(khashes[start + j]);
+            __builtin_prefetch(blocks[j], 0);
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            counts[start + j] = _test_bits(blocks[j], khashes[start + j]);
+        }
+    }
+}
+
+
+void
+BlockedBitStorage::reset()
+{
+    check_writable(_mapping);
+    _allocator.zero(reinterpret_cast<byte_t*>(_blocks), _n_blocks * BLOCK_BYTES);
+    _occupied_bins = 0;
+    _n_unique_kmers = 0;
+}
+
+
+void
+BlockedBitStorage::save(std::string outfilename, uint16_t ksize)
+{
+    if (!_blocks) {
+        throw GoetiaException();
+    }
+
+    unsigned int save_ksize = ksize;
+    unsigned char save_n_probes = _n_probes;
+    unsigned long long save_n_blocks = _n_blocks;
+    unsigned long long save_max_table = _max_table;
+    unsigned long long save_occupied_bins = _occupied_bins;
+    unsigned long long save_n_unique_kmers = _n_unique_kmers;
+
+    ofstream outfile(outfilename.c_str(), ios::binary);
+
+    outfile.write(SAVED_SIGNATURE, 4);
+    unsigned char version = SAVED_FORMAT_VERSION;
+    outfile.write((const char *) &version, 1);
+
+    unsigned char ht_type = SAVED_BLOCKEDHASHBITS;
+    outfile.write((const char *) &ht_type, 1);
+
+    outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+    outfile.write((const char *) &save_n_probes, sizeof(save_n_probes));
+    outfile.write((const char *) &save_max_table, sizeof(save_max_table));
+    outfile.write((const char *) &save_n_blocks, sizeof(save_n_blocks));
+    outfile.write((const char *) &save_occupied_bins,
+                  sizeof(save_occupied_bins));
+    outfile.write((const char *) &save_n_unique_kmers,
+                  sizeof(save_n_unique_kmers));
+
+    outfile.write((const char *) _blocks, _n_blocks * BLOCK_BYTES);
+
+    if (outfile.fail()) {
+        throw GoetiaFileException(strerror(errno));
+    }
+    outfile.close();
+}
+
+
+void
+BlockedBitStorage::load(std::string infilename, uint16_t &ksize)
+{
+    ifstream infile;
+
+    // configure ifstream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
+    try {
+        infile.open(infilename.c_str(), ios::binary);
+    } catch (std::ifstream::failure &e) {
+        std::string err;
+        if (!infile.is_open()) {
+            err = "Cannot open k-mer graph file: " + infilename;
+        } else {
+            err = "Unknown error in opening file: " + infilename;
+        }
+        throw GoetiaFileException(err);
+    } catch (const std::exception &e) {
+        std::string err = "Unknown error opening file: " + infilename + " "
+                          + strerror(errno);
+        throw GoetiaFileException(err);
+    }
+
+    try {
+        unsigned int save_ksize = 0;
+        unsigned char save_n_probes = 0;
+        unsigned long long save_max_table = 0;
+        unsigned long long save_n_blocks = 0;
+        unsigned long long save_occupied_bins = 0;
+        unsigned long long save_n_unique_kmers = 0;
+        char signature[4];
+        unsigned char version, ht_type;
+
+        infile.read(signature, 4);
+        infile.read((char *) &version, 1);
+        infile.read((char *) &ht_type, 1);
+        if (!(std::string(signature, 4) == SAVED_SIGNATURE)) {
+            std::ostringstream err;
+            err << "Does not start with signature for a oxli file: 0x";
+            for(size_t i=0; i < 4; ++i) {
+                err << std::hex << (int) signature[i];
+            }
+            err << " Should be: " << SAVED_SIGNATURE;
+            throw GoetiaFileException(err.str());
+        } else if (!(version == SAVED_FORMAT_VERSION)) {
+            std::ostringstream err;
+            err << "Incorrect file format version " << (int) version
+                << " while reading k-mer graph from " << infilename
+                << "; should be " << (int) SAVED_FORMAT_VERSION;
+            throw GoetiaFileException(err.str());
+        } else if (!(ht_type == SAVED_BLOCKEDHASHBITS)) {
+            std::ostringstream err;
+            err << "Incorrect file format type " << (int) ht_type
+                << " while reading k-mer graph from " << infilename;
+            throw GoetiaFileException(err.str());
+        }
+
+        infile.read((char *) &save_ksize, sizeof(save_ksize));
+        infile.read((char *) &save_n_probes, sizeof(save_n_probes));
+        infile.read((char *) &save_max_table, sizeof(save_max_table));
+        infile.read((char *) &save_n_blocks, sizeof(save_n_blocks));
+        infile.read((char *) &save_occupied_bins, sizeof(save_occupied_bins));
+        infile.read((char *) &save_n_unique_kmers, sizeof(save_n_unique_kmers));
+
+        if (save_n_probes == 0 || save_n_probes > MAX_PROBES) {
+            throw GoetiaFileException("Invalid number of probes in " + infilename);
+        }
+
+        _free_blocks();
+
+        ksize = (uint16_t) save_ksize;
+        _n_probes = save_n_probes;
+        _max_table = save_max_table;
+        _n_blocks = save_n_blocks;
+        _occupied_bins = save_occupied_bins;
+        _n_unique_kmers = save_n_unique_kmers;
+
+        _allocate_blocks();
+
+        char * buffer = reinterpret_cast<char*>(_blocks);
+        unsigned long long tablebytes = _n_blocks * BLOCK_BYTES;
+        unsigned long long loaded = 0;
+        while (loaded != tablebytes) {
+            infile.read(buffer + loaded, tablebytes - loaded);
+            loaded += infile.gcount();
+        }
+        infile.close();
+    } catch (std::ifstream::failure &e) {
+        std::string err;
+        if (infile.eof()) {
+            err = "Unexpected end of k-mer graph file: " + infilename;
+        } else {
+            err = "Error reading from k-mer graph file: " + infilename;
+        }
+        throw GoetiaFileException(err);
+    }
+}
+
+
+void
+BlockedBitStorage::save_mapped(std::string outfilename, uint16_t ksize)
+{
+    if (!_blocks) {
+        throw GoetiaException();
+    }
+
+    MappedFileWriter out(outfilename, SAVED_BLOCKEDHASHBITS);
+
+    out.write<uint32_t>(ksize);
+    out.write<uint16_t>(_n_probes);
+    out.write<uint64_t>(_max_table);
+    out.write<uint64_t>(_n_blocks);
+    out.write<uint64_t>(_occupied_bins);
+    out.write<uint64_t>(_n_unique_kmers);
+    // sections are page-aligned, which keeps the blocks on cache lines
+    out.write_section(_blocks, _n_blocks * BLOCK_BYTES);
+
+    out.close();
+}
+
+
+void
+BlockedBitStorage::load_mapped(std::string infilename, uint16_t &ksize, bool writable)
+{
+    auto mapping = MappedFile::open(infilename, writable);
+    size_t offset = mapping->check_header(SAVED_BLOCKEDHASHBITS);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const uint16_t n_probes = mapping->read<uint16_t>(offset);
+    const uint64_t max_table = mapping->read<uint64_t>(offset);
+    const uint64_t n_blocks = mapping->read<uint64_t>(offset);
+    const uint64_t occupied_bins = mapping->read<uint64_t>(offset);
+    const uint64_t n_unique_kmers = mapping->read<uint64_t>(offset);
+
+    if (n_probes == 0 || n_probes > MAX_PROBES) {
+        throw GoetiaFileException("Invalid number of probes in " + infilename);
+    }
+    if (n_blocks == 0 || n_blocks > mapping->size() / BLOCK_BYTES) {
+        throw GoetiaFileException("Invalid number of blocks in " + infilename);
+    }
+
+    byte_t * blocks = mapping->section(offset, n_blocks * BLOCK_BYTES);
+
+    _free_blocks();
+    _n_probes = n_probes;
+    _max_table = max_table;
+    _n_blocks = n_blocks;
+    _occupied_bins = occupied_bins;
+    _n_unique_kmers = n_unique_kmers;
+    _blocks = reinterpret_cast<uint64_t*>(blocks);
+    _raw_tables[0] = blocks;
+    _mapping = mapping;
+}
+
+
+template <typename Op>
+void
+BlockedBitStorage::_combine(const BlockedBitStorage& other, Op op)
+{
+    if (_n_blocks != other._n_blocks || _n_probes != other._n_probes) {
+        throw GoetiaException("both BlockedBitStorages must have the same blocks and probes");
+    }
+    if (&other == this) {
+        throw GoetiaException("Cannot combine a storage with itself.");
+    }
+    check_writable(_mapping);
+
+    uint64_t occupied = 0;
+    const uint64_t n_words = _n_blocks * BLOCK_WORDS;
+    parallel_chunks(n_words * sizeof(uint64_t), [&](size_t begin, size_t end) {
+        uint64_t *       me = _blocks + begin / sizeof(uint64_t);
+        const uint64_t * ot = other._blocks + begin / sizeof(uint64_t);
+        const size_t     n  = (end - begin) / sizeof(uint64_t);
+
+        uint64_t bits = 0;
+        for (size_t i = 0; i < n; ++i) {
+            me[i] = op(me[i], ot[i]);
+            bits += __builtin_popcountll(me[i]);
+        }
+        __sync_add_and_fetch(&occupied, bits);
+    });
+
+    _occupied_bins = occupied;
+    _n_unique_kmers = estimated_cardinality();
+}
+
+
+void
+BlockedBitStorage::merge(const BlockedBitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+
+void
+BlockedBitStorage::intersect(const BlockedBitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a & b; });
+}
+
+
+void
+BlockedBitStorage::subtract(const BlockedBitStorage& other)
+{
+    _combine(other, [](uint64_t a, uint64_t b) { return a & ~b; });
+}
+
+void
+BlockedBitStorage::serialize(std::ofstream& out)
+{
+    serialize_tag<BlockedBitStorage>(out);
+
+    out.write((const char *) &_n_probes, sizeof(_n_probes));
+    out.write((const char *) &_max_table, sizeof(_max_table));
+    out.write((const char *) &_n_blocks, sizeof(_n_blocks));
+    out.write((const char *) &_occupied_bins, sizeof(_occupied_bins));
+    out.write((const char *) &_n_unique_kmers, sizeof(_n_unique_kmers));
+    out.write((const char *) _blocks, _n_blocks * BLOCK_BYTES);
+}
+
+
+std::shared_ptr<BlockedBitStorage>
+BlockedBitStorage::deserialize(std::ifstream& in)
+{
+    deserialize_tag<BlockedBitStorage>(in);
+
+    uint16_t n_probes;
+    uint64_t max_table, n_blocks, occupied_bins, n_unique_kmers;
+    in.read((char *) &n_probes, sizeof(n_probes));
+    in.read((char *) &max_table, sizeof(max_table));
+    in.read((char *) &n_blocks, sizeof(n_blocks));
+    in.read((char *) &occupied_bins, sizeof(occupied_bins));
+    in.read((char *) &n_unique_kmers, sizeof(n_unique_kmers));
+    if (!in) {
+        throw GoetiaFileException("Invalid serialized BlockedBitStorage header.");
+    }
+
+    // the block count is derived from the other parameters
+    auto storage = BlockedBitStorage::build(max_table, n_probes);
+    if (storage->_n_blocks != n_blocks) {
+        throw GoetiaFileException("Serialized BlockedBitStorage has inconsistent block count.");
+    }
+    in.read((char *) storage->_blocks, n_blocks * BLOCK_BYTES);
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized BlockedBitStorage.");
+    }
+    storage->_occupied_bins = occupied_bins;
+    storage->_n_unique_kmers = n_unique_kmers;
+
+    return storage;
+}
+
+
+metrics::MemoryUsage
+BlockedBitStorage::memory_usage() const
+{
+    metrics::MemoryUsage usage;
+    usage.add("blocks", _n_blocks * BLOCK_BYTES);
+    return usage;
+}
@@ -45,9 +45,11 @@
 
 #include "goetia/storage/bytestorage.hh"
 
+#include <algorithm>
 #include <errno.h>
 #include <sstream> // IWYU pragma: keep
 #include <fstream>
+#include <limits>
 #include <iostream>
 
 #include "goetia/goetia.hh"
@@ -58,52 +60,72 @@ using namespace goetia;
 using namespace goetia::storage;
 
 
+byte_t
+ByteStorage::_increment_bin(size_t table, uint64_t bin)
+{
+    byte_t * const cell = _counts[table] + bin;
+    byte_t current_count = __atomic_load_n(cell, __ATOMIC_RELAXED);
+
+    // Saturating increment with a relaxed CAS on the counter byte:
+    // no thread ever pushes a bin past _max_count, and no lock is
+    // taken on the common path. On failure the CAS reloads
+    // current_count and we retry against the new value.
+    do {
+        if (current_count >= _max_count) {
+            break;
+        }
+    } while (!__atomic_compare_exchange_n(cell,
+                                          &current_count,
+                                          (byte_t)(current_count + 1),
+                                          true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    // track occupied bins in the first table only, as proxy
+    // for all.
+    if (current_count == 0 && table == 0) {
+        __sync_add_and_fetch(&_occupied_bins, 1);
+    }
+
+    return current_count;
+}
+
+
+void
+ByteStorage::_increment_bigcount(value_type khash)
+{
+    _bigcounts.increment(khash, _max_count + 1, _max_bigcount);
+}
+
+
+count_t
+ByteStorage::_query_bigcount(value_type khash, count_t min_count) const
+{
+    // if the count is saturated, check in the bigcount structure to
+    // see if we've accumulated more counts.
+    if (min_count == _max_count && _use_bigcount) {
+        _bigcounts.find(khash, min_count);
+    }
+    return min_count;
+}
+
+
 const bool
 ByteStorage::insert(value_type khash) {
+    check_writable(_mapping);
     bool is_new_kmer = false;
     unsigned int  n_full	  = 0;
 
     // add one to each entry in each table.
     for (unsigned int i = 0; i < _n_tables; i++) {
-        const uint64_t bin = khash % _tablesizes[i];
-        byte_t current_count = _counts[ i ][ bin ];
-
-        if (!is_new_kmer) {
-            if (current_count == 0) {
-                is_new_kmer = true;
-
-                // track occupied bins in the first table only, as proxy
-                // for all.
-                if (i == 0) {
-                    __sync_add_and_fetch(&_occupied_bins, 1);
-                }
-            }
-        }
-        // NOTE: Technically, multiple threads can cause the bin to spill
-        //	 over max_count a little, if they all read it as less than
-        //	 max_count before any of them increment it.
-        //	 However, do we actually care if there is a little
-        //	 bit of slop here? It can always be trimmed off later, if
-        //	 that would help with stats.
-
-        if ( _max_count > current_count ) {
-            __sync_add_and_fetch( *(_counts + i) + bin, 1 );
-        } else {
-            n_full++;
-        }
+        byte_t current_count = _increment_bin(i, khash % _tablesizes[i]);
+        is_new_kmer |= (current_count == 0);
+        n_full += (current_count >= _max_count);
     } // for each table
 
     // if all tables are full for this position, then add in bigcounts.
     if (n_full == _n_tables && _use_bigcount) {
-        while (!__sync_bool_compare_and_swap(&_bigcount_spin_lock, 0, 1));
-        if (_bigcounts[khash] == 0) {
-            _bigcounts[khash] = _max_count + 1;
-        } else {
-            if (_bigcounts[khash] < _max_bigcount) {
-                _bigcounts[khash] += 1;
-            }
-        }
-        __sync_bool_compare_and_swap( &_bigcount_spin_lock, 1, 0 );
+        _increment_bigcount(khash);
     }
 
     if (is_new_kmer) {
@@ -117,26 +139,18 @@ ByteStorage::insert(value_type khash) {
 const count_t
 ByteStorage::query(value_type khash) const
 {
-    count_t	 max_count	= _max_count;
-    count_t  min_count	= max_count; // bound count by max.
+    count_t  min_count	= _max_count; // bound count by max.
 
     // first, get the min count across all tables (standard CMS).
     for (unsigned int i = 0; i < _n_tables; i++) {
-        count_t the_count = _counts[i][khash % _tablesizes[i]];
+        count_t the_count = __atomic_load_n(_counts[i] + (khash % _tablesizes[i]),
+                                            __ATOMIC_RELAXED);
         if (the_count < min_count) {
             min_count = the_count;
         }
     }
 
-    // if the count is saturated, check in the bigcount structure to
-    // see if we've accumulated more counts.
-    if (min_count == max_count && _use_bigcount) {
-        CountMap::const_iterator it = _bigcounts.find(khash);
-        if (it != _bigcounts.end()) {
-            min_count = it->second;
-        }
-    }
-    return min_count;
+    return _query_bigcount(khash, min_count);
 }
 
 
@@ -151,6 +165,125 @@ ByteStorage::insert_and_query(value_type khash)
 }
 
 
+uint64_t
+ByteStorage::insert_many(const value_type * khashes,
+                         size_t             n,
+                         count_t *          counts)
+{
+    check_writable(_mapping);
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+    // saturated k-mers and their positions, promoted to the bigcounts in
+    // one batch at the end
+    std::vector<value_type> saturated;
+    std::vector<size_t> saturated_at;
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin, 1);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            const value_type khash = khashes[start + j];
+            bool is_new_kmer = false;
+            unsigned int n_full = 0;
+            count_t min_count = _max_count;
+
+            for (size_t i = 0; i < _n_tables; ++i) {
+                byte_t current_count = _increment_bin(i, bins[j * _n_tables + i]);
+                is_new_kmer |= (current_count == 0);
+                n_full += (current_count >= _max_count);
+                // post-increment count, saturating at _max_count
+                count_t the_count = std::min<count_t>(current_count + 1, _max_count);
+                if (the_count < min_count) {
+                    min_count = the_count;
+                }
+            }
+
+            if (n_full == _n_tables && _use_bigcount) {
+                saturated.push_back(khash);
+                saturated_at.push_back(start + j);
+            }
+
+            if (is_new_kmer) {
+                __sync_add_and_fetch(&_n_unique_kmers, 1);
+                ++n_new;
+            }
+
+            if (counts) {
+                counts[start + j] = is_new_kmer ? 1 : _query_bigcount(khash, min_count);
+            }
+        }
+    }
+
+    if (!saturated.empty()) {
+        // each position gets the bigcount as of its own increment, as a
+        // single insert would report, rather than the batch's last
+        if (counts) {
+            const count_t max_bigcount = std::min<uint32_t>(_max_bigcount,
+                                                            std::numeric_limits<count_t>::max());
+            std::unordered_map<value_type, count_t> running;
+            for (size_t i = 0; i < saturated.size(); ++i) {
+                auto it = running.find(saturated[i]);
+                if (it == running.end()) {
+                    it = running.emplace(saturated[i],
+                                         _query_bigcount(saturated[i], _max_count)).first;
+                }
+                if (it->second < max_bigcount) {
+                    ++it->second;
+                }
+                counts[saturated_at[i]] = it->second;
+            }
+        }
+        _bigcounts.increment_many(saturated.data(), saturated.size(),
+                                  _max_count + 1, _max_bigcount);
+    }
+
+    return n_new;
+}
+
+
+void
+ByteStorage::query_many(const value_type * khashes,
+                        size_t             n,
+                        count_t *          counts) const
+{
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin, 0);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            count_t min_count = _max_count;
+            for (size_t i = 0; i < _n_tables; ++i) {
+                count_t the_count = __atomic_load_n(_counts[i] + bins[j * _n_tables + i],
+                                                    __ATOMIC_RELAXED);
+                if (the_count < min_count) {
+                    min_count = the_count;
+                }
+            }
+            counts[start + j] = _query_bigcount(khashes[start + j], min_count);
+        }
+    }
+}
+
+
 void ByteStorageFile::save(
     const std::string   &outfilename,
     uint16_t ksize,
@@ -194,14 +327,7 @@ ByteStorageFileReader::ByteStorageFileReader(
         throw GoetiaFileException(err);
     }
 
-    if (store._counts) {
-        for (unsigned int i = 0; i < store._n_tables; i++) {
-            delete[] store._counts[i];
-            store._counts[i] = NULL;
-        }
-        delete[] store._counts;
-        store._counts = NULL;
-    }
+    store._free_counters();
     store._tablesizes.clear();
 
     try {
@@ -260,7 +386,7 @@ ByteStorageFileReader::ByteStorageFileReader(
             tablesize = save_tablesize;
             store._tablesizes.push_back(tablesize);
 
-            store._counts[i] = new byte_t[tablesize];
+            store._counts[i] = store._allocator.allocate(tablesize, i);
 
             unsigned long long loaded = 0;
             while (loaded != tablesize) {
@@ -281,7 +407,7 @@ ByteStorageFileReader::ByteStorageFileReader(
             for (uint64_t n = 0; n < n_counts; n++) {
                 infile.read((char *) &kmer, sizeof(kmer));
                 infile.read((char *) &count, sizeof(count));
-                store._bigcounts[kmer] = count;
+                store._bigcounts.set(kmer, count);
             }
         }
 
@@ -313,14 +439,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
         throw GoetiaFileException(err);
     }
 
-    if (store._counts) {
-        for (unsigned int i = 0; i < store._n_tables; i++) {
-            delete[] store._counts[i];
-            store._counts[i] = NULL;
-        }
-        delete[] store._counts;
-        store._counts = NULL;
-    }
+    store._free_counters();
     store._tablesizes.clear();
 
     unsigned int save_ksize = 0;
@@ -405,7 +524,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
         tablesize = save_tablesize;
         store._tablesizes.push_back(tablesize);
 
-        store._counts[i] = new byte_t[tablesize];
+        store._counts[i] = store._allocator.allocate(tablesize, i);
 
         uint64_t loaded = 0;
         while (loaded != tablesize) {
@@ -471,7 +590,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
                 throw GoetiaFileException(err);
             }
 
-            store._bigcounts[kmer] = count;
+            store._bigcounts.set(kmer, count);
         }
     }
 
@@ -523,12 +642,10 @@ ByteStorageFileWriter::ByteStorageFileWriter(
     outfile.write((const char *) &n_counts, sizeof(n_counts));
 
     if (n_counts) {
-        typename ByteStorage::CountMap::const_iterator it = store._bigcounts.begin();
-
-        for (; it != store._bigcounts.end(); ++it) {
-            outfile.write((const char *) &it->first, sizeof(it->first));
-            outfile.write((const char *) &it->second, sizeof(it->second));
-        }
+        store._bigcounts.for_each([&](uint64_t kmer, count_t count) {
+            outfile.write((const char *) &kmer, sizeof(kmer));
+            outfile.write((const char *) &count, sizeof(count));
+        });
     }
     if (outfile.fail()) {
         throw GoetiaFileException(strerror(errno));
@@ -625,12 +742,10 @@ ByteStorageGzFileWriter::ByteStorageGzFileWriter(
     gzwrite(outfile, (const char *) &n_counts, sizeof(n_counts));
 
     if (n_counts) {
-        typename ByteStorage::CountMap::const_iterator it = store._bigcounts.begin();
-
-        for (; it != store._bigcounts.end(); ++it) {
-            gzwrite(outfile, (const char *) &it->first, sizeof(it->first));
-            gzwrite(outfile, (const char *) &it->second, sizeof(it->second));
-        }
+        store._bigcounts.for_each([&](uint64_t kmer, count_t count) {
+            gzwrite(outfile, (const char *) &kmer, sizeof(kmer));
+            gzwrite(outfile, (const char *) &count, sizeof(count));
+        });
     }
     const char * error = gzerror(outfile, &errnum);
     if (errnum == Z_ERRNO) {
@@ -667,3 +782,257 @@ void ByteStorage::load(std::string infilename, uint16_t& ksize)
     ByteStorageFile::load(infilename, ksize, *this);
 }
 
+
+void ByteStorage::save_mapped(std::string outfilename, uint16_t ksize)
+{
+    if (!_counts[0]) {
+        throw GoetiaException();
+    }
+
+    MappedFileWriter out(outfilename, SAVED_COUNTING_HT);
+
+    out.write<uint32_t>(ksize);
+    out.write<uint8_t>(_use_bigcount);
+    out.write<uint32_t>(_n_tables);
+    out.write<uint64_t>(_occupied_bins);
+    out.write<uint64_t>(_n_unique_kmers);
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write<uint64_t>(_tablesizes[i]);
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write_section(_counts[i], _tablesizes[i]);
+    }
+
+    // bigcounts follow as sorted sections, searched in place once mapped
+    _bigcounts.save_mapped(out);
+
+    out.close();
+}
+
+
+void ByteStorage::load_mapped(std::string infilename, uint16_t& ksize, bool writable)
+{
+    auto mapping = MappedFile::open(infilename, writable);
+    size_t offset = mapping->check_header(SAVED_COUNTING_HT);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const bool use_bigcount = mapping->read<uint8_t>(offset);
+    const uint32_t n_tables = mapping->read<uint32_t>(offset);
+    const uint64_t occupied_bins = mapping->read<uint64_t>(offset);
+    const uint64_t n_unique_kmers = mapping->read<uint64_t>(offset);
+    if (n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid number of tables in " + infilename);
+    }
+
+    std::vector<uint64_t> tablesizes;
+    for (uint32_t i = 0; i < n_tables; i++) {
+        tablesizes.push_back(mapping->read<uint64_t>(offset));
+    }
+
+    std::unique_ptr<byte_t*[]> counts(new byte_t*[n_tables]);
+    for (uint32_t i = 0; i < n_tables; i++) {
+        counts[i] = mapping->section(offset, tablesizes[i]);
+    }
+
+    _free_counters();
+    _tablesizes = tablesizes;
+    _n_tables = n_tables;
+    _occupied_bins = occupied_bins;
+    _n_unique_kmers = n_unique_kmers;
+    _use_bigcount = use_bigcount;
+    _bigcounts.load_mapped(mapping, offset);
+    _counts = counts.release();
+    _mapping = mapping;
+}
+
+
+template <typename Op, typename FullOp>
+void
+ByteStorage::_combine(const ByteStorage& other, Op op, FullOp full_op)
+{
+    if (_tablesizes != other._tablesizes) {
+        throw GoetiaException("both countgraphs must have same table sizes");
+    }
+    if (&other == this) {
+        throw GoetiaException("Cannot combine a storage with itself.");
+    }
+    check_writable(_mapping);
+
+    // the bigcounts need both sides' counts from before the tables change;
+    // for_each releases each shard before calling back, so query is safe
+    CountMap bigcounts;
+    std::unordered_map<value_type, int> combined;
+    if (_use_bigcount) {
+        for (const BigCountMap * source : {(const BigCountMap *) &_bigcounts, &other._bigcounts}) {
+            source->for_each([&](value_type kmer, count_t) {
+                if (!combined.count(kmer)) {
+                    const int count = full_op(query(kmer), other.query(kmer));
+                    combined[kmer] = count;
+                    if (count > _max_count) {
+                        bigcounts[kmer] = std::min<int>({count, (int) _max_bigcount,
+                                                         std::numeric_limits<count_t>::max()});
+                    }
+                }
+            });
+        }
+    }
+
+    uint64_t occupied = 0;
+    for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
+        byte_t * __restrict__ me = _counts[table_num];
+        const byte_t * __restrict__ ot = other._counts[table_num];
+
+        parallel_chunks(_tablesizes[table_num], [&](size_t begin, size_t end) {
+            uint64_t nonzero = 0;
+            // plain byte loops, which the compiler vectorizes
+            for (size_t index = begin; index < end; index++) {
+                me[index] = op(me[index], ot[index]);
+                nonzero += me[index] != 0;
+            }
+            if (table_num == 0) {
+                __sync_add_and_fetch(&occupied, nonzero);
+            }
+        });
+    }
+
+    // saturated counters don't combine like the counts behind them, eg
+    // 400 - 300 subtracts to 255 - 255; raise each bigcount k-mer's bins
+    // back up to its combined count, as its own inserts would have
+    for (const auto& it : combined) {
+        const byte_t floor = (byte_t) std::min<int>(it.second, _max_count);
+        for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
+            byte_t& bin = _counts[table_num][it.first % _tablesizes[table_num]];
+            if (bin < floor) {
+                occupied += table_num == 0 && bin == 0;
+                bin = floor;
+            }
+        }
+    }
+
+    _bigcounts.assign(bigcounts);
+
+    _occupied_bins = occupied;
+    _n_unique_kmers = estimated_cardinality();
+}
+
+
+void
+ByteStorage::merge(const ByteStorage& other)
+{
+    const int max_count = _max_count;
+    _combine(other,
+             [max_count](byte_t a, byte_t b) {
+                 return (byte_t) std::min<int>(a + b, max_count);
+             },
+             [](int a, int b) { return a + b; });
+}
+
+
+void
+ByteStorage::intersect(const ByteStorage& other)
+{
+    _combine(other,
+             [](byte_t a, byte_t b) { return std::min(a, b); },
+             [](int a, int b) { return std::min(a, b); });
+}
+
+
+void
+ByteStorage::subtract(const ByteStorage& other)
+{
+    _combine(other,
+             [](byte_t a, byte_t b) { return (byte_t)(a > b ? a - b : 0); },
+             [](int a, int b) { return std::max(a - b, 0); });
+}
+
+void
+ByteStorage::serialize(std::ofstream& out)
+{
+    serialize_tag<ByteStorage>(out);
+
+    uint8_t use_bigcount = _use_bigcount;
+    out.write((const char *) &use_bigcount, sizeof(use_bigcount));
+
+    uint64_t n_tables = _n_tables;
+    out.write((const char *) &n_tables, sizeof(n_tables));
+    out.write((const char *) &_occupied_bins, sizeof(_occupied_bins));
+    out.write((const char *) &_n_unique_kmers, sizeof(_n_unique_kmers));
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) &_tablesizes[i], sizeof(_tablesizes[i]));
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) _counts[i], _tablesizes[i]);
+    }
+
+    std::vector<std::pair<value_type, count_t>> bigcounts;
+    _bigcounts.for_each([&](value_type kmer, count_t count) {
+        bigcounts.emplace_back(kmer, count);
+    });
+    uint64_t n_bigcounts = bigcounts.size();
+    out.write((const char *) &n_bigcounts, sizeof(n_bigcounts));
+    for (const auto& it : bigcounts) {
+        out.write((const char *) &it.first, sizeof(it.first));
+        out.write((const char *) &it.second, sizeof(it.second));
+    }
+}
+
+
+std::shared_ptr<ByteStorage>
+ByteStorage::deserialize(std::ifstream& in)
+{
+    deserialize_tag<ByteStorage>(in);
+
+    uint8_t use_bigcount = 0;
+    in.read((char *) &use_bigcount, sizeof(use_bigcount));
+
+    uint64_t n_tables, occupied_bins, n_unique_kmers;
+    in.read((char *) &n_tables, sizeof(n_tables));
+    in.read((char *) &occupied_bins, sizeof(occupied_bins));
+    in.read((char *) &n_unique_kmers, sizeof(n_unique_kmers));
+    if (!in || n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid serialized ByteStorage header.");
+    }
+
+    std::vector<uint64_t> tablesizes(n_tables);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) &tablesizes[i], sizeof(tablesizes[i]));
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized ByteStorage.");
+    }
+
+    auto storage = std::make_shared<ByteStorage>(tablesizes);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) storage->_counts[i], tablesizes[i]);
+    }
+
+    uint64_t n_bigcounts = 0;
+    in.read((char *) &n_bigcounts, sizeof(n_bigcounts));
+    for (uint64_t i = 0; in && i < n_bigcounts; i++) {
+        value_type kmer;
+        count_t count;
+        in.read((char *) &kmer, sizeof(kmer));
+        in.read((char *) &count, sizeof(count));
+        storage->_bigcounts.set(kmer, count);
+    }
+    storage->_use_bigcount = use_bigcount;
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized ByteStorage.");
+    }
+    storage->_occupied_bins = occupied_bins;
+    storage->_n_unique_kmers = n_unique_kmers;
+
+    return storage;
+}
+
+
+metrics::MemoryUsage
+ByteStorage::memory_usage() const
+{
+    metrics::MemoryUsage usage;
+    for (size_t i = 0; i < _n_tables; i++) {
+        usage.add("tables", _tablesizes[i]);
+    }
+    usage.add("bigcounts", _bigcounts.memory_usage());
+    return usage;
+}
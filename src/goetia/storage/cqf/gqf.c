@@ -1494,7 +1494,9 @@ int qfi_next(QFi *qfi)
 
 		if (!is_runend(qfi->qf, qfi->current)) {
 			qfi->current++;
-			if (qfi->current > qfi->qf->nslots)
+			/* a run can spill past nslots into the extra slots, so only
+			 * stop at the true end of the table */
+			if (qfi->current >= qfi->qf->xnslots)
 				return 1;
 			return 0;
 		}
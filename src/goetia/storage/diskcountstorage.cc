@@ -0,0 +1,666 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : diskcountstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/diskcountstorage.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <functional>
+#include <queue>
+#include <sstream> // IWYU pragma: keep
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace goetia {
+
+namespace storage {
+
+
+/*
+ * Reads the records of one merge input a READ_BUFFER at a time: a
+ * spilled run, or the partition's merged arrays from an earlier finalize.
+ */
+class MergeCursor {
+
+    std::ifstream                          _in;
+    uint64_t                               _remaining;
+    std::vector<DiskCountStorage::Record>  _buffer;
+    size_t                                 _pos;
+
+    const uint64_t *                       _hashes;
+    const uint32_t *                       _counts;
+
+public:
+
+    DiskCountStorage::Record current;
+
+    MergeCursor(const std::string& run_file, uint64_t offset, uint64_t n_records)
+        : _in(run_file.c_str(), std::ios::binary),
+          _remaining(n_records),
+          _pos(0),
+          _hashes(nullptr),
+          _counts(nullptr)
+    {
+        if (!_in.is_open()) {
+            throw GoetiaFileException("Cannot open run file: " + run_file);
+        }
+        _in.seekg(offset);
+    }
+
+    MergeCursor(const uint64_t * hashes, const uint32_t * counts, uint64_t size)
+        : _remaining(size),
+          _pos(0),
+          _hashes(hashes),
+          _counts(counts)
+    {
+    }
+
+    // Move to the next record; false once there are none.
+    bool next() {
+        if (!_remaining) {
+            return false;
+        }
+        --_remaining;
+        if (_hashes) {
+            current.hash = *_hashes++;
+            current.count = *_counts++;
+            return true;
+        }
+        if (_pos == _buffer.size()) {
+            _buffer.resize(std::min<uint64_t>(_remaining + 1, DiskCountStorage::READ_BUFFER));
+            _in.read((char *) _buffer.data(), _buffer.size() * sizeof(DiskCountStorage::Record));
+            if (!_in) {
+                throw GoetiaFileException("Unexpected end of run file while merging");
+            }
+            _pos = 0;
+        }
+        current = _buffer[_pos++];
+        return true;
+    }
+};
+
+
+/*
+ * K-way merge of the cursors, calling emit(hash, count) once per distinct
+ * hash in order with the counts of every cursor holding it summed.
+ */
+template<typename Emit>
+static void
+_kway_merge(std::vector<std::unique_ptr<MergeCursor>>& cursors, Emit emit)
+{
+    typedef std::pair<uint64_t, size_t> entry_type;
+    std::priority_queue<entry_type, std::vector<entry_type>, std::greater<entry_type>> heap;
+    for (size_t c = 0; c < cursors.size(); ++c) {
+        if (cursors[c]->next()) {
+            heap.emplace(cursors[c]->current.hash, c);
+        }
+    }
+
+    while (!heap.empty()) {
+        const uint64_t h = heap.top().first;
+        uint64_t count = 0;
+        while (!heap.empty() && heap.top().first == h) {
+            const size_t c = heap.top().second;
+            heap.pop();
+            count += cursors[c]->current.count;
+            if (cursors[c]->next()) {
+                heap.emplace(cursors[c]->current.hash, c);
+            }
+        }
+        emit(h, count);
+    }
+}
+
+
+DiskCountStorage::DiskCountStorage(const std::string& directory,
+                                   uint64_t           buffer_bytes,
+                                   uint16_t           n_partitions)
+    : _parent(directory),
+      _buffer_bytes(buffer_bytes),
+      _n_partitions(n_partitions),
+      _partition_shift(64 - __builtin_ctz(std::max<uint16_t>(n_partitions, 1))),
+      _keep(false),
+      _partitions(n_partitions),
+      _n_pending(0),
+      _n_runs(0),
+      _lock(0)
+{
+    if (n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+        throw GoetiaException("DiskCountStorage n_partitions must be a power of two, got "
+                              + std::to_string(n_partitions));
+    }
+    if (buffer_bytes < sizeof(value_type)) {
+        throw GoetiaException("DiskCountStorage buffer_bytes is too small to hold a hash");
+    }
+    _make_directory();
+}
+
+
+DiskCountStorage::~DiskCountStorage()
+{
+    for (auto& partition : _partitions) {
+        partition.hashes_map.reset();
+        partition.counts_map.reset();
+    }
+    try {
+        _remove_files();
+    } catch (...) {
+    }
+}
+
+
+std::string
+DiskCountStorage::_path(size_t partition, const std::string& kind) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/part-%05zu.", partition);
+    return _directory + name + kind;
+}
+
+
+void
+DiskCountStorage::_make_directory()
+{
+    if (mkdir(_parent.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw GoetiaFileException("Cannot create directory " + _parent + ": "
+                                  + strerror(errno));
+    }
+    std::string name = _parent + "/goetia-counts-XXXXXX";
+    if (!mkdtemp(&name[0])) {
+        throw GoetiaFileException("Cannot create working directory in " + _parent
+                                  + ": " + strerror(errno));
+    }
+    _directory = name;
+}
+
+
+void
+DiskCountStorage::_remove_files()
+{
+    // runs are always scratch; the merged arrays and directory stay if
+    // a manifest refers to them
+    for (size_t p = 0; p < _n_partitions; ++p) {
+        unlink(_path(p, "run").c_str());
+        unlink(_path(p, "run.tmp").c_str());
+    }
+    if (_keep) {
+        return;
+    }
+    for (size_t p = 0; p < _n_partitions; ++p) {
+        unlink(_path(p, "hashes").c_str());
+        unlink(_path(p, "counts").c_str());
+    }
+    rmdir(_directory.c_str());
+}
+
+
+void
+DiskCountStorage::_spill()
+{
+    if (_buffer.empty()) {
+        return;
+    }
+    std::sort(_buffer.begin(), _buffer.end());
+
+    // the buffer holds mixed hashes, so it sorts into partition order
+    std::vector<Record> records;
+    records.reserve(READ_BUFFER);
+    size_t i = 0;
+    while (i < _buffer.size()) {
+        const size_t partition = _partition_for(_buffer[i]);
+        Partition& part = _partitions[partition];
+        const std::string run_file = _path(partition, "run");
+        std::ofstream out(run_file.c_str(), std::ios::binary | std::ios::app);
+        if (!out.is_open()) {
+            throw GoetiaFileException("Cannot open run file for writing: " + run_file);
+        }
+
+        const uint64_t offset = part.runs.empty()
+                                ? 0
+                                : part.runs.back().offset + part.runs.back().n_records * sizeof(Record);
+        uint64_t n_records = 0;
+        while (i < _buffer.size() && _partition_for(_buffer[i]) == partition) {
+            const uint64_t h = _buffer[i];
+            uint64_t count = 0;
+            while (i < _buffer.size() && _buffer[i] == h) {
+                ++count;
+                ++i;
+            }
+            records.push_back(Record{h, count});
+            if (records.size() == READ_BUFFER) {
+                out.write((const char *) records.data(), records.size() * sizeof(Record));
+                n_records += records.size();
+                records.clear();
+            }
+        }
+        out.write((const char *) records.data(), records.size() * sizeof(Record));
+        n_records += records.size();
+        records.clear();
+
+        if (out.fail()) {
+            throw GoetiaFileException("Error writing " + run_file + ": " + strerror(errno));
+        }
+        part.runs.push_back(Run{offset, n_records});
+    }
+
+    _buffer.clear();
+    ++_n_runs;
+}
+
+
+void
+DiskCountStorage::_merge_passes(size_t partition)
+{
+    Partition& part = _partitions[partition];
+    const std::string run_file = _path(partition, "run");
+    const std::string pass_file = _path(partition, "run.tmp");
+
+    while (part.runs.size() > MERGE_FAN_IN) {
+        std::ofstream out(pass_file.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw GoetiaFileException("Cannot open run file for writing: " + pass_file);
+        }
+
+        std::vector<Run> merged;
+        std::vector<Record> records;
+        records.reserve(READ_BUFFER);
+        uint64_t offset = 0;
+        for (size_t begin = 0; begin < part.runs.size(); begin += MERGE_FAN_IN) {
+            const size_t end = std::min(begin + MERGE_FAN_IN, part.runs.size());
+            std::vector<std::unique_ptr<MergeCursor>> cursors;
+            for (size_t r = begin; r < end; ++r) {
+                cursors.emplace_back(new MergeCursor(run_file, part.runs[r].offset,
+                                                     part.runs[r].n_records));
+            }
+
+            uint64_t n_records = 0;
+            _kway_merge(cursors, [&](uint64_t h, uint64_t count) {
+                records.push_back(Record{h, count});
+                if (records.size() == READ_BUFFER) {
+                    out.write((const char *) records.data(), records.size() * sizeof(Record));
+                    n_records += records.size();
+                    records.clear();
+                }
+            });
+            out.write((const char *) records.data(), records.size() * sizeof(Record));
+            n_records += records.size();
+            records.clear();
+
+            merged.push_back(Run{offset, n_records});
+            offset += n_records * sizeof(Record);
+        }
+
+        out.close();
+        if (out.fail()) {
+            throw GoetiaFileException("Error writing " + pass_file + ": " + strerror(errno));
+        }
+        if (rename(pass_file.c_str(), run_file.c_str()) != 0) {
+            throw GoetiaFileException("Cannot replace run file " + run_file + ": "
+                                      + strerror(errno));
+        }
+        part.runs.swap(merged);
+    }
+}
+
+
+void
+DiskCountStorage::_merge(size_t partition)
+{
+    Partition& part = _partitions[partition];
+    if (part.runs.empty()) {
+        return;
+    }
+
+    // the merged arrays are read in place, so only the runs hold files
+    // and buffers open
+    _merge_passes(partition);
+
+    std::vector<std::unique_ptr<MergeCursor>> cursors;
+    if (part.size) {
+        cursors.emplace_back(new MergeCursor(part.hashes, part.counts, part.size));
+    }
+    const std::string run_file = _path(partition, "run");
+    for (const auto& run : part.runs) {
+        cursors.emplace_back(new MergeCursor(run_file, run.offset, run.n_records));
+    }
+
+    const std::string hashes_file = _path(partition, "hashes.tmp");
+    const std::string counts_file = _path(partition, "counts.tmp");
+    std::ofstream hashes_out(hashes_file.c_str(), std::ios::binary);
+    std::ofstream counts_out(counts_file.c_str(), std::ios::binary);
+    if (!hashes_out.is_open() || !counts_out.is_open()) {
+        throw GoetiaFileException("Cannot open merge output in " + _directory);
+    }
+
+    std::vector<uint64_t> out_hashes;
+    std::vector<full_count_type> out_counts;
+    uint64_t n_merged = 0;
+    auto flush = [&]() {
+        hashes_out.write((const char *) out_hashes.data(), out_hashes.size() * sizeof(uint64_t));
+        counts_out.write((const char *) out_counts.data(), out_counts.size() * sizeof(full_count_type));
+        n_merged += out_hashes.size();
+        out_hashes.clear();
+        out_counts.clear();
+    };
+
+    _kway_merge(cursors, [&](uint64_t h, uint64_t count) {
+        out_hashes.push_back(h);
+        out_counts.push_back(std::min<uint64_t>(count, std::numeric_limits<full_count_type>::max()));
+        if (out_hashes.size() == READ_BUFFER) {
+            flush();
+        }
+    });
+    flush();
+    hashes_out.close();
+    counts_out.close();
+    if (hashes_out.fail() || counts_out.fail()) {
+        throw GoetiaFileException("Error writing merged partition in " + _directory
+                                  + ": " + strerror(errno));
+    }
+
+    cursors.clear();
+    part.hashes_map.reset();
+    part.counts_map.reset();
+    if (rename(hashes_file.c_str(), _path(partition, "hashes").c_str()) != 0 ||
+        rename(counts_file.c_str(), _path(partition, "counts").c_str()) != 0) {
+        throw GoetiaFileException("Cannot replace merged partition in " + _directory
+                                  + ": " + strerror(errno));
+    }
+    unlink(run_file.c_str());
+    part.runs.clear();
+
+    _map(partition, n_merged);
+}
+
+
+void
+DiskCountStorage::_map(size_t partition, uint64_t size)
+{
+    Partition& part = _partitions[partition];
+    part.size = size;
+    part.samples.clear();
+    if (!size) {
+        // nothing to map: an empty file can't be
+        part.hashes_map.reset();
+        part.counts_map.reset();
+        part.hashes = nullptr;
+        part.counts = nullptr;
+        return;
+    }
+
+    part.hashes_map = MappedFile::open(_path(partition, "hashes"));
+    part.counts_map = MappedFile::open(_path(partition, "counts"));
+    part.hashes = (const uint64_t *) part.hashes_map->at(0, size * sizeof(uint64_t));
+    part.counts = (const full_count_type *) part.counts_map->at(0, size * sizeof(full_count_type));
+
+    part.samples.reserve(size / SAMPLE_STRIDE + 1);
+    for (uint64_t i = 0; i < size; i += SAMPLE_STRIDE) {
+        part.samples.push_back(part.hashes[i]);
+    }
+}
+
+
+void
+DiskCountStorage::_check_merged() const
+{
+    if (_n_pending) {
+        throw GoetiaException("DiskCountStorage has inserts waiting to be merged; "
+                              "call finalize() first");
+    }
+}
+
+
+std::shared_ptr<DiskCountStorage>
+DiskCountStorage::build(const std::string& directory) {
+    return std::make_shared<DiskCountStorage>(directory);
+}
+
+
+std::shared_ptr<DiskCountStorage>
+DiskCountStorage::build(const std::string& directory,
+                        uint64_t           buffer_bytes) {
+    return std::make_shared<DiskCountStorage>(directory, buffer_bytes);
+}
+
+
+std::shared_ptr<DiskCountStorage>
+DiskCountStorage::build(const std::string& directory,
+                        uint64_t           buffer_bytes,
+                        uint16_t           n_partitions) {
+    return std::make_shared<DiskCountStorage>(directory, buffer_bytes, n_partitions);
+}
+
+
+std::shared_ptr<DiskCountStorage>
+DiskCountStorage::clone() const {
+    return DiskCountStorage::build(_parent, _buffer_bytes, _n_partitions);
+}
+
+
+void
+DiskCountStorage::finalize(size_t n_threads) {
+    _lock_buffer();
+    try {
+        _spill();
+    } catch (...) {
+        _unlock_buffer();
+        throw;
+    }
+    _unlock_buffer();
+
+    if (n_threads == 0) {
+        n_threads = default_threads(_n_partitions);
+    }
+    n_threads = std::max<size_t>(1, std::min<size_t>(n_threads, _n_partitions));
+    uint64_t next = 0;
+    run_threads(n_threads, [&](size_t) {
+        size_t partition;
+        while ((partition = __sync_fetch_and_add(&next, 1)) < _n_partitions) {
+            _merge(partition);
+        }
+    });
+
+    _n_pending = 0;
+    _n_runs = 0;
+}
+
+
+void
+DiskCountStorage::reset() {
+    for (auto& partition : _partitions) {
+        partition.hashes_map.reset();
+        partition.counts_map.reset();
+    }
+    _remove_files();
+
+    _make_directory();
+    _keep = false;
+    _partitions.assign(_n_partitions, Partition());
+    std::vector<value_type>().swap(_buffer);
+    _n_pending = 0;
+    _n_runs = 0;
+}
+
+
+const uint64_t
+DiskCountStorage::n_unique_kmers() const {
+    uint64_t n = 0;
+    for (const auto& partition : _partitions) {
+        n += partition.size;
+    }
+    return n;
+}
+
+
+const bool
+DiskCountStorage::insert(value_type h) {
+    insert_many(&h, 1, nullptr);
+    return false;
+}
+
+
+const count_t
+DiskCountStorage::insert_and_query(value_type /*h*/) {
+    throw GoetiaException("DiskCountStorage counts aren't known until finalize()");
+}
+
+
+uint64_t
+DiskCountStorage::insert_many(const value_type * khashes,
+                              size_t             n,
+                              count_t *          counts) {
+    if (counts) {
+        throw GoetiaException("DiskCountStorage counts aren't known until finalize()");
+    }
+
+    const size_t capacity = _buffer_bytes / sizeof(value_type);
+    _lock_buffer();
+    try {
+        if (_buffer.capacity() < capacity) {
+            _buffer.reserve(capacity);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            _buffer.push_back(_mix(khashes[i]));
+            if (_buffer.size() >= capacity) {
+                _spill();
+            }
+        }
+        _n_pending += n;
+    } catch (...) {
+        _unlock_buffer();
+        throw;
+    }
+    _unlock_buffer();
+    return 0;
+}
+
+
+const DiskCountStorage::full_count_type
+DiskCountStorage::query_count(value_type h) const {
+    _check_merged();
+
+    const uint64_t mixed = _mix(h);
+    const Partition& part = _partitions[_partition_for(mixed)];
+    if (!part.size) {
+        return 0;
+    }
+
+    auto sample = std::upper_bound(part.samples.begin(), part.samples.end(), mixed);
+    if (sample == part.samples.begin()) {
+        return 0;
+    }
+    const uint64_t begin = (sample - part.samples.begin() - 1) * SAMPLE_STRIDE;
+    const uint64_t end = std::min(part.size, begin + SAMPLE_STRIDE);
+    const uint64_t * found = std::lower_bound(part.hashes + begin, part.hashes + end, mixed);
+    if (found != part.hashes + end && *found == mixed) {
+        return part.counts[found - part.hashes];
+    }
+    return 0;
+}
+
+
+const count_t
+DiskCountStorage::query(value_type h) const {
+    return std::min<full_count_type>(query_count(h), std::numeric_limits<count_t>::max());
+}
+
+
+void
+DiskCountStorage::save(std::string filename, uint16_t ksize) {
+    _check_merged();
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                  + filename);
+    }
+    out.write((const char *) &ksize, sizeof(ksize));
+    serialize_tag<DiskCountStorage>(out);
+
+    const uint64_t directory_length = _directory.size();
+    out.write((const char *) &directory_length, sizeof(directory_length));
+    out.write(_directory.c_str(), directory_length);
+    out.write((const char *) &_n_partitions, sizeof(_n_partitions));
+    for (const auto& partition : _partitions) {
+        out.write((const char *) &partition.size, sizeof(partition.size));
+    }
+    if (out.fail()) {
+        throw GoetiaFileException("Error writing " + filename);
+    }
+
+    // the manifest refers to the merged arrays, so they must outlive us
+    _keep = true;
+}
+
+
+void
+DiskCountStorage::load(std::string filename, uint16_t &ksize) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file: " + filename);
+    }
+    uint16_t save_ksize;
+    in.read((char *) &save_ksize, sizeof(save_ksize));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file: " + filename);
+    }
+    deserialize_tag<DiskCountStorage>(in);
+
+    uint64_t directory_length;
+    in.read((char *) &directory_length, sizeof(directory_length));
+    std::string directory(directory_length, '\0');
+    in.read(&directory[0], directory_length);
+    uint16_t n_partitions;
+    in.read((char *) &n_partitions, sizeof(n_partitions));
+    std::vector<uint64_t> sizes(n_partitions);
+    in.read((char *) sizes.data(), n_partitions * sizeof(uint64_t));
+    if (!in || n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+        throw GoetiaFileException("Invalid DiskCountStorage manifest: " + filename);
+    }
+
+    for (auto& partition : _partitions) {
+        partition.hashes_map.reset();
+        partition.counts_map.reset();
+    }
+    _remove_files();
+
+    // the loaded arrays belong to the manifest, not to us
+    _directory = directory;
+    _keep = true;
+    _n_partitions = n_partitions;
+    _partition_shift = 64 - __builtin_ctz(n_partitions);
+    _partitions.assign(n_partitions, Partition());
+    std::vector<value_type>().swap(_buffer);
+    _n_pending = 0;
+    _n_runs = 0;
+    for (size_t p = 0; p < n_partitions; ++p) {
+        _map(p, sizes[p]);
+    }
+    ksize = save_ksize;
+}
+
+
+metrics::MemoryUsage
+DiskCountStorage::memory_usage() const {
+    metrics::MemoryUsage usage;
+    usage.add("buffer", metrics::vector_bytes(_buffer));
+    for (const auto& partition : _partitions) {
+        usage.add("samples", metrics::vector_bytes(partition.samples));
+        usage.add("runs", metrics::vector_bytes(partition.runs));
+        usage.add("mapped", partition.size * (sizeof(uint64_t) + sizeof(full_count_type)));
+    }
+    return usage;
+}
+
+}
+}
@@ -0,0 +1,456 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : flatcountstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/flatcountstorage.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream> // IWYU pragma: keep
+
+namespace goetia {
+
+namespace storage {
+
+// A counter at the top of its tier means the count is in the next one.
+static constexpr uint8_t  PROMOTED_8  = std::numeric_limits<uint8_t>::max();
+static constexpr uint16_t PROMOTED_16 = std::numeric_limits<uint16_t>::max();
+
+
+FlatCountStorage::FlatCountStorage(double   max_load_factor,
+                                   uint16_t n_shards)
+    : _shards(n_shards),
+      _n_shards(n_shards),
+      _shard_shift(64 - __builtin_ctz(std::max<uint16_t>(n_shards, 1))),
+      _max_load_factor(max_load_factor)
+{
+    if (!(max_load_factor > 0.0 && max_load_factor < 1.0)) {
+        throw GoetiaException("FlatCountStorage max_load_factor must be in (0, 1), got "
+                              + std::to_string(max_load_factor));
+    }
+    if (n_shards == 0 || (n_shards & (n_shards - 1))) {
+        throw GoetiaException("FlatCountStorage n_shards must be a power of two, got "
+                              + std::to_string(n_shards));
+    }
+    for (auto& shard : _shards) {
+        _allocate(shard, flat::MIN_CAPACITY);
+    }
+}
+
+
+void
+FlatCountStorage::_allocate(Shard& shard, uint64_t capacity) const {
+    shard.capacity = capacity;
+    shard.growth_limit = flat::growth_limit(capacity, _max_load_factor);
+    shard.size = 0;
+    shard.ctrl.assign(capacity + flat::GROUP_WIDTH, flat::CTRL_EMPTY);
+    shard.slots.assign(capacity, 0);
+    shard.counts.assign(capacity, 0);
+}
+
+
+void
+FlatCountStorage::_rehash(Shard& shard, uint64_t capacity) const {
+    std::vector<byte_t>     old_ctrl;
+    std::vector<value_type> old_slots;
+    std::vector<uint8_t>    old_counts;
+    const uint64_t old_capacity = shard.capacity;
+    old_ctrl.swap(shard.ctrl);
+    old_slots.swap(shard.slots);
+    old_counts.swap(shard.counts);
+
+    _allocate(shard, capacity);
+    const uint64_t mask = capacity - 1;
+    for (uint64_t i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] == flat::CTRL_EMPTY) {
+            continue;
+        }
+        const uint64_t mixed = flat::mix(old_slots[i]);
+        uint64_t pos = flat::h1(mixed, capacity);
+        for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+            uint32_t empty = flat::match_empty(&shard.ctrl[pos]);
+            if (empty) {
+                const uint64_t slot = (pos + __builtin_ctz(empty)) & mask;
+                shard.ctrl[slot] = flat::h2(mixed);
+                if (slot < flat::GROUP_WIDTH) {
+                    shard.ctrl[capacity + slot] = flat::h2(mixed);
+                }
+                shard.slots[slot] = old_slots[i];
+                shard.counts[slot] = old_counts[i];
+                ++shard.size;
+                break;
+            }
+            pos = (pos + stride) & mask;
+        }
+    }
+}
+
+
+uint64_t
+FlatCountStorage::_find(const Shard& shard, value_type h, uint64_t mixed) const {
+    const uint64_t mask = shard.capacity - 1;
+    const byte_t   h2 = flat::h2(mixed);
+    uint64_t pos = flat::h1(mixed, shard.capacity);
+    for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+        for (uint32_t match = flat::match(&shard.ctrl[pos], h2); match; match &= match - 1) {
+            const uint64_t slot = (pos + __builtin_ctz(match)) & mask;
+            if (shard.slots[slot] == h) {
+                return slot;
+            }
+        }
+        if (flat::match_empty(&shard.ctrl[pos])) {
+            return shard.capacity;
+        }
+        pos = (pos + stride) & mask;
+    }
+}
+
+
+uint64_t
+FlatCountStorage::_find_or_insert(Shard&     shard,
+                                  value_type h,
+                                  uint64_t   mixed,
+                                  bool&      is_new) {
+    uint64_t slot = _find(shard, h, mixed);
+    if (slot != shard.capacity) {
+        is_new = false;
+        return slot;
+    }
+
+    if (shard.size + 1 > shard.growth_limit) {
+        _rehash(shard, shard.capacity * 2);
+    }
+    const uint64_t mask = shard.capacity - 1;
+    uint64_t pos = flat::h1(mixed, shard.capacity);
+    for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+        uint32_t empty = flat::match_empty(&shard.ctrl[pos]);
+        if (empty) {
+            slot = (pos + __builtin_ctz(empty)) & mask;
+            break;
+        }
+        pos = (pos + stride) & mask;
+    }
+
+    shard.ctrl[slot] = flat::h2(mixed);
+    if (slot < flat::GROUP_WIDTH) {
+        shard.ctrl[shard.capacity + slot] = flat::h2(mixed);
+    }
+    shard.slots[slot] = h;
+    shard.counts[slot] = 0;
+    ++shard.size;
+    is_new = true;
+    return slot;
+}
+
+
+FlatCountStorage::full_count_type
+FlatCountStorage::_slot_count(const Shard& shard, uint64_t slot) const {
+    const uint8_t count = shard.counts[slot];
+    if (count != PROMOTED_8) {
+        return count;
+    }
+    const value_type h = shard.slots[slot];
+    const uint16_t count16 = shard.counts16.find(h)->second;
+    if (count16 != PROMOTED_16) {
+        return count16;
+    }
+    return shard.counts32.find(h)->second;
+}
+
+
+FlatCountStorage::full_count_type
+FlatCountStorage::_increment(Shard& shard, uint64_t slot) {
+    uint8_t& count = shard.counts[slot];
+    if (count < PROMOTED_8 - 1) {
+        return ++count;
+    }
+
+    const value_type h = shard.slots[slot];
+    if (count == PROMOTED_8 - 1) {
+        count = PROMOTED_8;
+        shard.counts16[h] = PROMOTED_8;
+        return PROMOTED_8;
+    }
+
+    uint16_t& count16 = shard.counts16[h];
+    if (count16 < PROMOTED_16 - 1) {
+        return ++count16;
+    }
+    if (count16 == PROMOTED_16 - 1) {
+        count16 = PROMOTED_16;
+        shard.counts32[h] = PROMOTED_16;
+        return PROMOTED_16;
+    }
+
+    uint32_t& count32 = shard.counts32[h];
+    if (count32 < std::numeric_limits<full_count_type>::max()) {
+        ++count32;
+    }
+    return count32;
+}
+
+
+const bool
+FlatCountStorage::insert(value_type h) {
+    const uint64_t mixed = flat::mix(h);
+    Shard& shard = _shard(mixed);
+    bool is_new;
+
+    _lock(shard);
+    _increment(shard, _find_or_insert(shard, h, mixed, is_new));
+    _unlock(shard);
+    return is_new;
+}
+
+
+const count_t
+FlatCountStorage::insert_and_query(value_type h) {
+    const uint64_t mixed = flat::mix(h);
+    Shard& shard = _shard(mixed);
+    bool is_new;
+
+    _lock(shard);
+    full_count_type count = _increment(shard, _find_or_insert(shard, h, mixed, is_new));
+    _unlock(shard);
+    return _clamp(count);
+}
+
+
+const FlatCountStorage::full_count_type
+FlatCountStorage::query_count(value_type h) const {
+    const uint64_t mixed = flat::mix(h);
+    const Shard& shard = _shard(mixed);
+
+    _lock(shard);
+    const uint64_t slot = _find(shard, h, mixed);
+    full_count_type count = slot == shard.capacity ? 0 : _slot_count(shard, slot);
+    _unlock(shard);
+    return count;
+}
+
+
+const count_t
+FlatCountStorage::query(value_type h) const {
+    return _clamp(query_count(h));
+}
+
+
+const uint64_t
+FlatCountStorage::n_unique_kmers() const {
+    uint64_t sum = 0;
+    for (const auto& shard : _shards) {
+        sum += __atomic_load_n(&shard.size, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+
+const uint64_t
+FlatCountStorage::n_promoted() const {
+    uint64_t sum = 0;
+    for (const auto& shard : _shards) {
+        _lock(shard);
+        sum += shard.counts16.size();
+        _unlock(shard);
+    }
+    return sum;
+}
+
+
+const uint64_t
+FlatCountStorage::n_bytes() const {
+    uint64_t sum = 0;
+    for (const auto& shard : _shards) {
+        _lock(shard);
+        sum += shard.ctrl.size() + shard.capacity * (sizeof(value_type) + sizeof(uint8_t));
+        // as for SparseppSetStorage: the entries plus about half a byte
+        // of group header per bucket
+        sum += shard.counts16.size() * (sizeof(value_type) + sizeof(uint16_t))
+               + shard.counts16.bucket_count() / 2;
+        sum += shard.counts32.size() * (sizeof(value_type) + sizeof(uint32_t))
+               + shard.counts32.bucket_count() / 2;
+        _unlock(shard);
+    }
+    return sum;
+}
+
+
+void
+FlatCountStorage::reset() {
+    for (auto& shard : _shards) {
+        _lock(shard);
+        std::fill(shard.ctrl.begin(), shard.ctrl.end(), flat::CTRL_EMPTY);
+        std::fill(shard.counts.begin(), shard.counts.end(), 0);
+        shard.size = 0;
+        shard.counts16.clear();
+        shard.counts32.clear();
+        _unlock(shard);
+    }
+}
+
+
+std::shared_ptr<FlatCountStorage>
+FlatCountStorage::build() {
+    return std::make_shared<FlatCountStorage>();
+}
+
+
+std::shared_ptr<FlatCountStorage>
+FlatCountStorage::build(double max_load_factor) {
+    return std::make_shared<FlatCountStorage>(max_load_factor);
+}
+
+
+std::shared_ptr<FlatCountStorage>
+FlatCountStorage::build(double max_load_factor, uint16_t n_shards) {
+    return std::make_shared<FlatCountStorage>(max_load_factor, n_shards);
+}
+
+
+std::shared_ptr<FlatCountStorage>
+FlatCountStorage::clone() const {
+    return FlatCountStorage::build(_max_load_factor, _n_shards);
+}
+
+
+template <typename Map>
+static void write_count_map(std::ofstream& out, const Map& map) {
+    uint64_t size = map.size();
+    out.write((const char *) &size, sizeof(size));
+    for (const auto& item : map) {
+        out.write((const char *) &item.first, sizeof(item.first));
+        out.write((const char *) &item.second, sizeof(item.second));
+    }
+}
+
+
+template <typename Map>
+static void read_count_map(std::ifstream& in, Map& map) {
+    uint64_t size;
+    in.read((char *) &size, sizeof(size));
+    for (uint64_t i = 0; i < size && in; ++i) {
+        typename Map::key_type    key;
+        typename Map::mapped_type value;
+        in.read((char *) &key, sizeof(key));
+        in.read((char *) &value, sizeof(value));
+        map[key] = value;
+    }
+}
+
+
+void
+FlatCountStorage::serialize(std::ofstream& out) {
+    serialize_tag<FlatCountStorage>(out);
+    out.write((const char *) &_max_load_factor, sizeof(_max_load_factor));
+    out.write((const char *) &_n_shards, sizeof(_n_shards));
+    for (auto& shard : _shards) {
+        _lock(shard);
+        out.write((const char *) &shard.capacity, sizeof(shard.capacity));
+        out.write((const char *) &shard.size, sizeof(shard.size));
+        out.write((const char *) shard.ctrl.data(), shard.ctrl.size());
+        out.write((const char *) shard.slots.data(), shard.capacity * sizeof(value_type));
+        out.write((const char *) shard.counts.data(), shard.capacity);
+        write_count_map(out, shard.counts16);
+        write_count_map(out, shard.counts32);
+        _unlock(shard);
+    }
+}
+
+
+std::shared_ptr<FlatCountStorage>
+FlatCountStorage::deserialize(std::ifstream& in) {
+    deserialize_tag<FlatCountStorage>(in);
+
+    double   max_load_factor;
+    uint16_t n_shards;
+    in.read((char *) &max_load_factor, sizeof(max_load_factor));
+    in.read((char *) &n_shards, sizeof(n_shards));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading FlatCountStorage");
+    }
+
+    auto storage = FlatCountStorage::build(max_load_factor, n_shards);
+    for (auto& shard : storage->_shards) {
+        uint64_t capacity, size;
+        in.read((char *) &capacity, sizeof(capacity));
+        in.read((char *) &size, sizeof(size));
+        if (!in) {
+            throw GoetiaFileException("Unexpected end of file reading FlatCountStorage");
+        }
+        if (capacity < flat::MIN_CAPACITY || (capacity & (capacity - 1))) {
+            throw GoetiaFileException("Invalid FlatCountStorage capacity: "
+                                      + std::to_string(capacity));
+        }
+        storage->_allocate(shard, capacity);
+        in.read((char *) shard.ctrl.data(), shard.ctrl.size());
+        in.read((char *) shard.slots.data(), capacity * sizeof(value_type));
+        in.read((char *) shard.counts.data(), capacity);
+        read_count_map(in, shard.counts16);
+        read_count_map(in, shard.counts32);
+        shard.size = size;
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading FlatCountStorage");
+    }
+    return storage;
+}
+
+
+void
+FlatCountStorage::save(std::string filename, uint16_t ksize) {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                  + filename);
+    }
+    out.write((const char *) &ksize, sizeof(ksize));
+    serialize(out);
+    if (out.fail()) {
+        throw GoetiaFileException("Error writing " + filename);
+    }
+}
+
+
+void
+FlatCountStorage::load(std::string filename, uint16_t &ksize) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file: " + filename);
+    }
+    uint16_t save_ksize;
+    in.read((char *) &save_ksize, sizeof(save_ksize));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file: " + filename);
+    }
+    auto loaded = FlatCountStorage::deserialize(in);
+
+    _shards.swap(loaded->_shards);
+    _n_shards        = loaded->_n_shards;
+    _shard_shift     = loaded->_shard_shift;
+    _max_load_factor = loaded->_max_load_factor;
+    ksize = save_ksize;
+}
+
+
+metrics::MemoryUsage
+FlatCountStorage::memory_usage() const {
+    metrics::MemoryUsage usage;
+    for (const auto& shard : _shards) {
+        usage.add("ctrl", metrics::vector_bytes(shard.ctrl));
+        usage.add("slots", metrics::vector_bytes(shard.slots));
+        usage.add("counts", metrics::vector_bytes(shard.counts));
+        usage.add("bigcounts", metrics::sparse_map_bytes(shard.counts16)
+                               + metrics::sparse_map_bytes(shard.counts32));
+    }
+    return usage;
+}
+
+}
+
+}
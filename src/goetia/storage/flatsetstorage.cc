@@ -0,0 +1,304 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : flatsetstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/flatsetstorage.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream> // IWYU pragma: keep
+
+namespace goetia {
+
+namespace storage {
+
+
+FlatSetStorage::FlatSetStorage(double max_load_factor)
+    : _capacity(0),
+      _size(0),
+      _growth_limit(0),
+      _max_load_factor(max_load_factor)
+{
+    if (!(max_load_factor > 0.0 && max_load_factor < 1.0)) {
+        throw GoetiaException("FlatSetStorage max_load_factor must be in (0, 1), got "
+                              + std::to_string(max_load_factor));
+    }
+    _allocate(flat::MIN_CAPACITY);
+}
+
+
+void
+FlatSetStorage::_allocate(uint64_t capacity) {
+    _capacity = capacity;
+    _growth_limit = flat::growth_limit(capacity, _max_load_factor);
+    _size = 0;
+    _ctrl.assign(capacity + flat::GROUP_WIDTH, flat::CTRL_EMPTY);
+    _slots.assign(capacity, 0);
+}
+
+
+void
+FlatSetStorage::_rehash(uint64_t capacity) {
+    std::vector<byte_t>     old_ctrl;
+    std::vector<value_type> old_slots;
+    const uint64_t old_capacity = _capacity;
+    old_ctrl.swap(_ctrl);
+    old_slots.swap(_slots);
+
+    _allocate(capacity);
+    for (uint64_t i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] != flat::CTRL_EMPTY) {
+            _insert_new(old_slots[i], flat::mix(old_slots[i]));
+        }
+    }
+}
+
+
+void
+FlatSetStorage::_insert_new(value_type h, uint64_t mixed) {
+    const uint64_t mask = _capacity - 1;
+    uint64_t pos = flat::h1(mixed, _capacity);
+    for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+        uint32_t empty = flat::match_empty(&_ctrl[pos]);
+        if (empty) {
+            const uint64_t slot = (pos + __builtin_ctz(empty)) & mask;
+            _set_ctrl(slot, flat::h2(mixed));
+            _slots[slot] = h;
+            ++_size;
+            return;
+        }
+        pos = (pos + stride) & mask;
+    }
+}
+
+
+bool
+FlatSetStorage::_insert(value_type h, uint64_t mixed) {
+    const uint64_t mask = _capacity - 1;
+    const byte_t   h2 = flat::h2(mixed);
+    uint64_t pos = flat::h1(mixed, _capacity);
+    for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+        for (uint32_t match = flat::match(&_ctrl[pos], h2); match; match &= match - 1) {
+            if (_slots[(pos + __builtin_ctz(match)) & mask] == h) {
+                return false;
+            }
+        }
+        // nothing is erased, so an empty slot ends the probe and is
+        // also the first free slot on it
+        uint32_t empty = flat::match_empty(&_ctrl[pos]);
+        if (empty) {
+            const uint64_t slot = (pos + __builtin_ctz(empty)) & mask;
+            _set_ctrl(slot, h2);
+            _slots[slot] = h;
+            ++_size;
+            return true;
+        }
+        pos = (pos + stride) & mask;
+    }
+}
+
+
+bool
+FlatSetStorage::_contains(value_type h, uint64_t mixed) const {
+    const uint64_t mask = _capacity - 1;
+    const byte_t   h2 = flat::h2(mixed);
+    uint64_t pos = flat::h1(mixed, _capacity);
+    for (uint64_t stride = flat::GROUP_WIDTH; ; stride += flat::GROUP_WIDTH) {
+        for (uint32_t match = flat::match(&_ctrl[pos], h2); match; match &= match - 1) {
+            if (_slots[(pos + __builtin_ctz(match)) & mask] == h) {
+                return true;
+            }
+        }
+        if (flat::match_empty(&_ctrl[pos])) {
+            return false;
+        }
+        pos = (pos + stride) & mask;
+    }
+}
+
+
+const bool
+FlatSetStorage::insert(value_type h) {
+    _reserve(_size + 1);
+    return _insert(h, flat::mix(h));
+}
+
+
+const count_t
+FlatSetStorage::insert_and_query(value_type h) {
+    insert(h);
+    return 1; // its a presence filter so always 1 after insert
+}
+
+
+const count_t
+FlatSetStorage::query(value_type h) const {
+    return _contains(h, flat::mix(h));
+}
+
+
+uint64_t
+FlatSetStorage::insert_many(const value_type * khashes,
+                            size_t             n,
+                            count_t *          counts) {
+    uint64_t mixed[PREFETCH_BATCH];
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+        _reserve(_size + batch);
+
+        for (size_t i = 0; i < batch; ++i) {
+            mixed[i] = flat::mix(khashes[start + i]);
+            _prefetch(mixed[i]);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            n_new += _insert(khashes[start + i], mixed[i]);
+            if (counts) {
+                counts[start + i] = 1;
+            }
+        }
+    }
+    return n_new;
+}
+
+
+void
+FlatSetStorage::query_many(const value_type * khashes,
+                           size_t             n,
+                           count_t *          counts) const {
+    uint64_t mixed[PREFETCH_BATCH];
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+        for (size_t i = 0; i < batch; ++i) {
+            mixed[i] = flat::mix(khashes[start + i]);
+            _prefetch(mixed[i]);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            counts[start + i] = _contains(khashes[start + i], mixed[i]);
+        }
+    }
+}
+
+
+void
+FlatSetStorage::reset() {
+    std::fill(_ctrl.begin(), _ctrl.end(), flat::CTRL_EMPTY);
+    _size = 0;
+}
+
+
+std::shared_ptr<FlatSetStorage>
+FlatSetStorage::build() {
+    return std::make_shared<FlatSetStorage>();
+}
+
+
+std::shared_ptr<FlatSetStorage>
+FlatSetStorage::build(double max_load_factor) {
+    return std::make_shared<FlatSetStorage>(max_load_factor);
+}
+
+
+std::shared_ptr<FlatSetStorage>
+FlatSetStorage::clone() const {
+    return FlatSetStorage::build(_max_load_factor);
+}
+
+
+void
+FlatSetStorage::serialize(std::ofstream& out) {
+    serialize_tag<FlatSetStorage>(out);
+    out.write((const char *) &_max_load_factor, sizeof(_max_load_factor));
+    out.write((const char *) &_capacity, sizeof(_capacity));
+    out.write((const char *) &_size, sizeof(_size));
+    out.write((const char *) _ctrl.data(), _ctrl.size());
+    out.write((const char *) _slots.data(), _slots.size() * sizeof(value_type));
+}
+
+
+std::shared_ptr<FlatSetStorage>
+FlatSetStorage::deserialize(std::ifstream& in) {
+    deserialize_tag<FlatSetStorage>(in);
+
+    double   max_load_factor;
+    uint64_t capacity, size;
+    in.read((char *) &max_load_factor, sizeof(max_load_factor));
+    in.read((char *) &capacity, sizeof(capacity));
+    in.read((char *) &size, sizeof(size));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading FlatSetStorage");
+    }
+    if (capacity < flat::MIN_CAPACITY || (capacity & (capacity - 1))) {
+        throw GoetiaFileException("Invalid FlatSetStorage capacity: "
+                                  + std::to_string(capacity));
+    }
+
+    auto storage = FlatSetStorage::build(max_load_factor);
+    storage->_allocate(capacity);
+    in.read((char *) storage->_ctrl.data(), storage->_ctrl.size());
+    in.read((char *) storage->_slots.data(), capacity * sizeof(value_type));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading FlatSetStorage");
+    }
+    storage->_size = size;
+    return storage;
+}
+
+
+void
+FlatSetStorage::save(std::string filename, uint16_t ksize) {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                  + filename);
+    }
+    out.write((const char *) &ksize, sizeof(ksize));
+    serialize(out);
+    if (out.fail()) {
+        throw GoetiaFileException("Error writing " + filename);
+    }
+}
+
+
+void
+FlatSetStorage::load(std::string filename, uint16_t &ksize) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file: " + filename);
+    }
+    uint16_t save_ksize;
+    in.read((char *) &save_ksize, sizeof(save_ksize));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file: " + filename);
+    }
+    auto loaded = FlatSetStorage::deserialize(in);
+
+    _ctrl.swap(loaded->_ctrl);
+    _slots.swap(loaded->_slots);
+    _capacity        = loaded->_capacity;
+    _size            = loaded->_size;
+    _growth_limit    = loaded->_growth_limit;
+    _max_load_factor = loaded->_max_load_factor;
+    ksize = save_ksize;
+}
+
+
+metrics::MemoryUsage
+FlatSetStorage::memory_usage() const {
+    metrics::MemoryUsage usage;
+    usage.add("ctrl", metrics::vector_bytes(_ctrl));
+    usage.add("slots", metrics::vector_bytes(_slots));
+    return usage;
+}
+
+}
+
+}
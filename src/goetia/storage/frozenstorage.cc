@@ -0,0 +1,520 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : frozenstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/frozenstorage.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream> // IWYU pragma: keep
+
+namespace goetia {
+
+namespace storage {
+
+
+// Words of a packed array of n values of width bits, with a spare word so
+// that a read straddling the last word stays in bounds.
+static uint64_t packed_words(uint64_t n, uint8_t width)
+{
+    return width ? (n * width + 63) / 64 + 1 : 0;
+}
+
+
+FrozenStorage::FrozenStorage()
+    : _bits(nullptr),
+      _ranks(nullptr),
+      _fallback(nullptr),
+      _fingerprints(nullptr),
+      _counts(nullptr),
+      _n_keys(0),
+      _n_level_keys(0),
+      _n_fallback(0),
+      _fingerprint_bits(0),
+      _count_bits(0),
+      _gamma(DEFAULT_GAMMA)
+{
+    _tables = std::make_shared<Tables>();
+}
+
+
+void
+FrozenStorage::_set_packed(uint64_t * words, uint64_t i, uint8_t width, uint64_t value)
+{
+    const uint64_t bit = i * width;
+    const uint64_t word = bit >> 6;
+    const unsigned shift = bit & 63;
+    const uint64_t mask = (1ULL << width) - 1;
+    value &= mask;
+
+    words[word] = (words[word] & ~(mask << shift)) | (value << shift);
+    if (shift + width > 64) {
+        const unsigned spill = 64 - shift;
+        words[word + 1] = (words[word + 1] & ~(mask >> spill)) | (value >> spill);
+    }
+}
+
+
+void
+FrozenStorage::_set_levels(std::vector<uint64_t> level_bits)
+{
+    _level_bits = std::move(level_bits);
+    _level_offsets.clear();
+    uint64_t offset = 0;
+    for (uint64_t n_bits : _level_bits) {
+        _level_offsets.push_back(offset);
+        offset += n_bits;
+    }
+}
+
+
+void
+FrozenStorage::_point_at_tables()
+{
+    _bits = _tables->bits.data();
+    _ranks = _tables->ranks.data();
+    _fallback = _tables->fallback.data();
+    _fingerprints = _tables->fingerprints.data();
+    _counts = _tables->counts.data();
+}
+
+
+uint64_t
+FrozenStorage::_lookup(value_type h) const
+{
+    for (size_t level = 0; level < _level_bits.size(); ++level) {
+        const uint64_t pos = _level_offsets[level]
+                             + _reduce(_level_hash(h, level), _level_bits[level]);
+        if (_bits[pos >> 6] & (1ULL << (pos & 63))) {
+            return _rank(pos);
+        }
+    }
+
+    if (_n_fallback) {
+        const uint64_t * end = _fallback + _n_fallback;
+        const uint64_t * it = std::lower_bound(_fallback, end, h);
+        if (it != end && *it == h) {
+            return _n_level_keys + (it - _fallback);
+        }
+    }
+    return _n_keys;
+}
+
+
+std::shared_ptr<FrozenStorage>
+FrozenStorage::build() {
+    return std::make_shared<FrozenStorage>();
+}
+
+
+std::shared_ptr<FrozenStorage>
+FrozenStorage::build(std::vector<value_type>      hashes,
+                     std::vector<full_count_type> counts,
+                     uint8_t                      fingerprint_bits,
+                     uint8_t                      count_bits,
+                     double                       gamma)
+{
+    if (fingerprint_bits > 32 || count_bits > 32) {
+        throw GoetiaException("FrozenStorage fingerprint_bits and count_bits must be at most 32");
+    }
+    if (!(gamma >= 1.0)) {
+        throw GoetiaException("FrozenStorage gamma must be at least 1, got "
+                              + std::to_string(gamma));
+    }
+    if (!counts.empty() && counts.size() != hashes.size()) {
+        throw GoetiaException("FrozenStorage needs one count per hash");
+    }
+    if (counts.empty()) {
+        count_bits = 0;
+    }
+
+    auto frozen = std::make_shared<FrozenStorage>();
+    auto& tables = *frozen->_tables;
+    frozen->_fingerprint_bits = fingerprint_bits;
+    frozen->_count_bits = count_bits;
+    frozen->_gamma = gamma;
+
+    // Place what each level can: a hash is placed if no other unplaced
+    // hash lands on its bit, and the rest move on to the next level.
+    std::vector<value_type> unplaced(hashes);
+    std::vector<uint64_t> level_bits;
+    for (size_t level = 0; level < MAX_LEVELS && !unplaced.empty(); ++level) {
+        const uint64_t n_bits = std::max<uint64_t>(
+            (uint64_t) std::ceil(gamma * unplaced.size()) + 63, 64) / 64 * 64;
+        std::vector<uint64_t> seen(n_bits / 64, 0);
+        std::vector<uint64_t> collided(n_bits / 64, 0);
+
+        for (value_type h : unplaced) {
+            const uint64_t pos = _reduce(_level_hash(h, level), n_bits);
+            const uint64_t bit = 1ULL << (pos & 63);
+            if (seen[pos >> 6] & bit) {
+                collided[pos >> 6] |= bit;
+            } else {
+                seen[pos >> 6] |= bit;
+            }
+        }
+
+        size_t n_kept = 0;
+        for (value_type h : unplaced) {
+            const uint64_t pos = _reduce(_level_hash(h, level), n_bits);
+            if (collided[pos >> 6] & (1ULL << (pos & 63))) {
+                unplaced[n_kept++] = h;
+            }
+        }
+        unplaced.resize(n_kept);
+
+        for (size_t w = 0; w < seen.size(); ++w) {
+            seen[w] &= ~collided[w];
+        }
+        tables.bits.insert(tables.bits.end(), seen.begin(), seen.end());
+        level_bits.push_back(n_bits);
+    }
+
+    // duplicate hashes collide at every level, so they end up here
+    std::sort(unplaced.begin(), unplaced.end());
+    unplaced.erase(std::unique(unplaced.begin(), unplaced.end()), unplaced.end());
+    tables.fallback = std::move(unplaced);
+
+    const uint64_t words_per_block = RANK_BLOCK / 64;
+    tables.ranks.assign(tables.bits.size() / words_per_block + 1, 0);
+    uint64_t rank = 0;
+    for (size_t w = 0; w < tables.bits.size(); ++w) {
+        if (w % words_per_block == 0) {
+            tables.ranks[w / words_per_block] = rank;
+        }
+        rank += __builtin_popcountll(tables.bits[w]);
+    }
+
+    frozen->_n_level_keys = rank;
+    frozen->_n_fallback = tables.fallback.size();
+    frozen->_n_keys = rank + tables.fallback.size();
+    tables.fingerprints.assign(packed_words(frozen->_n_keys, fingerprint_bits), 0);
+    tables.counts.assign(packed_words(frozen->_n_keys, count_bits), 0);
+    frozen->_set_levels(std::move(level_bits));
+    frozen->_point_at_tables();
+
+    const uint64_t max_count = count_bits ? (1ULL << count_bits) - 1 : 0;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const uint64_t index = frozen->_lookup(hashes[i]);
+        if (fingerprint_bits) {
+            _set_packed(tables.fingerprints.data(), index, fingerprint_bits,
+                        frozen->_fingerprint(hashes[i]));
+        }
+        if (count_bits) {
+            _set_packed(tables.counts.data(), index, count_bits,
+                        std::min<uint64_t>(counts[i], max_count));
+        }
+    }
+
+    return frozen;
+}
+
+
+std::shared_ptr<FrozenStorage>
+FrozenStorage::freeze(const Storage<uint64_t>& source,
+                      std::vector<value_type>  hashes,
+                      bool                     counting,
+                      uint8_t                  fingerprint_bits,
+                      uint8_t                  count_bits)
+{
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    std::vector<count_t> found(hashes.size());
+    source.query_many(hashes.data(), hashes.size(), found.data());
+
+    std::vector<full_count_type> counts;
+    size_t n_kept = 0;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (found[i] > 0) {
+            hashes[n_kept++] = hashes[i];
+            if (counting && count_bits) {
+                counts.push_back(found[i]);
+            }
+        }
+    }
+    hashes.resize(n_kept);
+
+    return build(std::move(hashes), std::move(counts), fingerprint_bits, count_bits);
+}
+
+
+std::shared_ptr<FrozenStorage>
+FrozenStorage::clone() const {
+    return std::make_shared<FrozenStorage>(*this);
+}
+
+
+void
+FrozenStorage::reset() {
+    throw GoetiaException("FrozenStorage is read-only and can't be reset");
+}
+
+
+const bool
+FrozenStorage::insert(value_type /*h*/) {
+    throw GoetiaException("FrozenStorage is read-only");
+}
+
+
+const count_t
+FrozenStorage::insert_and_query(value_type /*h*/) {
+    throw GoetiaException("FrozenStorage is read-only");
+}
+
+
+uint64_t
+FrozenStorage::insert_many(const value_type * /*khashes*/,
+                           size_t             /*n*/,
+                           count_t *          /*counts*/) {
+    throw GoetiaException("FrozenStorage is read-only");
+}
+
+
+const FrozenStorage::full_count_type
+FrozenStorage::query_count(value_type h) const {
+    const uint64_t index = _index(h);
+    if (index == _n_keys) {
+        return 0;
+    }
+    return _count_bits ? _get_packed(_counts, index, _count_bits) : 1;
+}
+
+
+const count_t
+FrozenStorage::query(value_type h) const {
+    return std::min<full_count_type>(query_count(h), std::numeric_limits<count_t>::max());
+}
+
+
+void
+FrozenStorage::query_many(const value_type * khashes,
+                          size_t             n,
+                          count_t *          counts) const {
+    if (_level_bits.empty()) {
+        for (size_t i = 0; i < n; ++i) {
+            counts[i] = query(khashes[i]);
+        }
+        return;
+    }
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+        for (size_t i = 0; i < batch; ++i) {
+            const uint64_t pos = _reduce(_level_hash(khashes[start + i], 0), _level_bits[0]);
+            __builtin_prefetch(&_bits[pos >> 6], 0, 1);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            counts[start + i] = query(khashes[start + i]);
+        }
+    }
+}
+
+
+const uint64_t
+FrozenStorage::n_bytes() const {
+    const uint64_t words = (_level_offsets.empty() ? 0 : _level_offsets.back() + _level_bits.back()) / 64;
+    return (words
+            + words / (RANK_BLOCK / 64) + 1
+            + _n_fallback
+            + packed_words(_n_keys, _fingerprint_bits)
+            + packed_words(_n_keys, _count_bits)) * sizeof(uint64_t);
+}
+
+
+const double
+FrozenStorage::mphf_bits_per_kmer() const {
+    if (!_n_keys) {
+        return 0.0;
+    }
+    const uint64_t words = (_level_offsets.empty() ? 0 : _level_offsets.back() + _level_bits.back()) / 64;
+    return 64.0 * (words + words / (RANK_BLOCK / 64) + 1 + _n_fallback) / _n_keys;
+}
+
+
+const double
+FrozenStorage::bits_per_kmer() const {
+    return _n_keys ? 8.0 * n_bytes() / _n_keys : 0.0;
+}
+
+
+void
+FrozenStorage::save(std::string outfilename, uint16_t ksize) {
+    MappedFileWriter out(outfilename, SAVED_FROZEN);
+
+    out.write<uint32_t>(ksize);
+    out.write<uint64_t>(_n_keys);
+    out.write<uint64_t>(_n_level_keys);
+    out.write<uint64_t>(_n_fallback);
+    out.write<uint8_t>(_fingerprint_bits);
+    out.write<uint8_t>(_count_bits);
+    out.write<double>(_gamma);
+    out.write<uint32_t>(_level_bits.size());
+    for (uint64_t n_bits : _level_bits) {
+        out.write<uint64_t>(n_bits);
+    }
+
+    uint64_t words = 0;
+    for (uint64_t n_bits : _level_bits) {
+        words += n_bits / 64;
+    }
+    out.write_section(_bits, words * sizeof(uint64_t));
+    out.write_section(_ranks, (words / (RANK_BLOCK / 64) + 1) * sizeof(uint64_t));
+    out.write_section(_fallback, _n_fallback * sizeof(uint64_t));
+    out.write_section(_fingerprints, packed_words(_n_keys, _fingerprint_bits) * sizeof(uint64_t));
+    out.write_section(_counts, packed_words(_n_keys, _count_bits) * sizeof(uint64_t));
+
+    out.close();
+}
+
+
+void
+FrozenStorage::load(std::string infilename, uint16_t &ksize) {
+    auto mapping = MappedFile::open(infilename, false);
+    size_t offset = mapping->check_header(SAVED_FROZEN);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const uint64_t n_keys = mapping->read<uint64_t>(offset);
+    const uint64_t n_level_keys = mapping->read<uint64_t>(offset);
+    const uint64_t n_fallback = mapping->read<uint64_t>(offset);
+    const uint8_t fingerprint_bits = mapping->read<uint8_t>(offset);
+    const uint8_t count_bits = mapping->read<uint8_t>(offset);
+    const double gamma = mapping->read<double>(offset);
+    const uint32_t n_levels = mapping->read<uint32_t>(offset);
+
+    if (n_levels > MAX_LEVELS || fingerprint_bits > 32 || count_bits > 32
+        || n_level_keys + n_fallback != n_keys) {
+        throw GoetiaFileException("Invalid FrozenStorage file: " + infilename);
+    }
+
+    std::vector<uint64_t> level_bits;
+    uint64_t words = 0;
+    for (uint32_t i = 0; i < n_levels; ++i) {
+        level_bits.push_back(mapping->read<uint64_t>(offset));
+        if (level_bits.back() % 64) {
+            throw GoetiaFileException("Invalid FrozenStorage level in: " + infilename);
+        }
+        words += level_bits.back() / 64;
+    }
+
+    // sections are page aligned, so the words are too
+    const uint64_t * bits = (const uint64_t *) mapping->section(offset, words * sizeof(uint64_t));
+    const uint64_t * ranks = (const uint64_t *) mapping->section(
+        offset, (words / (RANK_BLOCK / 64) + 1) * sizeof(uint64_t));
+    const uint64_t * fallback = (const uint64_t *) mapping->section(
+        offset, n_fallback * sizeof(uint64_t));
+    const uint64_t * fingerprints = (const uint64_t *) mapping->section(
+        offset, packed_words(n_keys, fingerprint_bits) * sizeof(uint64_t));
+    const uint64_t * counts = (const uint64_t *) mapping->section(
+        offset, packed_words(n_keys, count_bits) * sizeof(uint64_t));
+
+    _tables = std::make_shared<Tables>();
+    _mapping = mapping;
+    _bits = bits;
+    _ranks = ranks;
+    _fallback = fallback;
+    _fingerprints = fingerprints;
+    _counts = counts;
+    _n_keys = n_keys;
+    _n_level_keys = n_level_keys;
+    _n_fallback = n_fallback;
+    _fingerprint_bits = fingerprint_bits;
+    _count_bits = count_bits;
+    _gamma = gamma;
+    _set_levels(std::move(level_bits));
+}
+
+
+void
+FrozenStorage::serialize(std::ofstream& out) {
+    serialize_tag<FrozenStorage>(out);
+
+    const uint64_t n_levels = _level_bits.size();
+    out.write((const char *) &_n_keys, sizeof(_n_keys));
+    out.write((const char *) &_n_level_keys, sizeof(_n_level_keys));
+    out.write((const char *) &_n_fallback, sizeof(_n_fallback));
+    out.write((const char *) &_fingerprint_bits, sizeof(_fingerprint_bits));
+    out.write((const char *) &_count_bits, sizeof(_count_bits));
+    out.write((const char *) &_gamma, sizeof(_gamma));
+    out.write((const char *) &n_levels, sizeof(n_levels));
+    out.write((const char *) _level_bits.data(), n_levels * sizeof(uint64_t));
+
+    uint64_t words = 0;
+    for (uint64_t n_bits : _level_bits) {
+        words += n_bits / 64;
+    }
+    out.write((const char *) _bits, words * sizeof(uint64_t));
+    out.write((const char *) _ranks, (words / (RANK_BLOCK / 64) + 1) * sizeof(uint64_t));
+    out.write((const char *) _fallback, _n_fallback * sizeof(uint64_t));
+    out.write((const char *) _fingerprints,
+              packed_words(_n_keys, _fingerprint_bits) * sizeof(uint64_t));
+    out.write((const char *) _counts, packed_words(_n_keys, _count_bits) * sizeof(uint64_t));
+}
+
+
+std::shared_ptr<FrozenStorage>
+FrozenStorage::deserialize(std::ifstream& in) {
+    deserialize_tag<FrozenStorage>(in);
+
+    auto frozen = std::make_shared<FrozenStorage>();
+    uint64_t n_levels;
+    in.read((char *) &frozen->_n_keys, sizeof(frozen->_n_keys));
+    in.read((char *) &frozen->_n_level_keys, sizeof(frozen->_n_level_keys));
+    in.read((char *) &frozen->_n_fallback, sizeof(frozen->_n_fallback));
+    in.read((char *) &frozen->_fingerprint_bits, sizeof(frozen->_fingerprint_bits));
+    in.read((char *) &frozen->_count_bits, sizeof(frozen->_count_bits));
+    in.read((char *) &frozen->_gamma, sizeof(frozen->_gamma));
+    in.read((char *) &n_levels, sizeof(n_levels));
+    if (!in || n_levels > MAX_LEVELS || frozen->_fingerprint_bits > 32
+        || frozen->_count_bits > 32) {
+        throw GoetiaFileException("Invalid or truncated FrozenStorage");
+    }
+
+    std::vector<uint64_t> level_bits(n_levels);
+    in.read((char *) level_bits.data(), n_levels * sizeof(uint64_t));
+    uint64_t words = 0;
+    for (uint64_t n_bits : level_bits) {
+        words += n_bits / 64;
+    }
+
+    auto& tables = *frozen->_tables;
+    tables.bits.resize(words);
+    tables.ranks.resize(words / (RANK_BLOCK / 64) + 1);
+    tables.fallback.resize(frozen->_n_fallback);
+    tables.fingerprints.resize(packed_words(frozen->_n_keys, frozen->_fingerprint_bits));
+    tables.counts.resize(packed_words(frozen->_n_keys, frozen->_count_bits));
+    in.read((char *) tables.bits.data(), tables.bits.size() * sizeof(uint64_t));
+    in.read((char *) tables.ranks.data(), tables.ranks.size() * sizeof(uint64_t));
+    in.read((char *) tables.fallback.data(), tables.fallback.size() * sizeof(uint64_t));
+    in.read((char *) tables.fingerprints.data(), tables.fingerprints.size() * sizeof(uint64_t));
+    in.read((char *) tables.counts.data(), tables.counts.size() * sizeof(uint64_t));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading FrozenStorage");
+    }
+
+    frozen->_set_levels(std::move(level_bits));
+    frozen->_point_at_tables();
+    return frozen;
+}
+
+
+metrics::MemoryUsage
+FrozenStorage::memory_usage() const {
+    const uint64_t words = (_level_offsets.empty() ? 0 : _level_offsets.back() + _level_bits.back()) / 64;
+    metrics::MemoryUsage usage;
+    usage.add("mphf", (words + words / (RANK_BLOCK / 64) + 1 + _n_fallback) * sizeof(uint64_t));
+    usage.add("fingerprints", packed_words(_n_keys, _fingerprint_bits) * sizeof(uint64_t));
+    usage.add("counts", packed_words(_n_keys, _count_bits) * sizeof(uint64_t));
+    return usage;
+}
+
+}
+}
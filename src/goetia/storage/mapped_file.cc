@@ -0,0 +1,155 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : mapped_file.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/storage/mapped_file.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream> // IWYU pragma: keep
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace goetia {
+namespace storage {
+
+
+MappedFile::MappedFile(const std::string& filename, bool writable)
+    : _fd(-1),
+      _data(nullptr),
+      _size(0),
+      _writable(writable),
+      _filename(filename)
+{
+    _fd = ::open(filename.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        throw GoetiaFileException("Cannot open k-mer storage file: " + filename
+                                  + " " + strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || st.st_size == 0) {
+        ::close(_fd);
+        throw GoetiaFileException("Cannot map empty or unreadable file: " + filename);
+    }
+    _size = st.st_size;
+
+    // read-only maps are shared so that processes share the pages;
+    // writable maps are private copy-on-write over the same pages
+    void * addr = writable
+        ? mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0)
+        : mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (addr == MAP_FAILED) {
+        ::close(_fd);
+        throw GoetiaFileException("Cannot map file: " + filename + " "
+                                  + strerror(errno));
+    }
+    _data = static_cast<byte_t*>(addr);
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (_data) {
+        munmap(_data, _size);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+
+byte_t *
+MappedFile::at(size_t offset, size_t length) const
+{
+    if (offset > _size || length > _size - offset) {
+        throw GoetiaFileException("Unexpected end of mapped k-mer storage file: "
+                                  + _filename);
+    }
+    return _data + offset;
+}
+
+
+size_t
+MappedFile::check_header(unsigned char ht_type) const
+{
+    size_t offset = 0;
+    const char * signature = (const char *) at(offset, 4);
+    offset += 4;
+    unsigned char version = read<unsigned char>(offset);
+    unsigned char file_type = read<unsigned char>(offset);
+
+    if (!(std::string(signature, 4) == SAVED_SIGNATURE)) {
+        std::ostringstream err;
+        err << "Does not start with signature for a oxli file: 0x";
+        for(size_t i=0; i < 4; ++i) {
+            err << std::hex << (int) signature[i];
+        }
+        err << " Should be: " << SAVED_SIGNATURE;
+        throw GoetiaFileException(err.str());
+    } else if (!(version == SAVED_MAPPED_FORMAT_VERSION)) {
+        std::ostringstream err;
+        err << "Incorrect file format version " << (int) version
+            << " while mapping " << _filename
+            << "; should be " << (int) SAVED_MAPPED_FORMAT_VERSION;
+        throw GoetiaFileException(err.str());
+    } else if (!(file_type == ht_type)) {
+        std::ostringstream err;
+        err << "Incorrect file format type " << (int) file_type
+            << " expected " << (int) ht_type
+            << " while mapping " << _filename;
+        throw GoetiaFileException(err.str());
+    }
+
+    return offset;
+}
+
+
+MappedFileWriter::MappedFileWriter(const std::string& filename,
+                                   unsigned char      ht_type)
+    : _out(filename.c_str(), std::ios::binary),
+      _filename(filename),
+      _offset(0)
+{
+    if (!_out.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                  + filename);
+    }
+
+    _out.write(SAVED_SIGNATURE, 4);
+    _offset += 4;
+    write<unsigned char>(SAVED_MAPPED_FORMAT_VERSION);
+    write<unsigned char>(ht_type);
+}
+
+
+void
+MappedFileWriter::write_section(const void * data, size_t length)
+{
+    static const char zeros[MappedFile::ALIGNMENT] = {0};
+
+    const size_t padding = MappedFile::align(_offset) - _offset;
+    _out.write(zeros, padding);
+    _out.write((const char *) data, length);
+    _offset += padding + length;
+}
+
+
+void
+MappedFileWriter::close()
+{
+    if (_out.fail()) {
+        throw GoetiaFileException("Error writing " + _filename + ": "
+                                  + strerror(errno));
+    }
+    _out.close();
+}
+
+}
+}
@@ -45,6 +45,7 @@
 
 #include "goetia/storage/nibblestorage.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <errno.h>
 #include <sstream> // IWYU pragma: keep
@@ -58,39 +59,59 @@ using namespace goetia;
 using namespace goetia::storage;
 
 
-const bool
-NibbleStorage::insert(value_type khash)
+uint8_t
+NibbleStorage::_increment_bin(size_t table, uint64_t bin)
 {
-    bool is_new_kmer = false;
-
-    for (unsigned int i = 0; i < _n_tables; i++) {
-        MuxGuard g(mutexes[i]);
-        byte_t* const table(_counts[i]);
-        const uint64_t idx = _table_index(khash, _tablesizes[i]);
-        const uint8_t mask = _mask(khash, _tablesizes[i]);
-        const uint8_t shift = _shift(khash, _tablesizes[i]);
-        const uint8_t current_count = (table[idx] & mask) >> shift;
-
-        if (!is_new_kmer) {
-            if (current_count == 0) {
-                is_new_kmer = true;
-
-                // track occupied bins in the first table only, as proxy
-                // for all.
-                if (i == 0) {
-                    __sync_add_and_fetch(&_occupied_bins, 1);
-                }
-            }
-        }
+    byte_t* const cell = _counts[table] + bin / 2;
+    const uint8_t mask = _bin_mask(bin);
+    const uint8_t shift = _bin_shift(bin);
+
+    // Two counters share each byte, so update the whole byte with a
+    // relaxed CAS rather than locking the table. On failure the CAS
+    // reloads the byte and the nibble is re-extracted.
+    byte_t current = __atomic_load_n(cell, __ATOMIC_RELAXED);
+    uint8_t current_count;
+    do {
+        current_count = (current & mask) >> shift;
         // if we have reached the maximum count stop incrementing the
         // counter. This avoids overflowing it.
         if (current_count == _max_count) {
-            continue;
+            break;
         }
+    } while (!__atomic_compare_exchange_n(cell,
+                                          &current,
+                                          (byte_t)((current & ~mask) |
+                                                   (((current_count + 1) << shift) & mask)),
+                                          true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    // track occupied bins in the first table only, as proxy
+    // for all.
+    if (current_count == 0 && table == 0) {
+        __sync_add_and_fetch(&_occupied_bins, 1);
+    }
+
+    return current_count;
+}
+
+
+uint8_t
+NibbleStorage::_query_bin(size_t table, uint64_t bin) const
+{
+    const byte_t cell = __atomic_load_n(_counts[table] + bin / 2, __ATOMIC_RELAXED);
+    return (cell & _bin_mask(bin)) >> _bin_shift(bin);
+}
+
 
-        // increase count, no checking for overflow
-        const uint8_t new_count = (current_count + 1) << shift;
-        table[idx] = (table[idx] & ~mask) | (new_count & mask);
+const bool
+NibbleStorage::insert(value_type khash)
+{
+    check_writable(_mapping);
+    bool is_new_kmer = false;
+
+    for (unsigned int i = 0; i < _n_tables; i++) {
+        is_new_kmer |= (_increment_bin(i, khash % _tablesizes[i]) == 0);
     }
 
     if (is_new_kmer) {
@@ -117,11 +138,7 @@ NibbleStorage::query(value_type khash) const
 
     // get the minimum count across all tables
     for (unsigned int i = 0; i < _n_tables; i++) {
-        const byte_t* table(_counts[i]);
-        const uint64_t idx = _table_index(khash, _tablesizes[i]);
-        const uint8_t mask = _mask(khash, _tablesizes[i]);
-        const uint8_t shift = _shift(khash, _tablesizes[i]);
-        const uint8_t the_count = (table[idx] & mask) >> shift;
+        const uint8_t the_count = _query_bin(i, khash % _tablesizes[i]);
 
         if (the_count < min_count) {
             min_count = the_count;
@@ -130,6 +147,89 @@ NibbleStorage::query(value_type khash) const
     return min_count;
 }
 
+
+uint64_t
+NibbleStorage::insert_many(const value_type * khashes,
+                           size_t             n,
+                           count_t *          counts)
+{
+    check_writable(_mapping);
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin / 2, 1);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            bool is_new_kmer = false;
+            uint8_t min_count = _max_count;
+
+            for (size_t i = 0; i < _n_tables; ++i) {
+                uint8_t current_count = _increment_bin(i, bins[j * _n_tables + i]);
+                is_new_kmer |= (current_count == 0);
+                // post-increment count, saturating at _max_count
+                uint8_t the_count = std::min<uint8_t>(current_count + 1, _max_count);
+                if (the_count < min_count) {
+                    min_count = the_count;
+                }
+            }
+
+            if (is_new_kmer) {
+                __sync_add_and_fetch(&_n_unique_kmers, 1);
+                ++n_new;
+            }
+
+            if (counts) {
+                counts[start + j] = is_new_kmer ? 1 : min_count;
+            }
+        }
+    }
+
+    return n_new;
+}
+
+
+void
+NibbleStorage::query_many(const value_type * khashes,
+                          size_t             n,
+                          count_t *          counts) const
+{
+    uint64_t bins[PREFETCH_BINS];
+    const size_t batch_size = prefetch_batch(_n_tables);
+
+    for (size_t start = 0; start < n; start += batch_size) {
+        const size_t batch = std::min(batch_size, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint64_t bin = khashes[start + j] % _tablesizes[i];
+                bins[j * _n_tables + i] = bin;
+                __builtin_prefetch(_counts[i] + bin / 2, 0);
+            }
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            uint8_t min_count = _max_count;
+            for (size_t i = 0; i < _n_tables; ++i) {
+                const uint8_t the_count = _query_bin(i, bins[j * _n_tables + i]);
+                if (the_count < min_count) {
+                    min_count = the_count;
+                }
+            }
+            counts[start + j] = min_count;
+        }
+    }
+}
+
 void
 NibbleStorage::save(std::string outfilename, uint16_t ksize)
 {
@@ -188,14 +288,7 @@ NibbleStorage::load(std::string infilename, uint16_t& ksize)
         throw GoetiaFileException(err);
     }
 
-    if (_counts) {
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            delete[] _counts[i];
-            _counts[i] = NULL;
-        }
-        delete[] _counts;
-        _counts = NULL;
-    }
+    _free_counters();
     _tablesizes.clear();
 
     try {
@@ -253,7 +346,7 @@ NibbleStorage::load(std::string infilename, uint16_t& ksize)
             tablesize = save_tablesize;
             _tablesizes.push_back(tablesize);
 
-            _counts[i] = new byte_t[tablebytes];
+            _counts[i] = _allocator.allocate(tablebytes, i);
 
             unsigned long long loaded = 0;
             while (loaded != tablebytes) {
@@ -278,3 +371,183 @@ NibbleStorage::load(std::string infilename, uint16_t& ksize)
     }
 }
 
+
+void
+NibbleStorage::save_mapped(std::string outfilename, uint16_t ksize)
+{
+    if (!_counts[0]) {
+        throw GoetiaException();
+    }
+
+    MappedFileWriter out(outfilename, SAVED_SMALLCOUNT);
+
+    out.write<uint32_t>(ksize);
+    out.write<uint32_t>(_n_tables);
+    out.write<uint64_t>(_occupied_bins);
+    out.write<uint64_t>(_n_unique_kmers);
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write<uint64_t>(_tablesizes[i]);
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write_section(_counts[i], _tablesizes[i] / 2 + 1);
+    }
+
+    out.close();
+}
+
+
+void
+NibbleStorage::load_mapped(std::string infilename, uint16_t& ksize, bool writable)
+{
+    auto mapping = MappedFile::open(infilename, writable);
+    size_t offset = mapping->check_header(SAVED_SMALLCOUNT);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const uint32_t n_tables = mapping->read<uint32_t>(offset);
+    const uint64_t occupied_bins = mapping->read<uint64_t>(offset);
+    const uint64_t n_unique_kmers = mapping->read<uint64_t>(offset);
+    if (n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid number of tables in " + infilename);
+    }
+
+    std::vector<uint64_t> tablesizes;
+    for (uint32_t i = 0; i < n_tables; i++) {
+        tablesizes.push_back(mapping->read<uint64_t>(offset));
+    }
+
+    std::unique_ptr<byte_t*[]> counts(new byte_t*[n_tables]);
+    for (uint32_t i = 0; i < n_tables; i++) {
+        counts[i] = mapping->section(offset, tablesizes[i] / 2 + 1);
+    }
+
+    _free_counters();
+    _tablesizes = tablesizes;
+    _n_tables = n_tables;
+    _occupied_bins = occupied_bins;
+    _n_unique_kmers = n_unique_kmers;
+    _counts = counts.release();
+    _mapping = mapping;
+}
+
+
+template <typename Op>
+void
+NibbleStorage::_combine(const NibbleStorage& other, Op op)
+{
+    if (_tablesizes != other._tablesizes) {
+        throw GoetiaException("both countgraphs must have same table sizes");
+    }
+    if (&other == this) {
+        throw GoetiaException("Cannot combine a storage with itself.");
+    }
+    check_writable(_mapping);
+
+    uint64_t occupied = 0;
+    for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
+        byte_t * __restrict__ me = _counts[table_num];
+        const byte_t * __restrict__ ot = other._counts[table_num];
+        const uint64_t tablebytes = _tablesizes[table_num] / 2 + 1;
+
+        parallel_chunks(tablebytes, [&](size_t begin, size_t end) {
+            uint64_t nonzero = 0;
+            for (size_t index = begin; index < end; index++) {
+                const uint8_t lo = op(me[index] & 15, ot[index] & 15);
+                const uint8_t hi = op(me[index] >> 4, ot[index] >> 4);
+                me[index] = (byte_t)(lo | (hi << 4));
+                nonzero += (lo != 0) + (hi != 0);
+            }
+            if (table_num == 0) {
+                __sync_add_and_fetch(&occupied, nonzero);
+            }
+        });
+    }
+
+    _occupied_bins = occupied;
+    _n_unique_kmers = estimated_cardinality();
+}
+
+
+void
+NibbleStorage::merge(const NibbleStorage& other)
+{
+    _combine(other, [](uint8_t a, uint8_t b) {
+        return (uint8_t) std::min<int>(a + b, _max_count);
+    });
+}
+
+
+void
+NibbleStorage::intersect(const NibbleStorage& other)
+{
+    _combine(other, [](uint8_t a, uint8_t b) { return std::min(a, b); });
+}
+
+
+void
+NibbleStorage::subtract(const NibbleStorage& other)
+{
+    _combine(other, [](uint8_t a, uint8_t b) { return (uint8_t)(a > b ? a - b : 0); });
+}
+
+void
+NibbleStorage::serialize(std::ofstream& out)
+{
+    serialize_tag<NibbleStorage>(out);
+
+    uint64_t n_tables = _n_tables;
+    out.write((const char *) &n_tables, sizeof(n_tables));
+    out.write((const char *) &_occupied_bins, sizeof(_occupied_bins));
+    out.write((const char *) &_n_unique_kmers, sizeof(_n_unique_kmers));
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) &_tablesizes[i], sizeof(_tablesizes[i]));
+    }
+    for (size_t i = 0; i < _n_tables; i++) {
+        out.write((const char *) _counts[i], _tablesizes[i] / 2 + 1);
+    }
+}
+
+
+std::shared_ptr<NibbleStorage>
+NibbleStorage::deserialize(std::ifstream& in)
+{
+    deserialize_tag<NibbleStorage>(in);
+
+    uint64_t n_tables, occupied_bins, n_unique_kmers;
+    in.read((char *) &n_tables, sizeof(n_tables));
+    in.read((char *) &occupied_bins, sizeof(occupied_bins));
+    in.read((char *) &n_unique_kmers, sizeof(n_unique_kmers));
+    if (!in || n_tables == 0 || n_tables > MAX_TABLES) {
+        throw GoetiaFileException("Invalid serialized NibbleStorage header.");
+    }
+
+    std::vector<uint64_t> tablesizes(n_tables);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) &tablesizes[i], sizeof(tablesizes[i]));
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized NibbleStorage.");
+    }
+
+    auto storage = std::make_shared<NibbleStorage>(tablesizes);
+    for (uint64_t i = 0; i < n_tables; i++) {
+        in.read((char *) storage->_counts[i], tablesizes[i] / 2 + 1);
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized NibbleStorage.");
+    }
+    storage->_occupied_bins = occupied_bins;
+    storage->_n_unique_kmers = n_unique_kmers;
+
+    return storage;
+}
+
+
+metrics::MemoryUsage
+NibbleStorage::memory_usage() const
+{
+    metrics::MemoryUsage usage;
+    for (size_t i = 0; i < _n_tables; i++) {
+        usage.add("tables", _tablesizes[i] / 2 + 1);
+    }
+    return usage;
+}
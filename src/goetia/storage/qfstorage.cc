@@ -45,12 +45,14 @@
 
 #include "goetia/storage/qfstorage.hh"
 
+#include <algorithm>
 #include <memory>
 #include <errno.h>
 #include <cstring>
 #include <sstream> // IWYU pragma: keep
 #include <fstream>
 #include <iostream>
+#include <limits>
 
 #include "goetia/goetia.hh"
 #include "goetia/storage/cqf/gqf.h"
@@ -60,87 +62,412 @@ using namespace goetia;
 using namespace goetia::storage;
 
 
-QFStorage::QFStorage(int size)
-    : _size(size)
+static inline size_t
+_qf_blocks_bytes(const QF * qf)
 {
-    cf = std::make_shared<QF>();
-    // size is the power of two to specify the number of slots in
-    // the filter (2**size). Third argument sets the number of bits used
-    // in the key (current value of size+8 is copied from the CQF example)
-    // Final argument is the number of bits allocated for the value, which
-    // we do not use.
-    qf_init(cf.get(), (1ULL << size), size+8, 0);
+    #if BITS_PER_SLOT == 8 || BITS_PER_SLOT == 16 || BITS_PER_SLOT == 32 || BITS_PER_SLOT == 64
+        return sizeof(qfblock) * qf->nblocks;
+    #else
+        return (sizeof(qfblock) + SLOTS_PER_BLOCK * qf->bits_per_slot / 8) * qf->nblocks;
+    #endif
+}
+
+
+static inline int
+_log_slots(const QF * qf)
+{
+    int log_slots = 0;
+    for (uint64_t nslots = qf->nslots; nslots > 1; nslots >>= 1) {
+        ++log_slots;
+    }
+    return log_slots;
+}
+
+
+QFStorage::QFStorage(int size, uint16_t n_partitions, uint64_t max_bytes)
+    : _size(size),
+      _n_partitions(n_partitions),
+      _partition_bits(0),
+      _max_bytes(max_bytes),
+      _n_bytes(0),
+      _overflow_lock(0)
+{
+    if (n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+        throw GoetiaException("QFStorage n_partitions must be a power of two.");
+    }
+    while ((1U << _partition_bits) < n_partitions) {
+        ++_partition_bits;
+    }
+    if (_partition_bits >= size) {
+        throw GoetiaException("QFStorage has too many partitions for size "
+                              + std::to_string(size));
+    }
+
+    _init_filters();
 }
 
 
 QFStorage::~QFStorage() 
 { 
-    qf_destroy(cf.get());
+}
+
+
+// Filters own their blocks unless they were mapped from a file, in which
+// case the deleter holds the mapping open instead.
+static std::shared_ptr<QF>
+_owned_filter()
+{
+    return std::shared_ptr<QF>(new QF(), [](QF * qf) {
+        if (qf->blocks) {
+            qf_destroy(qf);
+        }
+        delete qf;
+    });
+}
+
+
+std::shared_ptr<QF>
+QFStorage::_new_filter(int log_slots)
+{
+    // log_slots is the power of two to specify the number of slots in
+    // the filter (2**log_slots). Third argument sets the number of bits
+    // used in the key (current value of log_slots+8 is copied from the CQF
+    // example); the partition bits are taken off of the key, so the
+    // fingerprint length doesn't change with n_partitions.
+    // Final argument is the number of bits allocated for the value, which
+    // we do not use.
+    auto qf = _owned_filter();
+    qf_init(qf.get(), (1ULL << log_slots), log_slots + 8, 0);
+    return qf;
+}
+
+
+void
+QFStorage::_init_filters()
+{
+    const int part_size = _size - _partition_bits;
+
+    _filters.clear();
+    _filters.resize(_n_partitions);
+    _states.reset(new PartitionState[_n_partitions]);
+    _n_bytes = 0;
+    for (uint16_t i = 0; i < _n_partitions; ++i) {
+        _filters[i].push_back(_new_filter(part_size));
+        _states[i].active = _filters[i].back().get();
+        _n_bytes += _qf_blocks_bytes(_states[i].active);
+    }
+
+    if (_max_bytes && _n_bytes > _max_bytes - _max_bytes / OVERFLOW_BUDGET_SHARE) {
+        _filters.clear();
+        throw GoetiaException("QFStorage of size " + std::to_string(_size)
+                              + " does not fit in max_bytes "
+                              + std::to_string(_max_bytes));
+    }
+}
+
+
+void
+QFStorage::reset()
+{
+    check_writable(_mapping);
+    _reset_partitions(_n_partitions);
+    _overflow.reset();
+    _init_filters();
 }
 
 
 std::shared_ptr<QFStorage>
 QFStorage::clone() const {
-    return std::make_shared<QFStorage>(_size);
+    return std::make_shared<QFStorage>(_size, _n_partitions, _max_bytes);
+}
+
+
+uint64_t
+QFStorage::_key_for(const QF * qf, value_type khash) const
+{
+    return (khash >> _partition_bits) % qf->range;
+}
+
+
+bool
+QFStorage::_reserve_bytes(uint64_t bytes)
+{
+    if (!_max_bytes) {
+        __sync_add_and_fetch(&_n_bytes, bytes);
+        return true;
+    }
+
+    const uint64_t budget = _max_bytes - _max_bytes / OVERFLOW_BUDGET_SHARE;
+    uint64_t current = __atomic_load_n(&_n_bytes, __ATOMIC_RELAXED);
+    do {
+        if (current + bytes > budget) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&_n_bytes, &current, current + bytes,
+                                          true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+
+void
+QFStorage::_make_overflow()
+{
+    while (!__sync_bool_compare_and_swap(&_overflow_lock, 0, 1));
+    if (!_overflow) {
+        // four count-min tables sharing the budget held back for overflow
+        const uint64_t table_bytes = std::max<uint64_t>(
+            _max_bytes / OVERFLOW_BUDGET_SHARE / 4, 1024
+        );
+        _overflow = ByteStorage::build(table_bytes, 4);
+    }
+    __sync_bool_compare_and_swap(&_overflow_lock, 1, 0);
+}
+
+
+void
+QFStorage::_grow(size_t partition)
+{
+    const QF * active = _filters[partition].back().get();
+    const int log_slots = _log_slots(active) + 1;
+
+    // the block count very nearly doubles with the slots
+    if (_reserve_bytes(2 * _qf_blocks_bytes(active))) {
+        auto qf = _new_filter(log_slots);
+        const int64_t error = (int64_t)_qf_blocks_bytes(qf.get())
+                              - (int64_t)(2 * _qf_blocks_bytes(active));
+        __sync_add_and_fetch(&_n_bytes, error);
+        _filters[partition].push_back(qf);
+        __atomic_store_n(&_states[partition].active, qf.get(), __ATOMIC_RELEASE);
+    } else {
+        _make_overflow();
+        _states[partition].full = true;
+    }
+}
+
+
+count_t
+QFStorage::_count(size_t partition, value_type khash) const
+{
+    // summed wide, since the filters' counts can pass count_t between them
+    uint64_t count = 0;
+    for (const auto& qf : _filters[partition]) {
+        count += qf_count_key_value(qf.get(), _key_for(qf.get(), khash), 0);
+    }
+    if (_states[partition].full) {
+        count += _overflow->query(khash);
+    }
+    return std::min<uint64_t>(count, std::numeric_limits<count_t>::max());
+}
+
+
+count_t
+QFStorage::_insert(size_t partition, value_type khash)
+{
+    const count_t count = _count(partition, khash);
+
+    if (!_states[partition].full) {
+        const QF * active = _filters[partition].back().get();
+        if (active->noccupied_slots >= GROWTH_THRESHOLD * active->nslots) {
+            _grow(partition);
+        }
+    }
+
+    if (_states[partition].full) {
+        _overflow->insert(khash);
+    } else {
+        QF * active = _filters[partition].back().get();
+        qf_insert(active, _key_for(active, khash), 0, 1);
+    }
+
+    if (count == 0) {
+        _count_unique(partition);
+    }
+    return count;
 }
 
 
 const bool
 QFStorage::insert(value_type khash) {
-    bool is_new = query(khash) == 0;
-    qf_insert(cf.get(), khash % cf->range, 0, 1);
+    check_writable(_mapping);
+    const size_t partition = _partition_for(khash);
+
+    _lock(partition);
+    bool is_new = _insert(partition, khash) == 0;
+    _unlock(partition);
+
     return is_new;
 }
 
 
 const count_t
 QFStorage::insert_and_query(value_type khash) {
-    qf_insert(cf.get(), khash % cf->range, 0, 1);
-    return query(khash);
+    check_writable(_mapping);
+    const size_t partition = _partition_for(khash);
+
+    _lock(partition);
+    _insert(partition, khash);
+    count_t count = _count(partition, khash);
+    _unlock(partition);
+
+    return count;
 }
 
 
 const count_t
 QFStorage::query(value_type khash) const 
 {
-    return qf_count_key_value(cf.get(), khash % cf->range, 0);
+    const size_t partition = _partition_for(khash);
+
+    // an insert into the same partition can shift the run we're reading
+    _lock(partition);
+    count_t count = _count(partition, khash);
+    _unlock(partition);
+
+    return count;
+}
+
+
+// Address of the CQF block holding the home slot for key; the run for
+// the key usually starts there, so it is what the batch paths prefetch.
+static inline const void *
+_home_block(const QF * qf, uint64_t key)
+{
+    const uint64_t block_index = (key >> qf->bits_per_slot) / SLOTS_PER_BLOCK;
+    #if BITS_PER_SLOT == 8 || BITS_PER_SLOT == 16 || BITS_PER_SLOT == 32 || BITS_PER_SLOT == 64
+        return qf->blocks + block_index;
+    #else
+        return ((const char *)qf->blocks) +
+               block_index * (sizeof(qfblock) + SLOTS_PER_BLOCK * qf->bits_per_slot / 8);
+    #endif
+}
+
+
+uint64_t
+QFStorage::insert_many(const value_type * khashes,
+                       size_t             n,
+                       count_t *          counts)
+{
+    check_writable(_mapping);
+    size_t   partitions[PREFETCH_BATCH];
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+
+        // the newest filter in the chain is the one the insert lands in;
+        // filters live until the storage does, so a stale one is harmless
+        for (size_t j = 0; j < batch; ++j) {
+            partitions[j] = _partition_for(khashes[start + j]);
+            const QF * qf = __atomic_load_n(&_states[partitions[j]].active,
+                                            __ATOMIC_ACQUIRE);
+            __builtin_prefetch(_home_block(qf, _key_for(qf, khashes[start + j])), 1);
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            _lock(partitions[j]);
+            count_t count = _insert(partitions[j], khashes[start + j]);
+            if (count && counts) {
+                count = _count(partitions[j], khashes[start + j]);
+            }
+            _unlock(partitions[j]);
+
+            bool is_new = count == 0;
+            n_new += is_new;
+            if (counts) {
+                counts[start + j] = is_new ? 1 : count;
+            }
+        }
+    }
+
+    return n_new;
+}
+
+
+void
+QFStorage::query_many(const value_type * khashes,
+                      size_t             n,
+                      count_t *          counts) const
+{
+    size_t partitions[PREFETCH_BATCH];
+
+    for (size_t start = 0; start < n; start += PREFETCH_BATCH) {
+        const size_t batch = std::min(PREFETCH_BATCH, n - start);
+
+        for (size_t j = 0; j < batch; ++j) {
+            partitions[j] = _partition_for(khashes[start + j]);
+            const QF * qf = __atomic_load_n(&_states[partitions[j]].active,
+                                            __ATOMIC_ACQUIRE);
+            __builtin_prefetch(_home_block(qf, _key_for(qf, khashes[start + j])), 0);
+        }
+
+        for (size_t j = 0; j < batch; ++j) {
+            _lock(partitions[j]);
+            counts[start + j] = _count(partitions[j], khashes[start + j]);
+            _unlock(partitions[j]);
+        }
+    }
 }
 
 
 std::vector<uint64_t>
 QFStorage::get_tablesizes() const 
 { 
-    return {cf->xnslots}; 
+    uint64_t xnslots = 0;
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _lock(i);
+        for (const auto& qf : _filters[i]) {
+            xnslots += qf->xnslots;
+        }
+        _unlock(i);
+    }
+    return {xnslots}; 
+}
+
+
+const size_t
+QFStorage::n_filters(size_t partition) const
+{
+    if (partition >= _n_partitions) {
+        throw GoetiaException("Invalid QFStorage partition: " + std::to_string(partition));
+    }
+    _lock(partition);
+    size_t n = _filters[partition].size();
+    _unlock(partition);
+    return n;
 }
 
 
+// The per-partition counters are only written under the partition lock;
+// the relaxed loads here give a snapshot without stopping the writers.
 const uint64_t
 QFStorage::n_unique_kmers() const 
 { 
-    return cf->ndistinct_elts; 
+    uint64_t n = 0;
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        n += __atomic_load_n(&_states[i].n_unique, __ATOMIC_RELAXED);
+    }
+    return n;
 }
 
 
 const uint64_t
 QFStorage::n_occupied() const 
 { 
-    return cf->noccupied_slots; 
+    uint64_t n = 0;
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _lock(i);
+        for (const auto& qf : _filters[i]) {
+            n += qf->noccupied_slots;
+        }
+        _unlock(i);
+    }
+    return n;
 }
 
 
-void
-QFStorage::save(std::string outfilename, uint16_t ksize)
+static void
+_write_qf(ofstream& outfile, const QF * cf)
 {
-    ofstream outfile(outfilename.c_str(), ios::binary);
-
-    unsigned char version = SAVED_FORMAT_VERSION;
-    unsigned char ht_type = SAVED_QFCOUNT;
-
-    outfile.write(SAVED_SIGNATURE, 4);
-    outfile.write((const char *) &version, 1);
-    outfile.write((const char *) &ht_type, 1);
-    outfile.write((const char *) &ksize, sizeof(ksize));
-
     /* just a hack to handle __uint128_t value. Don't know a better to handle it
      * right now */
     uint64_t tmp_range;
@@ -158,12 +485,89 @@ QFStorage::save(std::string outfilename, uint16_t ksize)
     outfile.write((const char *) &cf->ndistinct_elts, sizeof(cf->ndistinct_elts));
     outfile.write((const char *) &cf->noccupied_slots, sizeof(cf->noccupied_slots));
 
-    #if BITS_PER_SLOT == 8 || BITS_PER_SLOT == 16 || BITS_PER_SLOT == 32 || BITS_PER_SLOT == 64
-        outfile.write((const char *) cf->blocks, sizeof(qfblock) * cf->nblocks);
-    #else
-        outfile.write((const char *) cf->blocks,
-                      (sizeof(qfblock) + SLOTS_PER_BLOCK * cf->bits_per_slot / 8) * cf->nblocks);
-    #endif
+    outfile.write((const char *) cf->blocks, _qf_blocks_bytes(cf));
+}
+
+
+static void
+_read_qf(ifstream& infile, QF * cf)
+{
+    uint64_t tmp_range;
+
+    infile.read((char *) &cf->nslots, sizeof(cf->nslots));
+    infile.read((char *) &cf->xnslots, sizeof(cf->xnslots));
+    infile.read((char *) &cf->key_bits, sizeof(cf->key_bits));
+    infile.read((char *) &cf->value_bits, sizeof(cf->value_bits));
+    infile.read((char *) &cf->key_remainder_bits, sizeof(cf->key_remainder_bits));
+    infile.read((char *) &cf->bits_per_slot, sizeof(cf->bits_per_slot));
+    infile.read((char *) &tmp_range, sizeof(tmp_range));
+
+    infile.read((char *) &cf->nblocks, sizeof(cf->nblocks));
+    infile.read((char *) &cf->nelts, sizeof(cf->nelts));
+    infile.read((char *) &cf->ndistinct_elts, sizeof(cf->ndistinct_elts));
+    infile.read((char *) &cf->noccupied_slots, sizeof(cf->noccupied_slots));
+    /* just a hack to handle __uint128_t value. Don't know a better to handle it
+     * right now */
+    cf->range = tmp_range;
+    /* allocate the space for the actual qf blocks */
+    cf->blocks = (qfblock *)calloc(1, _qf_blocks_bytes(cf));
+    infile.read((char *) cf->blocks, _qf_blocks_bytes(cf));
+}
+
+
+void
+QFStorage::save(std::string outfilename, uint16_t ksize)
+{
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _lock(i);
+    }
+
+    ofstream outfile(outfilename.c_str(), ios::binary);
+
+    unsigned char version = SAVED_FORMAT_VERSION;
+    // a single filter keeps the original layout
+    const bool single = _n_partitions == 1 && _filters[0].size() == 1 && !_overflow;
+    unsigned char ht_type = single ? SAVED_QFCOUNT : SAVED_PARTITIONEDQFCOUNT;
+
+    outfile.write(SAVED_SIGNATURE, 4);
+    outfile.write((const char *) &version, 1);
+    outfile.write((const char *) &ht_type, 1);
+    outfile.write((const char *) &ksize, sizeof(ksize));
+
+    if (single) {
+        _write_qf(outfile, _filters[0].front().get());
+    } else {
+        unsigned char has_overflow = bool(_overflow);
+        outfile.write((const char *) &_size, sizeof(_size));
+        outfile.write((const char *) &_n_partitions, sizeof(_n_partitions));
+        outfile.write((const char *) &_max_bytes, sizeof(_max_bytes));
+        outfile.write((const char *) &has_overflow, sizeof(has_overflow));
+
+        for (size_t i = 0; i < _n_partitions; ++i) {
+            unsigned char full = _states[i].full;
+            uint16_t n_filters = _filters[i].size();
+            outfile.write((const char *) &_states[i].n_unique,
+                          sizeof(_states[i].n_unique));
+            outfile.write((const char *) &full, sizeof(full));
+            outfile.write((const char *) &n_filters, sizeof(n_filters));
+            for (const auto& qf : _filters[i]) {
+                _write_qf(outfile, qf.get());
+            }
+        }
+
+        // the overflow tier goes alongside in ByteStorage's own format
+        if (_overflow) {
+            _overflow->save(outfilename + ".overflow", ksize);
+        }
+    }
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _unlock(i);
+    }
+
+    if (outfile.fail()) {
+        throw GoetiaFileException(strerror(errno));
+    }
     outfile.close();
 }
 
@@ -194,7 +598,6 @@ QFStorage::load(std::string infilename, uint16_t &ksize)
     uint16_t save_ksize = 0;
     char signature [4];
     unsigned char version = 0, ht_type = 0;
-    uint64_t tmp_range;
 
     infile.read(signature, 4);
     infile.read((char *) &version, 1);
@@ -214,10 +617,11 @@ QFStorage::load(std::string infilename, uint16_t &ksize)
             << " while reading k-mer count file from " << infilename
             << "; should be " << (int) SAVED_FORMAT_VERSION;
         throw GoetiaFileException(err.str());
-    } else if (!(ht_type == SAVED_QFCOUNT)) {
+    } else if (!(ht_type == SAVED_QFCOUNT || ht_type == SAVED_PARTITIONEDQFCOUNT)) {
         std::ostringstream err;
         err << "Incorrect file format type " << (int) ht_type
             << " expected " << (int) SAVED_QFCOUNT
+            << " or " << (int) SAVED_PARTITIONEDQFCOUNT
             << " while reading k-mer count file from " << infilename;
         throw GoetiaFileException(err.str());
     }
@@ -225,36 +629,518 @@ QFStorage::load(std::string infilename, uint16_t &ksize)
     infile.read((char *) &save_ksize, sizeof(save_ksize));
     ksize = save_ksize;
 
-    infile.read((char *) &cf->nslots, sizeof(cf->nslots));
-    infile.read((char *) &cf->xnslots, sizeof(cf->xnslots));
-    infile.read((char *) &cf->key_bits, sizeof(cf->key_bits));
-    infile.read((char *) &cf->value_bits, sizeof(cf->value_bits));
-    infile.read((char *) &cf->key_remainder_bits, sizeof(cf->key_remainder_bits));
-    infile.read((char *) &cf->bits_per_slot, sizeof(cf->bits_per_slot));
-    infile.read((char *) &tmp_range, sizeof(tmp_range));
-
-    infile.read((char *) &cf->nblocks, sizeof(cf->nblocks));
-    infile.read((char *) &cf->nelts, sizeof(cf->nelts));
-    infile.read((char *) &cf->ndistinct_elts, sizeof(cf->ndistinct_elts));
-    infile.read((char *) &cf->noccupied_slots, sizeof(cf->noccupied_slots));
-    /* just a hack to handle __uint128_t value. Don't know a better to handle it
-     * right now */
-    cf->range = tmp_range;
     // deallocate previously allocated blocks
-    free(cf->blocks);
-    /* allocate the space for the actual qf blocks */
-    #if BITS_PER_SLOT == 8 || BITS_PER_SLOT == 16 || BITS_PER_SLOT == 32 || BITS_PER_SLOT == 64
-        cf->blocks = (qfblock *)calloc(cf->nblocks, sizeof(qfblock));
-    #else
-        cf->blocks = (qfblock *)calloc(cf->nblocks, sizeof(qfblock) + SLOTS_PER_BLOCK * cf->bits_per_slot / 8);
-    #endif
-    #if BITS_PER_SLOT == 8 || BITS_PER_SLOT == 16 || BITS_PER_SLOT == 32 || BITS_PER_SLOT == 64
-        infile.read((char *) cf->blocks, sizeof(qfblock) * cf->nblocks);
-    #else
-        infile.read((char *) cf->blocks,
-                    (sizeof(qfblock) + SLOTS_PER_BLOCK * cf->bits_per_slot / 8) * cf->nblocks);
-    #endif
+    _filters.clear();
+    _overflow.reset();
+
+    if (ht_type == SAVED_QFCOUNT) {
+        _max_bytes = 0;
+        _reset_partitions(1);
+
+        auto qf = _owned_filter();
+        _read_qf(infile, qf.get());
+        _filters[0].push_back(qf);
+        _states[0].active = qf.get();
+
+        // single-filter files don't record size or our distinct count,
+        // so fall back on the filter's own
+        _states[0].n_unique = qf->ndistinct_elts;
+        _size = _log_slots(qf.get());
+    } else {
+        unsigned char has_overflow = 0;
+        uint16_t n_partitions = 0;
+        infile.read((char *) &_size, sizeof(_size));
+        infile.read((char *) &n_partitions, sizeof(n_partitions));
+        infile.read((char *) &_max_bytes, sizeof(_max_bytes));
+        infile.read((char *) &has_overflow, sizeof(has_overflow));
+        if (n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+            throw GoetiaFileException("Invalid number of partitions in " + infilename);
+        }
+        _reset_partitions(n_partitions);
+
+        for (uint16_t i = 0; i < _n_partitions; ++i) {
+            unsigned char full = 0;
+            uint16_t n_filters = 0;
+            infile.read((char *) &_states[i].n_unique, sizeof(_states[i].n_unique));
+            infile.read((char *) &full, sizeof(full));
+            infile.read((char *) &n_filters, sizeof(n_filters));
+            _states[i].full = full;
+            for (uint16_t f = 0; f < n_filters; ++f) {
+                auto qf = _owned_filter();
+                _read_qf(infile, qf.get());
+                _filters[i].push_back(qf);
+            }
+            if (_filters[i].empty()) {
+                throw GoetiaFileException("Partition with no filters in " + infilename);
+            }
+            _states[i].active = _filters[i].back().get();
+        }
+
+        if (has_overflow) {
+            uint16_t overflow_ksize;
+            _overflow = ByteStorage::build(1, 1);
+            _overflow->load(infilename + ".overflow", overflow_ksize);
+        }
+    }
+
+    _count_bytes();
     infile.close();
 }
 
 
+// Insert every key of src into dst with its count.
+static void
+_insert_all(const QF * src, QF * dst)
+{
+    if (src->nelts == 0) {
+        return;
+    }
+    QFi qfi;
+    qf_iterator(src, &qfi, 0);
+    do {
+        uint64_t key, value, count;
+        qfi_get(&qfi, &key, &value, &count);
+        qf_insert(dst, key, value, count);
+    } while (!qfi_next(&qfi));
+}
+
+
+void
+QFStorage::merge(const QFStorage& other)
+{
+    if (&other == this) {
+        throw GoetiaException("Cannot combine a storage with itself.");
+    }
+    if (_n_partitions != other._n_partitions) {
+        throw GoetiaException("QFStorages must have the same number of partitions to merge.");
+    }
+    check_writable(_mapping);
+
+    // lock in a fixed order so that opposing merges can't deadlock
+    const QFStorage * first  = this < &other ? this : &other;
+    const QFStorage * second = this < &other ? &other : this;
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        first->_lock(i);
+        second->_lock(i);
+    }
+    auto unlock = [&]() {
+        for (size_t i = 0; i < _n_partitions; ++i) {
+            second->_unlock(i);
+            first->_unlock(i);
+        }
+    };
+
+    // For each of other's filters, the index of the filter of ours it
+    // merges into, or -1 to copy it onto our chain; planned up front so
+    // that nothing changes if the budget is refused.
+    std::vector<std::vector<int64_t>> targets(_n_partitions);
+    try {
+        if (_overflow || other._overflow) {
+            throw GoetiaException("Cannot merge a QFStorage that has overflowed.");
+        }
+
+        uint64_t extra_bytes = 0;
+        for (size_t p = 0; p < _n_partitions; ++p) {
+            const auto& ours = _filters[p];
+            std::vector<uint64_t> occupied;
+            for (const auto& qf : ours) {
+                occupied.push_back(qf->noccupied_slots);
+            }
+            for (const auto& theirs : other._filters[p]) {
+                int64_t target = -1;
+                for (size_t j = 0; j < ours.size() && target < 0; ++j) {
+                    if (ours[j]->range == theirs->range
+                        && occupied[j] + theirs->noccupied_slots
+                           <= MERGE_CAPACITY * ours[j]->nslots) {
+                        target = j;
+                        occupied[j] += theirs->noccupied_slots;
+                    }
+                }
+                if (target < 0 && theirs->nelts) {
+                    extra_bytes += _qf_blocks_bytes(theirs.get());
+                }
+                targets[p].push_back(target);
+            }
+        }
+        if (!_reserve_bytes(extra_bytes)) {
+            throw GoetiaException("Merged QFStorage would exceed max_bytes.");
+        }
+    } catch (...) {
+        unlock();
+        throw;
+    }
+
+    // The combined filters are built and checked for every partition
+    // before any are swapped in, so that a failed merge leaves us intact.
+    std::vector<std::vector<std::shared_ptr<QF>>> built(_n_partitions);
+    std::vector<uint64_t> n_new(_n_partitions, 0);
+    uint32_t failed = 0;
+
+    const size_t n_threads = default_threads(_n_partitions);
+    run_threads(n_threads, [&](size_t t) {
+        for (size_t p = t; p < _n_partitions; p += n_threads) {
+            const auto& ours = _filters[p];
+            const auto& theirs = other._filters[p];
+
+            // A key of theirs is new unless one of ours, or an earlier
+            // filter of theirs, already has it. A filter with a wider range
+            // than the key's is asked about every key it could stand for,
+            // up to MERGE_MAX_PROBES of them.
+            auto has = [](const QF * qf, uint64_t key, uint64_t range) {
+                const uint64_t qf_range = qf->range;
+                if (qf_range <= range) {
+                    return qf_count_key_value(qf, key % qf_range, 0) > 0;
+                }
+                if (qf_range / range > MERGE_MAX_PROBES) {
+                    return false;
+                }
+                for (uint64_t high = key; high < qf_range; high += range) {
+                    if (qf_count_key_value(qf, high, 0)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            for (size_t i = 0; i < theirs.size(); ++i) {
+                if (theirs[i]->nelts == 0) {
+                    continue;
+                }
+                QFi qfi;
+                qf_iterator(theirs[i].get(), &qfi, 0);
+                do {
+                    uint64_t key, value, count;
+                    qfi_get(&qfi, &key, &value, &count);
+                    const uint64_t range = theirs[i]->range;
+                    bool seen = false;
+                    for (size_t j = 0; j < ours.size() && !seen; ++j) {
+                        seen = has(ours[j].get(), key, range);
+                    }
+                    for (size_t j = 0; j < i && !seen; ++j) {
+                        seen = has(theirs[j].get(), key, range);
+                    }
+                    n_new[p] += !seen;
+                } while (!qfi_next(&qfi));
+            }
+
+            // the plan keeps each combined filter under MERGE_CAPACITY of
+            // the slots of its sources, so every count should land; nelts
+            // sums the counts, and a shortfall means the CQF dropped some
+            built[p].resize(theirs.size());
+            for (size_t i = 0; i < theirs.size(); ++i) {
+                if (theirs[i]->nelts == 0) {
+                    continue;
+                }
+                const int64_t target = targets[p][i];
+                uint64_t expected = theirs[i]->nelts;
+                auto qf = _new_filter(_log_slots(theirs[i].get()));
+                if (target < 0 || ours[target]->nelts == 0) {
+                    _insert_all(theirs[i].get(), qf.get());
+                } else {
+                    expected += ours[target]->nelts;
+                    qf_merge(ours[target].get(), theirs[i].get(), qf.get());
+                }
+                if (qf->nelts != expected) {
+                    __sync_fetch_and_add(&failed, 1);
+                    return;
+                }
+                built[p][i] = qf;
+            }
+        }
+    });
+
+    if (failed) {
+        // give back what the plan reserved for copies
+        _count_bytes();
+        unlock();
+        throw GoetiaException("QFStorage merge lost counts; the storage is unchanged.");
+    }
+
+    for (size_t p = 0; p < _n_partitions; ++p) {
+        auto& ours = _filters[p];
+        const size_t n_ours = ours.size();
+        for (size_t i = 0; i < built[p].size(); ++i) {
+            if (!built[p][i]) {
+                continue;
+            }
+            const int64_t target = targets[p][i];
+            if (target < 0) {
+                ours.push_back(built[p][i]);
+            } else {
+                ours[target] = built[p][i];
+            }
+        }
+
+        // keep the largest filter at the back to take inserts
+        if (ours.size() > n_ours) {
+            std::stable_sort(ours.begin(), ours.end(),
+                             [](const std::shared_ptr<QF>& a, const std::shared_ptr<QF>& b) {
+                                 return a->nslots < b->nslots;
+                             });
+        }
+
+        _states[p].n_unique += n_new[p];
+        _states[p].active = ours.back().get();
+    }
+
+    _count_bytes();
+    unlock();
+}
+
+
+void
+QFStorage::serialize(std::ofstream& out)
+{
+    serialize_tag<QFStorage>(out);
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _lock(i);
+    }
+
+    unsigned char has_overflow = bool(_overflow);
+    out.write((const char *) &_size, sizeof(_size));
+    out.write((const char *) &_n_partitions, sizeof(_n_partitions));
+    out.write((const char *) &_max_bytes, sizeof(_max_bytes));
+    out.write((const char *) &has_overflow, sizeof(has_overflow));
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        unsigned char full = _states[i].full;
+        uint16_t n_filters = _filters[i].size();
+        out.write((const char *) &_states[i].n_unique, sizeof(_states[i].n_unique));
+        out.write((const char *) &full, sizeof(full));
+        out.write((const char *) &n_filters, sizeof(n_filters));
+        for (const auto& qf : _filters[i]) {
+            _write_qf(out, qf.get());
+        }
+    }
+
+    // unlike save, the overflow tier goes inline so the stream stands alone
+    if (_overflow) {
+        _overflow->serialize(out);
+    }
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _unlock(i);
+    }
+}
+
+
+std::shared_ptr<QFStorage>
+QFStorage::deserialize(std::ifstream& in)
+{
+    deserialize_tag<QFStorage>(in);
+
+    int size = 0;
+    uint16_t n_partitions = 0;
+    uint64_t max_bytes = 0;
+    unsigned char has_overflow = 0;
+    in.read((char *) &size, sizeof(size));
+    in.read((char *) &n_partitions, sizeof(n_partitions));
+    in.read((char *) &max_bytes, sizeof(max_bytes));
+    in.read((char *) &has_overflow, sizeof(has_overflow));
+    if (!in || n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+        throw GoetiaFileException("Invalid serialized QFStorage header.");
+    }
+
+    // build a minimal storage and swap in the serialized filters
+    auto storage = std::make_shared<QFStorage>(1);
+    storage->_size = size;
+    storage->_max_bytes = max_bytes;
+    storage->_reset_partitions(n_partitions);
+
+    for (uint16_t i = 0; i < n_partitions; ++i) {
+        auto& state = storage->_states[i];
+        unsigned char full = 0;
+        uint16_t n_filters = 0;
+        in.read((char *) &state.n_unique, sizeof(state.n_unique));
+        in.read((char *) &full, sizeof(full));
+        in.read((char *) &n_filters, sizeof(n_filters));
+        if (!in || n_filters == 0) {
+            throw GoetiaFileException("Invalid serialized QFStorage partition.");
+        }
+        state.full = full;
+        for (uint16_t f = 0; f < n_filters; ++f) {
+            auto qf = _owned_filter();
+            _read_qf(in, qf.get());
+            storage->_filters[i].push_back(qf);
+        }
+        state.active = storage->_filters[i].back().get();
+    }
+
+    if (has_overflow) {
+        storage->_overflow = ByteStorage::deserialize(in);
+    }
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of serialized QFStorage.");
+    }
+
+    storage->_count_bytes();
+    return storage;
+}
+
+
+void
+QFStorage::_reset_partitions(uint16_t n_partitions)
+{
+    _n_partitions = n_partitions;
+    _partition_bits = 0;
+    while ((1U << _partition_bits) < _n_partitions) {
+        ++_partition_bits;
+    }
+    _states.reset(new PartitionState[_n_partitions]);
+    _filters.clear();
+    _filters.resize(_n_partitions);
+    _mapping.reset();
+}
+
+
+void
+QFStorage::_count_bytes()
+{
+    _n_bytes = 0;
+    for (const auto& chain : _filters) {
+        for (const auto& qf : chain) {
+            _n_bytes += _qf_blocks_bytes(qf.get());
+        }
+    }
+}
+
+
+static void
+_write_mapped_qf(MappedFileWriter& out, const QF * cf)
+{
+    out.write<uint64_t>(cf->nslots);
+    out.write<uint64_t>(cf->xnslots);
+    out.write<uint64_t>(cf->key_bits);
+    out.write<uint64_t>(cf->value_bits);
+    out.write<uint64_t>(cf->key_remainder_bits);
+    out.write<uint64_t>(cf->bits_per_slot);
+    out.write<uint64_t>((uint64_t) cf->range);
+    out.write<uint64_t>(cf->nblocks);
+    out.write<uint64_t>(cf->nelts);
+    out.write<uint64_t>(cf->ndistinct_elts);
+    out.write<uint64_t>(cf->noccupied_slots);
+    out.write_section(cf->blocks, _qf_blocks_bytes(cf));
+}
+
+
+static std::shared_ptr<QF>
+_map_qf(const std::shared_ptr<MappedFile>& mapping, size_t& offset)
+{
+    // the deleter keeps the mapping alive for as long as the filter
+    std::shared_ptr<QF> cf(new QF(), [mapping](QF * qf) {
+        delete qf;
+    });
+
+    cf->nslots = mapping->read<uint64_t>(offset);
+    cf->xnslots = mapping->read<uint64_t>(offset);
+    cf->key_bits = mapping->read<uint64_t>(offset);
+    cf->value_bits = mapping->read<uint64_t>(offset);
+    cf->key_remainder_bits = mapping->read<uint64_t>(offset);
+    cf->bits_per_slot = mapping->read<uint64_t>(offset);
+    cf->range = mapping->read<uint64_t>(offset);
+    cf->nblocks = mapping->read<uint64_t>(offset);
+    cf->nelts = mapping->read<uint64_t>(offset);
+    cf->ndistinct_elts = mapping->read<uint64_t>(offset);
+    cf->noccupied_slots = mapping->read<uint64_t>(offset);
+
+    if (cf->bits_per_slot != BITS_PER_SLOT
+        || cf->nblocks > mapping->size() / sizeof(qfblock)) {
+        throw GoetiaFileException("Invalid quotient filter in " + mapping->filename());
+    }
+    cf->blocks = (qfblock *) mapping->section(offset, _qf_blocks_bytes(cf.get()));
+
+    return cf;
+}
+
+
+void
+QFStorage::save_mapped(std::string outfilename, uint16_t ksize)
+{
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _lock(i);
+    }
+
+    MappedFileWriter out(outfilename, SAVED_PARTITIONEDQFCOUNT);
+
+    out.write<uint32_t>(ksize);
+    out.write<int32_t>(_size);
+    out.write<uint16_t>(_n_partitions);
+    out.write<uint64_t>(_max_bytes);
+    out.write<uint8_t>(bool(_overflow));
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        out.write<uint64_t>(_states[i].n_unique);
+        out.write<uint8_t>(_states[i].full);
+        out.write<uint16_t>(_filters[i].size());
+        for (const auto& qf : _filters[i]) {
+            _write_mapped_qf(out, qf.get());
+        }
+    }
+
+    if (_overflow) {
+        _overflow->save_mapped(outfilename + ".overflow", ksize);
+    }
+
+    for (size_t i = 0; i < _n_partitions; ++i) {
+        _unlock(i);
+    }
+
+    out.close();
+}
+
+
+void
+QFStorage::load_mapped(std::string infilename, uint16_t &ksize, bool writable)
+{
+    auto mapping = MappedFile::open(infilename, writable);
+    size_t offset = mapping->check_header(SAVED_PARTITIONEDQFCOUNT);
+
+    ksize = (uint16_t) mapping->read<uint32_t>(offset);
+    const int32_t size = mapping->read<int32_t>(offset);
+    const uint16_t n_partitions = mapping->read<uint16_t>(offset);
+    const uint64_t max_bytes = mapping->read<uint64_t>(offset);
+    const bool has_overflow = mapping->read<uint8_t>(offset);
+    if (n_partitions == 0 || (n_partitions & (n_partitions - 1))) {
+        throw GoetiaFileException("Invalid number of partitions in " + infilename);
+    }
+
+    _overflow.reset();
+    _reset_partitions(n_partitions);
+    _size = size;
+    _max_bytes = max_bytes;
+
+    for (uint16_t i = 0; i < _n_partitions; ++i) {
+        _states[i].n_unique = mapping->read<uint64_t>(offset);
+        _states[i].full = mapping->read<uint8_t>(offset);
+        const uint16_t n_filters = mapping->read<uint16_t>(offset);
+        if (n_filters == 0) {
+            throw GoetiaFileException("Partition with no filters in " + infilename);
+        }
+        for (uint16_t f = 0; f < n_filters; ++f) {
+            _filters[i].push_back(_map_qf(mapping, offset));
+        }
+        _states[i].active = _filters[i].back().get();
+    }
+
+    if (has_overflow) {
+        uint16_t overflow_ksize;
+        _overflow = ByteStorage::build(1, 1);
+        _overflow->load_mapped(infilename + ".overflow", overflow_ksize, writable);
+    }
+
+    _mapping = mapping;
+    _count_bytes();
+}
+
+
+metrics::MemoryUsage
+QFStorage::memory_usage() const
+{
+    metrics::MemoryUsage usage;
+    usage.add("qf_blocks", n_bytes());
+    if (_overflow) {
+        usage.add("overflow", _overflow->memory_usage());
+    }
+    return usage;
+}
@@ -0,0 +1,287 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : rollingbitstorage.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/goetia.hh"
+#include "goetia/storage/rollingbitstorage.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream> // IWYU pragma: keep
+
+namespace goetia {
+
+namespace storage {
+
+
+RollingBitStorage::RollingBitStorage(const std::vector<uint64_t>& tablesizes,
+                                     uint16_t                     n_generations,
+                                     uint64_t                     rotate_every,
+                                     TablePolicy                  policy)
+    : _current(0),
+      _rotate_every(rotate_every),
+      _n_current(0),
+      _n_rotations(0),
+      _n_unique_kmers(0),
+      _lock(0)
+{
+    if (n_generations < 2) {
+        throw GoetiaException("RollingBitStorage needs at least two generations, got "
+                              + std::to_string(n_generations));
+    }
+    for (uint16_t g = 0; g < n_generations; ++g) {
+        _generations.push_back(std::make_shared<BitStorage>(tablesizes, policy));
+    }
+}
+
+
+RollingBitStorage::RollingBitStorage(std::vector<std::shared_ptr<BitStorage>> generations,
+                                     uint64_t                                 rotate_every)
+    : _generations(std::move(generations)),
+      _current(0),
+      _rotate_every(rotate_every),
+      _n_current(0),
+      _n_rotations(0),
+      _n_unique_kmers(0),
+      _lock(0)
+{
+}
+
+
+std::shared_ptr<RollingBitStorage>
+RollingBitStorage::build(uint64_t    max_table,
+                         uint16_t    N,
+                         uint16_t    n_generations,
+                         uint64_t    rotate_every,
+                         TablePolicy policy) {
+    return std::make_shared<RollingBitStorage>(max_table, N, n_generations, rotate_every, policy);
+}
+
+
+std::shared_ptr<RollingBitStorage>
+RollingBitStorage::clone() const {
+    return std::make_shared<RollingBitStorage>(get_tablesizes(),
+                                               _generations.size(),
+                                               _rotate_every,
+                                               _generations.front()->table_policy());
+}
+
+
+void
+RollingBitStorage::rotate() {
+    while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+
+    const size_t next = (_current + 1) % _generations.size();
+    _generations[next]->reset();
+    __atomic_store_n(&_n_current, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&_current, next, __ATOMIC_RELEASE);
+    ++_n_rotations;
+
+    __sync_bool_compare_and_swap(&_lock, 1, 0);
+}
+
+
+std::shared_ptr<BitStorage>
+RollingBitStorage::get_generation(size_t age) const {
+    if (age >= _generations.size()) {
+        throw GoetiaException("RollingBitStorage has " + std::to_string(_generations.size())
+                              + " generations, asked for age " + std::to_string(age));
+    }
+    const size_t n = _generations.size();
+    return _generations[(__atomic_load_n(&_current, __ATOMIC_ACQUIRE) + n - age) % n];
+}
+
+
+const uint64_t
+RollingBitStorage::estimated_cardinality() const {
+    uint64_t cardinality = 0;
+    for (auto& generation : _generations) {
+        cardinality += generation->estimated_cardinality();
+    }
+    return cardinality;
+}
+
+
+double
+RollingBitStorage::estimated_fp() {
+    double p_negative = 1.0;
+    for (auto& generation : _generations) {
+        p_negative *= 1.0 - generation->estimated_fp();
+    }
+    return 1.0 - p_negative;
+}
+
+
+const bool
+RollingBitStorage::insert(value_type h) {
+    const size_t current = __atomic_load_n(&_current, __ATOMIC_ACQUIRE);
+    if (!_generations[current]->insert(h)) {
+        return false;
+    }
+
+    const bool is_new = !_in_older(h, current);
+    if (is_new) {
+        __sync_add_and_fetch(&_n_unique_kmers, 1);
+    }
+    _count_new(1);
+    return is_new;
+}
+
+
+const count_t
+RollingBitStorage::insert_and_query(value_type h) {
+    insert(h);
+    return 1;
+}
+
+
+const count_t
+RollingBitStorage::query(value_type h) const {
+    for (auto& generation : _generations) {
+        if (generation->query(h)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void
+RollingBitStorage::query_many(const value_type * khashes,
+                              size_t             n,
+                              count_t *          counts) const {
+    std::fill(counts, counts + n, 0);
+    std::vector<count_t> present(n);
+    for (auto& generation : _generations) {
+        generation->query_many(khashes, n, present.data());
+        for (size_t i = 0; i < n; ++i) {
+            counts[i] |= present[i];
+        }
+    }
+}
+
+
+void
+RollingBitStorage::reset() {
+    while (!__sync_bool_compare_and_swap(&_lock, 0, 1));
+
+    for (auto& generation : _generations) {
+        generation->reset();
+    }
+    _current = 0;
+    _n_current = 0;
+    _n_rotations = 0;
+    _n_unique_kmers = 0;
+
+    __sync_bool_compare_and_swap(&_lock, 1, 0);
+}
+
+
+void
+RollingBitStorage::serialize(std::ofstream& out) {
+    serialize_tag<RollingBitStorage>(out);
+
+    uint64_t n_generations = _generations.size();
+    uint64_t current = _current;
+    out.write((const char *) &n_generations, sizeof(n_generations));
+    out.write((const char *) &current, sizeof(current));
+    out.write((const char *) &_rotate_every, sizeof(_rotate_every));
+    out.write((const char *) &_n_current, sizeof(_n_current));
+    out.write((const char *) &_n_rotations, sizeof(_n_rotations));
+    out.write((const char *) &_n_unique_kmers, sizeof(_n_unique_kmers));
+    for (auto& generation : _generations) {
+        generation->serialize(out);
+    }
+}
+
+
+std::shared_ptr<RollingBitStorage>
+RollingBitStorage::deserialize(std::ifstream& in) {
+    deserialize_tag<RollingBitStorage>(in);
+
+    uint64_t n_generations, current, rotate_every, n_current, n_rotations, n_unique_kmers;
+    in.read((char *) &n_generations, sizeof(n_generations));
+    in.read((char *) &current, sizeof(current));
+    in.read((char *) &rotate_every, sizeof(rotate_every));
+    in.read((char *) &n_current, sizeof(n_current));
+    in.read((char *) &n_rotations, sizeof(n_rotations));
+    in.read((char *) &n_unique_kmers, sizeof(n_unique_kmers));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file reading RollingBitStorage");
+    }
+    if (n_generations < 2 || n_generations > UINT16_MAX || current >= n_generations) {
+        throw GoetiaFileException("Invalid RollingBitStorage header.");
+    }
+
+    std::vector<std::shared_ptr<BitStorage>> generations;
+    for (uint64_t g = 0; g < n_generations; ++g) {
+        generations.push_back(BitStorage::deserialize(in));
+        if (generations.back()->get_tablesizes() != generations.front()->get_tablesizes()) {
+            throw GoetiaFileException("RollingBitStorage generations differ in table sizes.");
+        }
+    }
+
+    auto storage = std::shared_ptr<RollingBitStorage>(
+        new RollingBitStorage(std::move(generations), rotate_every));
+    storage->_current = current;
+    storage->_n_current = n_current;
+    storage->_n_rotations = n_rotations;
+    storage->_n_unique_kmers = n_unique_kmers;
+    return storage;
+}
+
+
+void
+RollingBitStorage::save(std::string filename, uint16_t ksize) {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file for writing: "
+                                  + filename);
+    }
+    out.write((const char *) &ksize, sizeof(ksize));
+    serialize(out);
+    if (out.fail()) {
+        throw GoetiaFileException("Error writing " + filename);
+    }
+}
+
+
+void
+RollingBitStorage::load(std::string filename, uint16_t &ksize) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        throw GoetiaFileException("Cannot open k-mer storage file: " + filename);
+    }
+    uint16_t save_ksize;
+    in.read((char *) &save_ksize, sizeof(save_ksize));
+    if (!in) {
+        throw GoetiaFileException("Unexpected end of file: " + filename);
+    }
+    auto loaded = RollingBitStorage::deserialize(in);
+
+    _generations.swap(loaded->_generations);
+    _current        = loaded->_current;
+    _rotate_every   = loaded->_rotate_every;
+    _n_current      = loaded->_n_current;
+    _n_rotations    = loaded->_n_rotations;
+    _n_unique_kmers = loaded->_n_unique_kmers;
+    ksize = save_ksize;
+}
+
+
+metrics::MemoryUsage
+RollingBitStorage::memory_usage() const {
+    metrics::MemoryUsage usage;
+    for (auto& generation : _generations) {
+        usage.add("generations", generation->memory_usage());
+    }
+    return usage;
+}
+
+}
+
+}
@@ -11,6 +11,7 @@
 #include "goetia/storage/sparsepp/spp.h"
 #include "goetia/storage/sparsepp/serialize.hh"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <sstream> // IWYU pragma: keep
@@ -21,13 +22,34 @@ namespace storage {
 
 const bool
 SparseppSetStorage::insert(value_type h) {
+    if (_overflow) {
+        if (_store->count(h)) {
+            return false;
+        }
+        return _overflow->insert(h);
+    }
+
     auto result = _store->insert(h);
+    if (result.second && _max_bytes &&
+        n_bytes() > _max_bytes - _max_bytes / OVERFLOW_BUDGET_SHARE) {
+        _make_overflow();
+    }
     // the second in the returned pair reports that the insert
     // took place ie the hash was new
     return result.second;
 }
 
 
+void
+SparseppSetStorage::_make_overflow() {
+    // four Bloom tables sharing the budget held back for overflow
+    const uint64_t table_bits = std::max<uint64_t>(
+        _max_bytes / OVERFLOW_BUDGET_SHARE * 8 / 4, 8192
+    );
+    _overflow = BitStorage::build(table_bits, 4);
+}
+
+
 const count_t
 SparseppSetStorage::insert_and_query(value_type h) {
     insert(h);
@@ -37,7 +59,10 @@ SparseppSetStorage::insert_and_query(value_type h) {
 
 const count_t
 SparseppSetStorage::query(value_type h) const {
-    return _store->count(h);
+    if (_store->count(h)) {
+        return 1;
+    }
+    return _overflow ? _overflow->query(h) : 0;
 }
 
 
@@ -47,9 +72,17 @@ SparseppSetStorage::build() {
 }
 
 
+std::shared_ptr<SparseppSetStorage>
+SparseppSetStorage::build(uint64_t max_bytes) {
+    auto storage = std::make_shared<SparseppSetStorage>();
+    storage->_max_bytes = max_bytes;
+    return storage;
+}
+
+
 std::shared_ptr<SparseppSetStorage>
 SparseppSetStorage::clone() const {
-    return std::make_shared<SparseppSetStorage>();
+    return SparseppSetStorage::build(_max_bytes);
 }
 
 
@@ -62,43 +95,38 @@ void SparseppSetStorage::load(std::string filename, uint16_t &K) {
 }
 
 void SparseppSetStorage::serialize(std::ofstream& out) {
-    out.write(std::string(this->NAME).c_str(), this->NAME.size());
-    out.write(this->version_binary(), sizeof(this->OBJECT_ABI_VERSION));
+    if (_overflow) {
+        throw GoetiaException("Cannot serialize a SparseppSetStorage that has "
+                              "overflowed its memory budget.");
+    }
+    serialize_tag<SparseppSetStorage>(out);
+    out.write((const char *) &_max_bytes, sizeof(_max_bytes));
     _store->serialize(BaseSppSerializer(), &out);
 }
 
 std::shared_ptr<SparseppSetStorage>
 SparseppSetStorage::deserialize(std::ifstream& in) {
 
-    std::string name;
-    name.resize(Tagged<SparseppSetStorage>::NAME.size());
-    size_t version;
-
-    in.read(name.data(), name.size());
-    in.read(reinterpret_cast<char *>(&version), sizeof(version));
-
-    if (name != Tagged<SparseppSetStorage>::NAME) {
-        std::ostringstream err;
-        err << "File has wrong type tag: found "
-            << name
-            << ", should be "
-            << Tagged<SparseppSetStorage>::NAME;
-        throw GoetiaFileException(err.str());
-    } else if (version != Tagged<SparseppSetStorage>::OBJECT_ABI_VERSION) {
-        std::ostringstream err;
-        err << "File has wrong binary version: found "
-            << std::to_string(version)
-            << ", expected "
-            << std::to_string(Tagged<SparseppSetStorage>::OBJECT_ABI_VERSION);
-        throw GoetiaFileException(err.str());
-
-    }
+    deserialize_tag<SparseppSetStorage>(in);
 
-    auto storage = SparseppSetStorage::build();
+    uint64_t max_bytes;
+    in.read((char *) &max_bytes, sizeof(max_bytes));
+    auto storage = SparseppSetStorage::build(max_bytes);
     storage->_store->unserialize(BaseSppSerializer(), &in);
     return storage;
 }
 
+
+metrics::MemoryUsage
+SparseppSetStorage::memory_usage() const {
+    metrics::MemoryUsage usage;
+    usage.add("sparse_groups", metrics::sparse_map_bytes(*_store));
+    if (_overflow) {
+        usage.add("overflow", _overflow->memory_usage());
+    }
+    return usage;
+}
+
 }
 
 }
@@ -0,0 +1,256 @@
+/**
+ * (c) Camille Scott, 2019
+ * File   : table_allocator.cc
+ * License: MIT
+ * Author : Camille Scott <camille.scott.w@gmail.com>
+ * Date   : 16.10.2026
+ */
+
+#include "goetia/storage/table_allocator.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <errno.h>
+#include <fstream>
+#include <sstream> // IWYU pragma: keep
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+// Not every libc exports these; the values are the kernel ABI.
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+
+namespace goetia {
+namespace storage {
+
+static constexpr size_t HUGE_2MB = 1ULL << 21;
+static constexpr size_t HUGE_1GB = 1ULL << 30;
+
+
+static size_t round_up(size_t bytes, size_t to)
+{
+    return (bytes + to - 1) / to * to;
+}
+
+
+static std::vector<int> online_numa_nodes()
+{
+    // eg "0-1,3"
+    std::vector<int> nodes;
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!(in >> ranges)) {
+        return nodes;
+    }
+    std::istringstream ss(ranges);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int node = first; node <= last; ++node) {
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+
+
+TablePolicy
+TablePolicy::from_names(const std::string& pages,
+                        const std::string& numa)
+{
+    Pages p;
+    if (pages == "heap") {
+        p = HEAP;
+    } else if (pages == "mmap") {
+        p = MMAP;
+    } else if (pages == "thp") {
+        p = THP;
+    } else if (pages == "hugetlb-2mb") {
+        p = HUGETLB_2MB;
+    } else if (pages == "hugetlb-1gb") {
+        p = HUGETLB_1GB;
+    } else {
+        throw GoetiaException("Unknown table page policy: " + pages);
+    }
+
+    Numa n;
+    if (numa == "local") {
+        n = NUMA_LOCAL;
+    } else if (numa == "interleave") {
+        n = NUMA_INTERLEAVE;
+    } else if (numa == "spread") {
+        n = NUMA_SPREAD;
+    } else {
+        throw GoetiaException("Unknown table NUMA policy: " + numa);
+    }
+
+    return TablePolicy(p, n);
+}
+
+
+size_t
+TableAllocator::n_numa_nodes()
+{
+    return std::max<size_t>(1, online_numa_nodes().size());
+}
+
+
+TableAllocator::~TableAllocator()
+{
+    for (auto& table : _mapped) {
+        munmap(table.first, table.second);
+    }
+}
+
+
+byte_t *
+TableAllocator::_map(size_t bytes, TablePolicy::Pages pages, size_t& length)
+{
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (pages == TablePolicy::HUGETLB_2MB || pages == TablePolicy::HUGETLB_1GB) {
+        const size_t page = pages == TablePolicy::HUGETLB_2MB ? HUGE_2MB : HUGE_1GB;
+        const int shift = pages == TablePolicy::HUGETLB_2MB ? 21 : 30;
+        length = round_up(bytes, page);
+        void * table = mmap(nullptr, length, prot,
+                            flags | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (table != MAP_FAILED) {
+            return (byte_t *) table;
+        }
+        // no reserved pages of that size: transparent huge pages instead
+        pages = TablePolicy::THP;
+    }
+
+    if (pages == TablePolicy::THP) {
+        // over-map so a 2 MB aligned range can be cut out of it
+        length = round_up(bytes, HUGE_2MB);
+        void * raw = mmap(nullptr, length + HUGE_2MB, prot, flags, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        byte_t * start = (byte_t *) raw;
+        byte_t * table = (byte_t *) round_up((uintptr_t) start, HUGE_2MB);
+        if (table > start) {
+            munmap(start, table - start);
+        }
+        byte_t * end = table + length;
+        if (end < start + length + HUGE_2MB) {
+            munmap(end, start + length + HUGE_2MB - end);
+        }
+        // advisory; without THP this is just an MMAP table
+        madvise(table, length, MADV_HUGEPAGE);
+        return table;
+    }
+
+    length = round_up(bytes, sysconf(_SC_PAGESIZE));
+    void * table = mmap(nullptr, length, prot, flags, -1, 0);
+    return table == MAP_FAILED ? nullptr : (byte_t *) table;
+}
+
+
+void
+TableAllocator::_place(byte_t * table, size_t length, size_t index) const
+{
+    if (_policy.numa == TablePolicy::NUMA_LOCAL) {
+        return;
+    }
+    auto nodes = online_numa_nodes();
+    if (nodes.size() < 2) {
+        return;
+    }
+
+    const int max_node = *std::max_element(nodes.begin(), nodes.end());
+    std::vector<unsigned long> mask(max_node / (8 * sizeof(unsigned long)) + 1, 0);
+    auto set_node = [&](int node) {
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    };
+
+    int mode;
+    if (_policy.numa == TablePolicy::NUMA_INTERLEAVE) {
+        mode = MPOL_INTERLEAVE;
+        for (int node : nodes) {
+            set_node(node);
+        }
+    } else {
+        // preferred rather than bound, so a full node spills over
+        // instead of failing
+        mode = MPOL_PREFERRED;
+        set_node(nodes[index % nodes.size()]);
+    }
+
+    // Called before any page is touched, so it places the whole table.
+    // Placement is advisory: a kernel without NUMA support leaves the
+    // table local.
+    syscall(SYS_mbind, table, length, mode, mask.data(),
+            mask.size() * 8 * sizeof(unsigned long), 0);
+}
+
+
+byte_t *
+TableAllocator::allocate(size_t bytes, size_t index)
+{
+    if (_policy.pages == TablePolicy::HEAP) {
+        // cache-line aligned, as BlockedBitStorage needs
+        byte_t * table = (byte_t *) std::aligned_alloc(64, round_up(std::max<size_t>(bytes, 1), 64));
+        if (!table) {
+            throw std::bad_alloc();
+        }
+        memset(table, 0, bytes);
+        return table;
+    }
+
+    size_t length = 0;
+    byte_t * table = _map(bytes, _policy.pages, length);
+    if (!table) {
+        throw GoetiaException("Could not map " + std::to_string(bytes)
+                              + " bytes for storage table: " + strerror(errno));
+    }
+    _place(table, length, index);
+    _mapped[table] = length;
+    return table;
+}
+
+
+void
+TableAllocator::release(byte_t * table)
+{
+    if (!table) {
+        return;
+    }
+    auto mapped = _mapped.find(table);
+    if (mapped != _mapped.end()) {
+        munmap(mapped->first, mapped->second);
+        _mapped.erase(mapped);
+    } else {
+        std::free(table);
+    }
+}
+
+
+void
+TableAllocator::zero(byte_t * table, size_t bytes)
+{
+    auto mapped = _mapped.find(table);
+    if (mapped != _mapped.end() &&
+        madvise(mapped->first, mapped->second, MADV_DONTNEED) == 0) {
+        // private anonymous pages read back as zero once dropped
+        return;
+    }
+    memset(table, 0, bytes);
+}
+
+}
+}
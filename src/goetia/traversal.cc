@@ -17,11 +17,42 @@ namespace goetia {
     template class dBGWalker<dBG<storage::BitStorage, hashing::CanLemireShifter>>;
     template class dBGWalker<dBG<storage::BitStorage, hashing::FwdUnikmerShifter>>;
     template class dBGWalker<dBG<storage::BitStorage, hashing::CanUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::BitStorage, hashing::FwdTwoBitShifter>>;
+    template class dBGWalker<dBG<storage::BitStorage, hashing::CanTwoBitShifter>>;
+
+    template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::BlockedBitStorage, hashing::CanUnikmerShifter>>;
 
     template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdLemireShifter>>;
     template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanLemireShifter>>;
     template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdUnikmerShifter>>;
     template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::FwdTwoBitShifter>>;
+    template class dBGWalker<dBG<storage::SparseppSetStorage, hashing::CanTwoBitShifter>>;
+
+    template class dBGWalker<dBG<storage::FlatSetStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::FlatSetStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::FlatSetStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::FlatSetStorage, hashing::CanUnikmerShifter>>;
+
+    template class dBGWalker<dBG<storage::FlatCountStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::FlatCountStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::FlatCountStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::FlatCountStorage, hashing::CanUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::FrozenStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::FrozenStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::FrozenStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::FrozenStorage, hashing::CanUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::DiskCountStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::DiskCountStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::DiskCountStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::DiskCountStorage, hashing::CanUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::RollingBitStorage, hashing::FwdLemireShifter>>;
+    template class dBGWalker<dBG<storage::RollingBitStorage, hashing::CanLemireShifter>>;
+    template class dBGWalker<dBG<storage::RollingBitStorage, hashing::FwdUnikmerShifter>>;
+    template class dBGWalker<dBG<storage::RollingBitStorage, hashing::CanUnikmerShifter>>;
 
     template class dBGWalker<dBG<storage::ByteStorage, hashing::FwdLemireShifter>>;
     template class dBGWalker<dBG<storage::ByteStorage, hashing::CanLemireShifter>>;
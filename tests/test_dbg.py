@@ -209,6 +209,17 @@ def test_insert_sequence_overload(graph, ksize, length, linear_path):
         assert graph.query(x[start:start + ksize]) == 1
 
 
+@using(ksize=21, length=50)
+def test_insert_sequence_new_kmers(graph, ksize, length, linear_path):
+    x = linear_path()
+    new_kmers = std.set[type(graph).hash_type]()
+    n_consumed = graph.insert_sequence(x, new_kmers)
+    assert n_consumed == len(x) - ksize + 1
+    assert new_kmers.size() == n_consumed
+
+    assert graph.insert_sequence(x, new_kmers) == 0
+
+
 @using(ksize=21, length=30)
 @pytest.mark.xfail
 def test_insert_sequence_bad_dna(graph, linear_path):
@@ -273,6 +284,62 @@ def test_hashing_2(graph, linear_path, ksize):
         assert u == v
 
 
+@using(ksize=[21, 31, 41], length=1000)
+@pytest.mark.parametrize('kernel', ['scalar', 'avx2', 'avx512'])
+def test_hash_values_kernels(graph, random_sequence, ksize, kernel):
+    ''' Graph.hash_values hashes whole sequences with the rolling hash
+    kernels; check that each gives the same values as a KmerIterator,
+    including on soft-masked and ambiguous symbols.'''
+
+    lemire = libgoetia.hashing.lemire
+    default = str(lemire.kernel())
+    try:
+        lemire.set_kernel(kernel)
+    except Exception:
+        pytest.skip('CPU lacks the {0} kernel'.format(kernel))
+
+    try:
+        S = random_sequence()
+        masked = S[:300] + S[300:600].lower() + S[600:]
+        ambiguous = S[:500] + 'N' + S[501:]
+        for seq in (S, masked, ambiguous):
+            expected = [h.value() for h in graph.hashes(seq)]
+            assert list(graph.hash_values(seq)) == expected
+    finally:
+        lemire.set_kernel(default)
+
+
+@using(length=150)
+def test_multik_inserter(random_sequence):
+    ''' A MultiKInserter should leave each graph as inserting the sequences
+    into it one at a time would.'''
+
+    graph_type = libgoetia.dBG[libgoetia.storage.SparseppSetStorage,
+                               libgoetia.hashing.CanLemireShifter]
+    Ks = [21, 31, 51]
+    graphs = std.vector[std.shared_ptr[graph_type]]()
+    expected = []
+    for K in Ks:
+        graphs.push_back(graph_type.build(libgoetia.storage.SparseppSetStorage.build(), K))
+        expected.append(graph_type.build(libgoetia.storage.SparseppSetStorage.build(), K))
+    inserter = libgoetia.MultiKInserter[graph_type].build(graphs)
+    assert inserter.K == 21
+
+    n_expected = 0
+    n_new = 0
+    for _ in range(20):
+        seq = random_sequence()
+        n_new += inserter.insert_sequence(seq)
+        n_expected += sum((g.insert_sequence(seq) for g in expected))
+
+    assert n_new == n_expected
+    for graph, other in zip(graphs, expected):
+        assert graph.n_unique() == other.n_unique()
+
+    with pytest.raises(Exception):
+        inserter.insert_sequence('A' * 20)
+
+
 @using(ksize=[21, 31, 41], length=[50000, 500000])
 @pytest.mark.benchmark(group='dbg-sequence')
 @exact_backends()
@@ -334,3 +401,129 @@ def test_pdbg_get_counts(random_sequence, ksize, benchmark, partitioned_graph):
 
     counts = benchmark(graph.query_sequence, sequence)
     assert all((count > 0 for count in counts))
+
+
+@using(ksize=[21, 31], length=1000)
+def test_query_sequence_matches_query(graph, ksize, random_sequence):
+    # the batched sequence methods should agree with per-k-mer queries
+    sequence = random_sequence()
+    graph.insert_sequence(sequence)
+    graph.insert_sequence(sequence[:len(sequence) // 2])
+
+    counts = graph.query_sequence(sequence)
+    for count, kmer in zip(counts, kmers(sequence, ksize)):
+        assert count == graph.query(kmer)
+
+
+@using(ksize=[21, 31], length=5000)
+def test_pdbg_insert_sequences(random_sequence, ksize, partitioned_graph, store):
+    from goetia.utils import check_trait
+    # parallel ingest should agree with inserting each sequence serially
+    sequences = [random_sequence() for _ in range(8)]
+    serial = partitioned_graph.clone()
+    for sequence in sequences:
+        serial.insert_sequence(sequence)
+
+    graph = partitioned_graph
+    graph.insert_sequences(std.vector[std.string](sequences), 4)
+
+    if check_trait(libgoetia.storage.is_probabilistic, type(store)):
+        # which hashes count as new depends on insertion order
+        assert abs(graph.n_unique() - serial.n_unique()) < len(sequences) * 5
+    else:
+        assert graph.n_unique() == serial.n_unique()
+    for sequence in sequences:
+        assert list(graph.query_sequence(sequence)) == list(serial.query_sequence(sequence))
+
+
+@using(ksize=[21, 31], length=1000)
+@exact_backends()
+def test_freeze(graph, ksize, store, random_sequence, tmpdir):
+    from goetia.utils import check_trait
+    sequence = random_sequence()
+    graph.insert_sequence(sequence)
+    graph.insert_sequence(sequence[:len(sequence) // 2])
+
+    if check_trait(libgoetia.storage.is_enumerable, type(store)):
+        frozen = graph.freeze()
+    else:
+        frozen = graph.freeze(std.vector[std.string]([sequence]))
+    assert frozen.n_unique() == graph.n_unique()
+    assert list(frozen.query_sequence(sequence)) == list(graph.query_sequence(sequence))
+
+    path = str(tmpdir.join('frozen.idx'))
+    frozen.save(path)
+    loaded = frozen.clone()
+    loaded.load(path)
+    assert list(loaded.query_sequence(sequence)) == list(graph.query_sequence(sequence))
+    with pytest.raises(Exception):
+        loaded.insert(sequence[:ksize])
+
+
+@using(ksize=21, length=1000)
+@presence_backends()
+def test_recent_cache(graph, ksize, store, random_sequence):
+    from goetia.storage import is_forgetful
+    if is_forgetful(type(store)):
+        with pytest.raises(Exception):
+            graph.enable_cache(4096)
+        return
+
+    sequence = random_sequence()
+    other = random_sequence()
+    graph.enable_cache(4096)
+    assert graph.insert_sequence(sequence) > 0
+    assert graph.insert_sequence(sequence) == 0
+
+    cache = graph.get_cache()
+    assert cache.hit_rate() > 0
+    rate = cache.hit_rate()
+    cache.flush()
+    assert cache.n_hits.load() > 0
+    assert cache.hit_rate() == rate
+    assert all(count == 1 for count in graph.query_sequence(sequence))
+    assert list(graph.query_sequence(other)) == [graph.query(kmer) for kmer in kmers(other, ksize)]
+
+    graph.reset()
+    assert not any(graph.query_sequence(sequence))
+
+
+@using(ksize=21, length=200)
+def test_recent_cache_rejects_rolling(ksize, random_sequence):
+    from goetia.storage import RollingBitStorage
+    sequence = random_sequence()
+    store = RollingBitStorage.build(100000, 4, 2)
+    graph = libgoetia.dBG[RollingBitStorage, FwdLemireShifter].build(store, ksize)
+    with pytest.raises(Exception):
+        graph.enable_cache(4096)
+    ukhs = UKHS[FwdLemireShifter].load(ksize, 7)
+    pstore = std.make_shared[libgoetia.storage.PartitionedStorage[RollingBitStorage]](ukhs.n_hashes(),
+                                                                                      store)
+    partitioned = std.make_shared[libgoetia.PdBG[RollingBitStorage, FwdUnikmerShifter]](ksize, 7,
+                                                                                       ukhs,
+                                                                                       pstore)
+    with pytest.raises(Exception):
+        partitioned.enable_cache(4096)
+
+    # without a cache, the graph keeps up with its storage's rotations
+    for _ in range(4):
+        graph.insert_sequence(sequence)
+        store.rotate()
+    assert all(graph.query_sequence(sequence))
+    store.rotate()
+    assert not any(graph.query_sequence(sequence))
+
+@using(ksize=21, length=1000)
+def test_memory_usage(graph, partitioned_graph, random_sequence):
+    sequence = random_sequence()
+    graph.insert_sequence(sequence)
+    usage = graph.memory_usage()
+    assert usage.total() > 0
+    assert usage.get('storage') == usage.total()
+
+    graph.enable_cache(4096)
+    assert graph.memory_usage().get('recent_cache') == 4096
+    assert graph.memory_usage().total() == usage.total() + 4096
+
+    partitioned_graph.insert_sequence(sequence)
+    assert partitioned_graph.memory_usage().get('storage.partitions') > 0
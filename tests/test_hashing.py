@@ -10,6 +10,7 @@ from .utils import *
 from goetia import libgoetia
 from goetia.hashing import (FwdLemireShifter, CanLemireShifter, 
                            FwdUnikmerShifter, CanUnikmerShifter,
+                           FwdTwoBitShifter, CanTwoBitShifter,
                            extender_selector_t)
 
 known_kmer = 'TCACCTGTGTTGTGCTACTTGCGGCGC'
@@ -172,6 +173,103 @@ def test_canonical_rolling_hash(ksize, length, random_sequence):
         assert can_hasher.hash(kmer).value == can.value
 
 
+@using(length=100)
+@pytest.mark.parametrize('ksize', [21, 25, 31, 51])
+@pytest.mark.parametrize('hash_type', ['Fwd', 'Can'])
+def test_fixed_k_shifter(ksize, length, random_sequence, hash_type):
+    seq = random_sequence()
+
+    fixed = getattr(libgoetia.hashing, 'Fixed{0}LemireShifter'.format(hash_type))[ksize](ksize)
+    runtime = getattr(libgoetia.hashing, '{0}LemireShifter'.format(hash_type))(ksize)
+
+    assert fixed.hash_base(seq[:ksize]).value == runtime.hash_base(seq[:ksize]).value
+    for out_base, in_base in zip(seq[0:-ksize], seq[ksize:]):
+        assert fixed.shift_right(out_base, in_base).value == runtime.shift_right(out_base, in_base).value
+    for kmer in kmers(seq, ksize):
+        assert fixed.hash(kmer).value == runtime.hash(kmer).value
+
+
+def test_fixed_k_shifter_wrong_k():
+    with pytest.raises(Exception):
+        libgoetia.hashing.FixedCanLemireShifter[31](27)
+
+
+@using(length=300)
+@pytest.mark.parametrize('kernel', ['scalar', 'avx2', 'avx512'])
+@pytest.mark.parametrize('hash_type', ['Fwd', 'Can'])
+def test_multik_hasher(length, random_sequence, hash_type, kernel):
+    ''' A MultiKHasher should give each K the same values as the Lemire
+    shifter at that K, including Ks longer than the sequence.'''
+
+    lemire = libgoetia.hashing.lemire
+    default = str(lemire.kernel())
+    try:
+        lemire.set_kernel(kernel)
+    except Exception:
+        pytest.skip('CPU lacks the {0} kernel'.format(kernel))
+
+    try:
+        seq = random_sequence()
+        Ks = [21, 31, 51, 64, 65, 400]
+        multik = getattr(libgoetia.hashing, '{0}MultiKHasher'.format(hash_type))(std.vector['uint16_t'](Ks))
+        multik.hash_sequence(seq)
+
+        for i, K in enumerate(Ks):
+            shifter = getattr(libgoetia.hashing, '{0}LemireShifter'.format(hash_type))(K)
+            expected = [shifter.hash(kmer).value for kmer in kmers(seq, K)]
+            assert list(multik.values(i)) == expected
+    finally:
+        lemire.set_kernel(default)
+
+
+def test_multik_hasher_bad_k():
+    with pytest.raises(Exception):
+        libgoetia.hashing.CanMultiKHasher(std.vector['uint16_t']([21, 0]))
+
+
+@using(ksize=[7, 21, 31, 32])
+@pytest.mark.parametrize('shifter_type', [FwdTwoBitShifter, CanTwoBitShifter])
+def test_twobit_shift_unhash(ksize, length, random_sequence, shifter_type):
+    seq = random_sequence()
+    hasher = shifter_type(ksize)
+
+    hashes = [hasher.hash_base(seq[:ksize])]
+    for out_base, in_base in zip(seq[0:-ksize], seq[ksize:]):
+        hashes.append(hasher.shift_right(out_base, in_base))
+
+    for kmer, h in zip(kmers(seq, ksize), hashes):
+        assert h.value == shifter_type.hash(kmer, ksize).value
+        assert hasher.unhash(h.value) in (kmer, hasher.alphabet.reverse_complement(kmer))
+
+
+@using(ksize=[7, 21, 31])
+def test_twobit_canonical(ksize, length, random_sequence):
+    seq = random_sequence()
+    hasher = CanTwoBitShifter(ksize)
+
+    for kmer in kmers(seq, ksize):
+        assert hasher.hash(kmer).value == hasher.hash(hasher.alphabet.reverse_complement(kmer)).value
+
+
+@using(ksize=21)
+def test_twobit_extensions(ksize, length, random_sequence):
+    seq = random_sequence()
+    extender = extender_selector_t[CanTwoBitShifter](ksize)
+    extender.set_cursor(seq)
+    root = seq[:ksize]
+
+    for ext in extender.right_extensions():
+        assert ext.value == CanTwoBitShifter.hash(root[1:] + ext.symbol, ksize).value
+    for ext in extender.left_extensions():
+        assert ext.value == CanTwoBitShifter.hash(ext.symbol + root[:-1], ksize).value
+    assert extender.get_cursor() == root
+
+
+def test_twobit_bad_k():
+    with pytest.raises(Exception):
+        FwdTwoBitShifter(33)
+
+
 @pytest.mark.parametrize('hasher_type', [FwdUnikmerShifter, CanUnikmerShifter], indirect=True)
 def test_unikmer_hash_base(ksize, length, random_sequence, hasher):
     seq = random_sequence()
@@ -284,6 +382,31 @@ def test_kmeriterator_from_proto(hasher, ksize, length, random_sequence):
     assert act == exp
 
 
+@pytest.mark.parametrize('hasher_type', [FwdLemireShifter, CanLemireShifter], indirect=True)
+def test_kmerrange(hasher, ksize, length, random_sequence):
+    # the range only views its sequence, so keep it alive on this side
+    s = std.string(random_sequence())
+
+    exp = [hasher.hash(kmer).value for kmer in kmers(str(s), ksize)]
+
+    owner = libgoetia.hashing.KmerRange[type(hasher)](s, ksize)
+    assert owner.size() == len(exp)
+    assert [h.value for h in owner] == exp
+
+    # a borrowed shifter follows the range, ending on the last k-mer
+    borrowed = libgoetia.hashing.KmerRange[type(hasher)](s, hasher)
+    assert [h.value for h in borrowed] == exp
+    assert hasher.get().value == exp[-1]
+
+
+@using(ksize=27)
+@pytest.mark.parametrize('hasher_type', [FwdLemireShifter, CanLemireShifter], indirect=True)
+def test_kmerrange_too_short(hasher, ksize):
+    s = std.string(known_kmer[:-1])
+    with pytest.raises(Exception):
+        libgoetia.hashing.KmerRange[type(hasher)](s, hasher)
+
+
 
 @pytest.mark.parametrize('hasher_type', [FwdLemireShifter, CanLemireShifter], indirect=True)
 def test_kmeriterator_hashextender(hasher, ksize, length, random_sequence):
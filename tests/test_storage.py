@@ -0,0 +1,553 @@
+# goetia/tests/test_storage.py
+# Copyright (C) 2018 Camille Scott
+# All rights reserved.
+#
+# This software may be modified and distributed under the terms
+# of the MIT license.  See the LICENSE file for details.
+
+import array
+import ctypes
+
+import cppyy
+import pytest
+from cppyy.gbl import std
+
+from .utils import *
+from goetia.storage import (BitStorage, BlockedBitStorage, ByteStorage,
+                            DiskCountStorage, FlatCountStorage, FlatSetStorage,
+                            NibbleStorage, RollingBitStorage, is_counting)
+
+
+combinable_types = [BitStorage, BlockedBitStorage, ByteStorage, NibbleStorage]
+
+
+# Inserts from native threads, so that they really run concurrently.
+cppyy.cppdef("""
+namespace goetia_tests {
+
+template <typename StorageType>
+void threaded_insert(StorageType& store, const std::vector<uint64_t>& hashes,
+                     size_t n_threads, bool batched)
+{
+    goetia::storage::run_threads(n_threads, [&](size_t t) {
+        std::vector<uint64_t> mine;
+        for (size_t i = t; i < hashes.size(); i += n_threads) {
+            if (batched) {
+                mine.push_back(hashes[i]);
+            } else {
+                store.insert(hashes[i]);
+            }
+        }
+        if (batched) {
+            store.insert_many(mine.data(), mine.size(), nullptr);
+        }
+    });
+}
+
+}
+""")
+
+
+@pytest.mark.parametrize('storage_t', combinable_types,
+                         ids=lambda t: pretty_repr(t))
+def test_merge_intersect_subtract(storage_t):
+    left, right = list(range(0, 3000)), list(range(2000, 5000))
+    a = storage_t.build(100000, 4)
+    b = storage_t.build(100000, 4)
+    for h in left:
+        a.insert(h * 7919)
+    for h in right:
+        b.insert(h * 7919)
+
+    union = a.clone()
+    union.merge(a)
+    union.merge(b)
+    assert all(union.query(h * 7919) for h in left + right)
+    assert abs(union.n_unique_kmers() - 5000) < 250
+
+    both = a.clone()
+    both.merge(a)
+    both.intersect(b)
+    assert all(both.query(h * 7919) for h in range(2000, 3000))
+
+    only_a = a.clone()
+    only_a.merge(a)
+    only_a.subtract(b)
+    assert not any(only_a.query(h * 7919) for h in range(2000, 3000))
+
+
+@pytest.mark.parametrize('storage_t', [ByteStorage, NibbleStorage],
+                         ids=lambda t: pretty_repr(t))
+def test_merge_adds_counts(storage_t):
+    a = storage_t.build(100000, 4)
+    b = storage_t.build(100000, 4)
+    for _ in range(3):
+        a.insert(42)
+    for _ in range(4):
+        b.insert(42)
+
+    a.merge(b)
+    assert a.query(42) == 7
+    for _ in range(3):
+        a.merge(b)
+    # nibble counters saturate at 15 rather than wrapping
+    assert a.query(42) == (15 if storage_t is NibbleStorage else 19)
+
+
+def test_merge_mismatched_sizes():
+    a = BitStorage.build(100000, 4)
+    b = BitStorage.build(50000, 4)
+    with pytest.raises(Exception):
+        a.merge(b)
+
+
+def test_qf_merge():
+    QFStorage = libgoetia.storage.QFStorage
+    a = QFStorage.build(16, 4)
+    b = QFStorage.build(16, 4)
+    for h in range(0, 3000):
+        a.insert(h * 7919)
+    for h in range(2000, 5000):
+        b.insert(h * 7919)
+
+    a.merge(b)
+    for h in range(0, 5000):
+        assert a.query(h * 7919) == (2 if 2000 <= h < 3000 else 1)
+    assert abs(a.n_unique_kmers() - 5000) < 50
+
+
+
+@pytest.mark.parametrize('n_partitions,n_left,n_right', [(1, 5000, 5000),
+                                                         (4, 40000, 10000)])
+def test_qf_merge_chained(n_partitions, n_left, n_right):
+    QFStorage = libgoetia.storage.QFStorage
+    keys = [hash((h, 'goetia')) & 0xFFFFFFFFFFFFFFFF for h in range(15000)]
+    a = QFStorage.build(12, n_partitions)
+    b = QFStorage.build(12, n_partitions)
+    for h in range(n_left):
+        a.insert(keys[(h * 7919) % len(keys)])
+    for h in range(n_right):
+        b.insert(keys[(h * 104729) % len(keys)])
+    # both sides have grown filter chains
+    assert a.n_filters(0) > 1 and b.n_filters(0) > 1
+
+    expected = [a.query(k) + b.query(k) for k in keys]
+    a.merge(b)
+    assert [a.query(k) for k in keys] == expected
+
+
+@pytest.mark.parametrize('batched', [False, True], ids=['insert', 'insert_many'])
+@pytest.mark.parametrize('build', [lambda: ByteStorage.build(1000000, 4),
+                                   lambda: NibbleStorage.build(1000000, 4),
+                                   lambda: libgoetia.storage.QFStorage.build(16, 1),
+                                   lambda: libgoetia.storage.QFStorage.build(16, 8)],
+                         ids=['ByteStorage', 'NibbleStorage', 'QFStorage', 'QFStorage-8'])
+def test_threaded_insert(build, batched):
+    keys = [h * 0x9E3779B97F4A7C15 & 0xFFFFFFFFFFFFFFFF for h in range(1, 20001)]
+    # up to three of each, spread over the threads
+    hashes = [k for r in range(3) for i, k in enumerate(keys) if (i + 1) % 3 >= r]
+
+    serial = build()
+    for h in hashes:
+        serial.insert(h)
+    threaded = build()
+    goetia_tests = cppyy.gbl.goetia_tests
+    goetia_tests.threaded_insert[type(threaded)](threaded, std.vector['uint64_t'](hashes),
+                                                 8, batched)
+
+    assert [threaded.query(k) for k in keys] == [serial.query(k) for k in keys]
+    if type(threaded) is libgoetia.storage.QFStorage:
+        assert threaded.n_unique_kmers() == serial.n_unique_kmers()
+    else:
+        # two threads inserting a new k-mer at once can both count it
+        assert 0 <= threaded.n_unique_kmers() - serial.n_unique_kmers() < 100
+
+
+def test_qf_count_clamped():
+    store = libgoetia.storage.QFStorage.build(16)
+    for _ in range(40000):
+        store.insert(42)
+    # the count passes count_t, and is clamped rather than wrapping
+    assert store.query(42) == 32767
+    assert store.n_unique_kmers() == 1
+
+
+def test_qf_grows():
+    store = libgoetia.storage.QFStorage.build(10)
+    start_bytes = store.n_bytes()
+    hashes = [h * 0x9E3779B97F4A7C15 & 0xFFFFFFFFFFFFFFFF for h in range(1, 5001)]
+    for h in hashes:
+        store.insert(h)
+    assert store.n_filters(0) > 1
+    assert store.n_bytes() > start_bytes
+    # counts after growth can be over, but never under
+    assert all(store.query(h) for h in hashes)
+    assert abs(store.n_unique_kmers() - 5000) < 50
+
+
+def test_qf_overflows_budget():
+    QFStorage = libgoetia.storage.QFStorage
+    # room for the first filter and one doubling
+    max_bytes = QFStorage.build(10).n_bytes() * 4
+    store = QFStorage.build(10, 1, max_bytes)
+    hashes = [h * 0x9E3779B97F4A7C15 & 0xFFFFFFFFFFFFFFFF for h in range(1, 20001)]
+    for h in hashes:
+        store.insert(h)
+    assert store.overflowed()
+    assert store.max_bytes() == max_bytes
+    assert store.n_bytes() <= max_bytes
+    assert all(store.query(h) for h in hashes)
+
+    with pytest.raises(Exception):
+        QFStorage.build(16, 1, max_bytes)
+
+
+def test_qf_reset():
+    QFStorage = libgoetia.storage.QFStorage
+    store = QFStorage.build(10, 1, QFStorage.build(10).n_bytes() * 4)
+    start_bytes = store.n_bytes()
+    for h in range(1, 20001):
+        store.insert(h * 7919)
+    assert store.overflowed()
+
+    store.reset()
+    assert not store.overflowed()
+    assert store.n_filters(0) == 1
+    assert store.n_bytes() == start_bytes
+    assert store.n_unique_kmers() == 0
+    assert not any(store.query(h * 7919) for h in range(1, 20001))
+    store.insert(7919)
+    assert store.query(7919) == 1
+
+
+def test_sparsepp_budget(tmpdir):
+    SparseppSetStorage = libgoetia.storage.SparseppSetStorage
+    store = SparseppSetStorage.build(4096)
+    store.insert(7919)
+    path = str(tmpdir.join('set.store'))
+    out = std.ofstream(path, std.ios_base.binary)
+    store.serialize(out)
+    out.close()
+
+    # the budget survives a round trip
+    infile = std.ifstream(path, std.ios_base.binary)
+    loaded = SparseppSetStorage.deserialize(infile)
+    infile.close()
+    assert loaded.max_bytes() == 4096
+    assert loaded.query(7919)
+
+    for h in range(1, 5001):
+        loaded.insert(h * 7919)
+    assert loaded.overflowed()
+    assert loaded.n_bytes() <= 4096
+    assert all(loaded.query(h * 7919) for h in range(1, 5001))
+    # hashes in the Bloom tier can't be written out
+    with pytest.raises(Exception):
+        loaded.serialize(std.ofstream(path, std.ios_base.binary))
+
+@pytest.mark.parametrize('storage_t', [BitStorage, ByteStorage],
+                         ids=lambda t: pretty_repr(t))
+def test_partitioned_save_load(storage_t, tmpdir):
+    partitioned_t = libgoetia.storage.PartitionedStorage[storage_t]
+    store = std.make_shared[partitioned_t](8, storage_t.build(100000, 4))
+    for h in range(4000):
+        for _ in range(h % 3 + 1):
+            store.insert(h * 7919, h % 8)
+    path = str(tmpdir.join('partitioned.store'))
+    store.save(path, 21)
+    counts = list(store.get_partition_counts())
+    queries = [store.query(h * 7919, h % 8) for h in range(4000)]
+
+    ksize = ctypes.c_uint16(0)
+    loaded = store.clone()
+    loaded.load(path, ksize)
+    assert ksize.value == 21
+    assert list(loaded.get_partition_counts()) == counts
+    assert [loaded.query(h * 7919, h % 8) for h in range(4000)] == queries
+
+    # the partitions not asked for stay as constructed
+    subset = store.clone()
+    subset.load_partitions(path, ksize, std.vector['uint64_t']([1, 5]))
+    assert list(subset.get_partition_counts()) == \
+        [count if p in (1, 5) else 0 for p, count in enumerate(counts)]
+    assert [subset.query(h * 7919, h % 8) for h in range(4000)] == \
+        [count if h % 8 in (1, 5) else 0 for h, count in enumerate(queries)]
+
+    mismatched = std.make_shared[partitioned_t](4, storage_t.build(100000, 4))
+    with pytest.raises(Exception):
+        mismatched.load(path, ksize)
+
+
+@pytest.mark.parametrize('storage_t', combinable_types,
+                         ids=lambda t: pretty_repr(t))
+def test_estimated_cardinality(storage_t):
+    store = storage_t.build(200000, 4)
+    for h in range(50000):
+        store.insert(hash((h, 'goetia')) & 0xFFFFFFFFFFFFFFFF)
+    # n_unique_kmers misses k-mers whose bins were all taken; the
+    # estimate corrects for that
+    assert abs(store.estimated_cardinality() - 50000) < 1000
+    assert 0 < store.estimated_fp() < 1
+
+    store.reset()
+    assert store.estimated_cardinality() == 0
+
+
+def test_flatset_grows():
+    store = FlatSetStorage.build(0.5)
+    for h in range(20000):
+        assert store.insert(h * 7919)
+    assert not store.insert(0)
+    assert store.n_unique_kmers() == 20000
+    assert store.load_factor() <= 0.5
+    assert all(store.query(h * 7919) for h in range(20000))
+    assert not any(store.query(h * 7919 + 1) for h in range(20000))
+
+
+def test_flatset_bad_load_factor():
+    with pytest.raises(Exception):
+        FlatSetStorage.build(1.0)
+
+
+def test_flatcount_exact():
+    store = FlatCountStorage.build()
+    for h in range(5000):
+        for _ in range(h % 7 + 1):
+            store.insert(h * 7919)
+    assert store.n_unique_kmers() == 5000
+    assert all(store.query(h * 7919) == h % 7 + 1 for h in range(5000))
+    assert store.query(1) == 0
+
+
+def test_flatcount_promotes():
+    store = FlatCountStorage.build(0.875, 1)
+    for _ in range(70000):
+        store.insert(42)
+    assert store.n_promoted() == 1
+    assert store.query_count(42) == 70000
+    # query is clamped to count_t
+    assert store.query(42) == 32767
+
+
+def test_bytestorage_bigcounts():
+    store = ByteStorage.build(100000, 4)
+    store.set_use_bigcount(True)
+    hashes = array.array('Q', [h * 7919 for h in range(1, 11)])
+    for _ in range(1000):
+        store.insert_many(hashes, len(hashes), None)
+    assert all(store.query(h) == 1000 for h in hashes)
+    for _ in range(40000):
+        store.insert(42)
+    # bigcounts are clamped to count_t
+    assert store.query(42) == 32767
+
+
+def test_bytestorage_batch_bigcounts_match_single():
+    batched = ByteStorage.build(100000, 4)
+    single = ByteStorage.build(100000, 4)
+    batched.set_use_bigcount(True)
+    single.set_use_bigcount(True)
+    # 42 repeats within every batch as it crosses the counter maximum
+    hashes = []
+    for i in range(400):
+        hashes += [42, 42, 7919, 15838 + i % 3]
+    counts = array.array('h', [0] * len(hashes))
+    batched.insert_many(array.array('Q', hashes), len(hashes), counts)
+    assert list(counts) == [single.insert_and_query(h) for h in hashes]
+    assert batched.query(42) == 800
+
+
+def test_bytestorage_combine_bigcounts():
+    def build(counts):
+        store = ByteStorage.build(100000, 4)
+        store.set_use_bigcount(True)
+        for h, n in counts.items():
+            for _ in range(n):
+                store.insert(h)
+        return store
+
+    other = build({42: 300, 7919: 600})
+
+    merged = build({42: 400, 7919: 300})
+    merged.merge(other)
+    assert merged.query(42) == 700
+    assert merged.query(7919) == 900
+
+    both = build({42: 400, 7919: 300})
+    both.intersect(other)
+    assert both.query(42) == 300
+    assert both.query(7919) == 300
+
+    diff = build({42: 400, 7919: 300})
+    diff.subtract(other)
+    # the saturated counters subtract to zero; the bigcounts don't
+    assert diff.query(42) == 100
+    assert diff.query(7919) == 0
+
+
+def test_bytestorage_mapped_bigcounts(tmpdir):
+    store = ByteStorage.build(100000, 4)
+    store.set_use_bigcount(True)
+    for _ in range(300):
+        store.insert(7919)
+        store.insert(15838)
+    path = str(tmpdir.join('counts.mapped'))
+    store.save_mapped(path, 21)
+
+    ksize = ctypes.c_uint16(0)
+    loaded = ByteStorage.build(100000, 4)
+    loaded.load_mapped(path, ksize, True)
+    assert ksize.value == 21
+    assert loaded.query(7919) == 300
+    # updates overlay the mapped counts
+    loaded.insert(7919)
+    assert loaded.query(7919) == 301
+    assert loaded.query(15838) == 300
+
+
+mapped_types = combinable_types + [libgoetia.storage.QFStorage]
+
+
+def build_mapped(storage_t):
+    if storage_t is libgoetia.storage.QFStorage:
+        return storage_t.build(16, 4)
+    return storage_t.build(100000, 4)
+
+
+@pytest.mark.parametrize('storage_t', mapped_types,
+                         ids=lambda t: pretty_repr(t))
+def test_mapped_round_trip(storage_t, tmpdir):
+    store = build_mapped(storage_t)
+    hashes = [h * 7919 for h in range(1, 2000)]
+    for h in hashes:
+        store.insert(h)
+    path = str(tmpdir.join('store.mapped'))
+    store.save_mapped(path, 21)
+
+    ksize = ctypes.c_uint16(0)
+    loaded = build_mapped(storage_t)
+    loaded.load_mapped(path, ksize, True)
+    assert ksize.value == 21
+    assert [loaded.query(h) for h in hashes] == [store.query(h) for h in hashes]
+    # writable mappings take updates, copy-on-write
+    loaded.insert(7919)
+    loaded.insert(42)
+    assert loaded.query(7919) == store.query(7919) + (1 if is_counting(storage_t) else 0)
+    assert loaded.query(42)
+
+
+@pytest.mark.parametrize('storage_t', mapped_types,
+                         ids=lambda t: pretty_repr(t))
+def test_mapped_read_only_throws(storage_t, tmpdir):
+    store = build_mapped(storage_t)
+    store.insert(7919)
+    path = str(tmpdir.join('store.mapped'))
+    store.save_mapped(path, 21)
+
+    ksize = ctypes.c_uint16(0)
+    loaded = build_mapped(storage_t)
+    loaded.load_mapped(path, ksize)
+    assert loaded.query(7919)
+    with pytest.raises(Exception):
+        loaded.insert(42)
+    with pytest.raises(Exception):
+        loaded.insert_many(array.array('Q', [42, 43]), 2, None)
+    with pytest.raises(Exception):
+        loaded.reset()
+    assert not loaded.query(42)
+
+
+@pytest.mark.parametrize('pages', ['heap', 'mmap', 'thp', 'hugetlb-2mb'])
+@pytest.mark.parametrize('storage_t', combinable_types,
+                         ids=lambda t: pretty_repr(t))
+def test_table_policy(storage_t, pages):
+    TablePolicy = libgoetia.storage.TablePolicy
+    policy = TablePolicy.from_names(pages, 'interleave')
+    store = storage_t.build(100000, 4, policy)
+    for h in range(1000):
+        store.insert(h * 7919)
+    assert all(store.query(h * 7919) for h in range(1000))
+    assert store.clone().table_policy().pages == policy.pages
+
+    store.reset()
+    assert not any(store.query(h * 7919) for h in range(1000))
+
+
+def test_diskcount_merges_runs(tmpdir):
+    # a 4 KiB buffer spills every 512 hashes
+    store = DiskCountStorage.build(str(tmpdir), 4096, 4)
+    for h in range(5000):
+        for _ in range(h % 3 + 1):
+            store.insert(h * 7919)
+    assert store.n_runs() > 1
+    with pytest.raises(Exception):
+        store.query(0)
+
+    store.finalize()
+    assert store.n_unique_kmers() == 5000
+    assert all(store.query(h * 7919) == h % 3 + 1 for h in range(5000))
+    assert store.query(1) == 0
+
+
+def test_diskcount_merges_in_passes(tmpdir):
+    # an 8-hash buffer spills far more runs than are merged at once
+    store = DiskCountStorage.build(str(tmpdir), 64, 1)
+    for h in range(3000):
+        for _ in range(h % 3 + 1):
+            store.insert(h * 7919)
+    assert store.n_runs() > 4 * DiskCountStorage.MERGE_FAN_IN
+
+    store.finalize()
+    assert store.n_unique_kmers() == 3000
+    assert all(store.query(h * 7919) == h % 3 + 1 for h in range(3000))
+
+    # and again on top of the merged arrays
+    for h in range(3000):
+        store.insert(h * 7919)
+    store.finalize()
+    assert all(store.query(h * 7919) == h % 3 + 2 for h in range(3000))
+
+
+def test_diskcount_save_load(tmpdir):
+    graph_t = libgoetia.dBG[DiskCountStorage, FwdLemireShifter]
+    store = DiskCountStorage.build(str(tmpdir), 4096)
+    graph = graph_t.build(store, 21)
+    sequence = 'ACGTAGCTAGCATCGACTAGCATCAGCATCAGCATCGACTAGCAGCTAC' * 2
+    graph.insert_sequence(sequence)
+    store.finalize()
+    counts = list(graph.query_sequence(sequence))
+    assert max(counts) == 2
+
+    manifest = str(tmpdir.join('counts.manifest'))
+    graph.save(manifest)
+    loaded = graph_t.build(DiskCountStorage.build(str(tmpdir)), 21)
+    loaded.load(manifest)
+    assert list(loaded.query_sequence(sequence)) == counts
+
+
+def test_rolling_forgets_old_generations():
+    store = RollingBitStorage.build(100000, 4, 3)
+    old, recent = list(range(1, 1001)), list(range(1001, 2001))
+    for h in old:
+        store.insert(h)
+    store.rotate()
+    for h in recent:
+        store.insert(h)
+    # inserting again refreshes into the current generation
+    assert not any(store.insert(h) for h in old[:100])
+
+    store.rotate()
+    store.rotate()
+    assert store.n_rotations() == 3
+    assert all(store.query(h) for h in old[:100])
+    assert all(store.query(h) for h in recent)
+    assert not any(store.query(h) for h in old[100:])
+
+
+def test_rolling_rotate_every():
+    store = RollingBitStorage.build(100000, 4, 4, 1000)
+    for h in range(1, 10001):
+        store.insert(h * 7919)
+    assert store.n_rotations() == 10
+    assert not any(store.query(h * 7919) for h in range(1, 6001))
+    assert all(store.query(h * 7919) for h in range(7001, 10001))